@@ -1,6 +1,10 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <cinttypes>
 #include <sstream>
+#include <vector>
 #include "asm.hpp"
 
 static std::string to_hex(uint32_t num, int digits = 0) {
@@ -162,3 +166,306 @@ std::string asm_inst::to_string() const {
 	}
 	return inst.str();
 }
+
+// レジスタリストに含まれるレジスタの数を数える
+static int count_regs(uint32_t regs) {
+	int count = 0;
+	for (int i = 0; i <= 8; i++) {
+		if ((regs >> i) & 1) count++;
+	}
+	return count;
+}
+
+int asm_inst::cycles(bool branch_taken) const {
+	switch (kind) {
+	case EMPTY: case LABEL:
+	case DB: case DB2: case DW: case DD:
+		// 実行されない
+		return 0;
+	case MOV_REG:
+		// MOV PC, Rm は分岐扱い
+		return params[0] == 15 ? 3 : 1;
+	case ADD_REG:
+		// ADD PC, Rm は分岐扱い
+		return params[0] == 15 ? 3 : 1;
+	case LDB_REG_LIT: case LDW_REG_LIT: case LDL_REG_LIT: case LDL_PC_LIT:
+	case LDB_REG_REG: case LDBS_REG_REG: case LDW_REG_REG: case LDWS_REG_REG: case LDL_REG_REG:
+	case STB_REG_LIT: case STW_REG_LIT: case STL_REG_LIT:
+	case STB_REG_REG: case STW_REG_REG: case STL_REG_REG:
+	case LDL_SP_LIT: case STL_SP_LIT:
+		return 2;
+	case JCC:
+		if (params[0] == ALWAYS) return 3;
+		return branch_taken ? 3 : 1;
+	case JMP_DIRECT: case JMP_INDIRECT:
+	case CALL_INDIRECT: case RET:
+		return 3;
+	case CALL_DIRECT:
+		// BLは32ビット命令
+		return 4;
+	case PUSH_REGS:
+		return 1 + count_regs(params[0]);
+	case POP_REGS:
+		// PCを含む場合はパイプラインの再充填が入る
+		return (params[0] & 0x100 ? 3 : 1) + count_regs(params[0]);
+	case LDM_REGS: case STM_REGS:
+		return 1 + count_regs(params[1]);
+	case WFI:
+		// 割り込みを待つ時間は含まない
+		return 2;
+	default:
+		// 演算命令など (乗算器はシングルサイクル)
+		return 1;
+	}
+}
+
+int asm_inst::size() const {
+	switch (kind) {
+	case EMPTY: case LABEL:
+		return 0;
+	case DB:
+		return 1;
+	case DB2: case DW:
+		return 2;
+	case DD:
+		return 4;
+	case CALL_DIRECT:
+		// BLは32ビット命令
+		return 4;
+	default:
+		return 2;
+	}
+}
+
+// asm15形式の文字列の字句
+struct asm_token {
+	std::string shape; // 照合用の形 (レジスタは"R"、数値は"N"、ラベルは"@")
+	uint32_t value;
+	std::string label;
+};
+
+// asm15形式の文字列を字句に分解する
+static bool asm_tokenize(const std::string& str, std::vector<asm_token>& tokens) {
+	static const char* operators[] = {
+		"<<=", ">>=", "+=", "-=", "*=", "&=", "|=", "^=", "<<", ">>",
+		"=", "+", "-", "~", "&", "[", "]", "(", ")", "{", "}", ","
+	};
+	size_t pos = 0;
+	while (pos < str.size()) {
+		char c = str[pos];
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			pos++;
+			continue;
+		}
+		asm_token token;
+		token.value = 0;
+		if (isdigit(static_cast<unsigned char>(c)) || c == '#') {
+			// 数値 (#から始まる場合は16進数)
+			int base = 10;
+			if (c == '#') {
+				base = 16;
+				pos++;
+			}
+			size_t start = pos;
+			while (pos < str.size() && isxdigit(static_cast<unsigned char>(str[pos]))) {
+				if (base == 10 && !isdigit(static_cast<unsigned char>(str[pos]))) break;
+				pos++;
+			}
+			if (start == pos) return false;
+			token.shape = "N";
+			token.value = static_cast<uint32_t>(strtoul(str.substr(start, pos - start).c_str(), NULL, base));
+		} else if (c == '@') {
+			// ラベル
+			size_t start = ++pos;
+			while (pos < str.size() && (isalnum(static_cast<unsigned char>(str[pos])) || str[pos] == '_')) pos++;
+			if (start == pos) return false;
+			token.shape = "@";
+			token.label = str.substr(start, pos - start);
+		} else if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+			// 単語 (R + 数字はレジスタ)
+			size_t start = pos;
+			while (pos < str.size() && (isalnum(static_cast<unsigned char>(str[pos])) || str[pos] == '_')) pos++;
+			std::string word = str.substr(start, pos - start);
+			if (word.size() >= 2 && word[0] == 'R' && word.find_first_not_of("0123456789", 1) == std::string::npos) {
+				token.shape = "R";
+				token.value = static_cast<uint32_t>(strtoul(word.c_str() + 1, NULL, 10));
+				if (token.value > 15) return false;
+			} else {
+				token.shape = word;
+			}
+		} else {
+			// 演算子など
+			bool found = false;
+			for (size_t i = 0; i < sizeof(operators) / sizeof(*operators); i++) {
+				size_t len = strlen(operators[i]);
+				if (str.compare(pos, len, operators[i]) == 0) {
+					token.shape = operators[i];
+					pos += len;
+					found = true;
+					break;
+				}
+			}
+			if (!found) return false;
+		}
+		tokens.push_back(token);
+	}
+	return true;
+}
+
+// レジスタリスト "{...}" を解釈する (special : LRやPCを表すビット8の名前)
+static bool asm_parse_reg_list(const std::vector<asm_token>& tokens, size_t start,
+const char* special, uint32_t& regs) {
+	regs = 0;
+	if (tokens.size() < start + 2 || tokens[start].shape != "{" || tokens.back().shape != "}") return false;
+	for (size_t i = start + 1; i + 1 < tokens.size(); i++) {
+		if ((i - start) % 2 == 0) {
+			if (tokens[i].shape != ",") return false;
+		} else if (tokens[i].shape == "R" && tokens[i].value <= 7) {
+			regs |= 1 << tokens[i].value;
+		} else if (special != NULL && tokens[i].shape == special) {
+			regs |= 0x100;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool asm_inst_from_string(const std::string& str, asm_inst& inst) {
+	// 各命令の形と種類 (パラメータは現れた順にparamsに入る)
+	static const struct {
+		const char* shape;
+		asm_inst_kind kind;
+	} patterns[] = {
+		{"DATAB N", DB}, {"DATAB N , N", DB2}, {"DATAW N", DW}, {"DATAL N", DD},
+		{"R = N", MOV_LIT}, {"R = R", MOV_REG}, {"R += N", ADD_LIT}, {"R -= N", SUB_LIT},
+		{"R = PC + N", ADD_PC_LIT}, {"R += R", ADD_REG},
+		{"R = R + N", ADD_REG_LIT}, {"R = R - N", SUB_REG_LIT},
+		{"R = R + R", ADD_REG_REG}, {"R = R - R", SUB_REG_REG},
+		{"R = - R", NEG_REG}, {"R *= R", MUL_REG},
+		{"R = R << N", SHL_REG_LIT}, {"R = R >> N", SHR_REG_LIT},
+		{"R <<= R", SHL_REG}, {"R >>= R", SHR_REG}, {"R = ~ R", NOT_REG},
+		{"R &= R", AND_REG}, {"R |= R", OR_REG}, {"R ^= R", XOR_REG},
+		{"R = [ R + N ]", LDB_REG_LIT}, {"R = [ R + N ] W", LDW_REG_LIT}, {"R = [ R + N ] L", LDL_REG_LIT},
+		{"R = [ PC + N ] L", LDL_PC_LIT},
+		{"R = [ R + R ]", LDB_REG_REG}, {"R = [ R + R ] C", LDBS_REG_REG},
+		{"R = [ R + R ] W", LDW_REG_REG}, {"R = [ R + R ] S", LDWS_REG_REG}, {"R = [ R + R ] L", LDL_REG_REG},
+		{"[ R + N ] = R", STB_REG_LIT}, {"[ R + N ] W = R", STW_REG_LIT}, {"[ R + N ] L = R", STL_REG_LIT},
+		{"[ R + R ] = R", STB_REG_REG}, {"[ R + R ] W = R", STW_REG_REG}, {"[ R + R ] L = R", STL_REG_REG},
+		{"R - N", CMP_REG_LIT}, {"R - R", CMP_REG_REG}, {"R + R", CADD_REG_REG}, {"R & R", TEST_REG_REG},
+		{"GOTO @", JMP_DIRECT}, {"GOTO R", JMP_INDIRECT}, {"GOSUB @", CALL_DIRECT}, {"GOSUB R", CALL_INDIRECT},
+		{"RET", RET},
+		{"SP += N", ADDSP_LIT}, {"SP -= N", SUBSP_LIT}, {"R = SP + N", ADD_SP_LIT},
+		{"R = [ SP + N ] L", LDL_SP_LIT}, {"[ SP + N ] L = R", STL_SP_LIT},
+		{"R = REV ( R )", REV_REG}, {"R = REV16 ( R )", REV16_REG}, {"R = REVSH ( R )", REVSH_REG},
+		{"R = ASR ( R , N )", ASR_REG_LIT}, {"ASR R , R", ASR_REG}, {"BIC R , R", BIC_REG},
+		{"ROR R , R", ROR_REG}, {"ADC R , R", ADC_REG}, {"SBC R , R", SBC_REG},
+		{"NOP", NOP}, {"CPSID", CPSID}, {"CPSIE", CPSIE}, {"WFI", WFI}
+	};
+	static const struct {
+		const char* name;
+		jcc_cond cond;
+	} conds[] = {
+		{"0", ZERO}, {"!0", NONZERO}, {"EQ", EQ}, {"NE", NEQ}, {"CS", CARRY}, {"CC", NO_CARRY},
+		{"MI", NEGATIVE}, {"PL", NON_NEGATIVE}, {"VS", OVERFLOW}, {"VC", NO_OVERFLOW},
+		{"HI", G_UNSIGN}, {"LS", LE_UNSIGN}, {"GE", GE_SIGN}, {"LT", L_SIGN},
+		{"GT", G_SIGN}, {"LE", LE_SIGN}, {"AL", ALWAYS}
+	};
+	inst = asm_inst(EMPTY);
+	// コメントを分離する
+	std::string body = str;
+	size_t comment_pos = str.find('\'');
+	if (comment_pos != std::string::npos) {
+		body = str.substr(0, comment_pos);
+		size_t comment_start = comment_pos + 1;
+		if (comment_start < str.size() && str[comment_start] == ' ') comment_start++;
+		inst.comment = str.substr(comment_start);
+		while (!inst.comment.empty() &&
+		(inst.comment.back() == '\r' || inst.comment.back() == '\n')) inst.comment.pop_back();
+	}
+	// 条件分岐は条件の表記が特殊なので、先に処理する
+	size_t body_start = body.find_first_not_of(" \t");
+	if (body_start != std::string::npos && body.compare(body_start, 3, "IF ") == 0) {
+		std::stringstream ss(body.substr(body_start + 3));
+		std::string cond_name, goto_word, label;
+		if (!(ss >> cond_name >> goto_word >> label) || goto_word != "GOTO" ||
+		label.size() < 2 || label[0] != '@') return false;
+		for (size_t i = 0; i < sizeof(conds) / sizeof(*conds); i++) {
+			if (cond_name == conds[i].name) {
+				std::string comment = inst.comment;
+				inst = asm_inst(JCC, conds[i].cond, label.substr(1));
+				inst.comment = comment;
+				return true;
+			}
+		}
+		return false;
+	}
+	std::vector<asm_token> tokens;
+	if (!asm_tokenize(body, tokens)) return false;
+	if (tokens.empty()) return true;
+	if (tokens.size() == 1 && tokens[0].shape == "@") {
+		inst.kind = LABEL;
+		inst.label = tokens[0].label;
+		return true;
+	}
+	if (tokens[0].shape == "PUSH" || tokens[0].shape == "POP") {
+		bool is_push = tokens[0].shape == "PUSH";
+		inst.kind = is_push ? PUSH_REGS : POP_REGS;
+		return asm_parse_reg_list(tokens, 1, is_push ? "LR" : "PC", inst.params[0]);
+	}
+	if ((tokens[0].shape == "LDM" || tokens[0].shape == "STM") &&
+	tokens.size() >= 3 && tokens[1].shape == "R" && tokens[2].shape == ",") {
+		inst.kind = tokens[0].shape == "LDM" ? LDM_REGS : STM_REGS;
+		inst.params[0] = tokens[1].value;
+		return asm_parse_reg_list(tokens, 3, NULL, inst.params[1]);
+	}
+	std::string shape;
+	for (auto itr = tokens.begin(); itr != tokens.end(); itr++) {
+		if (itr != tokens.begin()) shape += " ";
+		shape += itr->shape;
+	}
+	for (size_t i = 0; i < sizeof(patterns) / sizeof(*patterns); i++) {
+		if (shape != patterns[i].shape) continue;
+		inst.kind = patterns[i].kind;
+		int param_count = 0;
+		for (auto itr = tokens.begin(); itr != tokens.end(); itr++) {
+			if (itr->shape == "R" || itr->shape == "N") {
+				if (param_count >= 3) return false;
+				inst.params[param_count++] = itr->value;
+			} else if (itr->shape == "@") {
+				inst.label = itr->label;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+// 関数の先頭を表すラベル (__で始まらないラベル) かを判定する
+bool is_function_label(const asm_inst& inst) {
+	return inst.kind == LABEL && !(inst.label.size() >= 2 && inst.label[0] == '_' && inst.label[1] == '_');
+}
+
+// データかを判定する
+bool is_data(const asm_inst& inst) {
+	return inst.kind == DB || inst.kind == DB2 || inst.kind == DW || inst.kind == DD;
+}
+
+// instを置くアドレス (addressからアラインメントの詰め物を飛ばしたもの) を返す
+uint32_t asm_aligned_address(const asm_inst& inst, uint32_t address) {
+	if (inst.size() == 0 || inst.kind == DB) return address;
+	if (inst.kind == DD) return (address + 3) & ~UINT32_C(3);
+	return (address + 1) & ~UINT32_C(1);
+}
+
+// 各命令やデータの、プログラムの先頭からのアドレスを求める
+std::vector<uint32_t> asm_layout(const std::vector<asm_inst>& insts) {
+	std::vector<uint32_t> addresses(insts.size());
+	uint32_t address = 0;
+	for (size_t i = 0; i < insts.size(); i++) {
+		address = asm_aligned_address(insts[i], address);
+		addresses[i] = address;
+		address += insts[i].size();
+	}
+	return addresses;
+}
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 // LIT : リテラル
 // REG : レジスタ
@@ -110,19 +111,51 @@ struct asm_inst {
 	std::string label;
 	uint32_t params[3];
 	std::string comment;
+	// ループの後方ジャンプの場合、ループに1回入るごとにジャンプする回数の上限 (負 : 不明)
+	int loop_bound;
+	// ループの後方ジャンプの場合、ループに1回入るごとにジャンプする回数の下限 (負 : 不明)
+	int loop_min;
+	// codegen_put_number()で生成した、定数を置くための命令か
+	bool is_constant;
+	// 生成元のソースコードの行番号 (0 : 不明)
+	int lineno;
 
-	asm_inst() {}
+	asm_inst() : loop_bound(-1), loop_min(-1), is_constant(false), lineno(0) {}
 	asm_inst(asm_inst_kind kind_, const std::string& label_,
 	uint32_t p0 = 0, uint32_t p1 = 0, uint32_t p2 = 0) :
-		kind(kind_), label(label_), params{p0, p1, p2} {}
+		kind(kind_), label(label_), params{p0, p1, p2}, loop_bound(-1), loop_min(-1), is_constant(false), lineno(0) {}
 	asm_inst(asm_inst_kind kind_, uint32_t p0, const std::string& label_,
 	uint32_t p1 = 0, uint32_t p2 = 0) :
-		kind(kind_), label(label_), params{p0, p1, p2} {}
+		kind(kind_), label(label_), params{p0, p1, p2}, loop_bound(-1), loop_min(-1), is_constant(false), lineno(0) {}
 	asm_inst(asm_inst_kind kind_,
 	uint32_t p0 = 0, uint32_t p1 = 0, uint32_t p2 = 0) :
-		kind(kind_), label(), params{p0, p1, p2} {}
+		kind(kind_), label(), params{p0, p1, p2}, loop_bound(-1), loop_min(-1), is_constant(false), lineno(0) {}
 
 	std::string to_string() const;
+	// Cortex-M0での実行サイクル数を返す (branch_taken : 分岐する場合)
+	// 関数呼び出しは呼び出し命令自体のサイクル数のみ
+	int cycles(bool branch_taken = false) const;
+	// 命令またはデータのバイト数を返す (アラインメントによる詰め物は含まない)
+	int size() const;
 };
 
+// ジャンプ表の要素のJMP_DIRECTのparams[0]に入れる印
+// (PCへのADD_REGの後に並ぶ分岐命令で、消したり他の命令に変えたりしてはいけない)
+const uint32_t JMP_TABLE_ENTRY = 1;
+// CALL_DIRECTやCALL_INDIRECTのparams[1]に入れる、末尾呼び出しにしてよい呼び出しの印
+// (コード生成の最後に、関数から戻る処理と呼び出し先へのジャンプに置き換える)
+const uint32_t CALL_TAIL_OK = 1;
+
+// to_string()で出力した形式の1行を解釈する (解釈できなければfalseを返す)
+bool asm_inst_from_string(const std::string& str, asm_inst& inst);
+// 関数の先頭を表すラベル (__で始まらないラベル) かを判定する
+bool is_function_label(const asm_inst& inst);
+// データかを判定する
+bool is_data(const asm_inst& inst);
+// instを置くアドレス (addressからアラインメントの詰め物を飛ばしたもの) を返す
+// (DDは4バイト境界、DB以外の命令やデータは2バイト境界に置く)
+uint32_t asm_aligned_address(const asm_inst& inst, uint32_t address);
+// 各命令やデータの、プログラムの先頭からのアドレスを求める (大きさ0のものは直前の終わりを指す)
+std::vector<uint32_t> asm_layout(const std::vector<asm_inst>& insts);
+
 #endif
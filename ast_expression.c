@@ -387,6 +387,19 @@ void set_operator_expression_type(expression_node* node) {
 // 再利用できるところはしながら、新しいノードを返す (→残念ながらfree()すると危険！)
 expression_node* constfold(expression_node* node) {
 	if (node == NULL) return NULL;
+	if (node->kind == EXPR_OPERATOR && node->info.op.kind == OP_FUNC_CALL) {
+		// 引数を区切るカンマは畳み込まず、各引数のみconstfoldする
+		expression_node** arg_ptr = &node->info.op.operands[1];
+		node->info.op.operands[0] = constfold(node->info.op.operands[0]);
+		for (int i = node->info.op.argument_num - 1; i > 0; i--) {
+			(*arg_ptr)->info.op.operands[1] = constfold((*arg_ptr)->info.op.operands[1]);
+			node->info.op.arguments[i] = (*arg_ptr)->info.op.operands[1];
+			arg_ptr = &(*arg_ptr)->info.op.operands[0];
+		}
+		*arg_ptr = constfold(*arg_ptr);
+		node->info.op.arguments[0] = *arg_ptr;
+		return node;
+	}
 	if (node->kind == EXPR_OPERATOR) {
 		// オペランドのconstfoldをする
 		node->info.op.operands[0] = constfold(node->info.op.operands[0]);
@@ -495,9 +508,10 @@ expression_node* constfold(expression_node* node) {
 							value2 == UINT32_C(0x80000000) ? -INT32_C(0x7fffffff) - 1 :
 							value2 & UINT32_C(0x80000000) ? -((int32_t)(-value2)) :
 							(int32_t)value2;
-						let_value = svalue1 / svalue2;
+						// INT_MINを-1で割ると桁あふれするので、ラップアラウンドした結果にする
+						let_value = svalue1 == -INT32_C(0x7fffffff) - 1 && svalue2 == -1 ? value1 : (uint32_t)(svalue1 / svalue2);
 					} else {
-						let_value = value1 * value2;
+						let_value = value1 / value2;
 					}
 					break;
 				case OP_MOD:
@@ -511,9 +525,10 @@ expression_node* constfold(expression_node* node) {
 							value2 == UINT32_C(0x80000000) ? -INT32_C(0x7fffffff) - 1 :
 							value2 & UINT32_C(0x80000000) ? -((int32_t)(-value2)) :
 							(int32_t)value2;
-						let_value = svalue1 % svalue2;
+						// INT_MIN % -1 も桁あふれするので、0にする
+						let_value = svalue1 == -INT32_C(0x7fffffff) - 1 && svalue2 == -1 ? 0 : (uint32_t)(svalue1 % svalue2);
 					} else {
-						let_value = value1 * value2;
+						let_value = value1 % value2;
 					}
 					break;
 				case OP_ADD:
@@ -0,0 +1,27 @@
+unsigned int stamps[6] = {0, 999, 59999, 3600000, 86399999, 4000000000};
+unsigned char hours[6];
+unsigned char minutes[6];
+unsigned char seconds[6];
+unsigned short millis[6];
+unsigned int days[6];
+short temps[6] = {-1234, 567, -32768, 32767, 0, -60};
+short celsius[6];
+
+#pragma entry
+int main() {
+	int i;
+	unsigned int t;
+	for (i = 0; i < 6; i++) {
+		t = stamps[i];
+		millis[i] = t % 1000;
+		t /= 1000;
+		seconds[i] = t % 60;
+		t /= 60;
+		minutes[i] = t % 60;
+		t /= 60;
+		hours[i] = t % 24;
+		days[i] = t / 24;
+		celsius[i] = (temps[i] - 320) * 5 / 9;
+	}
+	return hours[4];
+}
@@ -0,0 +1,43 @@
+unsigned char data[32] = {
+	106, 5, 18, 80, 122, 8, 28, 75, 188, 122, 59, 173,
+	238, 182, 143, 200, 134, 176, 117, 105, 181, 160, 114, 156,
+	215, 118, 233, 214, 250, 40, 236, 184
+};
+unsigned int crc32;
+unsigned int crc16;
+
+unsigned int crc32_update(unsigned int crc, unsigned int byte) {
+	int k;
+	crc = crc ^ byte;
+	for (k = 0; k < 8; k++) {
+		if (crc & 1) crc = (crc >> 1) ^ 0xEDB88320;
+		else crc = crc >> 1;
+	}
+	return crc;
+}
+
+unsigned int crc16_update(unsigned int crc, unsigned int byte) {
+	int k;
+	crc = crc ^ (byte << 8);
+	for (k = 0; k < 8; k++) {
+		if (crc & 0x8000) crc = ((crc << 1) ^ 0x1021) & 0xffff;
+		else crc = (crc << 1) & 0xffff;
+	}
+	return crc;
+}
+
+#pragma entry
+int main() {
+	int i;
+	unsigned int c32;
+	unsigned int c16;
+	c32 = 0xffffffff;
+	c16 = 0xffff;
+	for (i = 0; i < 32; i++) {
+		c32 = crc32_update(c32, data[i]);
+		c16 = crc16_update(c16, data[i]);
+	}
+	crc32 = ~c32;
+	crc16 = c16;
+	return 0;
+}
@@ -0,0 +1,49 @@
+int sines[16];
+unsigned int roots[8];
+int energy;
+
+int fx_mul(int a, int b) {
+	return (a * b) >> 8;
+}
+
+int fx_sin(int x) {
+	int x2;
+	int x3;
+	int x5;
+	x2 = fx_mul(x, x);
+	x3 = fx_mul(x2, x);
+	x5 = fx_mul(x3, x2);
+	return x - fx_mul(x3, 43) + fx_mul(x5, 2);
+}
+
+unsigned int isqrt(unsigned int n) {
+	unsigned int res;
+	unsigned int bit;
+	res = 0;
+	bit = 0x40000000;
+	while (bit > n) bit = bit >> 2;
+	while (bit != 0) {
+		if (n >= res + bit) {
+			n = n - (res + bit);
+			res = (res >> 1) + bit;
+		} else {
+			res = res >> 1;
+		}
+		bit = bit >> 2;
+	}
+	return res;
+}
+
+#pragma entry
+int main() {
+	int i;
+	energy = 0;
+	for (i = 0; i < 16; i++) {
+		sines[i] = fx_sin(i * 25);
+		energy += fx_mul(sines[i], sines[i]);
+	}
+	for (i = 0; i < 8; i++) {
+		roots[i] = isqrt(i * 12345 + 7);
+	}
+	return energy;
+}
@@ -0,0 +1,88 @@
+#!/bin/sh
+# ベンチマークをコンパイル・実行し、結果の検証とコードサイズ・サイクル数の比較を行う
+#   sh bench/run.sh [--ssa] [--update] [--size-threshold=PERCENT] [--cycle-threshold=PERCENT]
+# --ssa : --ssa を付けてコンパイルし、baseline-ssa.txt と比較する
+# --update : 計測結果で基準値のファイルを更新する
+# 閾値 : 基準値からの増加がこの割合 (%) を超えたら退行とする (既定は0)
+# 使用するプログラムは環境変数 COMPILE15, SIM15 で変更できる
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+COMPILE15=${COMPILE15:-$BENCH_DIR/../compile15}
+SIM15=${SIM15:-$BENCH_DIR/../sim15}
+BASELINE=$BENCH_DIR/baseline.txt
+mode=
+update=0
+size_threshold=0
+cycle_threshold=0
+for arg in "$@"; do
+	case "$arg" in
+	--ssa) mode=--ssa; BASELINE=$BENCH_DIR/baseline-ssa.txt ;;
+	--update) update=1 ;;
+	--size-threshold=*) size_threshold=${arg#*=} ;;
+	--cycle-threshold=*) cycle_threshold=${arg#*=} ;;
+	*) echo "unknown option: $arg" >&2; exit 2 ;;
+	esac
+done
+
+work=$(mktemp -d) || exit 2
+trap 'rm -rf "$work"' EXIT
+
+# 基準値から増加量を判定する (0 : 問題なし, 1 : 退行)
+# 出力 : 増減の割合
+compare() {
+	awk -v cur="$1" -v base="$2" -v th="$3" 'BEGIN {
+		if (base == "") { printf "%8s", "new"; exit 0 }
+		printf "%+7.2f%%", base == 0 ? 0 : 100.0 * (cur - base) / base
+		exit (cur * 100 > base * (100 + th)) ? 1 : 0
+	}'
+}
+
+failed=0
+: > "$work/baseline.txt"
+printf '%-8s %8s %9s %10s %9s  %s\n' "name" "bytes" "" "cycles" "" "result"
+for src in "$BENCH_DIR"/*.c; do
+	name=$(basename "$src" .c)
+	status=ok
+	# コードサイズ
+	if ! "$COMPILE15" $mode --size-report-json="$work/size.json" < "$src" > "$work/$name.asm"; then
+		echo "$name: compile failed" >&2
+		failed=1
+		continue
+	fi
+	bytes=$(sed -n '/"code"/{n;s/[^0-9]//gp;}' "$work/size.json")
+	# 実行結果とサイクル数
+	if ! "$SIM15" "$work/$name.asm" > "$work/$name.out"; then
+		echo "$name: simulation failed" >&2
+		failed=1
+		continue
+	fi
+	cycles=$(sed -n 's/^cycles: //p' "$work/$name.out")
+	sed '1,/^flags:/d' "$work/$name.out" > "$work/$name.result"
+	if ! cmp -s "$work/$name.result" "$BENCH_DIR/$name.expected"; then
+		diff "$BENCH_DIR/$name.expected" "$work/$name.result" >&2
+		status="wrong result"
+		failed=1
+	fi
+	echo "$name $bytes $cycles" >> "$work/baseline.txt"
+	# 基準値との比較
+	base_bytes=$(awk -v n="$name" '$1 == n { print $2 }' "$BASELINE" 2>/dev/null)
+	base_cycles=$(awk -v n="$name" '$1 == n { print $3 }' "$BASELINE" 2>/dev/null)
+	bytes_diff=$(compare "$bytes" "$base_bytes" "$size_threshold")
+	bytes_ok=$?
+	cycles_diff=$(compare "$cycles" "$base_cycles" "$cycle_threshold")
+	cycles_ok=$?
+	if [ "$update" -eq 0 ] && [ "$status" = ok ] && [ $bytes_ok -ne 0 -o $cycles_ok -ne 0 ]; then
+		status=regression
+		failed=1
+	fi
+	printf '%-8s %8s %9s %10s %9s  %s\n' "$name" "$bytes" "$bytes_diff" "$cycles" "$cycles_diff" "$status"
+done
+
+if [ "$update" -ne 0 ]; then
+	{
+		echo "# name code_bytes cycles"
+		cat "$work/baseline.txt"
+	} > "$BASELINE"
+	echo "updated $BASELINE"
+fi
+exit $failed
@@ -0,0 +1,20 @@
+unsigned short samples[8] = {0, 1, 511, 512, 1000, 1022, 1023, 77};
+unsigned int millivolts[8];
+unsigned int stretched[8];
+unsigned short gray[8];
+int offsets[8];
+unsigned int total;
+
+#pragma entry
+int main() {
+	int i;
+	total = 0;
+	for (i = 0; i < 8; i++) {
+		millivolts[i] = samples[i] * 3300 / 1023;
+		stretched[i] = samples[i] * 65537;
+		gray[i] = (samples[i] >> 2) * 257;
+		offsets[i] = (samples[i] - 512) * 1023;
+		total += samples[i] * 4095;
+	}
+	return total;
+}
@@ -0,0 +1,46 @@
+unsigned char text[103] = {
+	116, 104, 101, 32, 113, 117, 105, 99, 107, 32, 98, 114, 111, 119, 110, 32,
+	102, 111, 120, 32, 106, 117, 109, 112, 115, 32, 111, 118, 101, 114, 32, 116,
+	104, 101, 32, 108, 97, 122, 121, 32, 100, 111, 103, 32, 119, 104, 105, 108,
+	101, 32, 115, 101, 118, 101, 110, 32, 116, 105, 110, 121, 32, 114, 111, 98,
+	111, 116, 115, 32, 99, 111, 117, 110, 116, 32, 101, 118, 101, 114, 121, 32,
+	118, 111, 119, 101, 108, 32, 105, 110, 32, 116, 104, 105, 115, 32, 115, 101,
+	110, 116, 101, 110, 99, 101, 0
+};
+int words;
+int vowels;
+int longest;
+unsigned int hash;
+
+int is_vowel(int c) {
+	switch (c) {
+	case 97: case 101: case 105: case 111: case 117:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+#pragma entry
+int main() {
+	unsigned char* p;
+	int length;
+	words = 0;
+	vowels = 0;
+	longest = 0;
+	hash = 5381;
+	length = 0;
+	for (p = text; *p != 0; p++) {
+		hash = hash * 33 + *p;
+		if (*p == 32) {
+			if (length > 0) words++;
+			length = 0;
+		} else {
+			length++;
+			if (length > longest) longest = length;
+			vowels += is_vowel(*p);
+		}
+	}
+	if (length > 0) words++;
+	return words;
+}
@@ -0,0 +1,19 @@
+int values[8] = {-1000, 2500, -37, 99999, -123456, 7, 0, -2147483647};
+int divisors[8] = {3, -7, 10, -100, 1, -1, 255, -32768};
+int quotients[8];
+int remainders[8];
+int average;
+
+#pragma entry
+int main() {
+	int i;
+	int sum;
+	sum = 0;
+	for (i = 0; i < 8; i++) {
+		quotients[i] = values[i] / divisors[i];
+		remainders[i] = values[i] % divisors[i];
+		sum += values[i] / 8;
+	}
+	average = sum / 8;
+	return average;
+}
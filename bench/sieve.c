@@ -0,0 +1,21 @@
+char flags[200];
+int count;
+int last;
+
+#pragma entry
+int main() {
+	int i;
+	int j;
+	count = 0;
+	for (i = 0; i < 200; i++) flags[i] = 1;
+	flags[0] = 0;
+	flags[1] = 0;
+	for (i = 2; i < 200; i++) {
+		if (flags[i]) {
+			count++;
+			last = i;
+			for (j = i + i; j < 200; j += i) flags[j] = 0;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,56 @@
+int input[24] = {
+	-51, 83, -178, 452, 210, 161, -39, -86, 295, 384, 329, -433,
+	2, 482, 467, 358, -481, -300, -357, 46, -324, 128, 460, 303
+};
+int bubble_sorted[24];
+int insertion_sorted[24];
+int swaps;
+int checksum;
+
+void bubble_sort(int* a, int n) {
+	int i;
+	int j;
+	int t;
+	for (i = n - 1; i > 0; i--) {
+		for (j = 0; j < i; j++) {
+			if (a[j] > a[j + 1]) {
+				t = a[j];
+				a[j] = a[j + 1];
+				a[j + 1] = t;
+				swaps++;
+			}
+		}
+	}
+}
+
+void insertion_sort(int* a, int n) {
+	int i;
+	int j;
+	int t;
+	for (i = 1; i < n; i++) {
+		t = a[i];
+		j = i - 1;
+		while (j >= 0 && a[j] > t) {
+			a[j + 1] = a[j];
+			j--;
+		}
+		a[j + 1] = t;
+	}
+}
+
+#pragma entry
+int main() {
+	int i;
+	swaps = 0;
+	for (i = 0; i < 24; i++) {
+		bubble_sorted[i] = input[i];
+		insertion_sorted[i] = input[i];
+	}
+	bubble_sort(bubble_sorted, 24);
+	insertion_sort(insertion_sorted, 24);
+	checksum = 0;
+	for (i = 0; i < 24; i++) {
+		checksum = checksum * 31 + bubble_sorted[i] - insertion_sorted[i] * 7;
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+unsigned char input[34] = {
+	49, 50, 44, 51, 52, 53, 44, 32, 54, 44, 120, 55, 44, 56, 57, 44,
+	49, 48, 48, 48, 44, 32, 32, 52, 50, 44, 51, 121, 44, 55, 55, 59,
+	57, 57
+};
+int sum;
+int count;
+int errors;
+int final_state;
+
+#pragma entry
+int main() {
+	int i;
+	int c;
+	int state;
+	int value;
+	state = 0;
+	value = 0;
+	sum = 0;
+	count = 0;
+	errors = 0;
+	for (i = 0; i < 34; i++) {
+		c = input[i];
+		switch (state) {
+		case 0:
+			if (c >= 48 && c <= 57) {
+				value = c - 48;
+				state = 1;
+			} else if (c != 32) {
+				errors++;
+				state = 2;
+			}
+			break;
+		case 1:
+			if (c >= 48 && c <= 57) {
+				value = value * 10 + c - 48;
+			} else if (c == 44) {
+				sum += value;
+				count++;
+				state = 0;
+			} else if (c == 59) {
+				sum += value;
+				count++;
+				state = 3;
+			} else {
+				errors++;
+				state = 2;
+			}
+			break;
+		case 2:
+			if (c == 44) state = 0;
+			break;
+		default:
+			break;
+		}
+	}
+	final_state = state;
+	return count;
+}
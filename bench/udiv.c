@@ -0,0 +1,21 @@
+unsigned int digits[10];
+unsigned int quotients[8];
+unsigned int remainders[8];
+
+#pragma entry
+int main() {
+	unsigned int n;
+	int i;
+	n = 0xEE6B27FF;
+	for (i = 0; i < 10; i++) {
+		digits[i] = n % 10;
+		n = n / 10;
+	}
+	n = 0xDEADBEEF;
+	for (i = 0; i < 8; i++) {
+		quotients[i] = n / (i * 37 + 3);
+		remainders[i] = n % (i * 37 + 3);
+		n = n * 1103515245 + 12345;
+	}
+	return digits[0];
+}
@@ -6,6 +6,7 @@
 #include "ast.h"
 #include "codegen.hpp"
 #include "codegen_internal.hpp"
+#include "codegen_ir.hpp"
 
 std::string codegen_error::build_message(int lineno, std::string message) {
 	std::stringstream ss;
@@ -47,10 +48,14 @@ std::vector<asm_inst> codegen_gvar(ast_node* ast, codegen_status& status) {
 			std::string("multiple definition of global variable ") + name);
 	}
 	int align = type->align;
+	int padding = 0;
 	if (status.gv_offset % align != 0) {
-		status.gv_offset = ((status.gv_offset + align - 1) / align) * align;
+		int aligned_offset = ((status.gv_offset + align - 1) / align) * align;
+		padding = aligned_offset - status.gv_offset;
+		status.gv_offset = aligned_offset;
 	}
 	var_map[name] = new var_info(status.gv_offset, type, true, false);
+	status.gv_layouts.push_back(gvar_layout(name, status.gv_offset, type->size, padding));
 	status.gv_offset += type->size;
 	std::vector<asm_inst> result;
 	std::vector<uint32_t> init_values;
@@ -115,29 +120,37 @@ std::vector<asm_inst> codegen_gvar(ast_node* ast, codegen_status& status) {
 		result.push_back(asm_inst(inst, value & mask));
 		if (i == 0) result.back().comment = name;
 	}
+	codegen_set_lineno(result, ast->lineno);
 	return result;
 }
 
-// 指定のレジスタに指定の数を置くコードを生成する
-std::vector<asm_inst> codegen_put_number(int dest_reg, uint32_t value) {
+// 指定のレジスタに指定の数を置くコードを、命令の組み合わせのみで生成する
+// search_limit : 探索で求める命令の並びの長さの上限
+std::vector<asm_inst> codegen_synthesize_number(int dest_reg, uint32_t value, size_t search_limit) {
 	std::vector<asm_inst> res[3];
 	uint32_t work_values[3] = {value, -value, ~value};
 	for (int i = 0; i < 3; i++) {
 		uint32_t work_value = work_values[i];
 		bool is_first = true;
+		int prev_pos = 0; // 前に置いた8ビットの最下位ビットの位置
 		for (int j = 31; j >= 7; j--) {
 			if ((work_value >> j) & 1) {
 				uint32_t current_value = (work_value >> (j - 7)) & 0xff;
+				if (!is_first) {
+					// 今までに置いた値を、今回置く位置まで左シフトする
+					res[i].push_back(asm_inst(SHL_REG_LIT, dest_reg, dest_reg, prev_pos - (j - 7)));
+				}
 				res[i].push_back(asm_inst(is_first ? MOV_LIT : ADD_LIT, dest_reg, current_value));
-				if (j > 7) res[i].push_back(asm_inst(SHL_REG_LIT, dest_reg, dest_reg, j - 7));
 				work_value &= ~(UINT32_C(0xff) << (j - 7));
+				prev_pos = j - 7;
 				is_first = false;
 			}
 		}
 		if (is_first) {
 			res[i].push_back(asm_inst(MOV_LIT, dest_reg, work_value));
-		} else if (work_value > 0) {
-			res[i].push_back(asm_inst(ADD_LIT, dest_reg, work_value));
+		} else {
+			if (prev_pos > 0) res[i].push_back(asm_inst(SHL_REG_LIT, dest_reg, dest_reg, prev_pos));
+			if (work_value > 0) res[i].push_back(asm_inst(ADD_LIT, dest_reg, work_value));
 		}
 	}
 	res[1].push_back(asm_inst(NEG_REG, dest_reg, dest_reg));
@@ -145,9 +158,31 @@ std::vector<asm_inst> codegen_put_number(int dest_reg, uint32_t value) {
 	int best = 0;
 	if (res[1].size() < res[best].size()) best = 1;
 	if (res[2].size() < res[best].size()) best = 2;
+	// 8ビットずつ置く方法で3命令以上かかる場合は、より短い命令の並びを探す
+	if (res[best].size() >= 3) {
+		size_t limit = res[best].size() - 1 < search_limit ? res[best].size() - 1 : search_limit;
+		std::vector<asm_inst> searched = codegen_search_number(dest_reg, value, limit);
+		if (!searched.empty()) return searched;
+	}
+	for (auto itr = res[best].begin(); itr != res[best].end(); itr++) {
+		itr->is_constant = true;
+	}
 	return res[best];
 }
 
+// 指定のレジスタに指定の数を置くコードを生成する
+// 命令の組み合わせで3命令以上かかる場合は、リテラルプールからの読み込みを要求する
+std::vector<asm_inst> codegen_put_number(int dest_reg, uint32_t value) {
+	if (dest_reg >= 8) return codegen_synthesize_number(dest_reg, value);
+	// リテラルプールを使うかの判断に必要な長さまでしか探索しない
+	std::vector<asm_inst> res = codegen_synthesize_number(dest_reg, value, LITERAL_POOL_MIN_INSTS - 1);
+	if (res.size() >= LITERAL_POOL_MIN_INSTS) {
+		res.clear();
+		res.push_back(codegen_literal_request(dest_reg, value));
+	}
+	return res;
+}
+
 // グローバル変数アクセス用のレジスタを設定する
 std::vector<asm_inst> codegen_set_gv_access_register(int dest_reg, int src_reg,
 int base_address, codegen_status& status) {
@@ -187,17 +222,16 @@ std::vector<asm_inst> codegen_func(ast_node* ast, codegen_status& status) {
 	status.gv_access_register = -1;
 	status.registers_written = 0;
 	status.registers_reserved = 0;
+	status.pragma_loop_bound = -1;
+	status.held_values.clear();
+	status.high_regs_in_use = 0;
 	status.return_label = status.next_label++;
 	status.return_type = ast->d.func_def.return_type;
 	// 引数の情報を登録
 	status.var_maps.push_back(std::map<std::string, var_info*>());
 	int args_on_stack = 0, args_on_reg = 0;
 	size_t args_num = 0;
-	std::vector<int> reg_args_given;
-	std::vector<int> reg_args_assigned;
-	std::vector<int> reg_args_size;
-	std::vector<bool> reg_args_signed;
-	bool r1_is_reg_arg = false; // R1はレジスタに保存する引数として使用されている
+	std::vector<var_info*> args_info;
 	if (ast->d.func_def.arguments != NULL && ast->d.func_def.arguments->kind == NODE_ARRAY) {
 		args_num = ast->d.func_def.arguments->d.array.num;
 		if (args_num > 4) {
@@ -205,90 +239,165 @@ std::vector<asm_inst> codegen_func(ast_node* ast, codegen_status& status) {
 		}
 		ast_node** args = ast->d.func_def.arguments->d.array.nodes;
 		for (size_t i = 0; i < args_num; i++) {
-			int assigned = codegen_register_variable(args[i], status, true, false, 0);
+			codegen_register_variable(args[i], status, true, false, 0);
 			// codegen_register_variable()内でチェックしているので、args[i]はNODE_ARGUMENT
-			if (args[i]->d.arg.is_register) {
+			args_info.push_back(status.var_maps.back()[args[i]->d.arg.name]);
+		}
+	}
+	// コード生成に備えた前処理を行う
+	codegen_preprocess_statement(ast->d.func_def.body, status);
+	// entry関数や、スタック上の変数を呼び出し先が参照しうる関数では、末尾呼び出しにしない
+	status.tail_call_allowed = !status.entry_function &&
+		!codegen_frame_escapes(ast->d.func_def.body, args_info);
+	// 指定されていれば、中間表現を経由して生成する (対応していない構造があれば従来の方法で生成する)
+	if (status.options.use_ir) {
+		std::vector<asm_inst> ir_code;
+		if (codegen_ir_func(ast, args_info, status, ir_code)) {
+			status.var_maps.pop_back();
+			return ir_code;
+		}
+	}
+	// アドレスを取られない変数を、自動でレジスタに置く
+	std::vector<var_info*> promoted = codegen_promote_variables(ast->d.func_def.body, args_info, status);
+
+	// レジスタ変数にレジスタを割り当て、本体のコードを生成する
+	// レジスタが足りなければ、自動でレジスタに置いた変数を優先度の低い順にメモリに戻してやり直す
+	// (それも無ければ、割り当てが指定されていない最後の枠の変数をメモリに戻す)
+	std::vector<int> reg_args_given;
+	std::vector<int> reg_args_assigned;
+	std::vector<int> reg_args_size;
+	std::vector<bool> reg_args_signed;
+	int args_mem_size;
+	bool r1_is_reg_arg;
+	std::vector<asm_inst> body_code;
+	std::vector<int> lv_reg_assign_specified = status.lv_reg_assign;
+	codegen_status::regen_checkpoint checkpoint = status.save_checkpoint();
+	for (;;) {
+		// 引数の置き場所を調べる
+		args_on_stack = args_on_reg = 0;
+		reg_args_given.clear();
+		reg_args_assigned.clear();
+		reg_args_size.clear();
+		reg_args_signed.clear();
+		args_mem_size = 0;
+		for (size_t i = 0; i < args_num; i++) {
+			if (args_info[i]->is_register) {
 				args_on_reg |= 1 << i;
 				reg_args_given.push_back(i);
-				reg_args_assigned.push_back(assigned);
-				reg_args_size.push_back(args[i]->d.arg.type->size);
-				reg_args_signed.push_back(is_integer_type(args[i]->d.arg.type) && args[i]->d.arg.type->info.is_signed);
+				reg_args_assigned.push_back(args_info[i]->offset);
+				reg_args_size.push_back(args_info[i]->type->size);
+				reg_args_signed.push_back(is_integer_type(args_info[i]->type) && args_info[i]->type->info.is_signed);
 			} else {
 				args_on_stack |= 1 << i;
+				args_mem_size += 4;
 			}
 		}
-		r1_is_reg_arg = args_num >= 2 && args[1]->d.arg.is_register;
-	}
-	int args_mem_size = status.lv_mem_size;
-	// コード生成に備えた前処理を行う
-	codegen_preprocess_statement(ast->d.func_def.body, status);
+		// R1はレジスタに保存する引数として使用されている
+		r1_is_reg_arg = args_num >= 2 && args_info[1]->is_register;
 
-	// レジスタ変数にレジスタを割り当てる
-	// グローバル変数が無ければ、アクセス用のレジスタは不要
-	// entry関数かつ関数呼び出しが無ければ、好きなレジスタを使えばいいので予約不要
-	// 関数呼び出しが無く、かつグローバル変数へのアクセスが無ければ、アクセス用のレジスタは不要
-	if (status.gv_exists && ((!status.entry_function && status.gv_access_exists) || status.call_exists)) {
-		// R7をグローバル変数領域へのポインタ用に予約する
-		status.registers_reserved |= 1 << 7;
-		status.gv_access_register = 7;
-	}
-	// 割り当てるレジスタが指定された変数用のレジスタを予約する
-	for (auto itr = status.lv_reg_assign.begin(); itr != status.lv_reg_assign.end(); itr++) {
-		if (*itr >= 0) {
-			if (*itr > 7) {
-				throw codegen_error(ast->lineno, "invalid register specified");
+		// レジスタ変数にレジスタを割り当てる
+		// グローバル変数が無ければ、アクセス用のレジスタは不要
+		// entry関数かつ関数呼び出しが無ければ、好きなレジスタを使えばいいので予約不要
+		// 関数呼び出しが無く、かつグローバル変数へのアクセスが無ければ、アクセス用のレジスタは不要
+		if (status.gv_exists && ((!status.entry_function && status.gv_access_exists) || status.call_exists)) {
+			// R7をグローバル変数領域へのポインタ用に予約する
+			status.registers_reserved |= 1 << 7;
+			status.gv_access_register = 7;
+		}
+		// 割り当てるレジスタが指定された変数用のレジスタを予約する
+		for (auto itr = status.lv_reg_assign.begin(); itr != status.lv_reg_assign.end(); itr++) {
+			if (*itr >= 0) {
+				if (*itr > 7) {
+					throw codegen_error(ast->lineno, "invalid register specified");
+				}
+				if ((status.registers_reserved >> *itr) & 1) {
+					throw codegen_error(ast->lineno, "register specification conflict");
+				}
+				status.registers_reserved |= 1 << *itr;
 			}
-			if ((status.registers_reserved >> *itr) & 1) {
-				throw codegen_error(ast->lineno, "register specification conflict");
+		}
+		// 関数呼び出しが無いモードの時、レジスタの引数をそのレジスタに優先して割り当てる
+		if (!status.call_exists) {
+			for (size_t i = 0; i < reg_args_given.size(); i++) {
+				if (status.lv_reg_assign[reg_args_assigned[i]] < 0 && // 割り当てが指定されていない
+				!((status.registers_reserved >> reg_args_given[i]) & 1)) { // そのレジスタが空いている
+					// 割り当てる
+					status.lv_reg_assign[reg_args_assigned[i]] = reg_args_given[i];
+					status.registers_reserved |= 1 << reg_args_given[i];
+				}
 			}
-			status.registers_reserved |= 1 << *itr;
 		}
-	}
-	// 関数呼び出しが無いモードの時、レジスタの引数をそのレジスタに優先して割り当てる
-	if (!status.call_exists) {
-		for (size_t i = 0; i < reg_args_given.size(); i++) {
-			if (status.lv_reg_assign[reg_args_assigned[i]] < 0 && // 割り当てが指定されていない
-			!((status.registers_reserved >> reg_args_given[i]) & 1)) { // そのレジスタが空いている
-				// 割り当てる
-				status.lv_reg_assign[reg_args_assigned[i]] = reg_args_given[i];
-				status.registers_reserved |= 1 << reg_args_given[i];
+		// 残りの変数を空いているレジスタに割り当てる
+		static const int regs_try_order_candidate[2][8] = {
+			{3, 2, 1, 0, 7, 6, 5, 4}, // 関数呼び出しが無い時
+			{7, 6, 5, 4, 3, 2, 1, 0} // 関数呼び出しがある時
+		};
+		const int* regs_try_order = regs_try_order_candidate[status.call_exists ? 1 : 0];
+		bool regs_exhausted = false;
+		for (int i = 0; i < status.lv_reg_size && !regs_exhausted; i++) {
+			if (status.lv_reg_assign[i] < 0) {
+				bool ok = false;
+				for (int j = 0; j < 8; j++) {
+					int reg = regs_try_order[j];
+					if (!((status.registers_reserved >> reg) & 1)) {
+						status.lv_reg_assign[i] = reg;
+						status.registers_reserved |= 1 << reg;
+						ok = true;
+						break;
+					}
+				}
+				if (!ok) regs_exhausted = true;
 			}
 		}
-	}
-	// 残りの変数を空いているレジスタに割り当てる
-	static const int regs_try_order_candidate[2][8] = {
-		{3, 2, 1, 0, 7, 6, 5, 4}, // 関数呼び出しが無い時
-		{7, 6, 5, 4, 3, 2, 1, 0} // 関数呼び出しがある時
-	};
-	const int* regs_try_order = regs_try_order_candidate[status.call_exists ? 1 : 0];
-	for (int i = 0; i < status.lv_reg_size; i++) {
-		if (status.lv_reg_assign[i] < 0) {
+		// グローバル変数へのアクセスがあり、かつまだアクセス用のレジスタを割り当てていなければ、割り当てる
+		if (!regs_exhausted && status.gv_access_exists && status.gv_access_register < 0) {
 			bool ok = false;
 			for (int j = 0; j < 8; j++) {
 				int reg = regs_try_order[j];
 				if (!((status.registers_reserved >> reg) & 1)) {
-					status.lv_reg_assign[i] = reg;
+					status.gv_access_register = reg;
 					status.registers_reserved |= 1 << reg;
 					ok = true;
 					break;
 				}
 			}
-			if (!ok) throw codegen_error(ast->lineno, "register exhausted for variables");
+			if (!ok) regs_exhausted = true;
 		}
-	}
-	// グローバル変数へのアクセスがあり、かつまだアクセス用のレジスタを割り当てていなければ、割り当てる
-	if (status.gv_access_exists && status.gv_access_register < 0) {
-		bool ok = false;
-		for (int j = 0; j < 8; j++) {
-			int reg = regs_try_order[j];
-			if (!((status.registers_reserved >> reg) & 1)) {
-				status.gv_access_register = reg;
-				status.registers_reserved |= 1 << reg;
-				ok = true;
+
+		// メモリに戻す枠 (自動でレジスタに置いた変数を優先する)
+		int slot_to_demote = -1;
+		if (!promoted.empty()) {
+			slot_to_demote = promoted.back()->offset;
+		} else {
+			for (int i = status.lv_reg_size - 1; i >= 0 && slot_to_demote < 0; i--) {
+				if (lv_reg_assign_specified[i] < 0) slot_to_demote = i;
+			}
+		}
+		if (regs_exhausted) {
+			if (slot_to_demote < 0) throw codegen_error(ast->lineno, "register exhausted for variables");
+		} else {
+			// 本体のコードを生成する
+			try {
+				body_code = codegen_statement(ast->d.func_def.body, status);
 				break;
+			} catch (const codegen_register_error&) {
+				if (slot_to_demote < 0) throw;
 			}
 		}
-		if (!ok) throw codegen_error(ast->lineno, "register exhausted for global variable access");
+		codegen_demote_register_slot(slot_to_demote, ast->d.func_def.body, args_info, status);
+		lv_reg_assign_specified.erase(lv_reg_assign_specified.begin() + slot_to_demote);
+		std::vector<var_info*> still_promoted;
+		for (auto itr = promoted.begin(); itr != promoted.end(); itr++) {
+			if ((*itr)->is_register) still_promoted.push_back(*itr);
+		}
+		promoted.swap(still_promoted);
+		status.lv_reg_assign = lv_reg_assign_specified;
+		status.load_checkpoint(checkpoint);
+		status.gv_access_register = -1;
+		status.registers_reserved = 0;
+		status.pragma_loop_bound = -1;
+		status.continue_labels.clear();
+		status.break_labels.clear();
 	}
 
 	std::vector<asm_inst> result;
@@ -448,8 +557,7 @@ std::vector<asm_inst> codegen_func(ast_node* ast, codegen_status& status) {
 		}
 	}
 
-	// 本体のコードを生成する
-	std::vector<asm_inst> body_code = codegen_statement(ast->d.func_def.body, status);
+	// 本体のコードを追加する
 	result.insert(result.end(), body_code.begin(), body_code.end());
 	// return用のラベルを追加する
 	result.push_back(asm_inst(LABEL, get_label(status.return_label)));
@@ -466,11 +574,37 @@ std::vector<asm_inst> codegen_func(ast_node* ast, codegen_status& status) {
 	// 値を書き込んだcallee-saveレジスタの退避コードを追加する
 	int regs_to_backup = status.registers_written & 0xf0;
 	if (status.call_exists) regs_to_backup |= 0x100;
-	if (regs_to_backup != 0) {
-		result.insert(result.begin(), asm_inst(PUSH_REGS, regs_to_backup));
+	// R8～R11はPUSHできないので、先に退避したR4～R7に移してからPUSHする
+	// (呼び出し元から受け取ったグローバル変数用のレジスタは経由しない)
+	int gv_live_in_reg = write_gv_access_register ? -1 : status.gv_access_register;
+	std::vector<int> high_regs, high_regs_via;
+	for (int reg = 8; reg < 12; reg++) {
+		if ((status.registers_written >> reg) & 1) high_regs.push_back(reg);
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		// 既に退避するレジスタを優先して使う
+		for (int reg = 4; reg < 8 && high_regs_via.size() < high_regs.size(); reg++) {
+			if (reg == gv_live_in_reg || ((regs_to_backup >> reg) & 1) != (pass == 0 ? 1 : 0)) continue;
+			regs_to_backup |= 1 << reg;
+			high_regs_via.push_back(reg);
+		}
 	}
-	// 関数のラベルを追加する
-	result.insert(result.begin(), asm_inst(LABEL, ast->d.func_def.name));
+	// 経由するレジスタが足りなければ、何回かに分けて退避する
+	std::vector<int> high_regs_masks;
+	std::vector<asm_inst> prologue;
+	prologue.push_back(asm_inst(LABEL, ast->d.func_def.name));
+	if (regs_to_backup != 0) prologue.push_back(asm_inst(PUSH_REGS, regs_to_backup));
+	for (size_t i = 0; i < high_regs.size(); i += high_regs_via.size()) {
+		int mask = 0;
+		for (size_t j = 0; j < high_regs_via.size() && i + j < high_regs.size(); j++) {
+			prologue.push_back(asm_inst(MOV_REG, high_regs_via[j], high_regs[i + j]));
+			mask |= 1 << high_regs_via[j];
+		}
+		prologue.push_back(asm_inst(PUSH_REGS, mask));
+		high_regs_masks.push_back(mask);
+	}
+	// 関数のラベルと退避コードを追加する
+	result.insert(result.begin(), prologue.begin(), prologue.end());
 
 	// スタック上の引数とローカル変数を取り除く
 	if (status.lv_mem_size > 0) {
@@ -484,6 +618,12 @@ std::vector<asm_inst> codegen_func(ast_node* ast, codegen_status& status) {
 		}
 	}
 	// 退避したレジスタを戻して関数から戻る
+	for (int i = static_cast<int>(high_regs_masks.size()) - 1; i >= 0; i--) {
+		result.push_back(asm_inst(POP_REGS, high_regs_masks[i]));
+		for (size_t j = 0; j < high_regs_via.size() && i * high_regs_via.size() + j < high_regs.size(); j++) {
+			result.push_back(asm_inst(MOV_REG, high_regs[i * high_regs_via.size() + j], high_regs_via[j]));
+		}
+	}
 	if (regs_to_backup != 0) {
 		result.push_back(asm_inst(POP_REGS, regs_to_backup));
 	}
@@ -491,6 +631,12 @@ std::vector<asm_inst> codegen_func(ast_node* ast, codegen_status& status) {
 		result.push_back(asm_inst(RET));
 	}
 
+	// 末尾呼び出しを、戻る処理と呼び出し先へのジャンプにする
+	codegen_tail_calls(result, get_label(status.return_label));
+
+	// 引数の処理や戻る処理は、関数定義の行から生成されたものとする
+	codegen_set_lineno(result, ast->lineno);
+
 	// 引数の情報を破棄
 	status.var_maps.pop_back();
 
@@ -498,7 +644,8 @@ std::vector<asm_inst> codegen_func(ast_node* ast, codegen_status& status) {
 }
 
 // 全体のコードを生成する
-std::vector<asm_inst> codegen(ast_node* ast) {
+std::vector<asm_inst> codegen(ast_node* ast, std::vector<gvar_layout>* gv_layouts,
+const codegen_options& options) {
 	if (ast == nullptr || ast->kind != NODE_ARRAY) {
 		throw codegen_error(ast == nullptr ? 0 : ast->lineno,
 			"top-level AST not array");
@@ -515,8 +662,11 @@ std::vector<asm_inst> codegen(ast_node* ast) {
 	status.gv_offset = 0;
 	status.gv_exists = false;
 	status.next_label = 1;
+	status.options = options;
 	status.var_maps.push_back(std::map<std::string, var_info*>());
 
+	codegen_inline_functions(ast, options.use_ir);
+
 	// グローバル変数を配置するコードを生成する
 	// ついでにbase_addressの指定を拾う
 	bool base_address_specified = false;
@@ -547,7 +697,12 @@ std::vector<asm_inst> codegen(ast_node* ast) {
 		}
 	}
 	// 最後にDATABが来たとき用に、アラインメントしておく
-	if (status.gv_offset % 2 != 0) status.gv_offset++;
+	if (status.gv_offset % 2 != 0) {
+		status.gv_offset++;
+		// 詰め物は名前の無い領域として記録する
+		status.gv_layouts.push_back(gvar_layout("", status.gv_offset, 0, 1));
+	}
+	if (gv_layouts != nullptr) *gv_layouts = status.gv_layouts;
 
 	// 余計なバイトが入らないように、連続するDATABをまとめる
 	auto prev_itr = result.begin();
@@ -565,6 +720,7 @@ std::vector<asm_inst> codegen(ast_node* ast) {
 				else merged_comment = prev_inst.comment + ", " + itr->comment;
 			}
 			merged.comment = merged_comment;
+			merged.lineno = prev_inst.lineno;
 			itr = result.erase(prev_itr);
 			itr = result.erase(itr);
 			itr = result.insert(itr, merged);
@@ -618,6 +774,12 @@ std::vector<asm_inst> codegen(ast_node* ast) {
 		}
 	}
 
+	// 使われている補助ルーチンを追加する
+	codegen_append_helpers(result, status);
+
+	// 配置先が4バイト境界でなければ、PC相対の読み込みのアドレスが合わないので、リテラルプールを使わない
+	if (status.base_address % 4 != 0) codegen_expand_literals(result);
+
 	// old entry用のコードを追加する
 	if (status.old_entry_exists) {
 		if (status.old_single_entry_exists) {
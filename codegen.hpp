@@ -7,7 +7,27 @@
 #include "ast.h"
 #include "asm.hpp"
 
-std::vector<asm_inst> codegen(ast_node* ast);
+// グローバル変数の配置情報
+struct gvar_layout {
+	std::string name; // 空 : 末尾の詰め物
+	int offset; // グローバル変数領域の先頭からのオフセット
+	int size;
+	int padding; // 直前に入るアラインメント用の詰め物のバイト数
+
+	gvar_layout(const std::string& name_ = "", int offset_ = 0, int size_ = 0, int padding_ = 0) :
+		name(name_), offset(offset_), size(size_), padding(padding_) {}
+};
+
+// コード生成の設定
+struct codegen_options {
+	bool use_ir; // SSA形式の中間表現を経由して関数のコードを生成する
+	std::string* ir_dump; // 中間表現の出力先 (nullptr : 出力しない)
+
+	codegen_options() : use_ir(false), ir_dump(nullptr) {}
+};
+
+std::vector<asm_inst> codegen(ast_node* ast, std::vector<gvar_layout>* gv_layouts = nullptr,
+	const codegen_options& options = codegen_options());
 void codegen_clean(std::vector<asm_inst>& insts);
 
 class codegen_error : public std::runtime_error {
@@ -0,0 +1,497 @@
+#include <utility>
+#include <vector>
+#include "ast.h"
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// 定数による掛け算・割り算のコード生成で使う一時レジスタ
+// 書き込めるレジスタが足りなければ、他のレジスタをスタックに退避して使う
+struct arith_temps {
+	int lineno;
+	int free_regs; // 空いているレジスタ
+	int borrowable_regs; // 退避すれば使えるレジスタ
+	int borrowed_regs; // 退避したレジスタ
+	int written_regs; // 書き込んだレジスタ (退避したものを除く)
+
+	arith_temps(int lineno_, int free_regs_, int borrowable_regs_) : lineno(lineno_),
+		free_regs(free_regs_), borrowable_regs(borrowable_regs_ & ~free_regs_),
+		borrowed_regs(0), written_regs(0) {}
+
+	int get() {
+		int reg;
+		if (free_regs != 0) {
+			reg = get_reg_to_use(lineno, free_regs, false);
+			if (((borrowed_regs >> reg) & 1) == 0) written_regs |= 1 << reg;
+		} else {
+			reg = get_reg_to_use(lineno, borrowable_regs, false);
+			borrowable_regs &= ~(1 << reg);
+			borrowed_regs |= 1 << reg;
+		}
+		free_regs &= ~(1 << reg);
+		return reg;
+	}
+	void release(int reg) {
+		free_regs |= 1 << reg;
+	}
+};
+
+// 最下位の1のビットより下位の0のビットの数を返す
+static int count_trailing_zeros(uint32_t value) {
+	int count = 0;
+	while (value != 0 && (value & 1) == 0) {
+		value >>= 1;
+		count++;
+	}
+	return count;
+}
+
+// 0～nmaxの数をdで割った商を、掛け算とシフトで求める方法
+struct udiv_plan {
+	int pre_shift; // 最初に被除数を右シフトする量
+	uint32_t multiplier;
+	int post_shift; // 積 (use_high_wordなら上位32ビット) を右シフトする量
+	bool use_high_word; // 積の上位32ビットを使う
+	bool add_indicator; // 上位32ビットと被除数から33ビットの値を作る (post_shiftはその後の量)
+};
+
+// m = ceil(2^s / d) を掛けて右にsシフトすれば、0～nmaxの全ての数について商が正しく求まるかを判定する
+static bool magic_is_exact(uint64_t m, int s, uint32_t d, uint32_t nmax) {
+	uint64_t error = m * d - (UINT64_C(1) << s);
+	return error * nmax < (UINT64_C(1) << s);
+}
+
+// 割る数の右シフトを行わずに商を求める方法を探す (3 <= d <= nmax で、dは2の非負整数乗でない)
+// 積が32ビットに収まる方法を優先し、無ければ積の上位32ビットを使う方法を探す
+static bool find_udiv_plan(uint32_t d, uint32_t nmax, udiv_plan& plan) {
+	for (int s = 0; s < 64; s++) {
+		uint64_t m = ((UINT64_C(1) << s) + d - 1) / d;
+		if (!magic_is_exact(m, s, d, nmax)) continue;
+		if (m * nmax <= UINT32_MAX) {
+			plan.multiplier = static_cast<uint32_t>(m);
+			plan.post_shift = s;
+			plan.use_high_word = false;
+			plan.add_indicator = false;
+			return true;
+		}
+		break;
+	}
+	for (int s = 32; s < 64; s++) {
+		uint64_t m = ((UINT64_C(1) << s) + d - 1) / d;
+		if (m > UINT32_MAX) break;
+		if (magic_is_exact(m, s, d, nmax)) {
+			plan.multiplier = static_cast<uint32_t>(m);
+			plan.post_shift = s - 32;
+			plan.use_high_word = true;
+			plan.add_indicator = false;
+			return true;
+		}
+	}
+	return false;
+}
+
+// 0～nmaxの数をdで割った商を求める方法を決める (3 <= d <= nmax で、dは2の非負整数乗でない)
+static udiv_plan get_udiv_plan(uint32_t d, uint32_t nmax) {
+	udiv_plan plan, shifted_plan;
+	int z = count_trailing_zeros(d);
+	bool found = find_udiv_plan(d, nmax, plan);
+	bool shifted_found = z > 0 && find_udiv_plan(d >> z, nmax >> z, shifted_plan);
+	if (found) plan.pre_shift = 0;
+	if (shifted_found) shifted_plan.pre_shift = z;
+	// 掛け算1回で済む方法、右シフト無し、の順に優先する
+	if (found && !plan.use_high_word) return plan;
+	if (shifted_found && !shifted_plan.use_high_word) return shifted_plan;
+	if (found) return plan;
+	if (shifted_found) return shifted_plan;
+	// 33ビットの値を掛ける必要がある (被除数が32ビットの時のみ)
+	// q = (t + ((n - t) >> 1)) >> (l - 1) (t : nとmの積の上位32ビット、l = ceil(log2(d)))
+	int l = 0;
+	while (l < 32 && (UINT64_C(1) << l) < d) l++;
+	plan.pre_shift = 0;
+	plan.multiplier = static_cast<uint32_t>((((UINT64_C(1) << l) - d) << 32) / d + 1);
+	plan.post_shift = l - 1;
+	plan.use_high_word = true;
+	plan.add_indicator = true;
+	return plan;
+}
+
+// レジスタに定数を置く
+static void append_number(std::vector<asm_inst>& result, int reg, uint32_t value) {
+	std::vector<asm_inst> code = codegen_put_number(reg, value);
+	result.insert(result.end(), code.begin(), code.end());
+}
+
+// src_regを右にshiftビットシフトした値をdest_regに置く
+static void append_shift_right(std::vector<asm_inst>& result, int dest_reg, int src_reg, int shift) {
+	if (shift > 0) {
+		result.push_back(asm_inst(SHR_REG_LIT, dest_reg, src_reg, shift));
+	} else if (dest_reg != src_reg) {
+		result.push_back(asm_inst(MOV_REG, dest_reg, src_reg));
+	}
+}
+
+// n_regの値とmの積の上位32ビットを求め、それを置いたレジスタを返す (n_regは書き換えない)
+// Cortex-M0のMULSは下位32ビットしか求めないので、16ビットずつに分けて掛ける
+static int append_mul_high(std::vector<asm_inst>& result, arith_temps& temps,
+int n_reg, uint32_t m, uint32_t nmax) {
+	uint32_t m_low = m & 0xffff, m_high = m >> 16;
+	if (nmax <= 0xffff) {
+		// ((n * m_high) + ((n * m_low) >> 16)) >> 16
+		int low_reg = temps.get();
+		append_number(result, low_reg, m_low);
+		result.push_back(asm_inst(MUL_REG, low_reg, n_reg));
+		result.push_back(asm_inst(SHR_REG_LIT, low_reg, low_reg, 16));
+		int high_reg = temps.get();
+		append_number(result, high_reg, m_high);
+		result.push_back(asm_inst(MUL_REG, high_reg, n_reg));
+		result.push_back(asm_inst(ADD_REG_REG, high_reg, high_reg, low_reg));
+		temps.release(low_reg);
+		result.push_back(asm_inst(SHR_REG_LIT, high_reg, high_reg, 16));
+		return high_reg;
+	}
+	// n = (nh << 16) + nl として、
+	// p = nh * m_low + ((nl * m_low) >> 16)
+	// 結果 = nh * m_high + (p >> 16) + ((nl * m_high + (p & 0xffff)) >> 16)
+	int nh_reg = temps.get();
+	result.push_back(asm_inst(SHR_REG_LIT, nh_reg, n_reg, 16));
+	int p_reg = temps.get();
+	append_number(result, p_reg, m_low);
+	int work_reg = temps.get();
+	result.push_back(asm_inst(SHL_REG_LIT, work_reg, n_reg, 16));
+	result.push_back(asm_inst(SHR_REG_LIT, work_reg, work_reg, 16));
+	result.push_back(asm_inst(MUL_REG, work_reg, p_reg));
+	result.push_back(asm_inst(SHR_REG_LIT, work_reg, work_reg, 16));
+	result.push_back(asm_inst(MUL_REG, p_reg, nh_reg));
+	result.push_back(asm_inst(ADD_REG_REG, p_reg, p_reg, work_reg));
+	result.push_back(asm_inst(SHR_REG_LIT, work_reg, p_reg, 16));
+	result.push_back(asm_inst(SHL_REG_LIT, p_reg, p_reg, 16));
+	result.push_back(asm_inst(SHR_REG_LIT, p_reg, p_reg, 16));
+	// nh_reg : nh * m_high + (p >> 16)
+	int m_high_reg = temps.get();
+	append_number(result, m_high_reg, m_high);
+	result.push_back(asm_inst(MUL_REG, nh_reg, m_high_reg));
+	result.push_back(asm_inst(ADD_REG_REG, nh_reg, nh_reg, work_reg));
+	// work_reg : (nl * m_high + (p & 0xffff)) >> 16
+	result.push_back(asm_inst(SHL_REG_LIT, work_reg, n_reg, 16));
+	result.push_back(asm_inst(SHR_REG_LIT, work_reg, work_reg, 16));
+	result.push_back(asm_inst(MUL_REG, work_reg, m_high_reg));
+	temps.release(m_high_reg);
+	result.push_back(asm_inst(ADD_REG_REG, work_reg, work_reg, p_reg));
+	temps.release(p_reg);
+	result.push_back(asm_inst(SHR_REG_LIT, work_reg, work_reg, 16));
+	result.push_back(asm_inst(ADD_REG_REG, nh_reg, nh_reg, work_reg));
+	temps.release(work_reg);
+	return nh_reg;
+}
+
+// 0～nmaxの数n_regをdで割った商を求める (3 <= d <= nmax で、dは2の非負整数乗でない)
+// dest_reg >= 0 ならそこに、そうでなければ一時レジスタに商を置き、置いたレジスタを返す
+// dest_regへの書き込みは最後に行う (n_regと同じでもよい)
+static int append_udiv_magic(std::vector<asm_inst>& result, arith_temps& temps,
+int n_reg, uint32_t d, uint32_t nmax, int dest_reg) {
+	udiv_plan plan = get_udiv_plan(d, nmax);
+	int src_reg = n_reg;
+	if (plan.pre_shift > 0) {
+		src_reg = temps.get();
+		result.push_back(asm_inst(SHR_REG_LIT, src_reg, n_reg, plan.pre_shift));
+		nmax >>= plan.pre_shift;
+	}
+	int product_reg;
+	if (plan.use_high_word) {
+		product_reg = append_mul_high(result, temps, src_reg, plan.multiplier, nmax);
+		if (plan.add_indicator) {
+			int work_reg = temps.get();
+			result.push_back(asm_inst(SUB_REG_REG, work_reg, src_reg, product_reg));
+			result.push_back(asm_inst(SHR_REG_LIT, work_reg, work_reg, 1));
+			result.push_back(asm_inst(ADD_REG_REG, product_reg, product_reg, work_reg));
+			temps.release(work_reg);
+		}
+	} else {
+		product_reg = temps.get();
+		append_number(result, product_reg, plan.multiplier);
+		result.push_back(asm_inst(MUL_REG, product_reg, src_reg));
+	}
+	if (src_reg != n_reg) temps.release(src_reg);
+	int quotient_reg = dest_reg >= 0 ? dest_reg : product_reg;
+	append_shift_right(result, quotient_reg, product_reg, plan.post_shift);
+	if (quotient_reg != product_reg) temps.release(product_reg);
+	return quotient_reg;
+}
+
+// 商を置いたレジスタから、余り (n - q * d) をdest_regに置く
+static void append_remainder(std::vector<asm_inst>& result, arith_temps& temps,
+int n_reg, int quotient_reg, uint32_t d, int dest_reg, codegen_status& status) {
+	int product_reg = temps.get();
+	std::vector<asm_inst> mul_code = codegen_multiply_by_constant(product_reg, quotient_reg, d, 0, temps.lineno, status);
+	result.insert(result.end(), mul_code.begin(), mul_code.end());
+	result.push_back(asm_inst(SUB_REG_REG, dest_reg, n_reg, product_reg));
+	temps.release(product_reg);
+}
+
+// 0～nmaxの数n_regをdで割った商または余りをdest_regに置く (1 <= d)
+static void append_udiv(std::vector<asm_inst>& result, arith_temps& temps,
+bool want_remainder, int n_reg, uint32_t d, uint32_t nmax, int dest_reg, codegen_status& status) {
+	int two_pow = get_two_pow_num(d);
+	if (d > nmax) {
+		// 商は0、余りは被除数そのもの
+		if (!want_remainder) {
+			result.push_back(asm_inst(MOV_LIT, dest_reg, 0));
+		} else if (dest_reg != n_reg) {
+			result.push_back(asm_inst(MOV_REG, dest_reg, n_reg));
+		}
+	} else if (two_pow == 0) {
+		if (want_remainder) {
+			result.push_back(asm_inst(MOV_LIT, dest_reg, 0));
+		} else if (dest_reg != n_reg) {
+			result.push_back(asm_inst(MOV_REG, dest_reg, n_reg));
+		}
+	} else if (two_pow > 0) {
+		if (want_remainder) {
+			// 下位のビットのみを残す
+			result.push_back(asm_inst(SHL_REG_LIT, dest_reg, n_reg, 32 - two_pow));
+			result.push_back(asm_inst(SHR_REG_LIT, dest_reg, dest_reg, 32 - two_pow));
+		} else {
+			result.push_back(asm_inst(SHR_REG_LIT, dest_reg, n_reg, two_pow));
+		}
+	} else if (want_remainder) {
+		int quotient_reg = append_udiv_magic(result, temps, n_reg, d, nmax, -1);
+		append_remainder(result, temps, n_reg, quotient_reg, d, dest_reg, status);
+		temps.release(quotient_reg);
+	} else {
+		append_udiv_magic(result, temps, n_reg, d, nmax, dest_reg);
+	}
+}
+
+// 被除数の絶対値の上限を型から求める
+// nonnegative : 被除数が負にならないか
+static uint32_t dividend_magnitude_max(type_node* type, bool is_signed, bool& nonnegative) {
+	nonnegative = !is_signed;
+	if (type == nullptr || !is_integer_type(type) || type->size >= 4) {
+		return is_signed ? UINT32_C(0x80000000) : UINT32_MAX;
+	}
+	int bits = 8 * type->size;
+	if (type->info.is_signed) {
+		// 符号なしの演算では、負の数は大きな数になる
+		return is_signed ? UINT32_C(1) << (bits - 1) : UINT32_MAX;
+	}
+	nonnegative = true;
+	return (UINT32_C(1) << bits) - 1;
+}
+
+// 定数による割り算を、補助ルーチンを呼び出さずに行うかを判定する
+bool codegen_is_constant_division(expression_node* expr) {
+	if (expr == nullptr || expr->kind != EXPR_OPERATOR) return false;
+	switch (expr->info.op.kind) {
+	case OP_DIV: case OP_MOD: case OP_DIV_ASSIGN: case OP_MOD_ASSIGN:
+		// 0で割る場合は、補助ルーチンに任せる
+		return expr->info.op.operands[1]->kind == EXPR_INTEGER_LITERAL &&
+			expr->info.op.operands[1]->info.value != 0;
+	default:
+		return false;
+	}
+}
+
+// 定数で割った商または余りをdest_regに置くコードを生成する
+// dividend_type : 被除数の (汎整数拡張前の) 型 (値の範囲を絞るのに使う)
+// dividend_regは書き換えない (dest_regと同じ場合を除く)
+// regs_available : 一時的に使ってよいレジスタ (足りなければ他のレジスタを退避して使う)
+std::vector<asm_inst> codegen_divide_by_constant(bool is_signed, bool want_remainder, uint32_t divisor,
+type_node* dividend_type, int dividend_reg, int dest_reg, int regs_available, int lineno,
+codegen_status& status) {
+	std::vector<asm_inst> result;
+	arith_temps temps(lineno, regs_available & 0xff & ~(1 << dividend_reg) & ~(1 << dest_reg),
+		0xff & ~(1 << dividend_reg) & ~(1 << dest_reg));
+	// 被除数と別のレジスタなら、結果を置くレジスタも一時的に使う
+	if (dest_reg != dividend_reg) temps.free_regs |= 1 << dest_reg;
+	bool nonnegative;
+	uint32_t nmax = dividend_magnitude_max(dividend_type, is_signed, nonnegative);
+	bool divisor_negative = is_signed && (divisor & UINT32_C(0x80000000));
+	uint32_t abs_divisor = divisor_negative ? -divisor : divisor;
+	int two_pow = get_two_pow_num(abs_divisor);
+	if (nonnegative) {
+		// 余りの符号は被除数に、商の符号は除数に従う
+		append_udiv(result, temps, want_remainder, dividend_reg, abs_divisor, nmax, dest_reg, status);
+		if (divisor_negative && !want_remainder) {
+			result.push_back(asm_inst(NEG_REG, dest_reg, dest_reg));
+		}
+	} else if (abs_divisor > nmax) {
+		// 商は0、余りは被除数そのもの
+		if (!want_remainder) {
+			result.push_back(asm_inst(MOV_LIT, dest_reg, 0));
+		} else if (dest_reg != dividend_reg) {
+			result.push_back(asm_inst(MOV_REG, dest_reg, dividend_reg));
+		}
+	} else if (two_pow == 0) {
+		// 商は被除数そのものか符号を反転したもの、余りは0
+		if (want_remainder) {
+			result.push_back(asm_inst(MOV_LIT, dest_reg, 0));
+		} else if (divisor_negative) {
+			result.push_back(asm_inst(NEG_REG, dest_reg, dividend_reg));
+		} else if (dest_reg != dividend_reg) {
+			result.push_back(asm_inst(MOV_REG, dest_reg, dividend_reg));
+		}
+	} else if (two_pow > 0) {
+		// 負の数は 2^two_pow - 1 を足してから右シフトすることで、0の方向に切り捨てる
+		int bias_reg = temps.get();
+		if (two_pow == 1) {
+			result.push_back(asm_inst(SHR_REG_LIT, bias_reg, dividend_reg, 31));
+		} else {
+			result.push_back(asm_inst(ASR_REG_LIT, bias_reg, dividend_reg, 31));
+			result.push_back(asm_inst(SHR_REG_LIT, bias_reg, bias_reg, 32 - two_pow));
+		}
+		result.push_back(asm_inst(ADD_REG_REG, bias_reg, bias_reg, dividend_reg));
+		if (want_remainder) {
+			result.push_back(asm_inst(SHR_REG_LIT, bias_reg, bias_reg, two_pow));
+			result.push_back(asm_inst(SHL_REG_LIT, bias_reg, bias_reg, two_pow));
+			result.push_back(asm_inst(SUB_REG_REG, dest_reg, dividend_reg, bias_reg));
+		} else {
+			result.push_back(asm_inst(ASR_REG_LIT, dest_reg, bias_reg, two_pow));
+			if (divisor_negative) result.push_back(asm_inst(NEG_REG, dest_reg, dest_reg));
+		}
+		temps.release(bias_reg);
+	} else {
+		// 絶対値を符号なしで割り、符号を付ける
+		int sign_reg = temps.get();
+		result.push_back(asm_inst(ASR_REG_LIT, sign_reg, dividend_reg, 31));
+		int abs_reg = temps.get();
+		result.push_back(asm_inst(ADD_REG_REG, abs_reg, dividend_reg, sign_reg));
+		result.push_back(asm_inst(XOR_REG, abs_reg, sign_reg));
+		int quotient_reg = append_udiv_magic(result, temps, abs_reg, abs_divisor, nmax, -1);
+		temps.release(abs_reg);
+		result.push_back(asm_inst(XOR_REG, quotient_reg, sign_reg));
+		int signed_quotient_reg = want_remainder ? quotient_reg : dest_reg;
+		if (divisor_negative) {
+			result.push_back(asm_inst(SUB_REG_REG, signed_quotient_reg, sign_reg, quotient_reg));
+		} else {
+			result.push_back(asm_inst(SUB_REG_REG, signed_quotient_reg, quotient_reg, sign_reg));
+		}
+		temps.release(sign_reg);
+		if (want_remainder) {
+			append_remainder(result, temps, dividend_reg, quotient_reg, divisor, dest_reg, status);
+		}
+		temps.release(quotient_reg);
+	}
+	status.registers_written |= temps.written_regs | (1 << dest_reg);
+	if (temps.borrowed_regs != 0) {
+		result.insert(result.begin(), asm_inst(PUSH_REGS, temps.borrowed_regs));
+		result.push_back(asm_inst(POP_REGS, temps.borrowed_regs));
+	}
+	return result;
+}
+
+// 掛け算の代わりに使う命令 (r : 結果を作るレジスタ、x : 掛けられる数)
+enum mul_step_kind {
+	MUL_START_SHIFT, // r = x << shift (shiftが0ならr = x)
+	MUL_START_NEG, // r = -x
+	MUL_SHIFT, // r = r << shift
+	MUL_ADD_X, // r = r + x
+	MUL_SUB_X, // r = r - x
+	MUL_RSUB_X, // r = x - r
+	MUL_NEG // r = -r
+};
+
+struct mul_step {
+	mul_step_kind kind;
+	int shift;
+
+	mul_step(mul_step_kind kind_ = MUL_START_SHIFT, int shift_ = 0) : kind(kind_), shift(shift_) {}
+};
+
+// xにvalueを掛けた値を作る、max_steps命令以下の並びを後ろから逆算して探す
+static bool search_mul_steps(uint32_t value, int max_steps, std::vector<mul_step>& steps) {
+	if (max_steps <= 0 || value == 0) return false;
+	int two_pow = get_two_pow_num(value);
+	if (two_pow >= 0) {
+		steps.assign(1, mul_step(MUL_START_SHIFT, two_pow));
+		return true;
+	}
+	if (value == UINT32_MAX) {
+		steps.assign(1, mul_step(MUL_START_NEG));
+		return true;
+	}
+	if (max_steps <= 1) return false;
+	// 最後の命令の前の値の候補
+	std::vector<std::pair<uint32_t, mul_step> > candidates;
+	if ((value & 1) == 0) {
+		// シフトで消えるビットは全部0か全部1のみ試す
+		int shift = count_trailing_zeros(value);
+		candidates.push_back(std::make_pair(value >> shift, mul_step(MUL_SHIFT, shift)));
+		candidates.push_back(std::make_pair((value >> shift) | ~(UINT32_MAX >> shift), mul_step(MUL_SHIFT, shift)));
+	} else {
+		candidates.push_back(std::make_pair(value - 1, mul_step(MUL_ADD_X)));
+		candidates.push_back(std::make_pair(value + 1, mul_step(MUL_SUB_X)));
+		candidates.push_back(std::make_pair(1 - value, mul_step(MUL_RSUB_X)));
+	}
+	candidates.push_back(std::make_pair(-value, mul_step(MUL_NEG)));
+	for (auto itr = candidates.begin(); itr != candidates.end(); itr++) {
+		if (search_mul_steps(itr->first, max_steps - 1, steps)) {
+			steps.push_back(itr->second);
+			return true;
+		}
+	}
+	return false;
+}
+
+// src_regの値に定数を掛けた値をdest_regに置くコードを生成する
+// 定数を置いてMULで掛けるより短ければ、シフト・足し算・引き算の並びにする
+// regs_available : 一時的に使ってよいレジスタ (dest_regとsrc_regが同じ場合のみ使う)
+std::vector<asm_inst> codegen_multiply_by_constant(int dest_reg, int src_reg, uint32_t value,
+int regs_available, int lineno, codegen_status& status) {
+	std::vector<asm_inst> result;
+	status.registers_written |= 1 << dest_reg;
+	if (value == 0) {
+		result.push_back(asm_inst(MOV_LIT, dest_reg, 0));
+		return result;
+	}
+	arith_temps temps(lineno, regs_available & 0xff & ~(1 << dest_reg) & ~(1 << src_reg),
+		0xff & ~(1 << dest_reg) & ~(1 << src_reg));
+	// 定数を置いて掛ける場合の命令数 (リテラルプールから読む場合は、データの分も含めて3命令とみなす)
+	std::vector<asm_inst> number_code = codegen_put_number(dest_reg, value);
+	size_t mul_cost = 1 + (number_code.size() == 1 && codegen_is_literal_request(number_code[0]) ?
+		LITERAL_POOL_MIN_INSTS : number_code.size());
+	std::vector<mul_step> steps;
+	bool use_steps = false;
+	for (size_t max_steps = 1; max_steps < mul_cost && !use_steps; max_steps++) {
+		use_steps = search_mul_steps(value, static_cast<int>(max_steps), steps);
+	}
+	if (use_steps) {
+		// 途中でxを使うなら、xを壊さないよう別のレジスタで計算する
+		bool use_x_later = false;
+		for (size_t i = 1; i < steps.size(); i++) {
+			if (steps[i].kind == MUL_ADD_X || steps[i].kind == MUL_SUB_X || steps[i].kind == MUL_RSUB_X) {
+				use_x_later = true;
+			}
+		}
+		int work_reg = dest_reg != src_reg || !use_x_later ? dest_reg : temps.get();
+		for (size_t i = 0; i < steps.size(); i++) {
+			int target_reg = i + 1 == steps.size() ? dest_reg : work_reg;
+			switch (steps[i].kind) {
+			case MUL_START_SHIFT:
+				if (steps[i].shift > 0) {
+					result.push_back(asm_inst(SHL_REG_LIT, target_reg, src_reg, steps[i].shift));
+				} else if (target_reg != src_reg) {
+					result.push_back(asm_inst(MOV_REG, target_reg, src_reg));
+				}
+				break;
+			case MUL_START_NEG: result.push_back(asm_inst(NEG_REG, target_reg, src_reg)); break;
+			case MUL_SHIFT: result.push_back(asm_inst(SHL_REG_LIT, target_reg, work_reg, steps[i].shift)); break;
+			case MUL_ADD_X: result.push_back(asm_inst(ADD_REG_REG, target_reg, work_reg, src_reg)); break;
+			case MUL_SUB_X: result.push_back(asm_inst(SUB_REG_REG, target_reg, work_reg, src_reg)); break;
+			case MUL_RSUB_X: result.push_back(asm_inst(SUB_REG_REG, target_reg, src_reg, work_reg)); break;
+			case MUL_NEG: result.push_back(asm_inst(NEG_REG, target_reg, work_reg)); break;
+			}
+		}
+	} else if (dest_reg != src_reg) {
+		result = number_code;
+		result.push_back(asm_inst(MUL_REG, dest_reg, src_reg));
+	} else {
+		int number_reg = temps.get();
+		append_number(result, number_reg, value);
+		result.push_back(asm_inst(MUL_REG, dest_reg, number_reg));
+	}
+	status.registers_written |= temps.written_regs;
+	if (temps.borrowed_regs != 0) {
+		result.insert(result.begin(), asm_inst(PUSH_REGS, temps.borrowed_regs));
+		result.push_back(asm_inst(POP_REGS, temps.borrowed_regs));
+	}
+	return result;
+}
@@ -4,13 +4,25 @@
 #include <map>
 #include "codegen.hpp"
 #include "codegen_internal.hpp"
+#include "codegen_ir.hpp"
+
+// ジャンプ表の要素か
+static bool is_jump_table_entry(const asm_inst& inst) {
+	return inst.kind == JMP_DIRECT && inst.params[0] == JMP_TABLE_ENTRY;
+}
+
+// ラベルを参照する命令か
+static bool refers_label(const asm_inst& inst) {
+	return inst.label != "" && (inst.kind == JCC || inst.kind == JMP_DIRECT || inst.kind == CALL_DIRECT ||
+		codegen_is_table_address_request(inst));
+}
 
 // 直後のラベルへのジャンプを削除する
 static bool remove_jump_to_next(std::vector<asm_inst>& insts) {
 	bool progress_exists = false;
 	for (auto itr = insts.begin(); itr != insts.end();) {
 		bool to_delete = false;
-		if (itr->kind == JCC || itr->kind == JMP_DIRECT) {
+		if ((itr->kind == JCC || itr->kind == JMP_DIRECT) && !is_jump_table_entry(*itr)) {
 			auto itr2 = itr;
 			for (itr2++; itr2 != insts.end(); itr2++) {
 				if (itr2->kind == LABEL) {
@@ -45,8 +57,7 @@ static bool remove_unused_generated_labels(std::vector<asm_inst>& insts) {
 	bool progress_exists = false;
 	std::set<std::string> used_labels;
 	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
-		if (itr->label != "" &&
-		(itr->kind == JCC || itr->kind == JMP_DIRECT || itr->kind == CALL_DIRECT)) {
+		if (refers_label(*itr)) {
 			used_labels.insert(itr->label);
 		}
 	}
@@ -93,8 +104,7 @@ static bool merge_generated_labels(std::vector<asm_inst>& insts) {
 	}
 	// 書き換えを実行する
 	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
-		if (itr->label != "" &&
-		(itr->kind == JCC || itr->kind == JMP_DIRECT || itr->kind == CALL_DIRECT)) {
+		if (refers_label(*itr)) {
 			if (rewrite_map.find(itr->label) != rewrite_map.end()) {
 				itr->label = rewrite_map[itr->label];
 				progress_exists = true;
@@ -138,7 +148,8 @@ static bool fold_goto(std::vector<asm_inst>& insts) {
 			if (goto_map.find(itr->label) != goto_map.end()) {
 				itr->label = goto_map[itr->label];
 				progress_exists = true;
-			} else if (itr->kind == JMP_DIRECT && ret_map.find(itr->label) != ret_map.end()) {
+			} else if (itr->kind == JMP_DIRECT && !is_jump_table_entry(*itr) &&
+			ret_map.find(itr->label) != ret_map.end()) {
 				uint32_t id = ret_map[itr->label];
 				if (id == 0) {
 					itr->kind = RET;
@@ -153,6 +164,38 @@ static bool fold_goto(std::vector<asm_inst>& insts) {
 	return progress_exists;
 }
 
+// 「IF 条件 GOTO A; GOTO B; A:」を「IF 逆の条件 GOTO B; A:」にする
+static bool invert_branch_over_goto(std::vector<asm_inst>& insts) {
+	bool progress_exists = false;
+	for (size_t i = 0; i < insts.size(); i++) {
+		if (insts[i].kind != JCC || insts[i].params[0] == ALWAYS) continue;
+		size_t j = i + 1;
+		while (j < insts.size() && insts[j].kind == EMPTY) j++;
+		// 飛び越えるGOTOは、関数内の自動生成ラベルへのもののみ扱う
+		if (j >= insts.size() || insts[j].kind != JMP_DIRECT || is_jump_table_entry(insts[j]) ||
+		insts[j].comment != "" || insts[j].label.compare(0, 2, "__") != 0) continue;
+		bool target_follows = false;
+		for (size_t k = j + 1; k < insts.size(); k++) {
+			if (insts[k].kind == LABEL) {
+				if (insts[k].label == insts[i].label) {
+					target_follows = true;
+					break;
+				}
+			} else if (insts[k].kind != EMPTY) {
+				break;
+			}
+		}
+		if (!target_follows) continue;
+		insts[i].params[0] = ir_invert_cond(static_cast<jcc_cond>(insts[i].params[0]));
+		insts[i].label = insts[j].label;
+		insts[i].loop_bound = insts[j].loop_bound;
+		insts[i].loop_min = insts[j].loop_min;
+		insts.erase(insts.begin() + j);
+		progress_exists = true;
+	}
+	return progress_exists;
+}
+
 // GOTOやRETから次のラベルまでのコードを削除する (間接ジャンプを破壊する可能性があるので注意)
 static bool remove_code_after_goto(std::vector<asm_inst>& insts) {
 	bool progress_exists = false;
@@ -177,7 +220,8 @@ static bool remove_code_after_goto(std::vector<asm_inst>& insts) {
 				progress_exists = true;
 			}
 		} else {
-			if (itr->kind == JMP_DIRECT || itr->kind == RET) {
+			// ジャンプ表の要素の後には、次の要素が続く
+			if ((itr->kind == JMP_DIRECT && !is_jump_table_entry(*itr)) || itr->kind == RET) {
 				removing = true;
 			}
 			itr++;
@@ -186,6 +230,360 @@ static bool remove_code_after_goto(std::vector<asm_inst>& insts) {
 	return progress_exists;
 }
 
+// 命令が書き込むレジスタ (R0～R12) の集合を返す (分からない命令は全部とする)
+static int written_regs(const asm_inst& inst) {
+	const uint32_t* p = inst.params;
+	switch (inst.kind) {
+	case EMPTY: case LABEL: case DB: case DB2: case DW: case DD:
+	case STB_REG_LIT: case STW_REG_LIT: case STL_REG_LIT:
+	case STB_REG_REG: case STW_REG_REG: case STL_REG_REG: case STL_SP_LIT:
+	case CMP_REG_LIT: case CMP_REG_REG: case CADD_REG_REG: case TEST_REG_REG:
+	case JCC: case JMP_DIRECT: case JMP_INDIRECT: case RET: case PUSH_REGS:
+	case ADDSP_LIT: case SUBSP_LIT: case NOP: case CPSID: case CPSIE: case WFI:
+		return 0;
+	case CALL_DIRECT: case CALL_INDIRECT:
+		// 呼び出し先で書き換えられる
+		return 0x100f;
+	case POP_REGS:
+		return p[0] & 0xff;
+	case LDM_REGS: case STM_REGS:
+		return (inst.kind == LDM_REGS ? p[1] & 0xff : 0) | (1 << p[0]);
+	default:
+		return p[0] <= 12 ? 1 << p[0] : 0;
+	}
+}
+
+// 定数を置く命令の並びを実行した結果を求める (求められなければfalseを返す)
+static bool eval_constant(std::vector<asm_inst>::const_iterator begin,
+std::vector<asm_inst>::const_iterator end, uint32_t& value) {
+	uint32_t v = 0;
+	for (auto itr = begin; itr != end; itr++) {
+		const uint32_t* p = itr->params;
+		switch (itr->kind) {
+		case MOV_LIT: v = p[1]; break;
+		case LDL_PC_LIT:
+			if (!codegen_is_literal_request(*itr)) return false;
+			v = p[1];
+			break;
+		case ADD_LIT: v += p[1]; break;
+		case SUB_LIT: v -= p[1]; break;
+		case SHL_REG_LIT: v <<= p[2]; break;
+		case SHR_REG_LIT: v >>= p[2]; break;
+		case ASR_REG_LIT: v = static_cast<uint32_t>(static_cast<int32_t>(v) >> p[2]); break;
+		case NEG_REG: v = -v; break;
+		case NOT_REG: v = ~v; break;
+		case MUL_REG: v *= v; break;
+		case REV_REG: v = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24); break;
+		case REV16_REG: v = ((v >> 8) & UINT32_C(0x00ff00ff)) | ((v << 8) & UINT32_C(0xff00ff00)); break;
+		case REVSH_REG: v = static_cast<uint32_t>(static_cast<int16_t>(((v >> 8) & 0xff) | ((v << 8) & 0xff00))); break;
+		default: return false;
+		}
+	}
+	value = v;
+	return true;
+}
+
+// 値が分かっているレジスタから、指定の値をdest_regに作る最短の命令の並びを求める
+// (2命令以内で作れなければfalseを返す)
+static bool derive_constant(int dest_reg, uint32_t value,
+const bool known[13], const uint32_t known_values[13], std::vector<asm_inst>& out) {
+	std::vector<asm_inst> best;
+	bool found = false;
+	auto consider = [&](const std::vector<asm_inst>& candidate) {
+		if (!found || candidate.size() < best.size()) {
+			best = candidate;
+			found = true;
+		}
+	};
+	for (int s = 0; s <= 12; s++) {
+		if (!known[s]) continue;
+		uint32_t kv = known_values[s];
+		uint32_t diff = value - kv;
+		if (kv == value) {
+			if (s == dest_reg) {
+				consider(std::vector<asm_inst>());
+			} else {
+				consider(std::vector<asm_inst>(1, asm_inst(MOV_REG, dest_reg, s)));
+			}
+			continue;
+		}
+		// 以下はR0～R7のみで使える命令
+		if (dest_reg >= 8 || s >= 8) continue;
+		if (s == dest_reg && (diff < 256 || -diff < 256)) {
+			consider(std::vector<asm_inst>(1, diff < 256 ?
+				asm_inst(ADD_LIT, dest_reg, diff) : asm_inst(SUB_LIT, dest_reg, -diff)));
+		} else if (s != dest_reg && (diff < 8 || -diff < 8)) {
+			consider(std::vector<asm_inst>(1, diff < 8 ?
+				asm_inst(ADD_REG_LIT, dest_reg, s, diff) : asm_inst(SUB_REG_LIT, dest_reg, s, -diff)));
+		}
+		if (-kv == value) consider(std::vector<asm_inst>(1, asm_inst(NEG_REG, dest_reg, s)));
+		if (~kv == value) consider(std::vector<asm_inst>(1, asm_inst(NOT_REG, dest_reg, s)));
+		for (int n = 1; n < 32; n++) {
+			if ((kv << n) == value) consider(std::vector<asm_inst>(1, asm_inst(SHL_REG_LIT, dest_reg, s, n)));
+			if ((kv >> n) == value) consider(std::vector<asm_inst>(1, asm_inst(SHR_REG_LIT, dest_reg, s, n)));
+			if (static_cast<uint32_t>(static_cast<int32_t>(kv) >> n) == value) {
+				consider(std::vector<asm_inst>(1, asm_inst(ASR_REG_LIT, dest_reg, s, n)));
+			}
+		}
+		if (s != dest_reg && (diff < 256 || -diff < 256)) {
+			std::vector<asm_inst> candidate;
+			candidate.push_back(asm_inst(MOV_REG, dest_reg, s));
+			candidate.push_back(diff < 256 ? asm_inst(ADD_LIT, dest_reg, diff) : asm_inst(SUB_LIT, dest_reg, -diff));
+			consider(candidate);
+		}
+	}
+	if (!found) return false;
+	out = best;
+	return true;
+}
+
+// 既にレジスタにある定数を使い回す
+// 分岐先にならない範囲で各レジスタの値を追跡し、定数を置く命令の並びを、
+// 同じ値のレジスタからのコピーや、近い値のレジスタからの計算に置き換える
+// (定数を置く命令のフラグの変化は使われないことを前提とする)
+static bool reuse_constants(std::vector<asm_inst>& insts) {
+	bool progress_exists = false;
+	bool known[13] = {false};
+	uint32_t known_values[13];
+	std::vector<asm_inst> out;
+	for (auto itr = insts.begin(); itr != insts.end();) {
+		if (itr->kind == LABEL) {
+			for (int i = 0; i <= 12; i++) known[i] = false;
+			out.push_back(*itr);
+			itr++;
+			continue;
+		}
+		bool is_start = itr->is_constant && (itr->kind == MOV_LIT || codegen_is_literal_request(*itr));
+		if (!is_start) {
+			int written = written_regs(*itr);
+			if (itr->kind == MOV_REG && itr->params[0] <= 12 && itr->params[1] <= 12 && known[itr->params[1]]) {
+				known[itr->params[0]] = true;
+				known_values[itr->params[0]] = known_values[itr->params[1]];
+			} else {
+				for (int i = 0; i <= 12; i++) {
+					if ((written >> i) & 1) known[i] = false;
+				}
+			}
+			out.push_back(*itr);
+			itr++;
+			continue;
+		}
+		// 同じレジスタに定数を置く命令の並びを取り出す
+		int dest_reg = itr->params[0];
+		auto end = itr + 1;
+		while (end != insts.end() && end->is_constant && static_cast<int>(end->params[0]) == dest_reg &&
+		end->kind != MOV_LIT && !codegen_is_literal_request(*end)) {
+			end++;
+		}
+		uint32_t value;
+		if (dest_reg > 12 || !eval_constant(itr, end, value)) {
+			if (dest_reg <= 12) known[dest_reg] = false;
+			out.insert(out.end(), itr, end);
+			itr = end;
+			continue;
+		}
+		// リテラルプールからの読み込みは、命令の組み合わせでLITERAL_POOL_MIN_INSTS命令かかるものとみなす
+		size_t current_cost = codegen_is_literal_request(*itr) ? LITERAL_POOL_MIN_INSTS : end - itr;
+		std::vector<asm_inst> derived;
+		if (derive_constant(dest_reg, value, known, known_values, derived) && derived.size() < current_cost) {
+			for (auto ditr = derived.begin(); ditr != derived.end(); ditr++) {
+				ditr->is_constant = true;
+				ditr->lineno = itr->lineno;
+			}
+			out.insert(out.end(), derived.begin(), derived.end());
+			progress_exists = true;
+		} else {
+			out.insert(out.end(), itr, end);
+		}
+		known[dest_reg] = true;
+		known_values[dest_reg] = value;
+		itr = end;
+	}
+	insts.swap(out);
+	return progress_exists;
+}
+
+// 右シフトの量0はThumbでは32の意味になるので、フラグの変化が同じ左シフトの量0 (MOVS) にする
+static void fix_zero_right_shifts(std::vector<asm_inst>& insts) {
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if ((itr->kind == SHR_REG_LIT || itr->kind == ASR_REG_LIT) && itr->params[2] == 0) {
+			itr->kind = SHL_REG_LIT;
+		}
+	}
+}
+
+// 分岐命令の飛び先までの距離が届くかを判定する
+static bool branch_in_range(const asm_inst& inst, int64_t offset) {
+	if (inst.kind == JCC) return -256 <= offset && offset <= 254;
+	return -2048 <= offset && offset <= 2046;
+}
+
+// 分岐の飛び石 (飛び先への無条件ジャンプ) を置く位置を、分岐から最大でこのバイト数だけ離す
+// (リテラルプールの位置の見積もりの誤差の分、無条件ジャンプが届く距離より短くする)
+static const int64_t BRANCH_ISLAND_REACH = 1900;
+
+// 分岐の飛び石
+struct branch_island {
+	std::string label; // 飛び石のラベル
+	asm_inst jump; // 飛び先へのジャンプ
+};
+
+// insts[pos]の直前に命令を挟めるか (ジャンプ表やデータの途中でないか)
+static bool can_insert_before(const std::vector<asm_inst>& insts, size_t pos) {
+	if (pos == 0 || pos >= insts.size()) return false;
+	const asm_inst& prev = insts[pos - 1];
+	return !is_data(insts[pos]) && !is_data(prev) && !is_jump_table_entry(insts[pos]) &&
+		!(prev.kind == ADD_REG && prev.params[0] == 15);
+}
+
+// insts[from]の分岐から、飛び先の方向に向かって飛び石を置く位置を探す (見つからなければinsts.size())
+// 実行が流れてこない位置を優先し、無ければなるべく遠い位置に飛び越えるジャンプと一緒に置く
+static size_t find_island_position(const std::vector<asm_inst>& insts, const std::vector<int64_t>& addresses,
+size_t from, int64_t target_address) {
+	bool forward = target_address > addresses[from];
+	size_t natural = insts.size(), forced = insts.size();
+	int64_t natural_distance = 0, forced_distance = 0;
+	for (size_t pos = forward ? from + 1 : from; pos > 0 && pos < insts.size(); forward ? pos++ : pos--) {
+		int64_t distance = forward ? addresses[pos] - addresses[from] : addresses[from] - addresses[pos];
+		if (distance > BRANCH_ISLAND_REACH ||
+		(forward ? addresses[pos] >= target_address : addresses[pos] <= target_address)) {
+			break;
+		}
+		if (!can_insert_before(insts, pos)) continue;
+		if (codegen_is_unconditional_transfer(insts[pos - 1])) {
+			natural = pos;
+			natural_distance = distance;
+		}
+		forced = pos;
+		forced_distance = distance;
+	}
+	// 近すぎて先に進めない位置には置かない
+	if (natural < insts.size() && natural_distance >= BRANCH_ISLAND_REACH / 2) return natural;
+	if (forced < insts.size() && forced_distance >= BRANCH_ISLAND_REACH / 2) return forced;
+	return insts.size();
+}
+
+// 飛び先が遠すぎて届かない分岐を書き換える
+// 条件分岐は、逆の条件で無条件ジャンプを飛び越える形にする
+// 関数への (末尾呼び出しの) ジャンプは、LRを退避して呼び出して戻る形にする
+// 関数内の無条件ジャンプ (ジャンプ表の要素を含む) は、届く範囲に置いた飛び先へのジャンプ (飛び石) を
+// 経由させる (飛び石も届かなければ、次の繰り返しでさらに飛び石を置く)
+// リテラルプールを置く前に呼ぶ (読み込みの要求は、命令の組み合わせになった場合の大きさに
+// プールの詰め物の分を足して見積もる)
+static void relax_branches(std::vector<asm_inst>& insts) {
+	std::set<std::string> used_labels;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if (itr->kind == LABEL) used_labels.insert(itr->label);
+	}
+	int next_label_id = 0;
+	auto new_label = [&]() {
+		std::string label;
+		do {
+			label = "__B" + std::to_string(next_label_id++);
+		} while (used_labels.count(label) > 0);
+		return label;
+	};
+	bool progress_exists;
+	do {
+		progress_exists = false;
+		// 各命令とラベルのアドレスを見積もる
+		std::vector<int64_t> addresses(insts.size());
+		std::map<std::string, int64_t> label_addresses;
+		int64_t address = 0;
+		for (size_t i = 0; i < insts.size(); i++) {
+			int size = insts[i].size();
+			if (codegen_is_literal_request(insts[i])) {
+				size = static_cast<int>(codegen_synthesize_number(insts[i].params[0], insts[i].params[1]).size()) * 2;
+				if (size < 6) size = 6;
+				size += 2;
+			}
+			address = asm_aligned_address(insts[i], static_cast<uint32_t>(address));
+			addresses[i] = address;
+			if (insts[i].kind == LABEL) label_addresses[insts[i].label] = address;
+			address += size;
+		}
+		// 書き換える命令と、各位置の直前に置く飛び石 (飛び先のラベル -> 飛び石のジャンプ)
+		std::map<size_t, std::vector<asm_inst> > replacements;
+		std::map<size_t, std::map<std::string, branch_island> > islands;
+		for (size_t i = 0; i < insts.size(); i++) {
+			const asm_inst& inst = insts[i];
+			auto target = label_addresses.find(inst.label);
+			bool is_function_jump = inst.kind == JMP_DIRECT && !is_jump_table_entry(inst) &&
+				!(inst.label[0] == '_' && inst.label[1] == '_');
+			if ((inst.kind != JCC && inst.kind != JMP_DIRECT) || target == label_addresses.end() ||
+			branch_in_range(inst, target->second - (addresses[i] + 4))) {
+				continue;
+			}
+			std::vector<asm_inst> code;
+			if (is_function_jump) {
+				code.push_back(asm_inst(PUSH_REGS, 0x100));
+				code.push_back(asm_inst(CALL_DIRECT, inst.label));
+				code.push_back(asm_inst(POP_REGS, 0x100));
+			} else if (inst.kind == JCC && inst.params[0] != ALWAYS) {
+				asm_inst jump = inst;
+				jump.kind = JMP_DIRECT;
+				jump.params[0] = 0;
+				std::string skip_label = new_label();
+				code.push_back(asm_inst(JCC, skip_label, ir_invert_cond(static_cast<jcc_cond>(inst.params[0]))));
+				code.push_back(jump);
+				code.push_back(asm_inst(LABEL, skip_label));
+			} else {
+				size_t pos = find_island_position(insts, addresses, i, target->second);
+				if (pos >= insts.size()) throw codegen_error(inst.lineno, "branch target too far");
+				// 飛び石が元のジャンプの代わりに飛び先に飛ぶ (ループの回数の情報も移す)
+				branch_island& island = islands[pos][inst.label];
+				if (island.label == "") {
+					island.label = new_label();
+					island.jump = asm_inst(JMP_DIRECT, inst.label);
+					island.jump.loop_bound = inst.loop_bound;
+					island.jump.loop_min = inst.loop_min;
+					island.jump.lineno = inst.lineno;
+				} else if (island.jump.loop_bound != inst.loop_bound || island.jump.loop_min != inst.loop_min) {
+					island.jump.loop_bound = island.jump.loop_min = -1;
+				}
+				asm_inst jump = inst;
+				if (jump.kind == JCC) {
+					jump.kind = JMP_DIRECT;
+					jump.params[0] = 0;
+				}
+				jump.label = island.label;
+				jump.loop_bound = jump.loop_min = -1;
+				replacements[i].push_back(jump);
+				progress_exists = true;
+				continue;
+			}
+			codegen_set_lineno(code, inst.lineno);
+			replacements[i] = code;
+			progress_exists = true;
+		}
+		if (!progress_exists) break;
+		std::vector<asm_inst> out;
+		for (size_t i = 0; i < insts.size(); i++) {
+			auto island_itr = islands.find(i);
+			if (island_itr != islands.end()) {
+				// 実行が流れてくる位置なら、飛び石を飛び越える
+				std::string skip_label;
+				if (!codegen_is_unconditional_transfer(insts[i - 1])) {
+					skip_label = new_label();
+					out.push_back(asm_inst(JMP_DIRECT, skip_label));
+				}
+				for (auto itr = island_itr->second.begin(); itr != island_itr->second.end(); itr++) {
+					out.push_back(asm_inst(LABEL, itr->second.label));
+					out.push_back(itr->second.jump);
+				}
+				if (skip_label != "") out.push_back(asm_inst(LABEL, skip_label));
+			}
+			auto replacement = replacements.find(i);
+			if (replacement == replacements.end()) {
+				out.push_back(insts[i]);
+			} else {
+				out.insert(out.end(), replacement->second.begin(), replacement->second.end());
+			}
+		}
+		insts.swap(out);
+	} while (progress_exists);
+}
+
 // 生成したコードを改善する
 void codegen_clean(std::vector<asm_inst>& insts) {
 	bool progress_exists;
@@ -195,6 +593,14 @@ void codegen_clean(std::vector<asm_inst>& insts) {
 		if (remove_unused_generated_labels(insts)) progress_exists = true;
 		if (merge_generated_labels(insts)) progress_exists = true;
 		if (fold_goto(insts)) progress_exists = true;
+		if (invert_branch_over_goto(insts)) progress_exists = true;
 		if (remove_code_after_goto(insts)) progress_exists = true;
 	} while (progress_exists);
+	// ラベルが減って分岐先にならない範囲が広がってから、定数を使い回す
+	reuse_constants(insts);
+	fix_zero_right_shifts(insts);
+	// 届かない分岐を書き換えてから、リテラルプールを置く
+	relax_branches(insts);
+	// 不要なコードを消し終わってから、リテラルプールを置く
+	codegen_place_literals(insts);
 }
@@ -14,7 +14,7 @@ int get_reg_to_use(int lineno, int regs_available, bool prefer_callee_save) {
 			if ((regs_available >> i) & 1) return i;
 		}
 	}
-	throw codegen_error(lineno, "no registers available");
+	throw codegen_register_error(lineno);
 }
 
 // 指定のノードのポインタを、一発でメモリアクセスできる形で表そうとする
@@ -276,8 +276,17 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 			}
 			if (is_write) {
 				if (!value_evaluated) {
-					expr_value = codegen_expr(value_node, lineno, true, false, -1,
-						regs_available2, stack_extra_offset, status);
+					if (!direct_ok) {
+						expr_value = codegen_expr_holding(expr_variable, value_node, lineno, true, false, -1,
+							regs_available2, stack_extra_offset, status);
+					} else if (use_stack_buffer) {
+						expr_value = codegen_expr_holding(
+							codegen_expr_result(std::vector<asm_inst>(1, asm_inst(MOV_REG, variable_reg, 13)), variable_reg),
+							value_node, lineno, true, false, -1, regs_available2, stack_extra_offset, status);
+					} else {
+						expr_value = codegen_expr(value_node, lineno, true, false, -1,
+							regs_available2, stack_extra_offset, status);
+					}
 					result.insert(result.end(), expr_value.insts.begin(), expr_value.insts.end());
 					regs_available2 &= ~(1 << expr_value.result_reg);
 				}
@@ -329,6 +338,10 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 			int regs_decided = 0;
 			// キャッシュを保存する場合、キャッシュ対象が壊すレジスタに割り当てられないようにする
 			if (preserve_cache && result_prefer_reg >= 0) regs_available2 &= ~(1 << result_prefer_reg);
+			// 結果を置くレジスタがレジスタ変数のものなら、まだ読んでいない式がその変数を使うかもしれないので、
+			// オフセットの計算には使わない
+			bool result_is_variable_reg = result_prefer_reg >= 0 &&
+				((status.registers_reserved >> result_prefer_reg) & 1);
 			if (cmp_expr_info(variable_hint, offset_hint) <= 0) {
 				bool offset_funcall_exists = (offset_hint != nullptr && offset_hint->func_call_exists);
 				if (is_write && cmp_expr_info(value_hint, variable_hint) < 0) {
@@ -377,19 +390,14 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 						// どうせ読んだ値を書いて壊すレジスタが決まっているなら、それを使う
 						// ただし、掛け算をする場合は、必ず別のレジスタを使う
 						offset_reg = result_prefer_reg >= 0 && !preserve_cache &&
-							!((regs_decided >> result_prefer_reg) & 1) &&
+							!((regs_decided >> result_prefer_reg) & 1) && !result_is_variable_reg &&
 							(size_shift >= 0 || result_prefer_reg != offset_reg) ? result_prefer_reg :
 								get_reg_to_use(lineno, regs_available2, offset_prefer_callee_save);
 					}
 					if (expr->type->size > 1) {
-						if (size_shift >= 0) {
-							result.push_back(asm_inst(SHL_REG_LIT,
-								offset_reg, expr_offset.result_reg, size_shift));
-						} else {
-							std::vector<asm_inst> ncode = codegen_put_number(offset_reg, expr->type->size);
-							result.insert(result.end(), ncode.begin(), ncode.end());
-							result.push_back(asm_inst(MUL_REG, offset_reg, expr_offset.result_reg));
-						}
+						std::vector<asm_inst> mcode = codegen_multiply_by_constant(offset_reg,
+							expr_offset.result_reg, expr->type->size, 0, lineno, status);
+						result.insert(result.end(), mcode.begin(), mcode.end());
 						if (ofr->negate_offset_node) {
 							result.push_back(asm_inst(NEG_REG, offset_reg, offset_reg));
 						}
@@ -398,12 +406,13 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 					}
 					status.registers_written |= 1 << offset_reg;
 				}
+				regs_available2 = regs_available2 & ~(1 << offset_reg);
 				regs_decided |= (1 << offset_reg);
 			} else {
 				// オフセットを適当なレジスタに置く
 				// どうせ読んだ値を書いて壊すレジスタが決まっているなら、それを使う
 				offset_reg = result_prefer_reg >= 0 && !preserve_cache &&
-					!((regs_decided >> result_prefer_reg) & 1) ? result_prefer_reg :
+					!((regs_decided >> result_prefer_reg) & 1) && !result_is_variable_reg ? result_prefer_reg :
 						get_reg_to_use(lineno, regs_available2, offset_prefer_callee_save);
 				std::vector<asm_inst> ncode = codegen_put_number(offset_reg, ofr->additional_offset);
 				result.insert(result.end(), ncode.begin(), ncode.end());
@@ -416,7 +425,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 				expr_variable = codegen_expr(ofr->vnode, lineno, true,
 					is_write && !value_generated &&
 						value_hint != nullptr && value_hint->func_call_exists,
-					-1, regs_available, stack_extra_offset, status);
+					-1, regs_available2, stack_extra_offset, status);
 				result.insert(result.end(), expr_variable.insts.begin(), expr_variable.insts.end());
 				regs_available2 = regs_available2 & ~(1 << expr_variable.result_reg);
 				regs_decided |= (1 << expr_variable.result_reg);
@@ -435,7 +444,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 				}
 				if (!variable_generated) {
 					expr_variable = codegen_expr(ofr->vnode, lineno, true, false, -1,
-						regs_available, stack_extra_offset, status);
+						regs_available2, stack_extra_offset, status);
 					result.insert(result.end(), expr_variable.insts.begin(), expr_variable.insts.end());
 					regs_available2 = regs_available2 & ~(1 << expr_variable.result_reg);
 					regs_decided |= (1 << expr_variable.result_reg);
@@ -487,8 +496,10 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 // result_prefer_regが非負の場合、指定されたレジスタはregs_availableに入っていなくても破壊(結果の配置)してよい
 //   (レジスタ変数への代入など)
 // status.registers_writtenの更新を忘れないように！ (callee-saveレジスタの退避に用いる情報)
-codegen_expr_result codegen_expr(expression_node* expr, int lineno, bool want_result, bool prefer_callee_save,
-int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_status& status) {
+// レジスタが足りない場合は、codegen_expr()が使用中のレジスタを退避してやり直す
+static codegen_expr_result codegen_expr_main(expression_node* expr, int lineno, bool want_result,
+bool prefer_callee_save, int result_prefer_reg, int regs_available, int stack_extra_offset,
+codegen_status& status) {
 	if (expr == nullptr) {
 		throw codegen_error(lineno, "NULL passed to codegen_expr()");
 	}
@@ -818,6 +829,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 				result.insert(result.end(), bcode.begin(), bcode.end());
 				result.push_back(asm_inst(MOV_LIT, result_reg, 0));
 				result.push_back(asm_inst(LABEL, label));
+				status.registers_written |= 1 << result_reg;
 			} else {
 				codegen_expr_result res = codegen_expr(
 					expr->info.op.operands[0], lineno, false, false,
@@ -866,6 +878,9 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 								result.push_back(asm_inst(
 									type->kind == TYPE_INTEGER && type->info.is_signed ? ASR_REG_LIT : SHR_REG_LIT,
 									result_reg, result_reg, shift_width));
+							} else if (result_reg != res.result_reg) {
+								// 拡張が不要でも、結果のレジスタが変わるならコピーする
+								result.push_back(asm_inst(MOV_REG, result_reg, res.result_reg));
 							}
 						}
 						break;
@@ -915,8 +930,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 					result0 = codegen_expr(operand0, lineno, want_result, false,
 						add_value < 8 || add_value_neg < 8 ||
 						(add_value > 255 * 2 && add_value_neg > 255 * 2) ? -1 : result_prefer_reg,
-						add_value <= 255 * 2 || add_value_neg <= 255 * 2 ? regs_available : -1,
-						stack_extra_offset, status);
+						regs_available, stack_extra_offset, status);
 					result.insert(result.end(), result0.insts.begin(), result0.insts.end());
 					if (want_result) {
 						if (add_value == 0) {
@@ -979,7 +993,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 						operand1->hint != nullptr && operand1->hint->func_call_exists,
 						-1, regs_available, stack_extra_offset, status);
 					auto checkpoint1 = status.save_checkpoint();
-					result1 = codegen_expr(operand1, lineno, want_result, false,
+					result1 = codegen_expr_holding(result0, operand1, lineno, want_result, false,
 						-1, regs_available & ~(1 << result0.result_reg), stack_extra_offset, status);
 					// result_prefer_regが設定されていて、どっちの辺もそこに置かれなかった
 					if (want_result && result_prefer_reg >= 0 &&
@@ -991,13 +1005,13 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 							result0 = codegen_expr(operand0, lineno, want_result,
 								operand1->hint != nullptr && operand1->hint->func_call_exists,
 								result_prefer_reg, regs_available, stack_extra_offset, status);
-							result1 = codegen_expr(operand1, lineno, want_result, false,
+							result1 = codegen_expr_holding(result0, operand1, lineno, want_result, false,
 								-1, regs_available & ~(1 << result0.result_reg), stack_extra_offset, status);
 						} else if (mult1 > 1 && !((regs_available >> result1.result_reg) & 1)) {
 							// 右辺が書き換え対象、かつ書き換え不可のレジスタにある
 							// → 右辺にresult_prefer_regを設定して生成し直す
 							status.load_checkpoint(checkpoint1);
-							result1 = codegen_expr(operand1, lineno, want_result, false,
+							result1 = codegen_expr_holding(result0, operand1, lineno, want_result, false,
 								result_prefer_reg, regs_available & ~(1 << result0.result_reg),
 								stack_extra_offset, status);
 						}
@@ -1017,18 +1031,14 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 								(operand1->hint != nullptr && operand1->hint->func_call_exists) ||
 								(prefer_callee_save && reg1 != result_prefer_reg));
 						}
-						if (tpn > 0) {
-							result.push_back(asm_inst(SHL_REG_LIT, reg0, result0.result_reg, tpn));
-						} else {
-							std::vector<asm_inst> ncode = codegen_put_number(reg0, mult0);
-							result.insert(result.end(), ncode.begin(), ncode.end());
-							result.push_back(asm_inst(MUL_REG, reg0, result_reg));
-						}
+						std::vector<asm_inst> mcode = codegen_multiply_by_constant(reg0,
+							result0.result_reg, mult0, 0, lineno, status);
+						result.insert(result.end(), mcode.begin(), mcode.end());
 						status.registers_written |= 1 << reg0;
 					}
 					result.insert(result.end(), result1.insts.begin(), result1.insts.end());
 					if (want_result && mult1 > 1) {
-						int tpn = get_two_pow_num(mult0);
+						int tpn = get_two_pow_num(mult1);
 						if (tpn >= 0 &&
 						((result_prefer_reg >= 0 && reg1 == result_prefer_reg && reg0 != result_prefer_reg) ||
 						((regs_available >> reg1) & 1))) {
@@ -1037,13 +1047,9 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 							// reg1に上書きできないので、新しいレジスタを割り当てる
 							reg1 = get_reg_to_use(lineno, regs_available & ~(1 << reg0) & ~(1 << reg1), false);
 						}
-						if (tpn > 0) {
-							result.push_back(asm_inst(SHL_REG_LIT, reg1, result1.result_reg, tpn));
-						} else {
-							std::vector<asm_inst> ncode = codegen_put_number(reg1, mult1);
-							result.insert(result.end(), ncode.begin(), ncode.end());
-							result.push_back(asm_inst(MUL_REG, reg1, result_reg));
-						}
+						std::vector<asm_inst> mcode = codegen_multiply_by_constant(reg1,
+							result1.result_reg, mult1, 0, lineno, status);
+						result.insert(result.end(), mcode.begin(), mcode.end());
 						status.registers_written |= 1 << reg1;
 					}
 					// 足し算を行う
@@ -1157,7 +1163,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 							operand1->hint != nullptr && operand1->hint->func_call_exists,
 							-1, regs_available, stack_extra_offset, status);
 						auto checkpoint = status.save_checkpoint();
-						result1 = codegen_expr(operand1, lineno, want_result, false, -1,
+						result1 = codegen_expr_holding(result0, operand1, lineno, want_result, false, -1,
 							regs_available & ~(1 << result0.result_reg), stack_extra_offset, status);
 						// result_prefer_reg設定あり && 結果が乗っていない &&
 						// 書き換え対象が書き換え不可 → 書き換え対象にresult_prefer_regを設定
@@ -1165,7 +1171,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 						result0.result_reg != result_prefer_reg && result1.result_reg != result_prefer_reg &&
 						mult > 1 && !((regs_available >> result1.result_reg) & 1)) {
 							status.load_checkpoint(checkpoint);
-							result1 = codegen_expr(operand1, lineno, want_result, false, result_prefer_reg,
+							result1 = codegen_expr_holding(result0, operand1, lineno, want_result, false, result_prefer_reg,
 								regs_available & ~(1 << result0.result_reg), stack_extra_offset, status);
 						}
 						result.insert(result.end(), result0.insts.begin(), result0.insts.end());
@@ -1175,7 +1181,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 						result1 = codegen_expr(operand1, lineno, want_result,
 							operand0->hint != nullptr && operand0->hint->func_call_exists,
 							-1, regs_available, stack_extra_offset, status);
-						result0 = codegen_expr(operand0, lineno, want_result, false,
+						result0 = codegen_expr_holding(result1, operand0, lineno, want_result, false,
 							-1, regs_available & ~(1 << result1.result_reg), stack_extra_offset, status);
 						// result_prefer_reg設定あり && 結果が乗っていない &&
 						// 書き換え対象が書き換え不可 → 書き換え対象にresult_prefer_regを設定
@@ -1186,7 +1192,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 							result1 = codegen_expr(operand1, lineno, want_result,
 								operand0->hint != nullptr && operand0->hint->func_call_exists,
 								result_prefer_reg, regs_available, stack_extra_offset, status);
-							result0 = codegen_expr(operand0, lineno, want_result, false,
+							result0 = codegen_expr_holding(result1, operand0, lineno, want_result, false,
 								-1, regs_available & ~(1 << result1.result_reg), stack_extra_offset, status);
 						}
 						result.insert(result.end(), result1.insts.begin(), result1.insts.end());
@@ -1203,13 +1209,9 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 								// reg1が書き込み禁止または掛け算に使うので、新しいレジスタを割り当てる
 								reg1 = get_reg_to_use(lineno, regs_available & ~(1 << reg0) & ~(1 << reg1), false);
 							}
-							if (tpn >= 0) {
-								result.push_back(asm_inst(SHL_REG_LIT, reg1, result1.result_reg, tpn));
-							} else {
-								std::vector<asm_inst> ncode = codegen_put_number(reg1, mult);
-								result.insert(result.end(), ncode.begin(), ncode.end());
-								result.push_back(asm_inst(MUL_REG, reg1, result1.result_reg));
-							}
+							std::vector<asm_inst> mcode = codegen_multiply_by_constant(reg1,
+								result1.result_reg, mult, 0, lineno, status);
+							result.insert(result.end(), mcode.begin(), mcode.end());
 							status.registers_written |= 1 << reg1;
 						}
 						// 引き算をする
@@ -1222,7 +1224,10 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 							if (tpn >= 0) {
 								result.push_back(asm_inst(ASR_REG_LIT, result_reg, result_reg, tpn));
 							} else {
-								throw codegen_error(lineno, "generic division not implemented yet");
+								std::vector<asm_inst> div_code = codegen_divide_by_constant(true, false, mult,
+									expr->type, result_reg, result_reg, regs_available & ~(1 << result_reg),
+									lineno, status);
+								result.insert(result.end(), div_code.begin(), div_code.end());
 							}
 						}
 						status.registers_written |= 1 << result_reg;
@@ -1249,7 +1254,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 							prefer_callee_save || (operand1->hint != nullptr && operand1->hint->func_call_exists),
 							result_prefer_reg >= 0 && (regs_available & (1 << result_prefer_reg)) ? result_prefer_reg : -1,
 							regs_available, stack_extra_offset, status);
-						result1 = codegen_expr(operand1, lineno, want_result, false,
+						result1 = codegen_expr_holding(result0, operand1, lineno, want_result, false,
 							-1, regs_available & ~(1 << result0.result_reg), stack_extra_offset, status);
 						result.insert(result.end(), result0.insts.begin(), result0.insts.end());
 						result.insert(result.end(), result1.insts.begin(), result1.insts.end());
@@ -1257,7 +1262,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 						result1 = codegen_expr(operand1, lineno, want_result,
 							operand0->hint != nullptr && operand0->hint->func_call_exists,
 							-1, regs_available, stack_extra_offset, status);
-						result0 = codegen_expr(operand0, lineno, want_result, prefer_callee_save,
+						result0 = codegen_expr_holding(result1, operand0, lineno, want_result, prefer_callee_save,
 							result_prefer_reg >= 0 && result1.result_reg != result_prefer_reg ? result_prefer_reg : -1,
 							regs_available & ~(1 << result1.result_reg), stack_extra_offset, status);
 						result.insert(result.end(), result1.insts.begin(), result1.insts.end());
@@ -1293,7 +1298,25 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 			break;
 		// 各種二項演算子 (対称性あり、即値使用不可)
 		case OP_MUL: case OP_AND: case OP_XOR: case OP_OR:
-			{
+			if (expr->info.op.kind == OP_MUL && (expr->info.op.operands[0]->kind == EXPR_INTEGER_LITERAL ||
+			expr->info.op.operands[1]->kind == EXPR_INTEGER_LITERAL)) {
+				// 定数を掛ける
+				bool literal_first = expr->info.op.operands[0]->kind == EXPR_INTEGER_LITERAL;
+				expression_node* operand = expr->info.op.operands[literal_first ? 1 : 0];
+				uint32_t value = expr->info.op.operands[literal_first ? 0 : 1]->info.value;
+				codegen_expr_result result0 = codegen_expr(operand, lineno, want_result, prefer_callee_save,
+					result_prefer_reg, regs_available, stack_extra_offset, status);
+				result = result0.insts;
+				if (want_result) {
+					int reg0 = result0.result_reg;
+					if (result_prefer_reg >= 0) result_reg = result_prefer_reg;
+					else if (regs_available & (1 << reg0)) result_reg = reg0;
+					else result_reg = get_reg_to_use(lineno, regs_available, prefer_callee_save);
+					std::vector<asm_inst> mul_code = codegen_multiply_by_constant(result_reg, reg0, value,
+						regs_available & ~(1 << reg0), lineno, status);
+					result.insert(result.end(), mul_code.begin(), mul_code.end());
+				}
+			} else {
 				expression_node* operand0 = expr->info.op.operands[0];
 				expression_node* operand1 = expr->info.op.operands[1];
 				codegen_expr_result result0, result1;
@@ -1303,7 +1326,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 					result0 = codegen_expr(operand0, lineno, want_result,
 						operand1->hint != nullptr && operand1->hint->func_call_exists,
 						-1, regs_available, stack_extra_offset, status);
-					result1 = codegen_expr(operand1, lineno, want_result, prefer_callee_save,
+					result1 = codegen_expr_holding(result0, operand1, lineno, want_result, prefer_callee_save,
 						result0.result_reg != result_prefer_reg ? result_prefer_reg : -1,
 						regs_available & ~(1 << result0.result_reg), stack_extra_offset, status);
 					result.insert(result.end(), result0.insts.begin(), result0.insts.end());
@@ -1312,7 +1335,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 					result1 = codegen_expr(operand1, lineno, want_result,
 						operand0->hint != nullptr && operand0->hint->func_call_exists,
 						-1, regs_available, stack_extra_offset, status);
-					result0 = codegen_expr(operand0, lineno, want_result, prefer_callee_save,
+					result0 = codegen_expr_holding(result1, operand0, lineno, want_result, prefer_callee_save,
 						result1.result_reg != result_prefer_reg ? result_prefer_reg : -1,
 						regs_available & ~(1 << result1.result_reg), stack_extra_offset, status);
 					result.insert(result.end(), result1.insts.begin(), result1.insts.end());
@@ -1357,6 +1380,68 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 				}
 			}
 			break;
+		// 割り算 (定数で割る場合以外は、補助ルーチンを呼び出す)
+		case OP_DIV: case OP_MOD:
+			if (codegen_is_constant_division(expr)) {
+				expression_node* operand0 = expr->info.op.operands[0];
+				codegen_expr_result result0 = codegen_expr(operand0, lineno, want_result, prefer_callee_save,
+					result_prefer_reg, regs_available, stack_extra_offset, status);
+				result = result0.insts;
+				if (want_result) {
+					int reg0 = result0.result_reg;
+					// 結果はresult_prefer_reg、書き込めるなら被除数のレジスタ、の順に置く
+					if (result_prefer_reg >= 0) result_reg = result_prefer_reg;
+					else if (regs_available & (1 << reg0)) result_reg = reg0;
+					else result_reg = get_reg_to_use(lineno, regs_available, prefer_callee_save);
+					std::vector<asm_inst> div_code = codegen_divide_by_constant(
+						is_integer_type(expr->type) && expr->type->info.is_signed, expr->info.op.kind == OP_MOD,
+						expr->info.op.operands[1]->info.value, operand0->type, reg0, result_reg,
+						regs_available & ~(1 << reg0), lineno, status);
+					result.insert(result.end(), div_code.begin(), div_code.end());
+				}
+			} else {
+				expression_node* operand0 = expr->info.op.operands[0];
+				expression_node* operand1 = expr->info.op.operands[1];
+				bool call0 = operand0->hint != nullptr && operand0->hint->func_call_exists;
+				bool call1 = operand1->hint != nullptr && operand1->hint->func_call_exists;
+				codegen_expr_result result0, result1;
+				// 他方に関数呼び出しが無ければ、補助ルーチンの引数のレジスタに直接置く
+				int prefer0 = !call1 && (regs_available & 1) ? 0 : -1;
+				int prefer1 = !call0 && (regs_available & 2) ? 1 : -1;
+				if (cmp_expr_info(operand0->hint, operand1->hint) <= 0) {
+					result0 = codegen_expr(operand0, lineno, want_result, call1,
+						prefer0, regs_available, stack_extra_offset, status);
+					result1 = codegen_expr_holding(result0, operand1, lineno, want_result, false,
+						result0.result_reg != 1 ? prefer1 : -1,
+						regs_available & ~(1 << result0.result_reg), stack_extra_offset, status);
+					result.insert(result.end(), result0.insts.begin(), result0.insts.end());
+					result.insert(result.end(), result1.insts.begin(), result1.insts.end());
+				} else {
+					result1 = codegen_expr(operand1, lineno, want_result, call0,
+						prefer1, regs_available, stack_extra_offset, status);
+					result0 = codegen_expr_holding(result1, operand0, lineno, want_result, false,
+						result1.result_reg != 0 ? prefer0 : -1,
+						regs_available & ~(1 << result1.result_reg), stack_extra_offset, status);
+					result.insert(result.end(), result1.insts.begin(), result1.insts.end());
+					result.insert(result.end(), result0.insts.begin(), result0.insts.end());
+				}
+				if (want_result) {
+					bool want_remainder = expr->info.op.kind == OP_MOD;
+					int reg0 = result0.result_reg, reg1 = result1.result_reg;
+					// 補助ルーチンの結果のレジスタ、オペランドのレジスタの順に、書き込めるものを結果にする
+					if (result_prefer_reg >= 0) result_reg = result_prefer_reg;
+					else if (regs_available & (1 << (want_remainder ? 1 : 0))) result_reg = want_remainder ? 1 : 0;
+					else if (regs_available & (1 << reg0)) result_reg = reg0;
+					else if (regs_available & (1 << reg1)) result_reg = reg1;
+					else result_reg = get_reg_to_use(lineno, regs_available, prefer_callee_save);
+					bool is_signed = is_integer_type(expr->type) && expr->type->info.is_signed;
+					std::vector<asm_inst> call_code = codegen_call_divmod(is_signed, want_remainder,
+						reg0, reg1, result_reg, ~regs_available | status.registers_reserved);
+					result.insert(result.end(), call_code.begin(), call_code.end());
+					status.registers_written |= 1 << result_reg;
+				}
+			}
+			break;
 		// 比較演算子・二項論理演算子
 		case OP_LESS: case OP_GREATER: case OP_LESS_EQUAL: case OP_GREATER_EQUAL:
 		case OP_EQUAL: case OP_NOT_EQUAL:
@@ -1418,10 +1503,13 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 					result_prefer_reg, regs_available, stack_extra_offset, status);
 				result = res.code.insts;
 				result_reg = res.code.result_reg;
-				if (!res.cache.is_register && res.cache.size < 4) {
+				if (want_result && !res.cache.is_register && res.cache.size < 4) {
 					// 符号拡張 or ゼロ拡張
+					// 書き込んだ値がレジスタ変数などの書き込み禁止のレジスタにある場合は、別のレジスタに置く
 					int shift_width = 8 * (4 - res.cache.size);
-					int out_reg = result_prefer_reg >= 0 ? result_prefer_reg : result_reg;
+					int out_reg = result_prefer_reg >= 0 ? result_prefer_reg :
+						((regs_available >> result_reg) & 1) ? result_reg :
+						get_reg_to_use(lineno, regs_available, prefer_callee_save);
 					result.push_back(asm_inst(SHL_REG_LIT, out_reg, result_reg, shift_width));
 					result.push_back(asm_inst(
 						res.cache.is_signed ? ASR_REG_LIT : SHR_REG_LIT, out_reg, out_reg, shift_width));
@@ -1434,6 +1522,7 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 		case OP_ADD_ASSIGN: case OP_SUB_ASSIGN: // 即値あり、係数あり
 		case OP_SHL_ASSIGN: case OP_SHR_ASSIGN: // 即値あり、係数なし
 		case OP_MUL_ASSIGN: case OP_AND_ASSIGN: case OP_XOR_ASSIGN: case OP_OR_ASSIGN: // 即値なし、係数なし
+		case OP_DIV_ASSIGN: case OP_MOD_ASSIGN: // 補助ルーチンを呼び出す
 			{
 				bool is_add = expr->info.op.kind == OP_ADD_ASSIGN || expr->info.op.kind == OP_SUB_ASSIGN;
 				bool is_shift = expr->info.op.kind == OP_SHL_ASSIGN || expr->info.op.kind == OP_SHR_ASSIGN;
@@ -1448,7 +1537,8 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 				uint32_t literal_value = right_is_literal ? mult * operand1->info.value : 0;
 				// 値を読み、新しい値を計算する
 				if (right_is_literal &&
-				((is_add && (literal_value < 256 || UINT32_MAX - (256 - 1) < literal_value)) || is_shift)) {
+				((is_add && (literal_value < 256 || UINT32_MAX - (256 - 1) < literal_value)) || is_shift ||
+				expr->info.op.kind == OP_MUL_ASSIGN || codegen_is_constant_division(expr))) {
 					// 即値を使用する
 					auto checkpoint = status.save_checkpoint();
 					res0 = codegen_mem(operand0, ofr, lineno, nullptr, false, true, false,
@@ -1471,6 +1561,23 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 							inst = literal_value < 256 ? SUB_LIT : ADD_LIT;
 						}
 						result.push_back(asm_inst(inst, res0.code.result_reg, immediate_value));
+					} else if (expr->info.op.kind == OP_MUL_ASSIGN) {
+						// 定数を掛ける
+						std::vector<asm_inst> mul_code = codegen_multiply_by_constant(
+							res0.code.result_reg, res0.code.result_reg, literal_value,
+							regs_available & ~res0.cache.regs_in_cache & ~(1 << res0.code.result_reg),
+							lineno, status);
+						result.insert(result.end(), mul_code.begin(), mul_code.end());
+					} else if (!is_shift) {
+						// 定数で割る
+						type_node* op_type = usual_arithmetic_conversion(operand0->type, operand1->type);
+						std::vector<asm_inst> div_code = codegen_divide_by_constant(
+							op_type != nullptr && is_integer_type(op_type) && op_type->info.is_signed,
+							expr->info.op.kind == OP_MOD_ASSIGN, literal_value, operand0->type,
+							res0.code.result_reg, res0.code.result_reg,
+							regs_available & ~res0.cache.regs_in_cache & ~(1 << res0.code.result_reg),
+							lineno, status);
+						result.insert(result.end(), div_code.begin(), div_code.end());
 					} else {
 						immediate_value = literal_value & 31;
 						if (expr->info.op.kind == OP_SHL_ASSIGN) {
@@ -1520,9 +1627,26 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 						result.insert(result.end(), res0.code.insts.begin(), res0.code.insts.end());
 					}
 					if (is_add) {
+						// ポインタの計算用の係数を反映させる
+						int reg1 = res1.result_reg;
+						if (mult > 1) {
+							int regs_to_use = regs_available & ~res0.cache.regs_in_cache & ~(1 << res0.code.result_reg);
+							if (!((regs_to_use >> reg1) & 1)) reg1 = get_reg_to_use(lineno, regs_to_use, false);
+							std::vector<asm_inst> mul_code = codegen_multiply_by_constant(reg1, res1.result_reg, mult,
+								regs_to_use & ~(1 << reg1), lineno, status);
+							result.insert(result.end(), mul_code.begin(), mul_code.end());
+						}
 						result.push_back(asm_inst(
 							expr->info.op.kind == OP_ADD_ASSIGN ? ADD_REG_REG : SUB_REG_REG,
-							res0.code.result_reg, res0.code.result_reg, res1.result_reg));
+							res0.code.result_reg, res0.code.result_reg, reg1));
+					} else if (expr->info.op.kind == OP_DIV_ASSIGN || expr->info.op.kind == OP_MOD_ASSIGN) {
+						// 書き込み先のアドレスを置いたレジスタも保つ
+						type_node* op_type = usual_arithmetic_conversion(operand0->type, operand1->type);
+						bool is_signed = op_type != nullptr && is_integer_type(op_type) && op_type->info.is_signed;
+						std::vector<asm_inst> call_code = codegen_call_divmod(is_signed,
+							expr->info.op.kind == OP_MOD_ASSIGN, res0.code.result_reg, res1.result_reg,
+							res0.code.result_reg, ~regs_available | status.registers_reserved | res0.cache.regs_in_cache);
+						result.insert(result.end(), call_code.begin(), call_code.end());
 					} else {
 						asm_inst_kind inst;
 						switch (expr->info.op.kind) {
@@ -1680,8 +1804,9 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 					direct_call = true;
 					direct_call_label = ofr->vnode->info.ident.name;
 				}
-				// オペランドの評価前に、引数として使うレジスタを保存する
-				int regs_to_save = argument_regs & ~regs_available;
+				// オペランドの評価前に、引数として使うレジスタおよび呼び出しで壊れる使用中のレジスタを保存する
+				// (予約済みレジスタは後で保存する)
+				int regs_to_save = (argument_regs | 0xf) & ~regs_available & ~status.registers_reserved;
 				if (result_prefer_reg >= 0) regs_to_save &= ~(1 << result_prefer_reg);
 				if (regs_to_save != 0) result.push_back(asm_inst(PUSH_REGS, regs_to_save));
 				int new_offset = stack_extra_offset;
@@ -1752,6 +1877,21 @@ int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_statu
 	return codegen_expr_result(result, result_reg);
 }
 
+// 式のコード生成を行う (引数の意味はcodegen_expr_main()と同じ)
+// レジスタが足りなければ、使用中のレジスタを退避して生成し直す
+codegen_expr_result codegen_expr(expression_node* expr, int lineno, bool want_result, bool prefer_callee_save,
+int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_status& status) {
+	auto checkpoint = status.save_checkpoint();
+	try {
+		return codegen_expr_main(expr, lineno, want_result, prefer_callee_save,
+			result_prefer_reg, regs_available, stack_extra_offset, status);
+	} catch (const codegen_register_error&) {
+		status.load_checkpoint(checkpoint);
+	}
+	return codegen_expr_with_spill(expr, lineno, want_result, prefer_callee_save,
+		result_prefer_reg, regs_available, stack_extra_offset, status);
+}
+
 // 条件分岐のコード生成を行う
 std::vector<asm_inst> codegen_conditional_jump(expression_node* expr, int lineno,
 const std::string& dest_label, bool jump_if_true,
@@ -1833,7 +1973,7 @@ int regs_available, int stack_extra_offset, codegen_status& status) {
 						res0 = codegen_expr(operand0, lineno, true,
 							operand1->hint != nullptr && operand1->hint->func_call_exists,
 							-1, regs_available, stack_extra_offset, status);
-						res1 = codegen_expr(operand1, lineno, true, false,
+						res1 = codegen_expr_holding(res0, operand1, lineno, true, false,
 							-1, regs_available & ~(1 << res0.result_reg), stack_extra_offset, status);
 						result.insert(result.end(), res0.insts.begin(), res0.insts.end());
 						result.insert(result.end(), res1.insts.begin(), res1.insts.end());
@@ -1841,7 +1981,7 @@ int regs_available, int stack_extra_offset, codegen_status& status) {
 						res1 = codegen_expr(operand1, lineno, true,
 							operand0->hint != nullptr && operand0->hint->func_call_exists,
 							-1, regs_available, stack_extra_offset, status);
-						res0 = codegen_expr(operand0, lineno, true, false,
+						res0 = codegen_expr_holding(res1, operand0, lineno, true, false,
 							-1, regs_available & ~(1 << res1.result_reg), stack_extra_offset, status);
 						result.insert(result.end(), res1.insts.begin(), res1.insts.end());
 						result.insert(result.end(), res0.insts.begin(), res0.insts.end());
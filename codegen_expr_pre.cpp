@@ -332,7 +332,7 @@ expr_info* get_operator_hint(expression_node* expr, int lineno) {
 		}
 		break;
 	// 複合代入演算子
-	case OP_MUL_ASSIGN: //case OP_DIV_ASSIGN: case OP_MOD_ASSIGN:
+	case OP_MUL_ASSIGN: case OP_DIV_ASSIGN: case OP_MOD_ASSIGN:
 	case OP_ADD_ASSIGN: case OP_SUB_ASSIGN: case OP_SHL_ASSIGN: case OP_SHR_ASSIGN:
 	case OP_AND_ASSIGN: case OP_XOR_ASSIGN: case OP_OR_ASSIGN:
 		{
@@ -365,8 +365,11 @@ expr_info* get_operator_hint(expression_node* expr, int lineno) {
 			// left_regsで保存するべきなのはアドレス用と評価用
 			// left_regs == right_regsの時は、値1個だけを保存する右辺を先に評価する
 			// u8の利用とかを考えていくと…？
+			// 割り算は補助ルーチンを呼び出すので、関数呼び出しありとする (定数で割る場合を除く)
 			return new expr_info(left_regs > right_regs ? left_regs : right_regs,
-				operands[0]->hint->func_call_exists || operands[1]->hint->func_call_exists);
+				operands[0]->hint->func_call_exists || operands[1]->hint->func_call_exists ||
+				((expr->info.op.kind == OP_DIV_ASSIGN || expr->info.op.kind == OP_MOD_ASSIGN) &&
+				!codegen_is_constant_division(expr)));
 		}
 		break;
 	// コンマ (左辺を評価し、それを捨てて右辺を評価)
@@ -377,14 +380,16 @@ expr_info* get_operator_hint(expression_node* expr, int lineno) {
 				operands[0]->hint->func_call_exists || operands[1]->hint->func_call_exists);
 		}
 		break;
-	// その他の二項演算子 (割り算は直接行える命令が無さそうなので保留)
-	case OP_MUL: //case OP_DIV: case OP_MOD:
+	// その他の二項演算子 (割り算は補助ルーチンを呼び出すので、関数呼び出しありとする (定数で割る場合を除く))
+	case OP_MUL: case OP_DIV: case OP_MOD:
 	case OP_AND: case OP_XOR: case OP_OR:
 		{
 			int nregs1 = operands[0]->hint->num_regs_to_use, nregs2 = operands[1]->hint->num_regs_to_use;
 			int ret = nregs1 == nregs2 ? nregs1 + 1 : (nregs1 > nregs2 ? nregs1 : nregs2);
 			return new expr_info(ret <= 0 ? 1 : ret,
-				operands[0]->hint->func_call_exists || operands[1]->hint->func_call_exists);
+				operands[0]->hint->func_call_exists || operands[1]->hint->func_call_exists ||
+				((expr->info.op.kind == OP_DIV || expr->info.op.kind == OP_MOD) &&
+				!codegen_is_constant_division(expr)));
 		}
 		break;
 	// 条件演算子
@@ -449,9 +454,20 @@ void codegen_preprocess_expr(expression_node* expr, int lineno, codegen_status&
 		if (expr->info.op.kind > OP_DUMMY_TERNARY_START) {
 			codegen_preprocess_expr(expr->info.op.operands[2], lineno, status);
 		}
-		// 関数呼び出しなら、使用フラグを立てる
-		if (expr->info.op.kind == OP_FUNC_CALL || expr->info.op.kind == OP_FUNC_CALL_NOARGS) {
+		// 変数のアドレスを取る場合、その変数に印をつける
+		if (expr->info.op.kind == OP_ADDRESS && expr->info.op.operands[0]->kind == EXPR_IDENTIFIER) {
+			expr->info.op.operands[0]->info.ident.info->address_taken = true;
+		}
+		// 関数呼び出しなら、使用フラグを立てる (割り算の補助ルーチンの呼び出しを含む)
+		switch (expr->info.op.kind) {
+		case OP_FUNC_CALL: case OP_FUNC_CALL_NOARGS:
 			status.call_exists = true;
+			break;
+		case OP_DIV: case OP_MOD: case OP_DIV_ASSIGN: case OP_MOD_ASSIGN:
+			if (!codegen_is_constant_division(expr)) status.call_exists = true;
+			break;
+		default:
+			break;
 		}
 		// ヒントを設定する (長くなりそうなので分割)
 		expr->hint = get_operator_hint(expr, lineno);
@@ -0,0 +1,135 @@
+#include <string>
+#include <set>
+#include <vector>
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// 補助ルーチンの名前 (ファイルスコープで処理系用に予約された名前を使う)
+static const char* const UDIVMOD_NAME = "_udivmod";
+static const char* const SDIVMOD_NAME = "_sdivmod";
+
+// 除算の補助ルーチンを呼び出し、商または余りをdest_regに置くコードを生成する
+// 補助ルーチンはR0に被除数、R1に除数を受け取り、R0に商、R1に余りを返す (R0～R3を壊す)
+std::vector<asm_inst> codegen_call_divmod(bool is_signed, bool want_remainder,
+int dividend_reg, int divisor_reg, int dest_reg, int regs_to_preserve) {
+	std::vector<asm_inst> result;
+	int regs_to_save = regs_to_preserve & 0xf & ~(1 << dest_reg);
+	if (regs_to_save != 0) result.push_back(asm_inst(PUSH_REGS, regs_to_save));
+	// 引数をR0とR1に移す
+	if (dividend_reg == 1 && divisor_reg == 0) {
+		result.push_back(asm_inst(MOV_REG, 12, 0));
+		result.push_back(asm_inst(MOV_REG, 0, 1));
+		result.push_back(asm_inst(MOV_REG, 1, 12));
+	} else if (divisor_reg == 0) {
+		result.push_back(asm_inst(MOV_REG, 1, 0));
+		if (dividend_reg != 0) result.push_back(asm_inst(MOV_REG, 0, dividend_reg));
+	} else {
+		if (dividend_reg != 0) result.push_back(asm_inst(MOV_REG, 0, dividend_reg));
+		if (divisor_reg != 1) result.push_back(asm_inst(MOV_REG, 1, divisor_reg));
+	}
+	result.push_back(asm_inst(CALL_DIRECT, is_signed ? SDIVMOD_NAME : UDIVMOD_NAME));
+	int result_reg = want_remainder ? 1 : 0;
+	if (dest_reg != result_reg) result.push_back(asm_inst(MOV_REG, dest_reg, result_reg));
+	if (regs_to_save != 0) result.push_back(asm_inst(POP_REGS, regs_to_save));
+	return result;
+}
+
+// 符号なし除算の補助ルーチンのコードを生成する
+// 1バイト分 (8ステップ) を展開した引き戻し法で、商の上位の0のバイトは飛ばす
+static std::vector<asm_inst> udivmod_code(codegen_status& status) {
+	std::vector<asm_inst> result;
+	std::string div_label = get_label(status.next_label++);
+	std::string next_label = get_label(status.next_label++);
+	result.push_back(asm_inst(LABEL, UDIVMOD_NAME));
+	// R2 : 商 (最初に置く1は、最後のバイトを処理し終えた時に桁あふれする番兵)
+	result.push_back(asm_inst(MOV_LIT, 2, 1));
+	result.push_back(asm_inst(SHL_REG_LIT, 2, 2, 24));
+	// 商が何バイトになるかを調べ、除数をその分左にずらす
+	result.push_back(asm_inst(SHR_REG_LIT, 3, 0, 8));
+	for (int i = 0; i < 3; i++) {
+		result.push_back(asm_inst(CMP_REG_REG, 3, 1));
+		result.push_back(asm_inst(JCC, L_UNSIGN, div_label));
+		result.push_back(asm_inst(SHL_REG_LIT, 1, 1, 8));
+		result.push_back(asm_inst(SHR_REG_LIT, 2, 2, 8));
+	}
+	result.push_back(asm_inst(JMP_DIRECT, div_label));
+	result.push_back(asm_inst(LABEL, next_label));
+	result.push_back(asm_inst(SHR_REG_LIT, 1, 1, 8));
+	result.push_back(asm_inst(LABEL, div_label));
+	// 1ビットずつ引けるかを調べ、引けたビットをキャリー経由で商に入れる
+	for (int j = 7; j >= 0; j--) {
+		std::string skip_label = get_label(status.next_label++);
+		if (j > 0) {
+			result.push_back(asm_inst(SHR_REG_LIT, 3, 0, j));
+			result.push_back(asm_inst(CMP_REG_REG, 3, 1));
+			result.push_back(asm_inst(JCC, L_UNSIGN, skip_label));
+			result.push_back(asm_inst(SHL_REG_LIT, 3, 1, j));
+			result.push_back(asm_inst(SUB_REG_REG, 0, 0, 3));
+		} else {
+			result.push_back(asm_inst(CMP_REG_REG, 0, 1));
+			result.push_back(asm_inst(JCC, L_UNSIGN, skip_label));
+			result.push_back(asm_inst(SUB_REG_REG, 0, 0, 1));
+		}
+		result.push_back(asm_inst(LABEL, skip_label));
+		result.push_back(asm_inst(ADC_REG, 2, 2));
+	}
+	// 番兵が出てくるまで、除数を1バイトずつ右にずらして繰り返す
+	result.push_back(asm_inst(JCC, NO_CARRY, next_label));
+	result.back().loop_bound = 3;
+	result.push_back(asm_inst(MOV_REG, 1, 0));
+	result.push_back(asm_inst(MOV_REG, 0, 2));
+	result.push_back(asm_inst(RET));
+	return result;
+}
+
+// 符号付き除算の補助ルーチンのコードを生成する
+// 絶対値で符号なし除算を行い、商は両者の符号が異なれば、余りは被除数が負なら符号を反転する
+static std::vector<asm_inst> sdivmod_code() {
+	std::vector<asm_inst> result;
+	result.push_back(asm_inst(LABEL, SDIVMOD_NAME));
+	result.push_back(asm_inst(PUSH_REGS, 0x110));
+	// R4 : 商の符号 (最上位ビット)
+	result.push_back(asm_inst(MOV_REG, 4, 0));
+	result.push_back(asm_inst(XOR_REG, 4, 1));
+	// R12 : 余りの符号 (0または-1)
+	for (int reg = 0; reg < 2; reg++) {
+		result.push_back(asm_inst(ASR_REG_LIT, 3, reg, 31));
+		result.push_back(asm_inst(XOR_REG, reg, 3));
+		result.push_back(asm_inst(SUB_REG_REG, reg, reg, 3));
+		if (reg == 0) result.push_back(asm_inst(MOV_REG, 12, 3));
+	}
+	result.push_back(asm_inst(CALL_DIRECT, UDIVMOD_NAME));
+	result.push_back(asm_inst(ASR_REG_LIT, 3, 4, 31));
+	result.push_back(asm_inst(XOR_REG, 0, 3));
+	result.push_back(asm_inst(SUB_REG_REG, 0, 0, 3));
+	result.push_back(asm_inst(MOV_REG, 3, 12));
+	result.push_back(asm_inst(XOR_REG, 1, 3));
+	result.push_back(asm_inst(SUB_REG_REG, 1, 1, 3));
+	result.push_back(asm_inst(POP_REGS, 0x110));
+	return result;
+}
+
+// 使われている補助ルーチンのコードを追加する
+void codegen_append_helpers(std::vector<asm_inst>& insts, codegen_status& status) {
+	std::set<std::string> called;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if (itr->kind == CALL_DIRECT) called.insert(itr->label);
+	}
+	bool use_sdivmod = called.count(SDIVMOD_NAME) > 0;
+	bool use_udivmod = use_sdivmod || called.count(UDIVMOD_NAME) > 0;
+	const char* const names[] = {SDIVMOD_NAME, UDIVMOD_NAME};
+	const bool used[] = {use_sdivmod, use_udivmod};
+	for (int i = 0; i < 2; i++) {
+		if (used[i] && status.var_maps.front().count(names[i]) > 0) {
+			throw codegen_error(0, std::string("name ") + names[i] + " is reserved for runtime helper");
+		}
+	}
+	if (use_sdivmod) {
+		std::vector<asm_inst> code = sdivmod_code();
+		insts.insert(insts.end(), code.begin(), code.end());
+	}
+	if (use_udivmod) {
+		std::vector<asm_inst> code = udivmod_code(status);
+		insts.insert(insts.end(), code.begin(), code.end());
+	}
+}
@@ -0,0 +1,907 @@
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "ast.h"
+#include "util.h"
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// 小さい関数とみなす、本体の大きさ (文と式のノードの数) の上限
+static const int INLINE_MAX_SMALL_COST = 12;
+// 呼び出しが1箇所だけの関数を展開する、本体の大きさの上限
+static const int INLINE_MAX_SINGLE_COST = 150;
+// 展開した本体の中の呼び出しを、さらに展開する深さの上限
+static const int INLINE_MAX_DEPTH = 4;
+// 中間表現を経由しない場合の、展開後の関数の変数の数の上限
+// (生存範囲を考えずに変数をレジスタに置くので、関数呼び出しをまたいで使えるR4～R7に
+// 収まらない分はメモリに置かれる)
+static const int INLINE_MAX_VARS_NO_IR = 4;
+// 中間表現を経由しない場合に、変数に代入する引数1個を本体の大きさに換算した値
+static const int INLINE_ARG_COPY_COST_NO_IR = 4;
+
+struct inline_function {
+	ast_node* def;
+	ast_node* pristine; // 展開を行う前の本体の複製
+	bool is_root; // 外から呼ばれうるので消さない
+	bool force_inline, no_inline; // #pragma inline / #pragma noinline
+	bool eligible; // 構造上展開できるか
+	bool ends_with_return; // 本体の最後の文がreturnか
+	int cost;
+	int num_vars; // 展開で増える変数の数 (引数、ローカル変数、戻り値)
+	int calls, other_refs; // 元のプログラムでの、呼び出しの数と、それ以外で名前が使われた数
+	std::set<std::string> free_names; // 関数内で宣言されていない (グローバルの) 名前
+	std::set<std::string> modified; // 書き換えやアドレスの取得をされる名前
+
+	inline_function() : def(nullptr), pristine(nullptr), is_root(false), force_inline(false),
+		no_inline(false), eligible(false), ends_with_return(false), cost(0), num_vars(0), calls(0), other_refs(0) {}
+};
+
+struct inline_status {
+	std::map<std::string, inline_function> functions;
+	std::vector<std::string> expanding; // 展開中の関数 (再帰を展開しないため)
+	// 展開先の関数で宣言されている変数の型 (同じ名前で型が違うものはnullptr)
+	std::map<std::string, type_node*> var_types;
+	std::set<std::string> address_taken; // 展開先の関数でアドレスを取られる変数
+	type_node* return_type; // 展開先の関数の戻り値の型
+	bool use_ir; // 中間表現を経由してコードを生成するか
+	int next_id;
+
+	inline_status() : return_type(nullptr), use_ir(false), next_id(0) {}
+};
+
+// ASTで使う文字列を作る
+static char* new_name(const std::string& name) {
+	char* str = static_cast<char*>(malloc_check(name.size() + 1));
+	std::strcpy(str, name.c_str());
+	return str;
+}
+
+// 文の配列のノードを作る
+static ast_node* new_block(const std::vector<ast_node*>& nodes, int lineno) {
+	ast_node* block = new_ast_node(NODE_ARRAY, lineno);
+	block->d.array.num = nodes.size();
+	block->d.array.nodes = static_cast<ast_node**>(malloc_check(sizeof(ast_node*) * nodes.size()));
+	for (size_t i = 0; i < nodes.size(); i++) block->d.array.nodes[i] = nodes[i];
+	return block;
+}
+
+// 初期化式の無い変数の宣言を作る
+static ast_node* new_var_define(type_node* type, const std::string& name, int is_register, int lineno) {
+	ast_node* var = new_ast_node(NODE_VAR_DEFINE, lineno);
+	var->d.var_def.type = type;
+	var->d.var_def.name = new_name(name);
+	var->d.var_def.is_register = is_register;
+	var->d.var_def.initializer = nullptr;
+	var->d.var_def.info = nullptr;
+	return var;
+}
+
+// 式文のノードを作る
+static ast_node* new_expr_statement(expression_node* expr, int lineno) {
+	ast_node* node = new_ast_node(NODE_EXPR, lineno);
+	node->d.expr.expression = expr;
+	return node;
+}
+
+// pragmaの最初の要素が指定の名前かを判定する
+static bool is_pragma(ast_node* node, const char* name) {
+	return node != nullptr && node->kind == NODE_PRAGMA && node->d.array.num >= 1 &&
+		node->d.array.nodes[0]->kind == NODE_CONTROL_IDENTIFIER &&
+		std::strcmp(node->d.array.nodes[0]->d.identifier.name, name) == 0;
+}
+
+// 番号を指定してレジスタに置く指定か
+static bool is_numbered_register_pragma(ast_node* node) {
+	return is_pragma(node, "use_register") && node->d.array.num >= 2 &&
+		node->d.array.nodes[1]->kind == NODE_CONTROL_INTEGER;
+}
+
+// 引数がレジスタに置く指定をされているか (番号の指定は無いものとする)
+static int argument_wants_register(ast_node* arg) {
+	if (arg->d.arg.is_register) return 1;
+	for (size_t i = 0; arg->d.arg.pragmas != nullptr && i < arg->d.arg.pragmas->d.array.num; i++) {
+		if (is_pragma(arg->d.arg.pragmas->d.array.nodes[i], "use_register")) return 1;
+	}
+	return 0;
+}
+
+// 演算子のオペランドの数を返す
+static int num_operands(operator_type op) {
+	return op > OP_DUMMY_TERNARY_START ? 3 : op > OP_DUMMY_BINARY_START ? 2 : 1;
+}
+
+// 外側のカッコを外す
+static expression_node* strip_parenthesis(expression_node* expr) {
+	while (expr->kind == EXPR_OPERATOR && expr->info.op.kind == OP_PARENTHESIS) expr = expr->info.op.operands[0];
+	return expr;
+}
+
+// 関数呼び出しの引数の情報を、カンマ演算子の列から作り直す
+static void rebuild_arguments(expression_node* call) {
+	expression_node* node_ptr = call->info.op.operands[1];
+	for (int i = call->info.op.argument_num - 1; i > 0; i--) {
+		call->info.op.arguments[i] = node_ptr->info.op.operands[1];
+		node_ptr = node_ptr->info.op.operands[0];
+	}
+	call->info.op.arguments[0] = node_ptr;
+}
+
+// 名前の有効範囲を追跡しながら、識別子の使われ方を調べる
+struct scope_walker {
+	std::vector<std::set<std::string> > scopes;
+
+	scope_walker() : scopes(1) {}
+	// 名前が宣言されている一番内側の有効範囲の位置を返す (無ければ負)
+	int find(const std::string& name) const {
+		for (int i = static_cast<int>(scopes.size()) - 1; i >= 0; i--) {
+			if (scopes[i].count(name) > 0) return i;
+		}
+		return -1;
+	}
+	bool is_bound(const std::string& name) const {
+		return find(name) >= 0;
+	}
+};
+
+// 関数の名前が呼び出しと、それ以外で使われた回数を数える
+static void count_refs_expr(expression_node* expr, const scope_walker& sw,
+std::map<std::string, int>& calls, std::map<std::string, int>& others) {
+	if (expr == nullptr) return;
+	if (expr->kind == EXPR_IDENTIFIER) {
+		if (!sw.is_bound(expr->info.ident.name)) others[expr->info.ident.name]++;
+		return;
+	}
+	if (expr->kind != EXPR_OPERATOR) return;
+	operator_type op = expr->info.op.kind;
+	int start = 0;
+	if ((op == OP_FUNC_CALL || op == OP_FUNC_CALL_NOARGS) &&
+	expr->info.op.operands[0]->kind == EXPR_IDENTIFIER) {
+		if (!sw.is_bound(expr->info.op.operands[0]->info.ident.name)) {
+			calls[expr->info.op.operands[0]->info.ident.name]++;
+		}
+		start = 1;
+	}
+	for (int i = start; i < num_operands(op); i++) count_refs_expr(expr->info.op.operands[i], sw, calls, others);
+}
+
+static void count_refs(ast_node* ast, scope_walker& sw,
+std::map<std::string, int>& calls, std::map<std::string, int>& others) {
+	if (ast == nullptr) return;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		sw.scopes.push_back(std::set<std::string>());
+		for (size_t i = 0; i < ast->d.array.num; i++) count_refs(ast->d.array.nodes[i], sw, calls, others);
+		sw.scopes.pop_back();
+		break;
+	case NODE_VAR_DEFINE:
+		sw.scopes.back().insert(ast->d.var_def.name);
+		count_refs_expr(ast->d.var_def.initializer, sw, calls, others);
+		break;
+	case NODE_EXPR: count_refs_expr(ast->d.expr.expression, sw, calls, others); break;
+	case NODE_LABEL: count_refs(ast->d.label.statement, sw, calls, others); break;
+	case NODE_IF:
+		count_refs_expr(ast->d.if_d.cond, sw, calls, others);
+		count_refs(ast->d.if_d.true_statement, sw, calls, others);
+		count_refs(ast->d.if_d.false_statement, sw, calls, others);
+		break;
+	case NODE_SWITCH:
+		count_refs_expr(ast->d.switch_d.expr, sw, calls, others);
+		count_refs(ast->d.switch_d.statement, sw, calls, others);
+		break;
+	case NODE_CASE: count_refs(ast->d.case_d.statement, sw, calls, others); break;
+	case NODE_DEFAULT: count_refs(ast->d.default_d.statement, sw, calls, others); break;
+	case NODE_WHILE: case NODE_DO_WHILE:
+		count_refs_expr(ast->d.while_d.cond, sw, calls, others);
+		count_refs(ast->d.while_d.statement, sw, calls, others);
+		break;
+	case NODE_FOR:
+		sw.scopes.push_back(std::set<std::string>());
+		count_refs(ast->d.for_d.init, sw, calls, others);
+		count_refs_expr(ast->d.for_d.cond, sw, calls, others);
+		count_refs_expr(ast->d.for_d.post, sw, calls, others);
+		count_refs(ast->d.for_d.body, sw, calls, others);
+		sw.scopes.pop_back();
+		break;
+	case NODE_RETURN: count_refs_expr(ast->d.ret.ret_expression, sw, calls, others); break;
+	default: break;
+	}
+}
+
+// 関数の本体の名前の使われ方を数える
+static void count_function_refs(ast_node* def, ast_node* body,
+std::map<std::string, int>& calls, std::map<std::string, int>& others) {
+	scope_walker sw;
+	ast_node* args = def->d.func_def.arguments;
+	for (size_t i = 0; args != nullptr && i < args->d.array.num; i++) {
+		sw.scopes.back().insert(args->d.array.nodes[i]->d.arg.name);
+	}
+	count_refs(body, sw, calls, others);
+}
+
+// 式の中で書き換えやアドレスの取得をされる変数の名前を集める
+// (address_only : アドレスの取得のみを集める)
+static void collect_modified_expr(expression_node* expr, std::set<std::string>& names, bool address_only) {
+	if (expr == nullptr || expr->kind != EXPR_OPERATOR) return;
+	operator_type op = expr->info.op.kind;
+	bool modify = op == OP_ADDRESS || (!address_only && ((op >= OP_ASSIGN && op <= OP_OR_ASSIGN) ||
+		op == OP_PRE_INC || op == OP_PRE_DEC || op == OP_POST_INC || op == OP_POST_DEC || op == OP_SIZEOF));
+	if (modify) {
+		expression_node* target = strip_parenthesis(expr->info.op.operands[0]);
+		if (target->kind == EXPR_IDENTIFIER) names.insert(target->info.ident.name);
+	}
+	for (int i = 0; i < num_operands(op); i++) collect_modified_expr(expr->info.op.operands[i], names, address_only);
+}
+
+// 文の中で宣言された変数の型と、書き換えやアドレスの取得をされる変数の名前を集める
+static void collect_vars(ast_node* ast, std::map<std::string, type_node*>* types,
+std::set<std::string>& names, bool address_only) {
+	if (ast == nullptr) return;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) collect_vars(ast->d.array.nodes[i], types, names, address_only);
+		break;
+	case NODE_VAR_DEFINE:
+		if (types != nullptr) {
+			auto itr = types->find(ast->d.var_def.name);
+			if (itr == types->end()) {
+				(*types)[ast->d.var_def.name] = ast->d.var_def.type;
+			} else if (!is_compatible_type(itr->second, ast->d.var_def.type)) {
+				itr->second = nullptr;
+			}
+		}
+		collect_modified_expr(ast->d.var_def.initializer, names, address_only);
+		break;
+	case NODE_EXPR: collect_modified_expr(ast->d.expr.expression, names, address_only); break;
+	case NODE_LABEL: collect_vars(ast->d.label.statement, types, names, address_only); break;
+	case NODE_IF:
+		collect_modified_expr(ast->d.if_d.cond, names, address_only);
+		collect_vars(ast->d.if_d.true_statement, types, names, address_only);
+		collect_vars(ast->d.if_d.false_statement, types, names, address_only);
+		break;
+	case NODE_SWITCH:
+		collect_modified_expr(ast->d.switch_d.expr, names, address_only);
+		collect_vars(ast->d.switch_d.statement, types, names, address_only);
+		break;
+	case NODE_CASE: collect_vars(ast->d.case_d.statement, types, names, address_only); break;
+	case NODE_DEFAULT: collect_vars(ast->d.default_d.statement, types, names, address_only); break;
+	case NODE_WHILE: case NODE_DO_WHILE:
+		collect_modified_expr(ast->d.while_d.cond, names, address_only);
+		collect_vars(ast->d.while_d.statement, types, names, address_only);
+		break;
+	case NODE_FOR:
+		collect_vars(ast->d.for_d.init, types, names, address_only);
+		collect_modified_expr(ast->d.for_d.cond, names, address_only);
+		collect_modified_expr(ast->d.for_d.post, names, address_only);
+		collect_vars(ast->d.for_d.body, types, names, address_only);
+		break;
+	case NODE_RETURN: collect_modified_expr(ast->d.ret.ret_expression, names, address_only); break;
+	default: break;
+	}
+}
+
+// 式の大きさ (ノードの数) を求める
+static int expr_cost(expression_node* expr) {
+	if (expr == nullptr) return 0;
+	if (expr->kind != EXPR_OPERATOR) return 1;
+	operator_type op = expr->info.op.kind;
+	int cost = op == OP_PARENTHESIS || op == OP_COMMA ? 0 : 1;
+	for (int i = 0; i < num_operands(op); i++) cost += expr_cost(expr->info.op.operands[i]);
+	return cost;
+}
+
+// 文の大きさ (文と式のノードの数) を求める
+static int statement_cost(ast_node* ast) {
+	if (ast == nullptr) return 0;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		{
+			int cost = 0;
+			for (size_t i = 0; i < ast->d.array.num; i++) cost += statement_cost(ast->d.array.nodes[i]);
+			return cost;
+		}
+	case NODE_VAR_DEFINE: return ast->d.var_def.initializer != nullptr ? 1 + expr_cost(ast->d.var_def.initializer) : 0;
+	case NODE_EXPR: return expr_cost(ast->d.expr.expression);
+	case NODE_LABEL: return statement_cost(ast->d.label.statement);
+	case NODE_IF:
+		return 1 + expr_cost(ast->d.if_d.cond) +
+			statement_cost(ast->d.if_d.true_statement) + statement_cost(ast->d.if_d.false_statement);
+	case NODE_SWITCH: return 1 + expr_cost(ast->d.switch_d.expr) + statement_cost(ast->d.switch_d.statement);
+	case NODE_CASE: return 1 + statement_cost(ast->d.case_d.statement);
+	case NODE_DEFAULT: return statement_cost(ast->d.default_d.statement);
+	case NODE_WHILE: case NODE_DO_WHILE:
+		return 1 + expr_cost(ast->d.while_d.cond) + statement_cost(ast->d.while_d.statement);
+	case NODE_FOR:
+		return 1 + statement_cost(ast->d.for_d.init) + expr_cost(ast->d.for_d.cond) +
+			expr_cost(ast->d.for_d.post) + statement_cost(ast->d.for_d.body);
+	case NODE_GOTO: case NODE_CONTINUE: case NODE_BREAK: return 1;
+	case NODE_RETURN: return 1 + expr_cost(ast->d.ret.ret_expression);
+	default: return 0;
+	}
+}
+
+// 本体を展開できる形か (returnの形が戻り値の型と合い、番号を指定したレジスタ変数が無い)
+static bool body_eligible(ast_node* ast, bool returns_value) {
+	if (ast == nullptr) return true;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			if (!body_eligible(ast->d.array.nodes[i], returns_value)) return false;
+		}
+		return true;
+	case NODE_PRAGMA: return !is_numbered_register_pragma(ast);
+	case NODE_FUNC_DEFINE: return false;
+	case NODE_LABEL: return body_eligible(ast->d.label.statement, returns_value);
+	case NODE_IF:
+		return body_eligible(ast->d.if_d.true_statement, returns_value) &&
+			body_eligible(ast->d.if_d.false_statement, returns_value);
+	case NODE_SWITCH: return body_eligible(ast->d.switch_d.statement, returns_value);
+	case NODE_CASE: return body_eligible(ast->d.case_d.statement, returns_value);
+	case NODE_DEFAULT: return body_eligible(ast->d.default_d.statement, returns_value);
+	case NODE_WHILE: case NODE_DO_WHILE: return body_eligible(ast->d.while_d.statement, returns_value);
+	case NODE_FOR:
+		return body_eligible(ast->d.for_d.init, returns_value) && body_eligible(ast->d.for_d.body, returns_value);
+	case NODE_RETURN: return (ast->d.ret.ret_expression != nullptr) == returns_value;
+	default: return true;
+	}
+}
+
+// 関数を展開先に複製するための情報
+struct clone_context {
+	scope_walker sw; // 一番外側は関数の引数
+	std::string suffix; // 関数内の名前に付ける接尾辞 (識別子には使えない文字を含む)
+	std::map<std::string, expression_node*> substitutions; // 式で置き換える引数
+	std::set<std::string> free_names; // 関数内で宣言されていない名前
+	std::string result_name; // 戻り値を置く変数 (空 : 戻り値を使わない)
+	std::string end_label; // returnの代わりに飛ぶラベル (空 : returnのまま残す)
+};
+
+static expression_node* clone_expr(expression_node* expr, clone_context& cc) {
+	if (expr == nullptr) return nullptr;
+	expression_node* res = static_cast<expression_node*>(malloc_check(sizeof(expression_node)));
+	*res = *expr;
+	if (expr->kind == EXPR_IDENTIFIER) {
+		std::string name = expr->info.ident.name;
+		auto itr = cc.substitutions.find(name);
+		if (itr != cc.substitutions.end() && cc.sw.find(name) == 0) {
+			// 置き換える式は識別子か整数リテラルなので、そのまま複製すればよい
+			*res = *itr->second;
+		} else if (cc.sw.is_bound(name)) {
+			res->info.ident.name = new_name(name + cc.suffix);
+		} else {
+			cc.free_names.insert(name);
+		}
+	} else if (expr->kind == EXPR_OPERATOR) {
+		operator_type op = expr->info.op.kind;
+		for (int i = 0; i < num_operands(op); i++) res->info.op.operands[i] = clone_expr(expr->info.op.operands[i], cc);
+		// 引数を定数に置き換えると、カッコの中が左辺値でなくなることがある
+		if (op == OP_PARENTHESIS) res->is_variable = res->info.op.operands[0]->is_variable;
+		if (op == OP_FUNC_CALL) {
+			res->info.op.arguments = static_cast<expression_node**>(
+				malloc_check(sizeof(expression_node*) * expr->info.op.argument_num));
+			rebuild_arguments(res);
+		}
+	}
+	return res;
+}
+
+// 変数のレジスタ指定はそのまま残す
+// (番号を指定したものは展開先の割り当てとぶつかりうるので、それがある関数は展開しない)
+// switch文の中身に、defaultがあるか
+static bool switch_has_default(ast_node* body) {
+	for (size_t i = 0; body != nullptr && body->kind == NODE_ARRAY && i < body->d.array.num; i++) {
+		ast_node* node = body->d.array.nodes[i];
+		while (node != nullptr && (node->kind == NODE_CASE || node->kind == NODE_DEFAULT)) {
+			if (node->kind == NODE_DEFAULT) return true;
+			node = node->d.case_d.statement;
+		}
+	}
+	return false;
+}
+
+static ast_node* clone_statement(ast_node* ast, clone_context& cc);
+
+// 全てのcaseで定数をreturnするswitch文を、戻り値を置いてbreakする形にして複製し、後に末尾へのgotoを置く
+// (各caseが同じ変数に定数を代入してbreakする形なので、展開した後も表引きにできる)
+static ast_node* clone_returning_switch(ast_node* ast, clone_context& cc) {
+	ast_node* res = new_ast_node(NODE_SWITCH, ast->lineno);
+	res->d = ast->d;
+	res->d.switch_d.expr = clone_expr(ast->d.switch_d.expr, cc);
+	ast_node* body = ast->d.switch_d.statement;
+	std::string end_label = cc.end_label;
+	cc.end_label = "";
+	cc.sw.scopes.push_back(std::set<std::string>());
+	std::vector<ast_node*> nodes;
+	for (size_t i = 0; i < body->d.array.num; i++) {
+		// returnの後のbreakは、置き換えたbreakと重なる
+		if (body->d.array.nodes[i]->kind == NODE_BREAK) continue;
+		ast_node* node = clone_statement(body->d.array.nodes[i], cc);
+		ast_node** ret = &node;
+		while ((*ret)->kind == NODE_CASE || (*ret)->kind == NODE_DEFAULT) {
+			ret = (*ret)->kind == NODE_CASE ? &(*ret)->d.case_d.statement : &(*ret)->d.default_d.statement;
+		}
+		*ret = new_expr_statement(new_operator(OP_ASSIGN, new_expr_identifier(new_name(cc.result_name)),
+			(*ret)->d.ret.ret_expression), (*ret)->lineno);
+		nodes.push_back(node);
+		nodes.push_back(new_ast_node(NODE_BREAK, (*ret)->lineno));
+	}
+	cc.sw.scopes.pop_back();
+	cc.end_label = end_label;
+	res->d.switch_d.statement = new_block(nodes, body->lineno);
+	ast_node* goto_node = new_ast_node(NODE_GOTO, ast->lineno);
+	goto_node->d.go_to.label = new_name(end_label);
+	std::vector<ast_node*> block;
+	block.push_back(res);
+	block.push_back(goto_node);
+	return new_block(block, ast->lineno);
+}
+
+static ast_node* clone_statement(ast_node* ast, clone_context& cc) {
+	if (ast == nullptr) return nullptr;
+	ast_node* res = new_ast_node(ast->kind, ast->lineno);
+	res->d = ast->d;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		cc.sw.scopes.push_back(std::set<std::string>());
+		res->d.array.nodes = static_cast<ast_node**>(malloc_check(sizeof(ast_node*) * ast->d.array.num));
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			res->d.array.nodes[i] = clone_statement(ast->d.array.nodes[i], cc);
+		}
+		cc.sw.scopes.pop_back();
+		break;
+	case NODE_VAR_DEFINE:
+		cc.sw.scopes.back().insert(ast->d.var_def.name);
+		res->d.var_def.name = new_name(ast->d.var_def.name + cc.suffix);
+		res->d.var_def.initializer = clone_expr(ast->d.var_def.initializer, cc);
+		break;
+	case NODE_EXPR: res->d.expr.expression = clone_expr(ast->d.expr.expression, cc); break;
+	case NODE_LABEL:
+		res->d.label.name = new_name(ast->d.label.name + cc.suffix);
+		res->d.label.statement = clone_statement(ast->d.label.statement, cc);
+		break;
+	case NODE_IF:
+		res->d.if_d.cond = clone_expr(ast->d.if_d.cond, cc);
+		res->d.if_d.true_statement = clone_statement(ast->d.if_d.true_statement, cc);
+		res->d.if_d.false_statement = clone_statement(ast->d.if_d.false_statement, cc);
+		break;
+	case NODE_SWITCH:
+		// defaultがあれば、switch文の後には進まないので、returnをbreakにできる
+		if (cc.end_label != "" && cc.result_name != "" && codegen_switch_returns_constants(ast) &&
+		switch_has_default(ast->d.switch_d.statement)) {
+			return clone_returning_switch(ast, cc);
+		}
+		res->d.switch_d.expr = clone_expr(ast->d.switch_d.expr, cc);
+		res->d.switch_d.statement = clone_statement(ast->d.switch_d.statement, cc);
+		break;
+	case NODE_CASE: res->d.case_d.statement = clone_statement(ast->d.case_d.statement, cc); break;
+	case NODE_DEFAULT: res->d.default_d.statement = clone_statement(ast->d.default_d.statement, cc); break;
+	case NODE_WHILE: case NODE_DO_WHILE:
+		res->d.while_d.cond = clone_expr(ast->d.while_d.cond, cc);
+		res->d.while_d.statement = clone_statement(ast->d.while_d.statement, cc);
+		break;
+	case NODE_FOR:
+		cc.sw.scopes.push_back(std::set<std::string>());
+		res->d.for_d.init = clone_statement(ast->d.for_d.init, cc);
+		res->d.for_d.cond = clone_expr(ast->d.for_d.cond, cc);
+		res->d.for_d.post = clone_expr(ast->d.for_d.post, cc);
+		res->d.for_d.body = clone_statement(ast->d.for_d.body, cc);
+		cc.sw.scopes.pop_back();
+		break;
+	case NODE_GOTO: res->d.go_to.label = new_name(ast->d.go_to.label + cc.suffix); break;
+	case NODE_RETURN:
+		if (cc.end_label != "") {
+			// 戻り値を置いて (または式を評価して) 末尾のラベルに飛ぶ
+			expression_node* value = clone_expr(ast->d.ret.ret_expression, cc);
+			std::vector<ast_node*> nodes;
+			if (value != nullptr) {
+				nodes.push_back(new_expr_statement(cc.result_name == "" ? value :
+					new_operator(OP_ASSIGN, new_expr_identifier(new_name(cc.result_name)), value), ast->lineno));
+			}
+			ast_node* goto_node = new_ast_node(NODE_GOTO, ast->lineno);
+			goto_node->d.go_to.label = new_name(cc.end_label);
+			nodes.push_back(goto_node);
+			res = new_block(nodes, ast->lineno);
+		} else {
+			res->d.ret.ret_expression = clone_expr(ast->d.ret.ret_expression, cc);
+		}
+		break;
+	default:
+		break;
+	}
+	return res;
+}
+
+// 展開先の変数で、アドレスを取られず、型がtypeと同じか
+// (このような変数は展開した本体から触られないので、引数や戻り値の代わりに直接使える)
+static bool is_plain_local(expression_node* expr, type_node* type, const inline_status& is) {
+	expr = strip_parenthesis(expr);
+	if (expr->kind != EXPR_IDENTIFIER) return false;
+	auto itr = is.var_types.find(expr->info.ident.name);
+	return itr != is.var_types.end() && itr->second != nullptr && is_compatible_type(itr->second, type) &&
+		is.address_taken.count(expr->info.ident.name) == 0;
+}
+
+// 引数を変数に代入せず、本体で直接使えるか
+static bool argument_substitutable(expression_node* arg, type_node* type, const inline_status& is) {
+	arg = strip_parenthesis(arg);
+	if (is_plain_local(arg, type, is)) return true;
+	// 引数の型で表せる定数
+	return arg->kind == EXPR_INTEGER_LITERAL && is_integer_type(type) &&
+		(type->size >= 4 || arg->info.value < (UINT32_C(1) << (type->size * 8 - 1)));
+}
+
+// 引数の代わりに本体で直接使う式を返す (使えなければnullptr)
+static expression_node* argument_substitution(expression_node* arg, type_node* type, const inline_status& is) {
+	if (!argument_substitutable(arg, type, is)) return nullptr;
+	arg = strip_parenthesis(arg);
+	if (arg->kind == EXPR_IDENTIFIER) return new_expr_identifier(new_name(arg->info.ident.name));
+	// その型の整数に昇格した定数にする
+	if (type->size >= 4) return new_integer_literal(arg->info.value, type->info.is_signed);
+	return new_integer_literal(arg->info.value, 1);
+}
+
+// 展開で変数に代入することになる引数の数
+static int copied_arguments(expression_node* call, const inline_function& func, const inline_status& is) {
+	ast_node* args = func.def->d.func_def.arguments;
+	int copied = 0;
+	for (size_t i = 0; args != nullptr && i < args->d.array.num; i++) {
+		ast_node* arg = args->d.array.nodes[i];
+		if (func.modified.count(arg->d.arg.name) > 0 ||
+		!argument_substitutable(call->info.op.arguments[i], arg->d.arg.type, is)) {
+			copied++;
+		}
+	}
+	return copied;
+}
+
+// 展開できる関数の呼び出しなら、呼び出す関数の情報を返す
+static inline_function* inlinable_call(expression_node* expr, inline_status& is, int depth) {
+	if (expr == nullptr || expr->kind != EXPR_OPERATOR ||
+	(expr->info.op.kind != OP_FUNC_CALL && expr->info.op.kind != OP_FUNC_CALL_NOARGS) ||
+	expr->info.op.operands[0]->kind != EXPR_IDENTIFIER) {
+		return nullptr;
+	}
+	std::string name = expr->info.op.operands[0]->info.ident.name;
+	auto itr = is.functions.find(name);
+	if (itr == is.functions.end() || is.var_types.count(name) > 0) return nullptr;
+	inline_function& func = itr->second;
+	if (!func.eligible || func.no_inline || depth >= INLINE_MAX_DEPTH) return nullptr;
+	for (auto eitr = is.expanding.begin(); eitr != is.expanding.end(); eitr++) {
+		if (*eitr == name) return nullptr;
+	}
+	// 関数の中で使われている外の名前が、展開先の変数に隠されるなら展開しない
+	for (auto nitr = func.free_names.begin(); nitr != func.free_names.end(); nitr++) {
+		if (is.var_types.count(*nitr) > 0) return nullptr;
+	}
+	// 引数の数が合わなければ、普通に呼び出してエラーにする
+	ast_node* args = func.def->d.func_def.arguments;
+	size_t num_args = expr->info.op.kind == OP_FUNC_CALL ? expr->info.op.argument_num : 0;
+	if ((args == nullptr ? 0 : args->d.array.num) != num_args) return nullptr;
+	if (func.force_inline) return &func;
+	if (!is.use_ir && is.var_types.size() + func.num_vars > static_cast<size_t>(INLINE_MAX_VARS_NO_IR)) {
+		return nullptr;
+	}
+	// 小さいか、呼び出しが1箇所だけで展開後に消せる関数を展開する
+	// 中間表現を経由しない場合、変数に代入する引数はレジスタの退避やスタックの読み書きになり、
+	// 呼び出しで引数をレジスタに置くより大きくなるので、その分も本体の大きさに含める
+	int small_cost = func.cost;
+	if (!is.use_ir) small_cost += INLINE_ARG_COPY_COST_NO_IR * copied_arguments(expr, func, is);
+	if (small_cost <= INLINE_MAX_SMALL_COST) return &func;
+	if (depth == 0 && func.calls == 1 && func.other_refs == 0 && !func.is_root &&
+	func.cost <= INLINE_MAX_SINGLE_COST) {
+		return &func;
+	}
+	return nullptr;
+}
+
+// 展開した結果の受け取り方
+enum inline_result_mode {
+	INLINE_RESULT_NONE, // 戻り値を使わない
+	INLINE_RESULT_DIRECT, // 展開先の変数に直接代入する
+	INLINE_RESULT_TEMP, // 一時変数に置き、後の文で使う
+	INLINE_RESULT_RETURN // 展開先の関数からそのままreturnする
+};
+
+static void inline_statement(ast_node*& ast, inline_status& is, int depth);
+
+// 関数呼び出しを、展開した本体のブロックにする
+// INLINE_RESULT_DIRECTではtargetに代入し、INLINE_RESULT_TEMPでは本体の後にtailを置き、
+// tail中の置き換え先 *result_slot に戻り値を置いた一時変数を入れる
+static ast_node* expand_call(expression_node* call, inline_function& func, inline_result_mode mode,
+expression_node* target, ast_node* tail, expression_node** result_slot, int lineno,
+inline_status& is, int depth) {
+	ast_node* def = func.def;
+	std::string id = std::to_string(is.next_id++);
+	clone_context cc;
+	cc.suffix = "@" + id;
+	if (mode != INLINE_RESULT_RETURN) cc.end_label = "end@" + id;
+	if (mode == INLINE_RESULT_DIRECT) cc.result_name = strip_parenthesis(target)->info.ident.name;
+	if (mode == INLINE_RESULT_TEMP) cc.result_name = "result@" + id;
+	std::vector<ast_node*> nodes, assigns;
+	// 引数は、書き換えられなければ展開先の変数や定数で置き換え、それ以外は同じ型の変数に代入する
+	ast_node* args = def->d.func_def.arguments;
+	for (size_t i = 0; args != nullptr && i < args->d.array.num; i++) {
+		ast_node* arg = args->d.array.nodes[i];
+		cc.sw.scopes.back().insert(arg->d.arg.name);
+		expression_node* subst = func.modified.count(arg->d.arg.name) > 0 ? nullptr :
+			argument_substitution(call->info.op.arguments[i], arg->d.arg.type, is);
+		if (subst != nullptr) {
+			cc.substitutions[arg->d.arg.name] = subst;
+			continue;
+		}
+		ast_node* var = new_var_define(arg->d.arg.type, arg->d.arg.name + cc.suffix,
+			argument_wants_register(arg), lineno);
+		nodes.push_back(var);
+		assigns.push_back(new_expr_statement(new_operator(OP_ASSIGN,
+			new_expr_identifier(var->d.var_def.name), call->info.op.arguments[i]), lineno));
+	}
+	if (mode == INLINE_RESULT_TEMP) {
+		nodes.push_back(new_var_define(def->d.func_def.return_type, cc.result_name, 0, lineno));
+	}
+	ast_node* body = clone_statement(func.pristine, cc);
+	ast_node* block_vars = new_block(nodes, lineno);
+	collect_vars(block_vars, &is.var_types, is.address_taken, true);
+	collect_vars(body, &is.var_types, is.address_taken, true);
+	for (auto itr = assigns.begin(); itr != assigns.end(); itr++) {
+		inline_statement(*itr, is, depth);
+		nodes.push_back(*itr);
+	}
+	is.expanding.push_back(def->d.func_def.name);
+	inline_statement(body, is, depth + 1);
+	is.expanding.pop_back();
+	nodes.push_back(body);
+	if (cc.end_label != "") {
+		ast_node* end = new_ast_node(NODE_LABEL, lineno);
+		end->d.label.name = new_name(cc.end_label);
+		end->d.label.statement = new_ast_node(NODE_EMPTY, lineno);
+		nodes.push_back(end);
+	}
+	if (mode == INLINE_RESULT_TEMP) {
+		*result_slot = new_expr_identifier(new_name(cc.result_name));
+		nodes.push_back(tail);
+	}
+	return new_block(nodes, lineno);
+}
+
+// 式の中で、他の部分より先に評価してよい位置にある展開できる関数呼び出しを、一時変数に置き換えて集める
+// (&&, ||, ?:, カンマ演算子で後から条件付きで評価される部分や、sizeofの中は対象外)
+struct hoisted_call {
+	std::string name;
+	expression_node* call;
+	inline_function* func;
+};
+
+static void hoist_calls(expression_node*& expr, bool argument_list, std::vector<hoisted_call>& hoisted,
+inline_status& is, int depth) {
+	if (expr == nullptr || expr->kind != EXPR_OPERATOR) return;
+	operator_type op = expr->info.op.kind;
+	if (argument_list && op == OP_COMMA) {
+		hoist_calls(expr->info.op.operands[0], true, hoisted, is, depth);
+		hoist_calls(expr->info.op.operands[1], false, hoisted, is, depth);
+		return;
+	}
+	switch (op) {
+	case OP_SIZEOF:
+		return;
+	case OP_LAND: case OP_LOR: case OP_COMMA: case OP_COND:
+		hoist_calls(expr->info.op.operands[0], false, hoisted, is, depth);
+		return;
+	case OP_FUNC_CALL:
+		hoist_calls(expr->info.op.operands[0], false, hoisted, is, depth);
+		hoist_calls(expr->info.op.operands[1], true, hoisted, is, depth);
+		rebuild_arguments(expr);
+		break;
+	default:
+		for (int i = 0; i < num_operands(op); i++) hoist_calls(expr->info.op.operands[i], false, hoisted, is, depth);
+		// 呼び出しを一時変数に置き換えると、カッコの中が左辺値になることがある
+		if (op == OP_PARENTHESIS) expr->is_variable = expr->info.op.operands[0]->is_variable;
+		break;
+	}
+	inline_function* func = inlinable_call(expr, is, depth);
+	if (func != nullptr && !is_void_type(func->def->d.func_def.return_type)) {
+		hoisted_call hc;
+		hc.name = "call@" + std::to_string(is.next_id++);
+		hc.call = expr;
+		hc.func = func;
+		hoisted.push_back(hc);
+		expr = new_expr_identifier(new_name(hc.name));
+	}
+}
+
+// 文の式に含まれる呼び出しを一時変数に置き換え、呼び出しを展開してから元の文を実行するブロックにする
+static void hoist_statement(ast_node*& ast, expression_node*& expr, inline_status& is, int depth) {
+	std::vector<hoisted_call> hoisted;
+	hoist_calls(expr, false, hoisted, is, depth);
+	if (hoisted.empty()) return;
+	std::vector<ast_node*> nodes;
+	for (auto itr = hoisted.begin(); itr != hoisted.end(); itr++) {
+		type_node* type = itr->func->def->d.func_def.return_type;
+		nodes.push_back(new_var_define(type, itr->name, 0, ast->lineno));
+		is.var_types[itr->name] = type;
+	}
+	for (auto itr = hoisted.begin(); itr != hoisted.end(); itr++) {
+		expression_node* target = new_expr_identifier(new_name(itr->name));
+		nodes.push_back(expand_call(itr->call, *itr->func, INLINE_RESULT_DIRECT, target,
+			nullptr, nullptr, ast->lineno, is, depth));
+	}
+	nodes.push_back(ast);
+	ast = new_block(nodes, ast->lineno);
+}
+
+// 文の中の関数呼び出しを展開する
+static void inline_statement(ast_node*& ast, inline_status& is, int depth) {
+	if (ast == nullptr) return;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) inline_statement(ast->d.array.nodes[i], is, depth);
+		break;
+	case NODE_EXPR:
+		{
+			expression_node* expr = ast->d.expr.expression;
+			inline_function* func;
+			if ((func = inlinable_call(expr, is, depth)) != nullptr) {
+				ast = expand_call(expr, *func, INLINE_RESULT_NONE, nullptr, nullptr, nullptr, ast->lineno, is, depth);
+			} else if (expr->kind == EXPR_OPERATOR && expr->info.op.kind >= OP_ASSIGN &&
+			expr->info.op.kind <= OP_OR_ASSIGN &&
+			(func = inlinable_call(expr->info.op.operands[1], is, depth)) != nullptr &&
+			!is_void_type(func->def->d.func_def.return_type)) {
+				if (expr->info.op.kind == OP_ASSIGN &&
+				is_plain_local(expr->info.op.operands[0], func->def->d.func_def.return_type, is)) {
+					ast = expand_call(expr->info.op.operands[1], *func, INLINE_RESULT_DIRECT,
+						expr->info.op.operands[0], nullptr, nullptr, ast->lineno, is, depth);
+				} else {
+					ast = expand_call(expr->info.op.operands[1], *func, INLINE_RESULT_TEMP, nullptr,
+						ast, &expr->info.op.operands[1], ast->lineno, is, depth);
+				}
+			} else {
+				hoist_statement(ast, ast->d.expr.expression, is, depth);
+			}
+		}
+		break;
+	case NODE_RETURN:
+		{
+			expression_node* expr = ast->d.ret.ret_expression;
+			inline_function* func = inlinable_call(expr, is, depth);
+			if (func != nullptr && !is_void_type(func->def->d.func_def.return_type)) {
+				if (func->ends_with_return && is.return_type != nullptr &&
+				is_compatible_type(func->def->d.func_def.return_type, is.return_type)) {
+					ast = expand_call(expr, *func, INLINE_RESULT_RETURN, nullptr, nullptr, nullptr,
+						ast->lineno, is, depth);
+				} else {
+					ast = expand_call(expr, *func, INLINE_RESULT_TEMP, nullptr,
+						ast, &ast->d.ret.ret_expression, ast->lineno, is, depth);
+				}
+			} else if (expr != nullptr) {
+				hoist_statement(ast, ast->d.ret.ret_expression, is, depth);
+			}
+		}
+		break;
+	case NODE_LABEL: inline_statement(ast->d.label.statement, is, depth); break;
+	case NODE_IF:
+		inline_statement(ast->d.if_d.true_statement, is, depth);
+		inline_statement(ast->d.if_d.false_statement, is, depth);
+		hoist_statement(ast, ast->d.if_d.cond, is, depth);
+		break;
+	case NODE_SWITCH:
+		inline_statement(ast->d.switch_d.statement, is, depth);
+		hoist_statement(ast, ast->d.switch_d.expr, is, depth);
+		break;
+	case NODE_CASE: inline_statement(ast->d.case_d.statement, is, depth); break;
+	case NODE_DEFAULT: inline_statement(ast->d.default_d.statement, is, depth); break;
+	case NODE_WHILE: case NODE_DO_WHILE: inline_statement(ast->d.while_d.statement, is, depth); break;
+	case NODE_FOR: inline_statement(ast->d.for_d.body, is, depth); break;
+	default: break;
+	}
+}
+
+// 小さい関数や呼び出しが1箇所だけの関数を、呼び出し元に展開する
+// (codegen_preprocess_statement()より前に、プログラム全体のASTに対して行う)
+// 関数の前の #pragma inline で必ず展開し、#pragma noinline で展開しない
+void codegen_inline_functions(ast_node* ast, bool use_ir) {
+	inline_status is;
+	is.use_ir = use_ir;
+	std::vector<ast_node*> defs;
+	{
+		bool pending_entry = false, pending_inline = false, pending_noinline = false, entry_exists = false;
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			ast_node* node = ast->d.array.nodes[i];
+			if (node->kind == NODE_PRAGMA) {
+				if (is_pragma(node, "entry")) pending_entry = entry_exists = true;
+				if (is_pragma(node, "inline")) pending_inline = true;
+				if (is_pragma(node, "noinline")) pending_noinline = true;
+				continue;
+			}
+			if (node->kind == NODE_FUNC_DEFINE && node->d.func_def.body != nullptr) {
+				inline_function& func = is.functions[node->d.func_def.name];
+				func.def = node;
+				func.is_root = pending_entry;
+				func.force_inline = pending_inline;
+				func.no_inline = pending_noinline;
+				defs.push_back(node);
+			}
+			pending_entry = pending_inline = pending_noinline = false;
+		}
+		// entryの指定が無ければ、先頭の関数から実行される
+		if (!entry_exists && !defs.empty()) is.functions[defs[0]->d.func_def.name].is_root = true;
+		if (is.functions.count("main") > 0) is.functions["main"].is_root = true;
+	}
+	// 展開できるかと大きさを調べ、展開する前の本体を複製しておく
+	std::map<std::string, int> calls, others;
+	for (auto itr = defs.begin(); itr != defs.end(); itr++) {
+		inline_function& func = is.functions[(*itr)->d.func_def.name];
+		ast_node* args = (*itr)->d.func_def.arguments;
+		ast_node* body = (*itr)->d.func_def.body;
+		bool returns_value = !is_void_type((*itr)->d.func_def.return_type);
+		func.eligible = !func.is_root && body->kind == NODE_ARRAY &&
+			(!returns_value || is_scalar_type((*itr)->d.func_def.return_type)) &&
+			body_eligible(body, returns_value);
+		clone_context cc;
+		for (size_t i = 0; args != nullptr && i < args->d.array.num; i++) {
+			ast_node* arg = args->d.array.nodes[i];
+			if (!is_scalar_type(arg->d.arg.type)) func.eligible = false;
+			for (size_t j = 0; arg->d.arg.pragmas != nullptr && j < arg->d.arg.pragmas->d.array.num; j++) {
+				if (is_numbered_register_pragma(arg->d.arg.pragmas->d.array.nodes[j])) func.eligible = false;
+			}
+			cc.sw.scopes.back().insert(arg->d.arg.name);
+		}
+		func.ends_with_return = body->kind == NODE_ARRAY && body->d.array.num > 0 &&
+			body->d.array.nodes[body->d.array.num - 1]->kind == NODE_RETURN;
+		func.cost = statement_cost(body);
+		std::map<std::string, type_node*> local_types;
+		std::set<std::string> local_addresses;
+		collect_vars(body, &local_types, local_addresses, true);
+		func.num_vars = (args == nullptr ? 0 : args->d.array.num) + local_types.size() + (returns_value ? 1 : 0);
+		func.pristine = clone_statement(body, cc);
+		func.free_names = cc.free_names;
+		collect_vars(body, nullptr, func.modified, false);
+		count_function_refs(*itr, body, calls, others);
+	}
+	for (auto itr = is.functions.begin(); itr != is.functions.end(); itr++) {
+		itr->second.calls = calls[itr->first];
+		itr->second.other_refs = others[itr->first];
+	}
+	// 各関数の中の呼び出しを展開する
+	for (auto itr = defs.begin(); itr != defs.end(); itr++) {
+		is.var_types.clear();
+		is.address_taken.clear();
+		ast_node* args = (*itr)->d.func_def.arguments;
+		for (size_t i = 0; args != nullptr && i < args->d.array.num; i++) {
+			is.var_types[args->d.array.nodes[i]->d.arg.name] = args->d.array.nodes[i]->d.arg.type;
+		}
+		collect_vars((*itr)->d.func_def.body, &is.var_types, is.address_taken, true);
+		is.return_type = (*itr)->d.func_def.return_type;
+		is.expanding.assign(1, (*itr)->d.func_def.name);
+		inline_statement((*itr)->d.func_def.body, is, 0);
+	}
+	// 展開によって使われなくなった関数を消す (消すと他の関数も使われなくなることがある)
+	std::set<std::string> removed;
+	for (;;) {
+		std::map<std::string, int> new_calls, new_others;
+		for (auto itr = defs.begin(); itr != defs.end(); itr++) {
+			if (removed.count((*itr)->d.func_def.name) == 0) {
+				count_function_refs(*itr, (*itr)->d.func_def.body, new_calls, new_others);
+			}
+		}
+		bool progress = false;
+		for (auto itr = is.functions.begin(); itr != is.functions.end(); itr++) {
+			const inline_function& func = itr->second;
+			if (func.def == nullptr || func.is_root || removed.count(itr->first) > 0 ||
+			func.calls + func.other_refs == 0) {
+				continue;
+			}
+			if (new_calls[itr->first] + new_others[itr->first] == 0) {
+				removed.insert(itr->first);
+				progress = true;
+			}
+		}
+		if (!progress) break;
+	}
+	size_t num = 0;
+	for (size_t i = 0; i < ast->d.array.num; i++) {
+		ast_node* node = ast->d.array.nodes[i];
+		if (node->kind == NODE_FUNC_DEFINE && removed.count(node->d.func_def.name) > 0) continue;
+		ast->d.array.nodes[num++] = node;
+	}
+	ast->d.array.num = num;
+}
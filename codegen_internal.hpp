@@ -12,8 +12,15 @@ struct var_info {
 	type_node* type;
 	bool is_global;
 	bool is_register;
+	bool address_taken; // アドレスを取られているか
 	var_info(int offset_ = 0, type_node* type_ = nullptr, bool isg = false, bool isr = false) :
-		offset(offset_), type(type_), is_global(isg), is_register(isr) {}
+		offset(offset_), type(type_), is_global(isg), is_register(isr), address_taken(false) {}
+};
+
+// 式の評価に使うレジスタが足りない
+class codegen_register_error : public codegen_error {
+public:
+	codegen_register_error(int lineno) : codegen_error(lineno, "no registers available") {}
 };
 
 struct expr_info {
@@ -35,6 +42,50 @@ struct switch_label_info {
 	switch_label_info(int id = 0) : label_id(id) {}
 };
 
+// switch文の分岐で、caseの値を調べる区間の種類
+enum switch_segment_kind {
+	SWITCH_SEG_CASE, // 1個の値と比較する
+	SWITCH_SEG_RANGE, // 連続した値の範囲に入っているかを調べる (分岐先は1個)
+	SWITCH_SEG_TABLE, // ジャンプ表で分岐する
+	SWITCH_SEG_BITS // 1を (値 - low) だけシフトしたビットが、分岐先ごとのビットの集合にあるかを調べる
+};
+
+struct switch_segment {
+	switch_segment_kind kind;
+	uint32_t low, high; // 区間の値の範囲 (両端を含む)
+	// CASE・RANGE : labels[0]が分岐先、TABLE : lowからの値ごとの分岐先 (caseが無い値はdefault)
+	std::vector<int> labels;
+	std::vector<std::pair<int, uint32_t> > bits; // BITS : 分岐先と、(値 - low) のビットの集合
+	switch_segment(switch_segment_kind kind_ = SWITCH_SEG_CASE, uint32_t low_ = 0, uint32_t high_ = 0) :
+		kind(kind_), low(low_), high(high_) {}
+};
+
+struct switch_plan {
+	// 値の小さい順 (符号なし) の区間
+	// 二分探索で区間を絞り、残った区間を順に調べ、どれにも当たらなければdefaultに進む
+	std::vector<switch_segment> segments;
+};
+
+// 値を表引きにするswitch文の中身
+struct switch_lookup {
+	bool is_return; // 各caseで定数をreturnする (false : 同じ変数に定数を代入してbreakする)
+	var_info* vinfo; // 代入先の変数
+	expression_node* target; // 代入先の式
+	int size; // 値の型のバイト数
+	bool is_signed;
+	std::map<uint32_t, uint32_t> values; // caseの値 → 値 (32ビットに拡張したもの)
+	bool default_exists;
+	uint32_t default_value;
+	std::vector<uint32_t> group_values; // 普通に分岐した場合の各分岐先の値
+	uint32_t low; // 表の先頭の要素に対応するcaseの値
+	std::vector<uint32_t> table; // (caseの値 - low) → 値 (caseの無い値はdefaultの値)
+	int element_size; // 表の要素のバイト数
+	bool element_signed; // 表の要素を符号拡張して読むか
+
+	switch_lookup() : is_return(false), vinfo(nullptr), target(nullptr), size(4), is_signed(false),
+		default_exists(false), default_value(0), low(0), element_size(4), element_signed(false) {}
+};
+
 struct codegen_status {
 	// global
 	int base_address;
@@ -43,7 +94,9 @@ struct codegen_status {
 	std::string old_single_entry_name;
 	int gv_offset;
 	bool gv_exists;
+	std::vector<gvar_layout> gv_layouts;
 	int next_label;
+	codegen_options options;
 	// global + function-local
 	std::vector<std::map<std::string, var_info*> > var_maps;
 	// function-local (specified from global)
@@ -67,6 +120,7 @@ struct codegen_status {
 
 	int return_label;
 	type_node* return_type;
+	bool tail_call_allowed; // return文の関数呼び出しを末尾呼び出しにしてよいか
 
 	std::vector<int> continue_labels;
 	std::vector<int> break_labels;
@@ -75,19 +129,34 @@ struct codegen_status {
 	// funcion-local (set from block processing)
 	bool pragma_use_register;
 	int pragma_use_register_id;
+	int pragma_loop_bound;
+
+	// function-local (set from expression processing)
+	// 式の評価中に保持しているレジスタのうち、値を作り直せるもの (レジスタ → 作り直す命令)
+	struct held_value {
+		std::vector<asm_inst> insts;
+		int stack_extra_offset; // 命令がSPを読む場合、その時のstack_extra_offset (読まない場合は-1)
+	};
+	std::map<int, held_value> held_values;
+	int high_regs_in_use; // 退避先として使用中のR8～R11
 
 	struct regen_checkpoint {
 		int next_label;
 		int registers_written;
+		std::map<int, held_value> held_values;
+		int high_regs_in_use;
 
-		regen_checkpoint(int nl = 0, int rw = 0) : next_label(nl), registers_written(rw) {}
+		regen_checkpoint(int nl = 0, int rw = 0, const std::map<int, held_value>& hv = std::map<int, held_value>(),
+			int hr = 0) : next_label(nl), registers_written(rw), held_values(hv), high_regs_in_use(hr) {}
 	};
 	regen_checkpoint save_checkpoint() const {
-		return regen_checkpoint(next_label, registers_written);
+		return regen_checkpoint(next_label, registers_written, held_values, high_regs_in_use);
 	}
 	void load_checkpoint(const regen_checkpoint& cp) {
 		next_label = cp.next_label;
 		registers_written = cp.registers_written;
+		held_values = cp.held_values;
+		high_regs_in_use = cp.high_regs_in_use;
 	}
 };
 
@@ -140,6 +209,9 @@ std::string get_label(int id);
 int get_two_pow_num(uint32_t value);
 // グローバル変数のコードを生成する
 std::vector<asm_inst> codegen_gvar(ast_node* ast, codegen_status& status);
+// 指定のレジスタに指定の数を置くコードを、命令の組み合わせのみで生成する
+// search_limit : 探索で求める命令の並びの長さの上限
+std::vector<asm_inst> codegen_synthesize_number(int dest_reg, uint32_t value, size_t search_limit = 4);
 // 指定のレジスタに指定の数を置くコードを生成する
 std::vector<asm_inst> codegen_put_number(int dest_reg, uint32_t value);
 // グローバル変数アクセス用のレジスタを設定する
@@ -147,14 +219,112 @@ std::vector<asm_inst> codegen_set_gv_access_register(int dest_reg, int src_reg,
 	int base_address, codegen_status& status);
 // 関数定義のコードを生成する
 std::vector<asm_inst> codegen_func(ast_node* ast, codegen_status& status);
-// 全体のコードを生成する
-std::vector<asm_inst> codegen(ast_node* ast);
+// 全体のコードを生成する (gv_layouts : グローバル変数の配置情報の出力先 (nullptr可))
+std::vector<asm_inst> codegen(ast_node* ast, std::vector<gvar_layout>* gv_layouts,
+	const codegen_options& options);
 
 // codegen_clean.cpp
 
 // 生成したコードを改善する
 void codegen_clean(std::vector<asm_inst>& insts);
 
+// codegen_number.cpp
+
+// 指定の数を作る命令の並びを探索で求める (max_insts命令以下で見つからなければ空を返す)
+std::vector<asm_inst> codegen_search_number(int dest_reg, uint32_t value, size_t max_insts);
+
+// codegen_literal.cpp
+
+// 命令の組み合わせでこの数以上の命令がかかる定数は、リテラルプールから読み込む
+const size_t LITERAL_POOL_MIN_INSTS = 3;
+// リテラルプールから定数を読み込む要求を作る
+// (params[1]に値、params[2]に1を入れたLDL_PC_LITで表し、codegen_place_literals()で解決する)
+asm_inst codegen_literal_request(int dest_reg, uint32_t value);
+// リテラルプールからの読み込みの要求かを判定する
+bool codegen_is_literal_request(const asm_inst& inst);
+// ラベルの直後に置いたデータ (表) のアドレスをPC相対で求める要求を作る
+// (labelに表のラベル、params[2]に1を入れたADD_PC_LITで表し、codegen_place_literals()で解決する)
+asm_inst codegen_table_address_request(int dest_reg, const std::string& label);
+// 表のアドレスを求める要求かを判定する
+bool codegen_is_table_address_request(const asm_inst& inst);
+// 次の命令に実行が進まない命令かを判定する
+bool codegen_is_unconditional_transfer(const asm_inst& inst);
+// リテラルプールからの読み込みの要求を、命令の組み合わせに置き換える
+void codegen_expand_literals(std::vector<asm_inst>& insts);
+// 関数の末尾にリテラルプールを置き、読み込みの要求をPC相対の読み込みにする
+// (表のアドレスを求める要求も解決する)
+void codegen_place_literals(std::vector<asm_inst>& insts);
+
+// codegen_helper.cpp
+
+// 除算の補助ルーチンを呼び出し、商または余りをdest_regに置くコードを生成する
+// regs_to_preserve : 呼び出しの前後で値を保つ必要があるレジスタ
+std::vector<asm_inst> codegen_call_divmod(bool is_signed, bool want_remainder,
+	int dividend_reg, int divisor_reg, int dest_reg, int regs_to_preserve);
+// 使われている補助ルーチンのコードを追加する
+void codegen_append_helpers(std::vector<asm_inst>& insts, codegen_status& status);
+
+// codegen_arith.cpp
+
+// 定数による割り算を、補助ルーチンを呼び出さずに行うかを判定する
+bool codegen_is_constant_division(expression_node* expr);
+// 定数で割った商または余りをdest_regに置くコードを生成する
+// dividend_type : 被除数の (汎整数拡張前の) 型 (値の範囲を絞るのに使う)
+// regs_available : 一時的に使ってよいレジスタ (足りなければ他のレジスタを退避して使う)
+std::vector<asm_inst> codegen_divide_by_constant(bool is_signed, bool want_remainder, uint32_t divisor,
+	type_node* dividend_type, int dividend_reg, int dest_reg, int regs_available, int lineno,
+	codegen_status& status);
+// src_regの値に定数を掛けた値をdest_regに置くコードを生成する
+// regs_available : 一時的に使ってよいレジスタ (dest_regとsrc_regが同じ場合のみ使う)
+std::vector<asm_inst> codegen_multiply_by_constant(int dest_reg, int src_reg, uint32_t value,
+	int regs_available, int lineno, codegen_status& status);
+
+// codegen_promote.cpp
+
+// アドレスを取られない変数を、使用回数の多い順に空いているレジスタに置く
+// arguments : 引数の情報 (宣言順)
+// レジスタに置いた変数を、優先度の高い順に返す
+std::vector<var_info*> codegen_promote_variables(ast_node* body, const std::vector<var_info*>& arguments,
+	codegen_status& status);
+// レジスタ変数の枠slotを使う変数を全てメモリに移し、後ろの枠を詰める
+void codegen_demote_register_slot(int slot, ast_node* body, const std::vector<var_info*>& arguments,
+	codegen_status& status);
+
+// codegen_spill.cpp
+
+// 値を保持する間、その値を作り直せるなら作り直し方を記録する
+void codegen_hold_value(const codegen_expr_result& held, int stack_extra_offset, codegen_status& status);
+// 値の保持をやめる
+void codegen_release_value(int reg, codegen_status& status);
+// heldの値を保持したまま、式のコード生成を行う
+codegen_expr_result codegen_expr_holding(const codegen_expr_result& held,
+	expression_node* expr, int lineno, bool want_result, bool prefer_callee_save,
+	int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_status& status);
+// 使用中のレジスタを退避して、式のコード生成を行う
+codegen_expr_result codegen_expr_with_spill(expression_node* expr, int lineno, bool want_result,
+	bool prefer_callee_save, int result_prefer_reg, int regs_available, int stack_extra_offset,
+	codegen_status& status);
+
+// codegen_inline.cpp
+
+// 小さい関数や呼び出しが1箇所だけの関数を、呼び出し元に展開する
+// use_ir : 中間表現を経由してコードを生成するか
+void codegen_inline_functions(ast_node* ast, bool use_ir);
+
+// codegen_tailcall.cpp
+
+// value_typeの値を返す関数の返り値を、拡張し直さずにreturn_typeの返り値にできるか
+bool codegen_return_value_fits(type_node* value_type, type_node* return_type);
+// 式がreturn_typeの関数から末尾呼び出しにできる関数呼び出しか
+bool codegen_is_tail_call(expression_node* expr, type_node* return_type);
+// 引数がnum_args個の関数呼び出しを末尾呼び出しにできるか
+bool codegen_tail_call_args_ok(int num_args);
+// 関数のスタック上の領域を、呼び出した関数が参照する可能性があるか
+bool codegen_frame_escapes(ast_node* body, const std::vector<var_info*>& arguments);
+// 末尾呼び出しの印が付いた呼び出しのうち、直後がreturn_labelへのジャンプのものを、
+// 関数から戻る処理と呼び出し先へのジャンプに置き換える
+void codegen_tail_calls(std::vector<asm_inst>& code, const std::string& return_label);
+
 // codegen_statement_pre.cpp
 
 // 今のブロックに変数を登録し、登録した変数のオフセットを返す
@@ -178,8 +348,46 @@ void codegen_preprocess_expr(expression_node* expr, int lineno, codegen_status&
 
 // codegen_statement.cpp
 
+// 行番号が設定されていない命令に行番号を設定する
+void codegen_set_lineno(std::vector<asm_inst>& insts, int lineno);
 // 文のコード生成を行う
 std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status);
+// 「変数 = 定数; 変数 比較 定数; 変数を定数だけ増減」の形のforループの繰り返し回数を求める
+// 求められない場合は負の数を返す
+long long get_for_loop_count(ast_node* ast);
+// forループが必ず繰り返す回数を求める (途中で抜ける可能性がある場合など、求められない場合は負の数を返す)
+long long get_for_loop_min_count(ast_node* ast);
+
+// codegen_switch.cpp
+
+// switch文の分岐の方法を、サイズと速度を合わせた費用が最小になるように決める
+// case_labels : caseの値 (符号なし) → 分岐先, num_temps : 使える一時レジスタの数
+// allow_table : ジャンプ表を使ってよいか
+switch_plan codegen_plan_switch(const std::map<uint32_t, int>& case_labels, int default_label,
+	int num_temps, bool allow_table);
+// segments[first, last) を二分探索で分ける位置を返す (分けずに順に調べる場合は負)
+int codegen_switch_split_point(const switch_plan& plan, size_t first, size_t last);
+// value_regの値によって、planに従ってcaseのラベルに分岐するコードを生成する
+std::vector<asm_inst> codegen_switch_dispatch(const switch_plan& plan, int value_reg, int default_label,
+	int regs_available, int lineno, codegen_status& status);
+// ジャンプ表の要素を作る
+asm_inst codegen_jump_table_entry(const std::string& label);
+// 全てのcaseで同じ変数に定数を代入するか定数をreturnするswitch文かを調べ、表引きの表を作る
+// 表引きにできない場合はfalseを返す
+bool codegen_plan_switch_lookup(ast_node* ast, switch_lookup& lk, const codegen_status& status);
+// 表引きのほうが、普通に分岐するより費用が小さいかを判定する
+// num_temps : 使える一時レジスタの数, store_needed : 読んだ値をメモリに書き込むか
+bool codegen_switch_lookup_pays(ast_node* ast, const switch_lookup& lk, int default_label, int num_temps,
+	bool store_needed);
+// 表引きの表 (ラベルと、要素を4バイトずつ詰めたデータ) を作る
+std::vector<asm_inst> codegen_lookup_table(const std::string& label, const std::vector<uint32_t>& table,
+	int element_size);
+// 全てのcaseで同じ変数に定数を代入するか定数をreturnするswitch文を、表引きにしたコードを生成する
+// 表引きにできない、または普通に分岐するほうが得な場合はfalseを返す
+bool codegen_switch_lookup(ast_node* ast, int value_reg, int end_label, int regs_available,
+	std::vector<asm_inst>& result, codegen_status& status);
+// switch文が、全てのcaseで定数をreturnする (表引きで値を返せる形の) ものかを判定する
+bool codegen_switch_returns_constants(ast_node* ast);
 
 // codegen_expr.cpp
 
@@ -0,0 +1,719 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+#include "codegen_ir.hpp"
+
+// 命令がブロックの最後に置く命令かを判定する
+bool ir_is_terminator(ir_opcode op) {
+	return op == IR_JUMP || op == IR_BRANCH || op == IR_SWITCH || op == IR_RETURN;
+}
+
+// 命令が副作用を持たない (結果が使われなければ消してよい) かを判定する
+bool ir_is_pure(ir_opcode op) {
+	switch (op) {
+	case IR_STORE: case IR_CALL: case IR_JUMP: case IR_BRANCH: case IR_SWITCH: case IR_RETURN:
+		return false;
+	default:
+		return true;
+	}
+}
+
+// 条件を反転する (成り立たない時に成り立つ条件を返す)
+jcc_cond ir_invert_cond(jcc_cond cond) {
+	switch (cond) {
+	case ZERO: return NONZERO;
+	case NONZERO: return ZERO;
+	case EQ: return NEQ;
+	case NEQ: return EQ;
+	case CARRY: return NO_CARRY;
+	case NO_CARRY: return CARRY;
+	case GE_UNSIGN: return L_UNSIGN;
+	case L_UNSIGN: return GE_UNSIGN;
+	case NEGATIVE: return NON_NEGATIVE;
+	case NON_NEGATIVE: return NEGATIVE;
+	case OVERFLOW: return NO_OVERFLOW;
+	case NO_OVERFLOW: return OVERFLOW;
+	case G_UNSIGN: return LE_UNSIGN;
+	case LE_UNSIGN: return G_UNSIGN;
+	case GE_SIGN: return L_SIGN;
+	case L_SIGN: return GE_SIGN;
+	case G_SIGN: return LE_SIGN;
+	case LE_SIGN: return G_SIGN;
+	default: return cond;
+	}
+}
+
+// 比較の左辺と右辺を入れ替えた時の条件を返す (比較の条件のみ対応)
+jcc_cond ir_swap_cond(jcc_cond cond) {
+	switch (cond) {
+	case GE_UNSIGN: return LE_UNSIGN;
+	case L_UNSIGN: return G_UNSIGN;
+	case G_UNSIGN: return L_UNSIGN;
+	case LE_UNSIGN: return GE_UNSIGN;
+	case GE_SIGN: return LE_SIGN;
+	case L_SIGN: return G_SIGN;
+	case G_SIGN: return L_SIGN;
+	case LE_SIGN: return GE_SIGN;
+	default: return cond;
+	}
+}
+
+// ブロックを指定の順番に並べ直す (orderに無いブロックは消す)
+// 消したブロックから来る辺は、分岐先のPHIの引数ごと取り除く
+void ir_reorder_blocks(ir_function& fn, const std::vector<int>& order) {
+	std::vector<int> new_id(fn.blocks.size(), -1);
+	for (size_t i = 0; i < order.size(); i++) new_id[order[i]] = i;
+	std::vector<ir_block> new_blocks;
+	for (size_t i = 0; i < order.size(); i++) {
+		ir_block& block = fn.blocks[order[i]];
+		std::vector<int> kept;
+		for (size_t j = 0; j < block.preds.size(); j++) {
+			if (new_id[block.preds[j]] >= 0) kept.push_back(j);
+		}
+		if (kept.size() != block.preds.size()) {
+			for (auto itr = block.insts.begin(); itr != block.insts.end() && itr->op == IR_PHI; itr++) {
+				std::vector<int> args;
+				for (size_t j = 0; j < kept.size(); j++) args.push_back(itr->args[kept[j]]);
+				itr->args.swap(args);
+			}
+		}
+		std::vector<int> preds;
+		for (size_t j = 0; j < kept.size(); j++) preds.push_back(new_id[block.preds[kept[j]]]);
+		block.preds.swap(preds);
+		for (auto itr = block.succs.begin(); itr != block.succs.end(); itr++) *itr = new_id[*itr];
+		new_blocks.push_back(block);
+	}
+	fn.blocks.swap(new_blocks);
+}
+
+// 入口から到達できないブロックを消す
+void ir_remove_unreachable_blocks(ir_function& fn) {
+	std::vector<bool> reached(fn.blocks.size(), false);
+	std::vector<int> stack(1, 0);
+	reached[0] = true;
+	while (!stack.empty()) {
+		int b = stack.back();
+		stack.pop_back();
+		const std::vector<int>& succs = fn.blocks[b].succs;
+		for (auto itr = succs.begin(); itr != succs.end(); itr++) {
+			if (!reached[*itr]) {
+				reached[*itr] = true;
+				stack.push_back(*itr);
+			}
+		}
+	}
+	std::vector<int> order;
+	for (size_t i = 0; i < fn.blocks.size(); i++) {
+		if (reached[i]) order.push_back(i);
+	}
+	if (order.size() != fn.blocks.size()) ir_reorder_blocks(fn, order);
+}
+
+// 入口から辿った帰りがけ順の逆順を求める
+static std::vector<int> reverse_postorder(const ir_function& fn) {
+	std::vector<int> order;
+	std::vector<bool> visited(fn.blocks.size(), false);
+	// (ブロック, 次に見る分岐先の番号) のスタック
+	std::vector<std::pair<int, size_t> > stack;
+	stack.push_back(std::make_pair(0, 0));
+	visited[0] = true;
+	while (!stack.empty()) {
+		int b = stack.back().first;
+		size_t& next = stack.back().second;
+		if (next < fn.blocks[b].succs.size()) {
+			int s = fn.blocks[b].succs[next++];
+			if (!visited[s]) {
+				visited[s] = true;
+				stack.push_back(std::make_pair(s, 0));
+			}
+		} else {
+			order.push_back(b);
+			stack.pop_back();
+		}
+	}
+	std::reverse(order.begin(), order.end());
+	return order;
+}
+
+// 各ブロックの直接の支配ブロックを求める (入口および到達できないブロックは-1)
+// Cooper, Harvey, Kennedy "A Simple, Fast Dominance Algorithm" の方法を用いる
+std::vector<int> ir_compute_idom(const ir_function& fn) {
+	std::vector<int> rpo = reverse_postorder(fn);
+	std::vector<int> rpo_index(fn.blocks.size(), -1);
+	for (size_t i = 0; i < rpo.size(); i++) rpo_index[rpo[i]] = i;
+	std::vector<int> idom(fn.blocks.size(), -1);
+	idom[0] = 0;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t i = 1; i < rpo.size(); i++) {
+			int b = rpo[i];
+			int new_idom = -1;
+			const std::vector<int>& preds = fn.blocks[b].preds;
+			for (auto itr = preds.begin(); itr != preds.end(); itr++) {
+				int p = *itr;
+				if (idom[p] < 0) continue;
+				if (new_idom < 0) {
+					new_idom = p;
+				} else {
+					int x = p, y = new_idom;
+					while (x != y) {
+						while (rpo_index[x] > rpo_index[y]) x = idom[x];
+						while (rpo_index[y] > rpo_index[x]) y = idom[y];
+					}
+					new_idom = x;
+				}
+			}
+			if (new_idom != idom[b]) {
+				idom[b] = new_idom;
+				changed = true;
+			}
+		}
+	}
+	idom[0] = -1;
+	return idom;
+}
+
+// ブロックaがブロックbを支配するかを判定する
+bool ir_dominates(const std::vector<int>& idom, int a, int b) {
+	while (b >= 0) {
+		if (a == b) return true;
+		b = idom[b];
+	}
+	return false;
+}
+
+// 各ブロックのループの深さを求める
+// 支配ブロックへの後方の辺ごとに自然ループを求め、先頭が同じループはまとめて数える
+std::vector<int> ir_compute_loop_depth(const ir_function& fn) {
+	std::vector<int> idom = ir_compute_idom(fn);
+	std::vector<std::set<int> > loops(fn.blocks.size());
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		const std::vector<int>& succs = fn.blocks[b].succs;
+		for (auto itr = succs.begin(); itr != succs.end(); itr++) {
+			int header = *itr;
+			if (!ir_dominates(idom, header, b)) continue;
+			std::set<int>& body = loops[header];
+			body.insert(header);
+			std::vector<int> stack;
+			if (body.insert(b).second) stack.push_back(b);
+			while (!stack.empty()) {
+				int x = stack.back();
+				stack.pop_back();
+				const std::vector<int>& preds = fn.blocks[x].preds;
+				for (auto pitr = preds.begin(); pitr != preds.end(); pitr++) {
+					if (body.insert(*pitr).second) stack.push_back(*pitr);
+				}
+			}
+		}
+	}
+	std::vector<int> depth(fn.blocks.size(), 0);
+	for (size_t h = 0; h < loops.size(); h++) {
+		for (auto itr = loops[h].begin(); itr != loops[h].end(); itr++) depth[*itr]++;
+	}
+	return depth;
+}
+
+// 置き換え先を辿る
+static int resolve_rename(std::vector<int>& rename, int value) {
+	int target = value;
+	while (rename[target] >= 0) target = rename[target];
+	// 辿った経路を縮める
+	while (rename[value] >= 0 && rename[value] != target) {
+		int next = rename[value];
+		rename[value] = target;
+		value = next;
+	}
+	return target;
+}
+
+// 後方の辺からループを求める (先頭が同じものはまとめ、内側のループから順に並べる)
+std::vector<ir_loop> ir_find_loops(const ir_function& fn) {
+	std::vector<int> idom = ir_compute_idom(fn);
+	std::map<int, std::set<int> > bodies;
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		const std::vector<int>& succs = fn.blocks[b].succs;
+		for (auto itr = succs.begin(); itr != succs.end(); itr++) {
+			int header = *itr;
+			if (!ir_dominates(idom, header, b)) continue;
+			std::set<int>& body = bodies[header];
+			body.insert(header);
+			std::vector<int> stack;
+			if (body.insert(b).second) stack.push_back(b);
+			while (!stack.empty()) {
+				int x = stack.back();
+				stack.pop_back();
+				const std::vector<int>& preds = fn.blocks[x].preds;
+				for (auto pitr = preds.begin(); pitr != preds.end(); pitr++) {
+					if (body.insert(*pitr).second) stack.push_back(*pitr);
+				}
+			}
+		}
+	}
+	std::vector<ir_loop> loops;
+	for (auto itr = bodies.begin(); itr != bodies.end(); itr++) {
+		ir_loop loop;
+		loop.header = itr->first;
+		loop.body = itr->second;
+		loop.preheader = -1;
+		loops.push_back(loop);
+	}
+	std::stable_sort(loops.begin(), loops.end(), [](const ir_loop& a, const ir_loop& b) {
+		return a.body.size() < b.body.size();
+	});
+	// ループの外から入る唯一の辺の元が、ループの先頭にだけ進むブロックなら、それを前置ブロックとする
+	for (auto itr = loops.begin(); itr != loops.end(); itr++) {
+		const std::vector<int>& preds = fn.blocks[itr->header].preds;
+		int outside = -1, count = 0;
+		for (auto p = preds.begin(); p != preds.end(); p++) {
+			if (!itr->body.count(*p)) {
+				outside = *p;
+				count++;
+			}
+		}
+		if (count == 1 && fn.blocks[outside].succs.size() == 1) itr->preheader = outside;
+	}
+	return loops;
+}
+
+// 前置ブロックが無いループに、ループの先頭の直前に置くブロックを作る
+// 作った場合はtrueを返す (ブロックの番号が変わるので、ループを求め直す必要がある)
+bool ir_insert_preheaders(ir_function& fn, const std::vector<ir_loop>& loops) {
+	size_t original_num = fn.blocks.size();
+	std::vector<int> inserted(original_num, -1);
+	for (auto litr = loops.begin(); litr != loops.end(); litr++) {
+		if (litr->preheader >= 0 || inserted[litr->header] >= 0) continue;
+		int header = litr->header;
+		int n = fn.blocks.size();
+		fn.blocks.push_back(ir_block());
+		ir_block& pre = fn.blocks.back();
+		ir_block& head = fn.blocks[header];
+		std::vector<int> outside_index, inside_index;
+		for (size_t i = 0; i < head.preds.size(); i++) {
+			(litr->body.count(head.preds[i]) ? inside_index : outside_index).push_back(i);
+		}
+		for (auto i = outside_index.begin(); i != outside_index.end(); i++) {
+			int p = head.preds[*i];
+			pre.preds.push_back(p);
+			std::vector<int>& succs = fn.blocks[p].succs;
+			for (auto s = succs.begin(); s != succs.end(); s++) {
+				if (*s == header) *s = n;
+			}
+		}
+		// ループの外から来る値は、前置ブロックのPHIでまとめる
+		for (auto itr = head.insts.begin(); itr != head.insts.end() && itr->op == IR_PHI; itr++) {
+			std::vector<int> args;
+			for (auto i = inside_index.begin(); i != inside_index.end(); i++) args.push_back(itr->args[*i]);
+			if (outside_index.size() == 1) {
+				args.push_back(itr->args[outside_index[0]]);
+			} else {
+				ir_inst phi(IR_PHI, fn.new_value(), itr->lineno);
+				for (auto i = outside_index.begin(); i != outside_index.end(); i++) {
+					phi.args.push_back(itr->args[*i]);
+				}
+				pre.insts.push_back(phi);
+				args.push_back(phi.dest);
+			}
+			itr->args.swap(args);
+		}
+		std::vector<int> preds;
+		for (auto i = inside_index.begin(); i != inside_index.end(); i++) preds.push_back(head.preds[*i]);
+		preds.push_back(n);
+		head.preds.swap(preds);
+		pre.insts.push_back(ir_inst(IR_JUMP, -1, head.insts.empty() ? fn.lineno : head.insts[0].lineno));
+		pre.succs.push_back(header);
+		inserted[header] = n;
+	}
+	if (fn.blocks.size() == original_num) return false;
+	std::vector<int> order;
+	for (size_t b = 0; b < original_num; b++) {
+		if (inserted[b] >= 0) order.push_back(inserted[b]);
+		order.push_back(b);
+	}
+	ir_reorder_blocks(fn, order);
+	return true;
+}
+
+// ブロックの最後の命令の直前に命令を置く
+void ir_insert_before_terminator(ir_block& block, const ir_inst& inst) {
+	block.insts.insert(block.insts.end() - 1, inst);
+}
+
+// 値の使用をrenameに従って置き換える (負の要素は置き換えない)
+void ir_replace_uses(ir_function& fn, const std::vector<int>& rename) {
+	std::vector<int> work(rename);
+	work.resize(fn.num_values, -1);
+	for (auto bitr = fn.blocks.begin(); bitr != fn.blocks.end(); bitr++) {
+		for (auto itr = bitr->insts.begin(); itr != bitr->insts.end(); itr++) {
+			for (auto aitr = itr->args.begin(); aitr != itr->args.end(); aitr++) {
+				*aitr = resolve_rename(work, *aitr);
+			}
+		}
+	}
+}
+
+// 自明なPHI (自身以外の引数が1種類のみ) とCOPYを取り除く
+void ir_simplify_copies(ir_function& fn) {
+	std::vector<int> rename(fn.num_values, -1);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (auto bitr = fn.blocks.begin(); bitr != fn.blocks.end(); bitr++) {
+			std::vector<ir_inst> kept;
+			for (auto itr = bitr->insts.begin(); itr != bitr->insts.end(); itr++) {
+				for (auto aitr = itr->args.begin(); aitr != itr->args.end(); aitr++) {
+					*aitr = resolve_rename(rename, *aitr);
+				}
+				int same = -1;
+				if (itr->op == IR_COPY) {
+					same = itr->args[0];
+				} else if (itr->op == IR_PHI) {
+					for (auto aitr = itr->args.begin(); aitr != itr->args.end(); aitr++) {
+						if (*aitr == itr->dest || *aitr == same) continue;
+						if (same >= 0) {
+							same = -1;
+							break;
+						}
+						same = *aitr;
+					}
+				}
+				if (same >= 0 && same != itr->dest) {
+					rename[itr->dest] = same;
+					changed = true;
+				} else {
+					kept.push_back(*itr);
+				}
+			}
+			bitr->insts.swap(kept);
+		}
+	}
+	ir_replace_uses(fn, rename);
+}
+
+// 結果が使われない副作用の無い命令を消す
+void ir_remove_dead_code(ir_function& fn) {
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		std::vector<int> use_count(fn.num_values, 0);
+		for (auto bitr = fn.blocks.begin(); bitr != fn.blocks.end(); bitr++) {
+			for (auto itr = bitr->insts.begin(); itr != bitr->insts.end(); itr++) {
+				for (auto aitr = itr->args.begin(); aitr != itr->args.end(); aitr++) {
+					// PHIが自身を使うだけなら、使われていないとみなす
+					if (itr->op != IR_PHI || *aitr != itr->dest) use_count[*aitr]++;
+				}
+			}
+		}
+		for (auto bitr = fn.blocks.begin(); bitr != fn.blocks.end(); bitr++) {
+			std::vector<ir_inst> kept;
+			for (auto itr = bitr->insts.begin(); itr != bitr->insts.end(); itr++) {
+				if (itr->dest >= 0 && ir_is_pure(itr->op) && use_count[itr->dest] == 0) {
+					changed = true;
+				} else {
+					kept.push_back(*itr);
+				}
+			}
+			bitr->insts.swap(kept);
+		}
+	}
+}
+
+// 分岐元が複数の分岐先を持ち、分岐先がPHIを持つ辺の間にブロックを挟む
+// (PHIを消す時のコピーを、その辺を通る時だけ実行できるようにする)
+// 挟んだブロックは分岐元の直後に置く
+void ir_split_critical_edges(ir_function& fn) {
+	size_t original_num = fn.blocks.size();
+	std::vector<std::vector<int> > inserted(original_num);
+	for (size_t p = 0; p < original_num; p++) {
+		if (fn.blocks[p].succs.size() < 2) continue;
+		for (size_t i = 0; i < fn.blocks[p].succs.size(); i++) {
+			int s = fn.blocks[p].succs[i];
+			if (fn.blocks[s].insts.empty() || fn.blocks[s].insts[0].op != IR_PHI) continue;
+			int n = fn.blocks.size();
+			fn.blocks.push_back(ir_block());
+			ir_block& nb = fn.blocks.back();
+			ir_inst jump(IR_JUMP, -1, fn.blocks[p].insts.back().lineno);
+			nb.insts.push_back(jump);
+			nb.preds.push_back(p);
+			nb.succs.push_back(s);
+			fn.blocks[p].succs[i] = n;
+			std::vector<int>& preds = fn.blocks[s].preds;
+			*std::find(preds.begin(), preds.end(), static_cast<int>(p)) = n;
+			inserted[p].push_back(n);
+		}
+	}
+	if (fn.blocks.size() == original_num) return;
+	std::vector<int> order;
+	for (size_t p = 0; p < original_num; p++) {
+		order.push_back(p);
+		order.insert(order.end(), inserted[p].begin(), inserted[p].end());
+	}
+	ir_reorder_blocks(fn, order);
+}
+
+// 命令が取る引数の数 (負 : 可変)
+static int ir_num_args(ir_opcode op) {
+	switch (op) {
+	case IR_CONST: case IR_PARAM: case IR_GV_BASE: case IR_FRAME_ADDR: case IR_JUMP:
+		return 0;
+	case IR_COPY: case IR_NEG: case IR_NOT: case IR_EXT: case IR_LOAD: case IR_TABLE_LOAD: case IR_SWITCH:
+		return 1;
+	case IR_CALL: case IR_PHI: case IR_RETURN:
+		return -1;
+	default:
+		return 2;
+	}
+}
+
+// 命令が結果を持つかを判定する
+static bool ir_has_dest(ir_opcode op) {
+	return op != IR_STORE && op != IR_JUMP && op != IR_BRANCH && op != IR_SWITCH && op != IR_RETURN;
+}
+
+// 中間表現が正しい形をしているかを検査する (誤りがあれば例外を投げる)
+void ir_verify(const ir_function& fn) {
+	struct verify_error {
+		static void raise(const ir_function& fn, int block, const std::string& message) {
+			std::stringstream ss;
+			ss << "IR verification failed in " << fn.name << " (block " << block << "): " << message;
+			throw codegen_error(fn.lineno, ss.str());
+		}
+	};
+	int num_blocks = fn.blocks.size();
+	if (num_blocks == 0) verify_error::raise(fn, -1, "no blocks");
+	if (!fn.blocks[0].preds.empty()) verify_error::raise(fn, 0, "entry block has predecessors");
+	// 値の定義位置を調べる
+	std::vector<int> def_block(fn.num_values, -1), def_index(fn.num_values, -1);
+	for (int b = 0; b < num_blocks; b++) {
+		const ir_block& block = fn.blocks[b];
+		if (block.insts.empty()) verify_error::raise(fn, b, "empty block");
+		for (size_t i = 0; i < block.insts.size(); i++) {
+			const ir_inst& inst = block.insts[i];
+			bool last = i + 1 == block.insts.size();
+			if (ir_is_terminator(inst.op) != last) verify_error::raise(fn, b, "misplaced terminator");
+			if (inst.op == IR_PHI && i > 0 && block.insts[i - 1].op != IR_PHI) {
+				verify_error::raise(fn, b, "phi after non-phi instruction");
+			}
+			int nargs = ir_num_args(inst.op);
+			if (nargs >= 0 && static_cast<int>(inst.args.size()) != nargs) {
+				verify_error::raise(fn, b, "wrong number of arguments");
+			}
+			if (inst.op == IR_PHI && inst.args.size() != block.preds.size()) {
+				verify_error::raise(fn, b, "phi arity does not match predecessors");
+			}
+			if (inst.op == IR_RETURN && inst.args.size() > 1) verify_error::raise(fn, b, "too many return values");
+			if (ir_has_dest(inst.op) != (inst.dest >= 0)) verify_error::raise(fn, b, "wrong destination");
+			if (inst.dest >= fn.num_values) verify_error::raise(fn, b, "value number out of range");
+			if (inst.dest >= 0) {
+				if (def_block[inst.dest] >= 0) verify_error::raise(fn, b, "value defined more than once");
+				def_block[inst.dest] = b;
+				def_index[inst.dest] = i;
+			}
+		}
+		// 分岐先の数と、分岐元との対応
+		const ir_inst& term = block.insts.back();
+		size_t want_succs = term.op == IR_JUMP ? 1 : term.op == IR_BRANCH ? 2 : 0;
+		if (term.op == IR_SWITCH) {
+			// 分岐先は全て表から使われていること
+			std::vector<bool> used(block.succs.size(), false);
+			if (term.targets.empty()) verify_error::raise(fn, b, "empty switch table");
+			for (auto itr = term.targets.begin(); itr != term.targets.end(); itr++) {
+				if (*itr < 0 || *itr >= static_cast<int>(block.succs.size())) {
+					verify_error::raise(fn, b, "switch target out of range");
+				}
+				used[*itr] = true;
+			}
+			if (std::count(used.begin(), used.end(), false) != 0) verify_error::raise(fn, b, "unused switch successor");
+			want_succs = block.succs.size();
+		}
+		if (block.succs.size() != want_succs) verify_error::raise(fn, b, "wrong number of successors");
+		if (want_succs == 2 && block.succs[0] == block.succs[1]) {
+			verify_error::raise(fn, b, "branch to the same block");
+		}
+		for (auto itr = block.succs.begin(); itr != block.succs.end(); itr++) {
+			if (*itr < 0 || *itr >= num_blocks) verify_error::raise(fn, b, "successor out of range");
+			const std::vector<int>& preds = fn.blocks[*itr].preds;
+			if (std::count(preds.begin(), preds.end(), b) != 1) {
+				verify_error::raise(fn, b, "successor does not list this block as predecessor");
+			}
+		}
+		for (auto itr = block.preds.begin(); itr != block.preds.end(); itr++) {
+			if (*itr < 0 || *itr >= num_blocks) verify_error::raise(fn, b, "predecessor out of range");
+			const std::vector<int>& succs = fn.blocks[*itr].succs;
+			if (std::count(succs.begin(), succs.end(), b) != 1) {
+				verify_error::raise(fn, b, "predecessor does not list this block as successor");
+			}
+		}
+	}
+	// 定義が使用を支配しているか
+	std::vector<int> idom = ir_compute_idom(fn);
+	for (int b = 0; b < num_blocks; b++) {
+		const ir_block& block = fn.blocks[b];
+		if (b != 0 && idom[b] < 0) verify_error::raise(fn, b, "unreachable block");
+		for (size_t i = 0; i < block.insts.size(); i++) {
+			const ir_inst& inst = block.insts[i];
+			for (size_t j = 0; j < inst.args.size(); j++) {
+				int value = inst.args[j];
+				if (value < 0 || value >= fn.num_values || def_block[value] < 0) {
+					verify_error::raise(fn, b, "use of undefined value");
+				}
+				// PHIの引数は、対応する分岐元の最後で使われるとみなす
+				int use_block = inst.op == IR_PHI ? block.preds[j] : b;
+				bool ok;
+				if (def_block[value] == use_block) {
+					ok = inst.op == IR_PHI || def_index[value] < static_cast<int>(i);
+				} else {
+					ok = ir_dominates(idom, def_block[value], use_block);
+				}
+				if (!ok) verify_error::raise(fn, b, "definition does not dominate use");
+			}
+		}
+	}
+}
+
+// 比較の条件の名前
+static const char* cond_name(jcc_cond cond) {
+	switch (cond) {
+	case EQ: return "eq";
+	case NEQ: return "ne";
+	case GE_UNSIGN: return "uge";
+	case L_UNSIGN: return "ult";
+	case G_UNSIGN: return "ugt";
+	case LE_UNSIGN: return "ule";
+	case GE_SIGN: return "sge";
+	case L_SIGN: return "slt";
+	case G_SIGN: return "sgt";
+	case LE_SIGN: return "sle";
+	default: return "?";
+	}
+}
+
+// 命令の名前
+static const char* op_name(ir_opcode op) {
+	switch (op) {
+	case IR_CONST: return "const";
+	case IR_COPY: return "copy";
+	case IR_PARAM: return "param";
+	case IR_GV_BASE: return "gv_base";
+	case IR_FRAME_ADDR: return "frame_addr";
+	case IR_ADD: return "add";
+	case IR_SUB: return "sub";
+	case IR_MUL: return "mul";
+	case IR_AND: return "and";
+	case IR_OR: return "or";
+	case IR_XOR: return "xor";
+	case IR_SHL: return "shl";
+	case IR_SHR: return "shr";
+	case IR_ASR: return "asr";
+	case IR_NEG: return "neg";
+	case IR_NOT: return "not";
+	case IR_DIV: return "div";
+	case IR_MOD: return "mod";
+	case IR_EXT: return "ext";
+	case IR_SETCC: return "setcc";
+	case IR_LOAD: return "load";
+	case IR_TABLE_LOAD: return "table_load";
+	case IR_STORE: return "store";
+	case IR_CALL: return "call";
+	case IR_PHI: return "phi";
+	case IR_JUMP: return "jump";
+	case IR_BRANCH: return "branch";
+	case IR_SWITCH: return "switch";
+	case IR_RETURN: return "return";
+	}
+	return "?";
+}
+
+// 中間表現を文字列にする
+std::string ir_to_string(const ir_function& fn) {
+	std::stringstream ss;
+	ss << "function " << fn.name << " (frame " << fn.frame_size << ")\n";
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		const ir_block& block = fn.blocks[b];
+		ss << "b" << b << ":";
+		if (!block.preds.empty()) {
+			ss << " ; preds";
+			for (auto itr = block.preds.begin(); itr != block.preds.end(); itr++) ss << " b" << *itr;
+		}
+		if (block.loop_bound >= 0) ss << " ; loop_bound " << block.loop_bound;
+		if (block.loop_min >= 0) ss << " ; loop_min " << block.loop_min;
+		ss << "\n";
+		for (auto itr = block.insts.begin(); itr != block.insts.end(); itr++) {
+			ss << "\t";
+			if (itr->dest >= 0) ss << "%" << itr->dest << " = ";
+			ss << op_name(itr->op);
+			switch (itr->op) {
+			case IR_DIV: case IR_MOD:
+				ss << (itr->is_signed ? ".s" : ".u");
+				break;
+			case IR_EXT: case IR_LOAD: case IR_TABLE_LOAD: case IR_STORE:
+				ss << (itr->is_signed && itr->op != IR_STORE ? ".s" : ".u") << itr->size * 8;
+				break;
+			case IR_SETCC: case IR_BRANCH:
+				ss << "." << cond_name(itr->cond);
+				break;
+			default:
+				break;
+			}
+			const char* sep = " ";
+			if (itr->op == IR_CALL && !itr->name.empty()) {
+				ss << sep << itr->name;
+				sep = ", ";
+			}
+			for (size_t i = 0; i < itr->args.size(); i++) {
+				ss << sep;
+				if (itr->op == IR_PHI) ss << "[b" << block.preds[i] << "] ";
+				ss << "%" << itr->args[i];
+				sep = ", ";
+			}
+			if (itr->op == IR_CONST || itr->op == IR_PARAM || itr->op == IR_FRAME_ADDR ||
+			((itr->op == IR_LOAD || itr->op == IR_STORE) && itr->imm != 0)) {
+				ss << sep << itr->imm;
+			}
+			if (itr->op == IR_SWITCH) {
+				ss << " [";
+				for (size_t i = 0; i < itr->targets.size(); i++) ss << (i > 0 ? " " : "") << itr->targets[i];
+				ss << "]";
+			}
+			if (itr->op == IR_TABLE_LOAD) {
+				ss << " [";
+				for (size_t i = 0; i < itr->table.size(); i++) ss << (i > 0 ? " " : "") << itr->table[i];
+				ss << "]";
+			}
+			if (itr->keep_in_register) ss << " ; keep";
+			if (!block.succs.empty() && ir_is_terminator(itr->op)) {
+				ss << " ->";
+				for (auto sitr = block.succs.begin(); sitr != block.succs.end(); sitr++) ss << " b" << *sitr;
+			}
+			ss << "\n";
+		}
+	}
+	return ss.str();
+}
+
+// 関数定義のコードを中間表現を経由して生成する
+// 対応していない構造があればfalseを返す (statusは従来の方法で生成し直せる状態に戻す)
+bool codegen_ir_func(ast_node* ast, const std::vector<var_info*>& arguments,
+codegen_status& status, std::vector<asm_inst>& result) {
+	int next_label_saved = status.next_label;
+	int registers_written_saved = status.registers_written;
+	try {
+		ir_function fn = codegen_ir_lower(ast, arguments, status);
+		ir_simplify_copies(fn);
+		ir_remove_dead_code(fn);
+		ir_value_numbering(fn);
+		ir_hoist_loop_invariants(fn, ir_gv_register(status) >= 0);
+		ir_reduce_induction_variables(fn, ir_gv_register(status) >= 0);
+		ir_remove_dead_code(fn);
+		ir_verify(fn);
+		if (status.options.ir_dump != nullptr) *status.options.ir_dump += ir_to_string(fn);
+		result = codegen_ir_emit(fn, status);
+	} catch (const codegen_ir_unsupported&) {
+		status.next_label = next_label_saved;
+		status.registers_written = registers_written_saved;
+		return false;
+	}
+	return true;
+}
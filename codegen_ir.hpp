@@ -0,0 +1,216 @@
+#ifndef CODEGEN_IR_HPP_GUARD_76AC5CBC_173F_4AFD_A83B_C80B0C54ABFD
+#define CODEGEN_IR_HPP_GUARD_76AC5CBC_173F_4AFD_A83B_C80B0C54ABFD
+
+#include <set>
+#include <vector>
+#include <string>
+#include "ast.h"
+#include "asm.hpp"
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// SSA形式の中間表現
+// 値は0から始まる番号で表し、それぞれちょうど1個の命令で定義する
+
+enum ir_opcode {
+	IR_CONST, // dest = imm
+	IR_COPY, // dest = args[0]
+	IR_PARAM, // dest = imm番目の引数
+	IR_GV_BASE, // dest = グローバル変数領域の先頭のアドレス
+	IR_FRAME_ADDR, // dest = スタック上のローカル変数領域の先頭のアドレス + imm
+	IR_ADD, IR_SUB, IR_MUL, IR_AND, IR_OR, IR_XOR,
+	IR_SHL, IR_SHR, IR_ASR, // シフト幅は下位8ビットを使う
+	IR_NEG, IR_NOT,
+	IR_DIV, IR_MOD, // is_signed : 符号付きか、type : 被除数の (汎整数拡張前の) 型
+	IR_EXT, // dest = args[0]の下位sizeバイトをis_signedに従って拡張した値
+	IR_SETCC, // dest = args[0]とargs[1]を比較した結果がcondなら1、そうでなければ0
+	IR_LOAD, // dest = [args[0] + imm] (sizeバイト、is_signedに従って拡張する)
+	IR_TABLE_LOAD, // dest = table[args[0]] (args[0]は表の範囲内であること、表はsizeバイトずつ置く)
+	IR_STORE, // [args[0] + imm] = args[1] (sizeバイト)
+	IR_CALL, // dest = name(args...) (nameが空なら、args[0](args[1]...))
+	IR_PHI, // dest = 直前のブロックがpreds[i]ならargs[i]
+	// 以下はブロックの最後に置く命令
+	IR_JUMP, // succs[0]に進む
+	IR_BRANCH, // args[0]とargs[1]を比較した結果がcondならsuccs[0]、そうでなければsuccs[1]に進む
+	IR_SWITCH, // succs[targets[args[0]]]に進む (args[0]はtargetsの添字の範囲内であること)
+	IR_RETURN // 関数から戻る (argsが空でなければargs[0]を返す)
+};
+
+struct ir_inst {
+	ir_opcode op;
+	int dest; // 結果の値 (無ければ-1)
+	std::vector<int> args;
+	uint32_t imm;
+	int size;
+	bool is_signed;
+	jcc_cond cond;
+	std::string name;
+	type_node* type;
+	var_info* object; // IR_LOAD・IR_STORE : アドレスの元になった変数 (不明ならnullptr)
+	std::vector<int> targets; // IR_SWITCH : args[0]の値ごとの分岐先 (succsの添字)
+	std::vector<uint32_t> table; // IR_TABLE_LOAD : 表の要素 (32ビットに拡張したもの)
+	// IR_CONST・IR_FRAME_ADDR : 使う場所で作り直さず、求めた値をレジスタに置いたまま使う
+	bool keep_in_register;
+	int lineno;
+
+	ir_inst(ir_opcode op_ = IR_CONST, int dest_ = -1, int lineno_ = 0) : op(op_), dest(dest_),
+		imm(0), size(4), is_signed(false), cond(ALWAYS), type(nullptr), object(nullptr),
+		keep_in_register(false), lineno(lineno_) {}
+};
+
+struct ir_block {
+	std::vector<ir_inst> insts; // PHIが先頭に並び、最後の命令がIR_JUMP・IR_BRANCH・IR_SWITCH・IR_RETURN
+	std::vector<int> preds;
+	std::vector<int> succs;
+	// ループの先頭のブロックの場合、ループに1回入るごとに後ろのブロックからここに飛ぶ回数の上限 (負 : 不明)
+	int loop_bound;
+	// 同じく、飛ぶ回数の下限 (負 : 不明)
+	int loop_min;
+
+	ir_block() : loop_bound(-1), loop_min(-1) {}
+};
+
+// ループ
+struct ir_loop {
+	int header;
+	std::set<int> body; // ループに含まれるブロック (headerを含む)
+	int preheader; // ループの外からheaderへ進む唯一のブロック (無ければ-1)
+};
+
+struct ir_function {
+	std::string name;
+	int lineno;
+	std::vector<ir_block> blocks; // blocks[0]が入口 (並び順がそのまま出力するコードの順番になる)
+	int num_values;
+	int frame_size; // IR_FRAME_ADDRで指すローカル変数領域のバイト数
+	int num_params;
+
+	ir_function() : lineno(0), num_values(0), frame_size(0), num_params(0) {}
+	int new_value() { return num_values++; }
+};
+
+// 中間表現を経由したコード生成に対応していない構造 (従来の方法で生成し直す)
+class codegen_ir_unsupported : public codegen_error {
+public:
+	codegen_ir_unsupported(int lineno, const std::string& message) : codegen_error(lineno, message) {}
+};
+
+// 命令選択の結果 (レジスタ割り当て前の機械語命令)
+// レジスタ番号16以上は仮想レジスタを表す
+enum mir_kind {
+	MIR_ASM, // instをそのまま出力する
+	MIR_NUMBER, // params[0]にparams[1]の数を置く
+	MIR_MUL_CONST, // params[0] = params[1] * params[2]
+	MIR_DIV_CONST // params[0] = params[1]をparams[2]で割った商または余り
+};
+
+struct mir_inst {
+	mir_kind kind;
+	asm_inst inst;
+	int extra_uses, extra_defs; // 命令が暗黙に読み書きする物理レジスタ
+	bool partial_def; // 書き込み先のレジスタに条件付きで書き込む (元の値も使う)
+	bool is_signed, want_remainder; // MIR_DIV_CONST
+	type_node* dividend_type; // MIR_DIV_CONST
+
+	mir_inst(const asm_inst& inst_ = asm_inst(), mir_kind kind_ = MIR_ASM) : kind(kind_), inst(inst_),
+		extra_uses(0), extra_defs(0), partial_def(false), is_signed(false), want_remainder(false),
+		dividend_type(nullptr) {}
+};
+
+struct mir_block {
+	std::vector<mir_inst> insts;
+	std::vector<int> succs;
+	int loop_depth;
+
+	mir_block() : loop_depth(0) {}
+};
+
+// 仮想レジスタの番号の始まり
+const int MIR_FIRST_VREG = 16;
+
+// codegen_ir.cpp
+
+// 命令がブロックの最後に置く命令かを判定する
+bool ir_is_terminator(ir_opcode op);
+// 命令が副作用を持たない (結果が使われなければ消してよい) かを判定する
+bool ir_is_pure(ir_opcode op);
+// 条件を反転する
+jcc_cond ir_invert_cond(jcc_cond cond);
+// 比較の左辺と右辺を入れ替えた時の条件を返す
+jcc_cond ir_swap_cond(jcc_cond cond);
+// ブロックを指定の順番に並べ直す (orderに無いブロックは消す)
+void ir_reorder_blocks(ir_function& fn, const std::vector<int>& order);
+// 入口から到達できないブロックを消す
+void ir_remove_unreachable_blocks(ir_function& fn);
+// 各ブロックの直接の支配ブロックを求める (入口は-1)
+std::vector<int> ir_compute_idom(const ir_function& fn);
+// ブロックaがブロックbを支配するかを判定する
+bool ir_dominates(const std::vector<int>& idom, int a, int b);
+// 各ブロックのループの深さを求める
+std::vector<int> ir_compute_loop_depth(const ir_function& fn);
+// 後方の辺からループを求める (先頭が同じものはまとめ、内側のループから順に並べる)
+std::vector<ir_loop> ir_find_loops(const ir_function& fn);
+// 前置ブロックが無いループに、ループの先頭の直前に置くブロックを作る
+// 作った場合はtrueを返す (ブロックの番号が変わるので、ループを求め直す必要がある)
+bool ir_insert_preheaders(ir_function& fn, const std::vector<ir_loop>& loops);
+// ブロックの最後の命令の直前に命令を置く
+void ir_insert_before_terminator(ir_block& block, const ir_inst& inst);
+// 値の使用をrenameに従って置き換える (負の要素は置き換えない)
+void ir_replace_uses(ir_function& fn, const std::vector<int>& rename);
+// 自明なPHIとCOPYを取り除く
+void ir_simplify_copies(ir_function& fn);
+// 結果が使われない副作用の無い命令を消す
+void ir_remove_dead_code(ir_function& fn);
+// 分岐元が複数の分岐先を持ち、分岐先がPHIを持つ辺の間にブロックを挟む
+void ir_split_critical_edges(ir_function& fn);
+// 中間表現が正しい形をしているかを検査する (誤りがあれば例外を投げる)
+void ir_verify(const ir_function& fn);
+// 中間表現を文字列にする
+std::string ir_to_string(const ir_function& fn);
+// 関数定義のコードを中間表現を経由して生成する
+// 対応していない構造があればfalseを返す
+bool codegen_ir_func(ast_node* ast, const std::vector<var_info*>& arguments,
+	codegen_status& status, std::vector<asm_inst>& result);
+
+// codegen_ir_lower.cpp
+
+// 前処理を済ませた関数定義を中間表現にする
+ir_function codegen_ir_lower(ast_node* ast, const std::vector<var_info*>& arguments, codegen_status& status);
+
+// codegen_ir_gvn.cpp
+
+// 支配木に沿って値番号付けを行い、同じ値を計算する命令や読み直しを取り除く
+void ir_value_numbering(ir_function& fn);
+
+// codegen_ir_licm.cpp
+
+// ループの中で値が変わらない計算を、ループの前に移す
+// gv_in_register : グローバル変数領域の位置を専用のレジスタに置くか
+void ir_hoist_loop_invariants(ir_function& fn, bool gv_in_register);
+
+// codegen_ir_iv.cpp
+
+// ループの中で配列の添字に使う帰納変数を、アドレスと同じ割合で増える値に置き換える
+// gv_in_register : グローバル変数領域の位置を専用のレジスタに置くか
+void ir_reduce_induction_variables(ir_function& fn, bool gv_in_register);
+
+// codegen_ir_isel.cpp
+
+// グローバル変数領域の位置を置く物理レジスタを返す (置かない場合は負の数)
+int ir_gv_register(const codegen_status& status);
+
+// 中間表現から関数のコードを生成する
+std::vector<asm_inst> codegen_ir_emit(ir_function& fn, codegen_status& status);
+
+// codegen_ir_regalloc.cpp
+
+// 命令が読み書きするレジスタを求める
+void mir_get_regs(const mir_inst& inst, std::vector<int>& uses, std::vector<int>& defs);
+// 仮想レジスタに物理レジスタ (allocatableの中から) を割り当てる
+// 足りなければスタック上のspill_baseワード目以降に退避し、使った退避領域のワード数を返す
+int mir_allocate_registers(std::vector<mir_block>& blocks, int& num_regs, int allocatable,
+	int spill_base, int lineno);
+// 物理レジスタを割り当てた後の命令列について、各命令の直後で生きているR0～R7を求める
+std::vector<std::vector<int> > mir_live_after(const std::vector<mir_block>& blocks);
+
+#endif
@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "codegen_ir.hpp"
+
+// 値番号付けで同じ値とみなすための、命令の内容
+struct gvn_key {
+	int op;
+	std::vector<int> args;
+	uint32_t imm;
+	int size;
+	bool is_signed;
+	int cond;
+	type_node* type;
+	std::vector<uint32_t> table;
+
+	bool operator<(const gvn_key& other) const {
+		if (op != other.op) return op < other.op;
+		if (args != other.args) return args < other.args;
+		if (imm != other.imm) return imm < other.imm;
+		if (size != other.size) return size < other.size;
+		if (is_signed != other.is_signed) return is_signed < other.is_signed;
+		if (cond != other.cond) return cond < other.cond;
+		if (type != other.type) return type < other.type;
+		return table < other.table;
+	}
+};
+
+// メモリの領域
+enum gvn_region {
+	REGION_UNKNOWN, // どこを指すかわからないポインタ
+	REGION_FRAME, // スタック上のローカル変数領域
+	REGION_GLOBAL // グローバル変数領域
+};
+
+// 読み書きする場所 (root + offset から sizeバイト)
+// rootはFRAME_ADDR・GV_BASEを辿った場合は負の値、そうでなければアドレスの計算の元になった値
+struct gvn_location {
+	gvn_region region;
+	int root;
+	uint32_t offset;
+	int size;
+	var_info* object; // 読み書きする場所を含む変数 (不明ならnullptr)
+};
+
+// 読み込める値がわかっているメモリの内容
+struct gvn_memory_entry {
+	int addr;
+	uint32_t imm;
+	int size;
+	bool is_signed;
+	gvn_location loc;
+	int value;
+};
+
+struct gvn_status {
+	ir_function& fn;
+	std::vector<ir_inst*> defs;
+	std::vector<int> rename;
+	std::map<gvn_key, int> table;
+	std::vector<std::vector<int> > children;
+
+	explicit gvn_status(ir_function& fn_) : fn(fn_) {}
+};
+
+// 定数の値を得る (定数でなければfalse)
+static bool get_const(const gvn_status& gs, int value, uint32_t& result) {
+	const ir_inst* def = gs.defs[value];
+	if (def == nullptr || def->op != IR_CONST) return false;
+	result = def->imm;
+	return true;
+}
+
+// アドレスの値がどの領域を指すかを求める
+static gvn_region get_region(const gvn_status& gs, int value, int depth = 0) {
+	const ir_inst* def = gs.defs[value];
+	if (def == nullptr || depth > 8) return REGION_UNKNOWN;
+	switch (def->op) {
+	case IR_FRAME_ADDR: return REGION_FRAME;
+	case IR_GV_BASE: return REGION_GLOBAL;
+	case IR_COPY: case IR_SUB: return get_region(gs, def->args[0], depth + 1);
+	case IR_ADD:
+		{
+			gvn_region region = get_region(gs, def->args[0], depth + 1);
+			return region != REGION_UNKNOWN ? region : get_region(gs, def->args[1], depth + 1);
+		}
+	default:
+		return REGION_UNKNOWN;
+	}
+}
+
+// 読み書きする場所を求める (定数の加減算を辿る)
+static gvn_location get_location(const gvn_status& gs, const ir_inst& inst) {
+	int addr = inst.args[0];
+	gvn_location loc;
+	loc.offset = inst.imm;
+	loc.size = inst.size;
+	loc.object = inst.object;
+	int value = addr;
+	for (;;) {
+		const ir_inst* def = gs.defs[value];
+		uint32_t c;
+		if (def == nullptr) break;
+		if (def->op == IR_FRAME_ADDR) {
+			loc.region = REGION_FRAME;
+			loc.root = -1;
+			loc.offset += def->imm;
+			return loc;
+		} else if (def->op == IR_GV_BASE) {
+			loc.region = REGION_GLOBAL;
+			loc.root = -2;
+			return loc;
+		} else if (def->op == IR_COPY) {
+			value = def->args[0];
+		} else if (def->op == IR_ADD && get_const(gs, def->args[1], c)) {
+			loc.offset += c;
+			value = def->args[0];
+		} else if (def->op == IR_ADD && get_const(gs, def->args[0], c)) {
+			loc.offset += c;
+			value = def->args[1];
+		} else if (def->op == IR_SUB && get_const(gs, def->args[1], c)) {
+			loc.offset -= c;
+			value = def->args[0];
+		} else {
+			break;
+		}
+	}
+	loc.region = get_region(gs, value);
+	if (loc.object != nullptr) loc.region = loc.object->is_global ? REGION_GLOBAL : REGION_FRAME;
+	loc.root = value;
+	return loc;
+}
+
+// 2個の場所が重なる可能性があるかを判定する
+static bool may_alias(const gvn_location& a, const gvn_location& b) {
+	if (a.region != REGION_UNKNOWN && b.region != REGION_UNKNOWN && a.region != b.region) return false;
+	// 変数の範囲の外を指すポインタの演算は未定義なので、別の変数には重ならない
+	if (a.object != nullptr && b.object != nullptr && a.object != b.object) return false;
+	if (a.root != b.root) return true;
+	int32_t diff = static_cast<int32_t>(b.offset - a.offset);
+	return diff < a.size && -diff < b.size;
+}
+
+// 引数が全て定数の命令を計算する (計算できなければfalse)
+static bool fold_constant(const gvn_status& gs, const ir_inst& inst, uint32_t& result) {
+	uint32_t a = 0, b = 0;
+	if (inst.args.size() >= 1 && !get_const(gs, inst.args[0], a)) return false;
+	if (inst.args.size() >= 2 && !get_const(gs, inst.args[1], b)) return false;
+	switch (inst.op) {
+	case IR_ADD: result = a + b; return true;
+	case IR_SUB: result = a - b; return true;
+	case IR_MUL: result = a * b; return true;
+	case IR_AND: result = a & b; return true;
+	case IR_OR: result = a | b; return true;
+	case IR_XOR: result = a ^ b; return true;
+	case IR_SHL: b &= 0xff; result = b >= 32 ? 0 : a << b; return true;
+	case IR_SHR: b &= 0xff; result = b >= 32 ? 0 : a >> b; return true;
+	case IR_ASR:
+		b &= 0xff;
+		if (b >= 32) b = 31;
+		result = (a >> b) | ((a & 0x80000000u) && b > 0 ? ~(0xffffffffu >> b) : 0);
+		return true;
+	case IR_NEG: result = -a; return true;
+	case IR_TABLE_LOAD:
+		if (a >= inst.table.size()) return false;
+		result = inst.table[a];
+		return true;
+	case IR_NOT: result = ~a; return true;
+	case IR_EXT:
+		if (inst.size >= 4) {
+			result = a;
+		} else {
+			uint32_t mask = (UINT32_C(1) << (inst.size * 8)) - 1;
+			result = a & mask;
+			if (inst.is_signed && (result & ~(mask >> 1))) result |= ~mask;
+		}
+		return true;
+	case IR_SETCC:
+		{
+			int32_t sa = static_cast<int32_t>(a), sb = static_cast<int32_t>(b);
+			bool cond;
+			switch (inst.cond) {
+			case EQ: cond = a == b; break;
+			case NEQ: cond = a != b; break;
+			case L_UNSIGN: cond = a < b; break;
+			case GE_UNSIGN: cond = a >= b; break;
+			case G_UNSIGN: cond = a > b; break;
+			case LE_UNSIGN: cond = a <= b; break;
+			case L_SIGN: cond = sa < sb; break;
+			case GE_SIGN: cond = sa >= sb; break;
+			case G_SIGN: cond = sa > sb; break;
+			case LE_SIGN: cond = sa <= sb; break;
+			default: return false;
+			}
+			result = cond ? 1 : 0;
+			return true;
+		}
+	default:
+		return false;
+	}
+}
+
+// 結果が引数の一方と同じになる命令なら、その値を返す (そうでなければ-1)
+static int simplify_identity(const gvn_status& gs, const ir_inst& inst) {
+	if (inst.args.size() != 2) return -1;
+	uint32_t c;
+	switch (inst.op) {
+	case IR_ADD: case IR_OR: case IR_XOR:
+		if (get_const(gs, inst.args[1], c) && c == 0) return inst.args[0];
+		if (get_const(gs, inst.args[0], c) && c == 0) return inst.args[1];
+		break;
+	case IR_SUB: case IR_SHL: case IR_SHR: case IR_ASR:
+		if (get_const(gs, inst.args[1], c) && c == 0) return inst.args[0];
+		break;
+	case IR_MUL:
+		if (get_const(gs, inst.args[1], c) && c == 1) return inst.args[0];
+		if (get_const(gs, inst.args[0], c) && c == 1) return inst.args[1];
+		break;
+	case IR_AND:
+		if (get_const(gs, inst.args[1], c) && c == 0xffffffffu) return inst.args[0];
+		if (get_const(gs, inst.args[0], c) && c == 0xffffffffu) return inst.args[1];
+		if (inst.args[0] == inst.args[1]) return inst.args[0];
+		break;
+	default:
+		break;
+	}
+	if (inst.op == IR_OR && inst.args[0] == inst.args[1]) return inst.args[0];
+	return -1;
+}
+
+static bool is_commutative(ir_opcode op) {
+	return op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR || op == IR_XOR;
+}
+
+// ブロックとその支配木の子孫の値番号付けを行う
+// memory : ブロックの入口で読み込める値がわかっているメモリの内容
+static void gvn_block(gvn_status& gs, int block, std::vector<gvn_memory_entry> memory) {
+	std::vector<gvn_key> added;
+	std::vector<ir_inst>& insts = gs.fn.blocks[block].insts;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		for (auto aitr = itr->args.begin(); aitr != itr->args.end(); aitr++) {
+			if (gs.rename[*aitr] >= 0) *aitr = gs.rename[*aitr];
+		}
+		switch (itr->op) {
+		case IR_PHI: case IR_PARAM:
+		case IR_JUMP: case IR_BRANCH: case IR_SWITCH: case IR_RETURN:
+			continue;
+		case IR_CALL:
+			memory.clear();
+			continue;
+		case IR_LOAD:
+			{
+				bool is_signed = itr->size < 4 && itr->is_signed;
+				bool found = false;
+				for (auto m = memory.begin(); m != memory.end(); m++) {
+					if (m->addr == itr->args[0] && m->imm == itr->imm && m->size == itr->size &&
+					m->is_signed == is_signed) {
+						gs.rename[itr->dest] = m->value;
+						found = true;
+						break;
+					}
+				}
+				uint32_t c;
+				if (!found) {
+					gvn_memory_entry entry;
+					entry.addr = itr->args[0];
+					entry.imm = itr->imm;
+					entry.size = itr->size;
+					entry.is_signed = is_signed;
+					entry.loc = get_location(gs, *itr);
+					entry.value = itr->dest;
+					// 定数のアドレスは入出力のレジスタかもしれないので、読み直しを省かない
+					if (entry.loc.root < 0 || !get_const(gs, entry.loc.root, c)) memory.push_back(entry);
+				}
+			}
+			continue;
+		case IR_STORE:
+			{
+				gvn_location loc = get_location(gs, *itr);
+				std::vector<gvn_memory_entry> kept;
+				for (auto m = memory.begin(); m != memory.end(); m++) {
+					if (!may_alias(m->loc, loc)) kept.push_back(*m);
+				}
+				memory.swap(kept);
+				// 4バイトの書き込みは、そのまま読み込む値として使える
+				if (itr->size == 4) {
+					gvn_memory_entry entry;
+					entry.addr = itr->args[0];
+					entry.imm = itr->imm;
+					entry.size = 4;
+					entry.is_signed = false;
+					entry.loc = loc;
+					entry.value = itr->args[1];
+					memory.push_back(entry);
+				}
+			}
+			continue;
+		default:
+			break;
+		}
+		if (itr->dest < 0 || !ir_is_pure(itr->op)) continue;
+		uint32_t folded;
+		if (itr->op != IR_CONST && fold_constant(gs, *itr, folded)) {
+			itr->op = IR_CONST;
+			itr->args.clear();
+			itr->imm = folded;
+			itr->size = 4;
+			itr->is_signed = false;
+			itr->cond = ALWAYS;
+			itr->type = nullptr;
+			itr->table.clear();
+		}
+		int same = simplify_identity(gs, *itr);
+		if (same >= 0) {
+			gs.rename[itr->dest] = same;
+			continue;
+		}
+		gvn_key key;
+		key.op = itr->op;
+		key.args = itr->args;
+		if (is_commutative(itr->op)) std::sort(key.args.begin(), key.args.end());
+		key.imm = itr->imm;
+		key.size = itr->size;
+		key.is_signed = itr->is_signed;
+		key.cond = itr->cond;
+		key.type = itr->type;
+		key.table = itr->table;
+		auto found = gs.table.find(key);
+		if (found != gs.table.end()) {
+			gs.rename[itr->dest] = found->second;
+		} else {
+			gs.table.insert(std::make_pair(key, itr->dest));
+			added.push_back(key);
+		}
+	}
+	const std::vector<int>& children = gs.children[block];
+	for (auto itr = children.begin(); itr != children.end(); itr++) {
+		// 前のブロックがこのブロックだけなら、メモリの内容をそのまま引き継ぐ
+		if (gs.fn.blocks[*itr].preds.size() == 1) {
+			gvn_block(gs, *itr, memory);
+		} else {
+			gvn_block(gs, *itr, std::vector<gvn_memory_entry>());
+		}
+	}
+	for (auto itr = added.begin(); itr != added.end(); itr++) gs.table.erase(*itr);
+}
+
+// 支配木に沿って値番号付けを行い、同じ値を計算する命令や読み直しを取り除く
+void ir_value_numbering(ir_function& fn) {
+	gvn_status gs(fn);
+	gs.defs.assign(fn.num_values, nullptr);
+	gs.rename.assign(fn.num_values, -1);
+	for (auto bitr = fn.blocks.begin(); bitr != fn.blocks.end(); bitr++) {
+		for (auto itr = bitr->insts.begin(); itr != bitr->insts.end(); itr++) {
+			if (itr->dest >= 0) gs.defs[itr->dest] = &*itr;
+		}
+	}
+	std::vector<int> idom = ir_compute_idom(fn);
+	gs.children.resize(fn.blocks.size());
+	for (size_t b = 1; b < fn.blocks.size(); b++) {
+		if (idom[b] >= 0) gs.children[idom[b]].push_back(b);
+	}
+	gvn_block(gs, 0, std::vector<gvn_memory_entry>());
+	ir_replace_uses(fn, gs.rename);
+	ir_remove_dead_code(fn);
+}
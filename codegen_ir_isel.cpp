@@ -0,0 +1,699 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "codegen_ir.hpp"
+
+// SPを減らす命令で一度に確保できるワード数の上限
+static const int ISEL_MAX_FRAME_WORDS = 127;
+
+// 命令選択中の状態
+struct isel_status {
+	ir_function& fn;
+	codegen_status& status;
+	std::vector<mir_block> blocks;
+	std::vector<const ir_inst*> defs; // 値 → 定義する命令
+	std::vector<int> def_block; // 値 → 定義するブロック
+	std::vector<int> use_count;
+	std::vector<bool> folded; // 使う側の命令に組み込んだので、定義の命令を出力しない値
+	std::vector<std::string> labels; // ブロック → ラベル
+	std::string return_label;
+	int num_regs;
+	int cur;
+	int lineno;
+	int gv_register; // グローバル変数領域を指す物理レジスタ (負 : 無し)
+	std::vector<bool> tail_call; // ブロック → 最後の関数呼び出しを末尾呼び出しにするか
+	std::vector<std::vector<asm_inst> > tables; // ブロック → ブロックの後に置く表引きの表
+
+	isel_status(ir_function& fn_, codegen_status& status_) : fn(fn_), status(status_),
+		num_regs(MIR_FIRST_VREG + fn_.num_values), cur(0), lineno(0), gv_register(-1) {}
+};
+
+static int vreg(int value) {
+	return MIR_FIRST_VREG + value;
+}
+
+static int new_reg(isel_status& is) {
+	return is.num_regs++;
+}
+
+static mir_inst& emit(isel_status& is, const mir_inst& inst) {
+	is.blocks[is.cur].insts.push_back(inst);
+	mir_inst& added = is.blocks[is.cur].insts.back();
+	if (added.inst.lineno == 0) added.inst.lineno = is.lineno;
+	return added;
+}
+
+static mir_inst& emit(isel_status& is, const asm_inst& inst) {
+	return emit(is, mir_inst(inst));
+}
+
+static const ir_inst* def_of(isel_status& is, int value) {
+	return is.defs[value];
+}
+
+// 値が定数ならtrueを返し、valueに値を入れる
+// (レジスタに置いたままにする定数は、即値として使わないので対象外)
+static bool get_const(isel_status& is, int value, uint32_t& result) {
+	const ir_inst* def = def_of(is, value);
+	if (def == nullptr || def->op != IR_CONST || def->keep_in_register) return false;
+	result = def->imm;
+	return true;
+}
+
+// 使う場所で作り直す値か (定数とスタック上のアドレス)
+static bool is_remat_value(isel_status& is, int value) {
+	const ir_inst* def = def_of(is, value);
+	if (def == nullptr || def->keep_in_register) return false;
+	return def->op == IR_CONST || def->op == IR_FRAME_ADDR || (def->op == IR_GV_BASE && is.gv_register >= 0);
+}
+
+// 定数をレジスタregに置く
+static void put_const_to(isel_status& is, int reg, uint32_t value) {
+	if (value < 256) {
+		emit(is, asm_inst(MOV_LIT, reg, value));
+	} else {
+		emit(is, mir_inst(asm_inst(EMPTY, reg, value), MIR_NUMBER));
+	}
+}
+
+// スタック上のアドレスをレジスタregに置く
+static void put_frame_addr_to(isel_status& is, int reg, uint32_t offset) {
+	emit(is, asm_inst(ADD_SP_LIT, reg, offset / 4));
+	if (offset % 4 != 0) emit(is, asm_inst(ADD_LIT, reg, offset % 4));
+}
+
+// 値をレジスタregに置く
+static void put_value_to(isel_status& is, int reg, int value) {
+	const ir_inst* def = def_of(is, value);
+	if (def != nullptr && def->keep_in_register) {
+		emit(is, asm_inst(MOV_REG, reg, vreg(value)));
+	} else if (def != nullptr && def->op == IR_CONST) {
+		put_const_to(is, reg, def->imm);
+	} else if (def != nullptr && def->op == IR_FRAME_ADDR) {
+		put_frame_addr_to(is, reg, def->imm);
+	} else if (def != nullptr && def->op == IR_GV_BASE && is.gv_register >= 0) {
+		emit(is, asm_inst(MOV_REG, reg, is.gv_register));
+	} else {
+		emit(is, asm_inst(MOV_REG, reg, vreg(value)));
+	}
+}
+
+// 値を置いたレジスタを返す (必要なら作り直す)
+static int use_value(isel_status& is, int value) {
+	const ir_inst* def = def_of(is, value);
+	if (def != nullptr && def->op == IR_GV_BASE && is.gv_register >= 0) return is.gv_register;
+	if (!is_remat_value(is, value)) return vreg(value);
+	int reg = new_reg(is);
+	put_value_to(is, reg, value);
+	return reg;
+}
+
+// dest = a op b の形の命令 (opは結果を左辺に上書きする2オペランドの命令)
+static void emit_two_operand(isel_status& is, asm_inst_kind kind, int dest, int a, int b, bool commutative) {
+	uint32_t value;
+	// 定数を置いてから演算すると、移動が要らなくなる
+	if (commutative && get_const(is, a, value) && !get_const(is, b, value)) std::swap(a, b);
+	if (commutative && get_const(is, b, value)) {
+		int a_reg = use_value(is, a);
+		put_const_to(is, dest, value);
+		emit(is, asm_inst(kind, dest, a_reg));
+		return;
+	}
+	int a_reg = use_value(is, a);
+	int b_reg = use_value(is, b);
+	emit(is, asm_inst(MOV_REG, dest, a_reg));
+	emit(is, asm_inst(kind, dest, b_reg));
+}
+
+// dest = a + value (valueは定数)
+static void emit_add_const(isel_status& is, int dest, int a, uint32_t value) {
+	int a_reg = use_value(is, a);
+	uint32_t neg = -value;
+	if (value == 0) {
+		emit(is, asm_inst(MOV_REG, dest, a_reg));
+	} else if (value < 8) {
+		emit(is, asm_inst(ADD_REG_LIT, dest, a_reg, value));
+	} else if (neg < 8) {
+		emit(is, asm_inst(SUB_REG_LIT, dest, a_reg, neg));
+	} else if (value < 256) {
+		emit(is, asm_inst(MOV_REG, dest, a_reg));
+		emit(is, asm_inst(ADD_LIT, dest, value));
+	} else if (neg < 256) {
+		emit(is, asm_inst(MOV_REG, dest, a_reg));
+		emit(is, asm_inst(SUB_LIT, dest, neg));
+	} else {
+		int value_reg = new_reg(is);
+		put_const_to(is, value_reg, value);
+		emit(is, asm_inst(ADD_REG_REG, dest, a_reg, value_reg));
+	}
+}
+
+// 定数幅のシフト (幅は下位8ビットを使う)
+static void emit_shift_const(isel_status& is, ir_opcode op, int dest, int a, uint32_t amount) {
+	amount &= 0xff;
+	if (amount == 0) {
+		emit(is, asm_inst(MOV_REG, dest, use_value(is, a)));
+	} else if (op == IR_SHL) {
+		if (amount < 32) emit(is, asm_inst(SHL_REG_LIT, dest, use_value(is, a), amount));
+		else emit(is, asm_inst(MOV_LIT, dest, 0));
+	} else if (op == IR_SHR) {
+		if (amount <= 32) emit(is, asm_inst(SHR_REG_LIT, dest, use_value(is, a), amount));
+		else emit(is, asm_inst(MOV_LIT, dest, 0));
+	} else {
+		emit(is, asm_inst(ASR_REG_LIT, dest, use_value(is, a), amount > 32 ? 32 : amount));
+	}
+}
+
+// aとbを比較し、比較の条件を返す (定数が左辺なら入れ替える)
+static jcc_cond emit_compare(isel_status& is, jcc_cond cond, int a, int b) {
+	uint32_t value;
+	if (get_const(is, a, value) && value < 256 && !get_const(is, b, value)) {
+		std::swap(a, b);
+		cond = ir_swap_cond(cond);
+	}
+	if (get_const(is, b, value) && value < 256) {
+		emit(is, asm_inst(CMP_REG_LIT, use_value(is, a), value));
+	} else {
+		int a_reg = use_value(is, a);
+		int b_reg = use_value(is, b);
+		emit(is, asm_inst(CMP_REG_REG, a_reg, b_reg));
+	}
+	return cond;
+}
+
+// 読み書きの命令の種類
+static asm_inst_kind mem_inst_kind(bool is_store, int size, bool is_signed, bool reg_offset) {
+	if (is_store) {
+		switch (size) {
+		case 1: return reg_offset ? STB_REG_REG : STB_REG_LIT;
+		case 2: return reg_offset ? STW_REG_REG : STW_REG_LIT;
+		default: return reg_offset ? STL_REG_REG : STL_REG_LIT;
+		}
+	}
+	switch (size) {
+	case 1: return reg_offset ? (is_signed ? LDBS_REG_REG : LDB_REG_REG) : LDB_REG_LIT;
+	case 2: return reg_offset ? (is_signed ? LDWS_REG_REG : LDW_REG_REG) : LDW_REG_LIT;
+	default: return reg_offset ? LDL_REG_REG : LDL_REG_LIT;
+	}
+}
+
+// メモリの読み書き (読む場合はregに読み、書く場合はregの値を書く)
+static void emit_memory(isel_status& is, const ir_inst& inst, bool is_store, int reg) {
+	int base = inst.args[0];
+	uint32_t offset = inst.imm;
+	int size = inst.size;
+	bool is_signed = !is_store && inst.is_signed && size < 4;
+	if (size != 1 && size != 2 && size != 4) throw codegen_error(inst.lineno, "unsupported memory access size");
+	const ir_inst* base_def = def_of(is, base);
+	// スタック上の4バイトはSPからの位置で直接読み書きする
+	if (base_def != nullptr && base_def->op == IR_FRAME_ADDR && size == 4) {
+		uint32_t total = base_def->imm + offset;
+		if (total % 4 == 0 && total / 4 < 256) {
+			if (is_store) emit(is, asm_inst(STL_SP_LIT, total / 4, reg));
+			else emit(is, asm_inst(LDL_SP_LIT, reg, total / 4));
+			return;
+		}
+	}
+	int base_reg, offset_reg;
+	if (is.folded[base]) {
+		// アドレスの足し算を読み書きの命令に組み込む
+		base_reg = use_value(is, base_def->args[0]);
+		offset_reg = use_value(is, base_def->args[1]);
+	} else if (!is_signed && offset % size == 0 && offset / size < 32) {
+		base_reg = use_value(is, base);
+		if (is_store) emit(is, asm_inst(mem_inst_kind(true, size, false, false), base_reg, offset / size, reg));
+		else emit(is, asm_inst(mem_inst_kind(false, size, false, false), reg, base_reg, offset / size));
+		return;
+	} else {
+		base_reg = use_value(is, base);
+		offset_reg = new_reg(is);
+		put_const_to(is, offset_reg, offset);
+	}
+	if (is_store) emit(is, asm_inst(mem_inst_kind(true, size, false, true), base_reg, offset_reg, reg));
+	else emit(is, asm_inst(mem_inst_kind(false, size, is_signed, true), reg, base_reg, offset_reg));
+}
+
+static void emit_call(isel_status& is, const ir_inst& inst) {
+	bool direct = !inst.name.empty();
+	size_t first_arg = direct ? 0 : 1;
+	int target_reg = direct ? -1 : use_value(is, inst.args[0]);
+	int arg_regs = 0;
+	for (size_t i = first_arg; i < inst.args.size(); i++) {
+		int reg = static_cast<int>(i - first_arg);
+		put_value_to(is, reg, inst.args[i]);
+		arg_regs |= 1 << reg;
+	}
+	mir_inst call(direct ? asm_inst(CALL_DIRECT, inst.name) : asm_inst(CALL_INDIRECT, target_reg));
+	call.extra_uses = arg_regs;
+	call.extra_defs = 0x100f;
+	// 末尾呼び出しでは、返り値をR0に置いたまま戻る
+	const std::vector<ir_inst>& block_insts = is.fn.blocks[is.cur].insts;
+	bool tail = is.tail_call[is.cur] && &inst == &block_insts[block_insts.size() - 2];
+	if (tail) call.inst.params[1] = CALL_TAIL_OK;
+	emit(is, call);
+	if (tail) return;
+	if (inst.dest >= 0 && is.use_count[inst.dest] > 0) emit(is, asm_inst(MOV_REG, vreg(inst.dest), 0));
+}
+
+static void emit_divmod(isel_status& is, const ir_inst& inst) {
+	int dest = vreg(inst.dest);
+	bool want_remainder = inst.op == IR_MOD;
+	const ir_inst* divisor_def = def_of(is, inst.args[1]);
+	if (divisor_def != nullptr && divisor_def->op == IR_CONST && divisor_def->imm != 0) {
+		uint32_t divisor = divisor_def->imm;
+		mir_inst div(asm_inst(EMPTY, dest, use_value(is, inst.args[0]), divisor), MIR_DIV_CONST);
+		div.is_signed = inst.is_signed;
+		div.want_remainder = want_remainder;
+		div.dividend_type = inst.type;
+		emit(is, div);
+		return;
+	}
+	// 補助ルーチンはR0に被除数、R1に除数を受け取り、R0に商、R1に余りを返す
+	put_value_to(is, 0, inst.args[0]);
+	put_value_to(is, 1, inst.args[1]);
+	mir_inst call(asm_inst(CALL_DIRECT, inst.is_signed ? "_sdivmod" : "_udivmod"));
+	call.extra_uses = 0x3;
+	call.extra_defs = 0x100f;
+	emit(is, call);
+	emit(is, asm_inst(MOV_REG, dest, want_remainder ? 1 : 0));
+}
+
+// 中間表現の命令1個分の機械語命令を生成する
+static void select_inst(isel_status& is, const ir_inst& inst) {
+	is.lineno = inst.lineno;
+	int dest = inst.dest >= 0 ? vreg(inst.dest) : -1;
+	uint32_t value;
+	switch (inst.op) {
+	case IR_CONST: case IR_FRAME_ADDR:
+		// レジスタに置いたままにするもの以外は、使う場所で作る
+		if (!inst.keep_in_register) break;
+		if (inst.op == IR_CONST) put_const_to(is, dest, inst.imm);
+		else put_frame_addr_to(is, dest, inst.imm);
+		break;
+	case IR_PHI:
+		// 分岐元で移動する
+		break;
+	case IR_COPY:
+		emit(is, asm_inst(MOV_REG, dest, use_value(is, inst.args[0])));
+		break;
+	case IR_PARAM:
+		emit(is, asm_inst(MOV_REG, dest, inst.imm));
+		break;
+	case IR_GV_BASE:
+		if (is.gv_register >= 0) break;
+		if (!is.status.entry_function) throw codegen_ir_unsupported(inst.lineno, "global variable register missing");
+		// entry関数では、R1で渡された位置からグローバル変数の位置を求める
+		if (is.status.old_entry) {
+			emit(is, asm_inst(MOV_REG, dest, 1));
+		} else {
+			emit(is, mir_inst(asm_inst(EMPTY, dest, is.status.base_address), MIR_NUMBER));
+			emit(is, asm_inst(ADD_REG, dest, 1));
+		}
+		break;
+	case IR_ADD:
+		if (is.folded[inst.dest]) break;
+		if (get_const(is, inst.args[1], value)) {
+			emit_add_const(is, dest, inst.args[0], value);
+		} else if (get_const(is, inst.args[0], value)) {
+			emit_add_const(is, dest, inst.args[1], value);
+		} else {
+			int a_reg = use_value(is, inst.args[0]);
+			int b_reg = use_value(is, inst.args[1]);
+			emit(is, asm_inst(ADD_REG_REG, dest, a_reg, b_reg));
+		}
+		break;
+	case IR_SUB:
+		if (get_const(is, inst.args[1], value)) {
+			emit_add_const(is, dest, inst.args[0], -value);
+		} else if (get_const(is, inst.args[0], value) && value == 0) {
+			emit(is, asm_inst(NEG_REG, dest, use_value(is, inst.args[1])));
+		} else {
+			int a_reg = use_value(is, inst.args[0]);
+			int b_reg = use_value(is, inst.args[1]);
+			emit(is, asm_inst(SUB_REG_REG, dest, a_reg, b_reg));
+		}
+		break;
+	case IR_MUL:
+		if (get_const(is, inst.args[0], value) || get_const(is, inst.args[1], value)) {
+			int src = get_const(is, inst.args[1], value) ? inst.args[0] : inst.args[1];
+			emit(is, mir_inst(asm_inst(EMPTY, dest, use_value(is, src), value), MIR_MUL_CONST));
+		} else {
+			emit_two_operand(is, MUL_REG, dest, inst.args[0], inst.args[1], true);
+		}
+		break;
+	case IR_AND: emit_two_operand(is, AND_REG, dest, inst.args[0], inst.args[1], true); break;
+	case IR_OR: emit_two_operand(is, OR_REG, dest, inst.args[0], inst.args[1], true); break;
+	case IR_XOR: emit_two_operand(is, XOR_REG, dest, inst.args[0], inst.args[1], true); break;
+	case IR_SHL: case IR_SHR: case IR_ASR:
+		if (get_const(is, inst.args[1], value)) {
+			emit_shift_const(is, inst.op, dest, inst.args[0], value);
+		} else {
+			asm_inst_kind kind = inst.op == IR_SHL ? SHL_REG : inst.op == IR_SHR ? SHR_REG : ASR_REG;
+			emit_two_operand(is, kind, dest, inst.args[0], inst.args[1], false);
+		}
+		break;
+	case IR_NEG:
+		emit(is, asm_inst(NEG_REG, dest, use_value(is, inst.args[0])));
+		break;
+	case IR_NOT:
+		emit(is, asm_inst(NOT_REG, dest, use_value(is, inst.args[0])));
+		break;
+	case IR_DIV: case IR_MOD:
+		emit_divmod(is, inst);
+		break;
+	case IR_EXT:
+		{
+			int shift_width = 8 * (4 - inst.size);
+			emit(is, asm_inst(SHL_REG_LIT, dest, use_value(is, inst.args[0]), shift_width));
+			emit(is, asm_inst(inst.is_signed ? ASR_REG_LIT : SHR_REG_LIT, dest, dest, shift_width));
+		}
+		break;
+	case IR_SETCC:
+		{
+			// 条件が成り立てば1のまま、成り立たなければ0にする
+			std::string skip_label = get_label(is.status.next_label++);
+			emit(is, asm_inst(MOV_LIT, dest, 1));
+			jcc_cond cond = emit_compare(is, inst.cond, inst.args[0], inst.args[1]);
+			emit(is, asm_inst(JCC, cond, skip_label));
+			mir_inst clear(asm_inst(MOV_LIT, dest, 0));
+			clear.partial_def = true;
+			emit(is, clear);
+			emit(is, asm_inst(LABEL, skip_label));
+		}
+		break;
+	case IR_LOAD:
+		emit_memory(is, inst, false, dest);
+		break;
+	case IR_TABLE_LOAD:
+		{
+			// 表のアドレスをPC相対で求め、(値 × 要素のバイト数) の位置を読む
+			std::string label = get_label(is.status.next_label++);
+			int table_reg = new_reg(is);
+			emit(is, codegen_table_address_request(table_reg, label));
+			int index_reg = use_value(is, inst.args[0]);
+			if (inst.size > 1) {
+				int scaled = new_reg(is);
+				emit(is, asm_inst(SHL_REG_LIT, scaled, index_reg, get_two_pow_num(inst.size)));
+				index_reg = scaled;
+			}
+			emit(is, asm_inst(mem_inst_kind(false, inst.size, inst.is_signed, true), dest, table_reg, index_reg));
+			std::vector<asm_inst> table = codegen_lookup_table(label, inst.table, inst.size);
+			is.tables[is.cur].insert(is.tables[is.cur].end(), table.begin(), table.end());
+		}
+		break;
+	case IR_STORE:
+		emit_memory(is, inst, true, use_value(is, inst.args[1]));
+		break;
+	case IR_CALL:
+		emit_call(is, inst);
+		break;
+	case IR_JUMP: case IR_BRANCH: case IR_SWITCH: case IR_RETURN:
+		// 分岐元でのPHIの移動の後に生成する
+		break;
+	}
+}
+
+// 後方ジャンプならループの繰り返し回数の上限と下限を設定する
+static void set_loop_bound(isel_status& is, mir_inst& inst, int target) {
+	if (target <= is.cur && is.fn.blocks[target].loop_bound >= 0) {
+		inst.inst.loop_bound = is.fn.blocks[target].loop_bound;
+		inst.inst.loop_min = is.fn.blocks[target].loop_min;
+	}
+}
+
+static void select_terminator(isel_status& is, const ir_inst& inst) {
+	is.lineno = inst.lineno;
+	const ir_block& block = is.fn.blocks[is.cur];
+	int next = is.cur + 1;
+	switch (inst.op) {
+	case IR_JUMP:
+		if (block.succs[0] != next) {
+			set_loop_bound(is, emit(is, asm_inst(JMP_DIRECT, is.labels[block.succs[0]])), block.succs[0]);
+		}
+		break;
+	case IR_BRANCH:
+		{
+			jcc_cond cond = emit_compare(is, inst.cond, inst.args[0], inst.args[1]);
+			int true_block = block.succs[0], false_block = block.succs[1];
+			if (true_block == next) {
+				std::swap(true_block, false_block);
+				cond = ir_invert_cond(cond);
+			}
+			set_loop_bound(is, emit(is, asm_inst(JCC, cond, is.labels[true_block])), true_block);
+			if (false_block != next) {
+				set_loop_bound(is, emit(is, asm_inst(JMP_DIRECT, is.labels[false_block])), false_block);
+			}
+		}
+		break;
+	case IR_SWITCH:
+		{
+			// 値の2倍をPCに足し、表の分岐命令に飛ぶ
+			// (PCは足し算の命令の4バイト先を指すので、間に実行されない詰め物を置く)
+			int offset = new_reg(is);
+			emit(is, asm_inst(SHL_REG_LIT, offset, use_value(is, inst.args[0]), 1));
+			emit(is, asm_inst(ADD_REG, 15, offset));
+			emit(is, codegen_jump_table_entry(is.labels[block.succs[inst.targets[0]]]));
+			for (auto itr = inst.targets.begin(); itr != inst.targets.end(); itr++) {
+				int target = block.succs[*itr];
+				set_loop_bound(is, emit(is, codegen_jump_table_entry(is.labels[target])), target);
+			}
+		}
+		break;
+	case IR_RETURN:
+		{
+			int uses = 0;
+			if (!inst.args.empty()) {
+				if (!is.tail_call[is.cur]) put_value_to(is, 0, inst.args[0]);
+				uses = 1;
+			}
+			mir_inst jump(asm_inst(JMP_DIRECT, is.return_label));
+			jump.extra_uses = uses;
+			emit(is, jump);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// アドレスの足し算のうち、読み書きの命令に組み込めるものを探す
+static void find_folded_adds(isel_status& is) {
+	for (size_t b = 0; b < is.fn.blocks.size(); b++) {
+		const std::vector<ir_inst>& insts = is.fn.blocks[b].insts;
+		for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+			if ((itr->op != IR_LOAD && itr->op != IR_STORE) || itr->imm != 0) continue;
+			int base = itr->args[0];
+			const ir_inst* def = is.defs[base];
+			if (def == nullptr || def->op != IR_ADD || is.use_count[base] != 1 ||
+			is.def_block[base] != static_cast<int>(b)) continue;
+			if (itr->op == IR_STORE && itr->args[1] == base) continue;
+			uint32_t value;
+			// 小さい定数を足す場合は、オフセットを持つ命令の方が良い
+			if (get_const(is, def->args[1], value) || get_const(is, def->args[0], value)) continue;
+			is.folded[base] = true;
+		}
+	}
+}
+
+// 物理レジスタを割り当てた後の命令が書き込むレジスタ (R0～R7) を求める
+static int written_regs(const std::vector<asm_inst>& insts) {
+	int regs = 0;
+	std::vector<int> uses, defs;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if (itr->kind == POP_REGS || itr->kind == PUSH_REGS) continue;
+		mir_get_regs(mir_inst(*itr), uses, defs);
+		for (auto d = defs.begin(); d != defs.end(); d++) {
+			if (*d < 8) regs |= 1 << *d;
+		}
+	}
+	return regs;
+}
+
+// グローバル変数領域の位置を置く物理レジスタを返す (置かない場合は負の数)
+int ir_gv_register(const codegen_status& status) {
+	if (status.gv_exists && ((!status.entry_function && status.gv_access_exists) || status.call_exists)) {
+		return 7;
+	}
+	return -1;
+}
+
+// 関数呼び出しの直後に、その結果を返すブロックを探す
+// (スタック上の領域を呼び出し先が参照する可能性がある場合や、entry関数では行わない)
+static void find_tail_calls(isel_status& is) {
+	is.tail_call.assign(is.fn.blocks.size(), false);
+	if (is.status.entry_function || is.fn.frame_size > 0) return;
+	for (size_t b = 0; b < is.fn.blocks.size(); b++) {
+		const std::vector<ir_inst>& insts = is.fn.blocks[b].insts;
+		if (insts.size() < 2) continue;
+		const ir_inst& call = insts[insts.size() - 2];
+		const ir_inst& ret = insts.back();
+		if (call.op != IR_CALL || ret.op != IR_RETURN) continue;
+		size_t num_args = call.args.size() - (call.name.empty() ? 1 : 0);
+		if (!codegen_tail_call_args_ok(static_cast<int>(num_args))) continue;
+		if (!ret.args.empty() && (call.dest < 0 || ret.args[0] != call.dest)) continue;
+		is.tail_call[b] = true;
+	}
+}
+
+// 中間表現から関数のコードを生成する
+std::vector<asm_inst> codegen_ir_emit(ir_function& fn, codegen_status& status) {
+	ir_split_critical_edges(fn);
+	isel_status is(fn, status);
+	size_t num_blocks = fn.blocks.size();
+	is.defs.assign(fn.num_values, nullptr);
+	is.def_block.assign(fn.num_values, -1);
+	is.use_count.assign(fn.num_values, 0);
+	is.folded.assign(fn.num_values, false);
+	for (size_t b = 0; b < num_blocks; b++) {
+		for (auto itr = fn.blocks[b].insts.begin(); itr != fn.blocks[b].insts.end(); itr++) {
+			if (itr->dest >= 0) {
+				is.defs[itr->dest] = &*itr;
+				is.def_block[itr->dest] = b;
+			}
+			for (auto a = itr->args.begin(); a != itr->args.end(); a++) is.use_count[*a]++;
+		}
+	}
+	is.gv_register = ir_gv_register(status);
+	find_tail_calls(is);
+	find_folded_adds(is);
+	for (size_t b = 0; b < num_blocks; b++) is.labels.push_back(get_label(status.next_label++));
+	is.return_label = get_label(status.next_label++);
+	std::vector<int> loop_depth = ir_compute_loop_depth(fn);
+	is.blocks.resize(num_blocks);
+	is.tables.resize(num_blocks);
+	for (size_t b = 0; b < num_blocks; b++) {
+		is.blocks[b].succs = fn.blocks[b].succs;
+		is.blocks[b].loop_depth = loop_depth[b];
+	}
+
+	// PHIは、分岐元で一時レジスタに移し、ブロックの先頭で一時レジスタから移す
+	std::map<int, int> phi_temps;
+	for (size_t b = 0; b < num_blocks; b++) {
+		is.cur = b;
+		is.lineno = fn.lineno;
+		emit(is, asm_inst(LABEL, is.labels[b]));
+		const std::vector<ir_inst>& insts = fn.blocks[b].insts;
+		for (auto itr = insts.begin(); itr != insts.end() && itr->op == IR_PHI; itr++) {
+			int temp = new_reg(is);
+			phi_temps[itr->dest] = temp;
+			is.lineno = itr->lineno;
+			emit(is, asm_inst(MOV_REG, vreg(itr->dest), temp));
+		}
+	}
+	for (size_t b = 0; b < num_blocks; b++) {
+		is.cur = b;
+		const std::vector<ir_inst>& insts = fn.blocks[b].insts;
+		for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+			if (ir_is_terminator(itr->op)) {
+				// 分岐先のPHIの値を移す
+				is.lineno = itr->lineno;
+				for (auto s = fn.blocks[b].succs.begin(); s != fn.blocks[b].succs.end(); s++) {
+					const ir_block& succ = fn.blocks[*s];
+					size_t pred_index = 0;
+					while (pred_index < succ.preds.size() && succ.preds[pred_index] != static_cast<int>(b)) {
+						pred_index++;
+					}
+					for (auto p = succ.insts.begin(); p != succ.insts.end() && p->op == IR_PHI; p++) {
+						put_value_to(is, phi_temps[p->dest], p->args[pred_index]);
+					}
+				}
+				select_terminator(is, *itr);
+			} else {
+				select_inst(is, *itr);
+			}
+		}
+	}
+
+	// レジスタを割り当てる
+	int allocatable = is.gv_register >= 0 ? 0x7f : 0xff;
+	int frame_words = (fn.frame_size + 3) / 4;
+	int spill_words = mir_allocate_registers(is.blocks, is.num_regs, allocatable, frame_words, fn.lineno);
+	frame_words += spill_words;
+	if (frame_words > ISEL_MAX_FRAME_WORDS) throw codegen_ir_unsupported(fn.lineno, "frame too large");
+
+	// 疑似命令を展開する (一時的に使うレジスタは、その時点で空いているものから選ぶ)
+	std::vector<asm_inst> body;
+	std::vector<int> uses, defs;
+	for (size_t b = 0; b < num_blocks; b++) {
+		std::vector<mir_inst>& insts = is.blocks[b].insts;
+		std::vector<mir_inst> kept;
+		for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+			if (itr->kind == MIR_ASM && itr->inst.kind == MOV_REG && itr->inst.params[0] == itr->inst.params[1]) continue;
+			kept.push_back(*itr);
+		}
+		insts.swap(kept);
+	}
+	std::vector<std::vector<int> > live_after = mir_live_after(is.blocks);
+	for (size_t b = 0; b < num_blocks; b++) {
+		std::vector<mir_inst>& insts = is.blocks[b].insts;
+		for (size_t i = 0; i < insts.size(); i++) {
+			mir_inst& inst = insts[i];
+			int dest = static_cast<int>(inst.inst.params[0]);
+			int src = static_cast<int>(inst.inst.params[1]);
+			// まだ使っていないcallee-saveレジスタも、関数の入口で退避すれば使える
+			// (その場で退避して借りるより安いので、caller-saveが足りない時に使う)
+			int avail = allocatable & ~live_after[b][i];
+			// params は命令によってはレジスタ番号ではない
+			if (0 <= dest && dest < 16) avail &= ~(1 << dest);
+			if (0 <= src && src < 16) avail &= ~(1 << src);
+			std::vector<asm_inst> code;
+			switch (inst.kind) {
+			case MIR_ASM:
+				code.push_back(inst.inst);
+				break;
+			case MIR_NUMBER:
+				code = codegen_put_number(dest, inst.inst.params[1]);
+				break;
+			case MIR_MUL_CONST:
+				code = codegen_multiply_by_constant(dest, src, inst.inst.params[2], avail, inst.inst.lineno, status);
+				break;
+			case MIR_DIV_CONST:
+				code = codegen_divide_by_constant(inst.is_signed, inst.want_remainder, inst.inst.params[2],
+					inst.dividend_type, src, dest, avail, inst.inst.lineno, status);
+				break;
+			}
+			for (auto c = code.begin(); c != code.end(); c++) {
+				if (c->lineno == 0) c->lineno = inst.inst.lineno;
+				if (c->kind == JCC || c->kind == JMP_DIRECT) {
+					if (c->loop_bound < 0) {
+						c->loop_bound = inst.inst.loop_bound;
+						c->loop_min = inst.inst.loop_min;
+					}
+				}
+			}
+			body.insert(body.end(), code.begin(), code.end());
+		}
+		// 表引きの表はブロックの直後に置く (実行が続くなら、表を飛び越える)
+		if (!is.tables[b].empty()) {
+			if (!codegen_is_unconditional_transfer(body.back())) {
+				body.push_back(asm_inst(JMP_DIRECT, b + 1 < num_blocks ? is.labels[b + 1] : is.return_label));
+			}
+			body.insert(body.end(), is.tables[b].begin(), is.tables[b].end());
+		}
+	}
+
+	// 値を書き込んだcallee-saveレジスタを退避する
+	int regs_to_backup = written_regs(body) & 0xf0;
+	bool write_gv_register = status.entry_function && is.gv_register >= 0;
+	if (write_gv_register) regs_to_backup |= 1 << is.gv_register;
+	for (auto itr = body.begin(); itr != body.end(); itr++) {
+		if (itr->kind == CALL_DIRECT || itr->kind == CALL_INDIRECT) regs_to_backup |= 0x100;
+	}
+	std::vector<asm_inst> result;
+	result.push_back(asm_inst(LABEL, fn.name));
+	if (regs_to_backup != 0) result.push_back(asm_inst(PUSH_REGS, regs_to_backup));
+	if (write_gv_register) {
+		std::vector<asm_inst> gv_code = codegen_set_gv_access_register(is.gv_register, 1,
+			status.base_address, status);
+		result.insert(result.end(), gv_code.begin(), gv_code.end());
+	}
+	if (frame_words > 0) result.push_back(asm_inst(SUBSP_LIT, frame_words));
+	result.insert(result.end(), body.begin(), body.end());
+	result.push_back(asm_inst(LABEL, is.return_label));
+	if (frame_words > 0) result.push_back(asm_inst(ADDSP_LIT, frame_words));
+	if (regs_to_backup != 0) result.push_back(asm_inst(POP_REGS, regs_to_backup));
+	if (!(regs_to_backup & 0x100)) result.push_back(asm_inst(RET));
+	codegen_tail_calls(result, is.return_label);
+	codegen_set_lineno(result, fn.lineno);
+	return result;
+}
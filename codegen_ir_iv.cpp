@@ -0,0 +1,519 @@
+#include <map>
+#include <set>
+#include <vector>
+#include "codegen_ir.hpp"
+
+// 帰納変数の係数として扱う上限 (これより大きい要素の配列は対象にしない)
+static const uint32_t IV_MAX_SCALE = 0xffff;
+
+// 値を使う命令
+struct iv_use {
+	int block;
+	ir_inst* inst;
+};
+
+// 帰納変数に比例して変わるアドレス (base + 帰納変数 * scale + offset)
+struct iv_address {
+	ir_inst* inst; // アドレスを求めるIR_ADD
+	int base; // ループの中で変わらない値
+	uint32_t scale;
+	uint32_t offset;
+};
+
+// 書き換える帰納変数
+struct iv_candidate {
+	ir_inst* phi;
+	ir_inst* inc; // phi + step
+	int init; // ループに入る時の値
+	uint32_t step;
+	ir_inst* branch; // ループを続けるかの判定
+	int branch_block;
+	int bound; // 判定でphiと比べる値
+	jcc_cond cond; // phi cond bound の時ループを続ける
+	uint32_t scale; // アドレスの係数の最小値 (他の係数はこの倍数)
+	std::vector<iv_address> addresses;
+	std::vector<int> derived; // phiからアドレスまでの途中の値
+};
+
+struct iv_status {
+	ir_function& fn;
+	bool gv_in_register; // グローバル変数領域の位置を専用のレジスタに置くか
+	const ir_loop* loop;
+	int latch; // ループの先頭に戻るブロック
+	std::vector<int> idom;
+	std::vector<ir_inst*> defs;
+	std::vector<int> def_block;
+	std::vector<std::vector<iv_use> > uses;
+	// 前置ブロックに置く命令
+	std::vector<ir_inst> preheader_insts;
+	std::map<uint32_t, int> consts;
+	std::map<int, int> materialized;
+	std::set<int> created; // 置き換えで作った帰納変数 (もう一度置き換えない)
+
+	iv_status(ir_function& fn_, bool gv_in_register_) : fn(fn_), gv_in_register(gv_in_register_),
+		loop(nullptr), latch(-1) {}
+};
+
+static void collect_defs(iv_status& st) {
+	ir_function& fn = st.fn;
+	st.defs.assign(fn.num_values, nullptr);
+	st.def_block.assign(fn.num_values, -1);
+	st.uses.assign(fn.num_values, std::vector<iv_use>());
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		for (auto itr = fn.blocks[b].insts.begin(); itr != fn.blocks[b].insts.end(); itr++) {
+			if (itr->dest >= 0) {
+				st.defs[itr->dest] = &*itr;
+				st.def_block[itr->dest] = b;
+			}
+			for (auto a = itr->args.begin(); a != itr->args.end(); a++) {
+				iv_use use = {static_cast<int>(b), &*itr};
+				st.uses[*a].push_back(use);
+			}
+		}
+	}
+}
+
+static bool in_loop(const iv_status& st, int value) {
+	return st.def_block[value] >= 0 && st.loop->body.count(st.def_block[value]) > 0;
+}
+
+static bool get_const(const iv_status& st, int value, uint32_t& result) {
+	const ir_inst* def = st.defs[value];
+	if (def == nullptr || def->op != IR_CONST) return false;
+	result = def->imm;
+	return true;
+}
+
+// ループの中で値が変わらないか
+static bool is_invariant(const iv_status& st, int value) {
+	if (!in_loop(st, value)) return true;
+	const ir_inst* def = st.defs[value];
+	if (def == nullptr || !ir_is_pure(def->op)) return false;
+	switch (def->op) {
+	case IR_PHI: case IR_LOAD: case IR_DIV: case IR_MOD: return false;
+	default: break;
+	}
+	for (auto itr = def->args.begin(); itr != def->args.end(); itr++) {
+		if (!is_invariant(st, *itr)) return false;
+	}
+	return true;
+}
+
+// 読み書きのアドレスとしての使用か
+static bool is_address_use(const ir_inst& inst, int value) {
+	if (inst.op == IR_LOAD) return true;
+	return inst.op == IR_STORE && inst.args[1] != value;
+}
+
+// 帰納変数の1次式 (value = phi * scale + offset) を使う命令をたどる
+static bool trace_derived(const iv_status& st, iv_candidate& cand, int value, uint32_t scale, uint32_t offset) {
+	const std::vector<iv_use>& uses = st.uses[value];
+	for (auto itr = uses.begin(); itr != uses.end(); itr++) {
+		ir_inst* user = itr->inst;
+		if (user == cand.inc || user == cand.branch) continue;
+		if (!st.loop->body.count(itr->block) || user->dest < 0) return false;
+		uint32_t c;
+		int other = -1;
+		uint32_t next_scale = scale, next_offset = offset;
+		switch (user->op) {
+		case IR_ADD:
+			other = user->args[0] == value ? user->args[1] : user->args[0];
+			if (other == value) return false;
+			if (get_const(st, other, c)) {
+				next_offset = offset + c;
+				break;
+			}
+			if (!is_invariant(st, other)) return false;
+			if (cand.scale == 0 || scale < cand.scale) cand.scale = scale;
+			{
+				iv_address address = {user, other, scale, offset};
+				cand.addresses.push_back(address);
+			}
+			continue;
+		case IR_SUB:
+			if (user->args[0] != value || !get_const(st, user->args[1], c)) return false;
+			next_offset = offset - c;
+			break;
+		case IR_SHL:
+			if (user->args[0] != value || !get_const(st, user->args[1], c) || c >= 32) return false;
+			if ((static_cast<uint64_t>(scale) << c) > IV_MAX_SCALE) return false;
+			next_scale = scale << c;
+			next_offset = offset << c;
+			break;
+		case IR_MUL:
+			other = user->args[0] == value ? user->args[1] : user->args[0];
+			if (!get_const(st, other, c)) return false;
+			if (static_cast<uint64_t>(scale) * c > IV_MAX_SCALE || c == 0) return false;
+			next_scale = scale * c;
+			next_offset = offset * c;
+			break;
+		default:
+			return false;
+		}
+		cand.derived.push_back(user->dest);
+		if (!trace_derived(st, cand, user->dest, next_scale, next_offset)) return false;
+	}
+	return true;
+}
+
+// ループの先頭のPHIが、アドレスの計算とループの終了判定にだけ使う帰納変数かを調べる
+static bool analyze_candidate(const iv_status& st, ir_inst* phi, iv_candidate& cand) {
+	const ir_loop& loop = *st.loop;
+	const ir_block& header = st.fn.blocks[loop.header];
+	if (header.preds.size() != 2) return false;
+	int pre_index = header.preds[0] == loop.preheader ? 0 : 1;
+	cand.phi = phi;
+	cand.init = phi->args[pre_index];
+	cand.inc = st.defs[phi->args[1 - pre_index]];
+	cand.branch = nullptr;
+	cand.scale = 0;
+	const ir_inst* inc = cand.inc;
+	if (inc == nullptr || inc->op != IR_ADD || !in_loop(st, inc->dest)) return false;
+	if (st.uses[inc->dest].size() != 1) return false;
+	if (inc->args[0] != phi->dest && inc->args[1] != phi->dest) return false;
+	int step_value = inc->args[0] == phi->dest ? inc->args[1] : inc->args[0];
+	if (step_value == phi->dest || !get_const(st, step_value, cand.step)) return false;
+	if (cand.step == 0 || cand.step > IV_MAX_SCALE) return false;
+	const std::vector<iv_use>& uses = st.uses[phi->dest];
+	for (auto itr = uses.begin(); itr != uses.end(); itr++) {
+		if (itr->inst == inc) continue;
+		if (itr->inst->op != IR_BRANCH) continue;
+		if (cand.branch != nullptr || !st.loop->body.count(itr->block)) return false;
+		cand.branch = itr->inst;
+		cand.branch_block = itr->block;
+		// 毎回のループで判定していないと、終了の判定を置き換えられない
+		if (!ir_dominates(st.idom, itr->block, st.latch)) return false;
+	}
+	if (cand.branch == nullptr) return false;
+	// ループの終了判定を phi cond bound の時に続ける形にする
+	const ir_inst* branch = cand.branch;
+	if (branch->args[0] == branch->args[1]) return false;
+	bool phi_left = branch->args[0] == phi->dest;
+	cand.bound = phi_left ? branch->args[1] : branch->args[0];
+	if (!is_invariant(st, cand.bound)) return false;
+	const std::vector<int>& succs = st.fn.blocks[cand.branch_block].succs;
+	bool stay_first = loop.body.count(succs[0]) > 0;
+	if (stay_first == (loop.body.count(succs[1]) > 0)) return false;
+	cand.cond = phi_left ? branch->cond : ir_swap_cond(branch->cond);
+	if (!stay_first) cand.cond = ir_invert_cond(cand.cond);
+	// 残りの使用はすべてアドレスの計算でなければならない
+	if (!trace_derived(st, cand, phi->dest, 1, 0)) return false;
+	for (auto itr = cand.addresses.begin(); itr != cand.addresses.end(); itr++) {
+		if (itr->scale % cand.scale != 0) return false;
+	}
+	return !cand.addresses.empty();
+}
+
+// ループを抜けるまでに帰納変数が増える量を求める
+// 求められなければfalseを返す (ループの前で求める必要がある)
+static bool constant_distance(const iv_status& st, const iv_candidate& cand, uint64_t& distance) {
+	uint32_t init, bound;
+	if (!get_const(st, cand.init, init) || !get_const(st, cand.bound, bound)) return false;
+	int64_t first, limit, max_value;
+	switch (cand.cond) {
+	case L_SIGN: case LE_SIGN:
+		first = static_cast<int32_t>(init);
+		limit = static_cast<int32_t>(bound);
+		max_value = INT32_MAX;
+		break;
+	case L_UNSIGN: case LE_UNSIGN:
+		first = init;
+		limit = bound;
+		max_value = UINT32_MAX;
+		break;
+	case NEQ:
+		{
+			uint32_t diff = bound - init;
+			if (diff % cand.step != 0) return false;
+			distance = diff;
+			return true;
+		}
+	default:
+		return false;
+	}
+	if (cand.cond == LE_SIGN || cand.cond == LE_UNSIGN) limit++;
+	int64_t count = first < limit ? (limit - first + cand.step - 1) / cand.step : 0;
+	distance = count * cand.step;
+	// 元のループで帰納変数があふれる場合は扱わない
+	return first + static_cast<int64_t>(distance) <= max_value;
+}
+
+static int preheader_const(iv_status& st, uint32_t value, int lineno) {
+	auto found = st.consts.find(value);
+	if (found != st.consts.end()) return found->second;
+	ir_inst inst(IR_CONST, st.fn.new_value(), lineno);
+	inst.imm = value;
+	st.preheader_insts.push_back(inst);
+	st.consts.insert(std::make_pair(value, inst.dest));
+	return inst.dest;
+}
+
+static int preheader_op(iv_status& st, ir_opcode op, int a, int b, int lineno) {
+	ir_inst inst(op, st.fn.new_value(), lineno);
+	inst.args.push_back(a);
+	if (b >= 0) inst.args.push_back(b);
+	st.preheader_insts.push_back(inst);
+	return inst.dest;
+}
+
+// ループの中で求めている不変な値を、前置ブロックでも求める
+static int materialize(iv_status& st, int value) {
+	if (!in_loop(st, value)) return value;
+	auto found = st.materialized.find(value);
+	if (found != st.materialized.end()) return found->second;
+	ir_inst inst = *st.defs[value];
+	for (auto itr = inst.args.begin(); itr != inst.args.end(); itr++) *itr = materialize(st, *itr);
+	inst.dest = st.fn.new_value();
+	st.preheader_insts.push_back(inst);
+	st.materialized.insert(std::make_pair(value, inst.dest));
+	return inst.dest;
+}
+
+static int preheader_scale(iv_status& st, int value, uint32_t scale, int lineno) {
+	if (scale == 1) return value;
+	int shift = 0;
+	while ((1u << shift) < scale) shift++;
+	if ((1u << shift) == scale) return preheader_op(st, IR_SHL, value, preheader_const(st, shift, lineno), lineno);
+	return preheader_op(st, IR_MUL, value, preheader_const(st, scale, lineno), lineno);
+}
+
+static void insert_before(ir_block& block, int value, const ir_inst& inst) {
+	for (auto itr = block.insts.begin(); itr != block.insts.end(); itr++) {
+		if (itr->dest == value) {
+			block.insts.insert(itr, inst);
+			return;
+		}
+	}
+}
+
+static void insert_after(ir_block& block, int value, const ir_inst& inst) {
+	for (auto itr = block.insts.begin(); itr != block.insts.end(); itr++) {
+		if (itr->dest == value) {
+			block.insts.insert(itr + 1, inst);
+			return;
+		}
+	}
+}
+
+// 帰納変数を、アドレスと同じ割合で増える値に置き換える
+static bool reduce_candidate(iv_status& st, const iv_candidate& cand) {
+	ir_function& fn = st.fn;
+	int lineno = cand.phi->lineno;
+	uint64_t distance;
+	bool constant = constant_distance(st, cand, distance);
+	if (constant) {
+		if (distance * cand.scale > UINT32_MAX) return false;
+	} else {
+		if (cand.step != 1) return false;
+		if (cand.cond != L_SIGN && cand.cond != L_UNSIGN && cand.cond != NEQ) return false;
+		// 毎回読み書きするアドレスでなければ、置き換えた値が一周しないことを保証できない
+		bool unconditional = cand.scale == 1;
+		for (auto a = cand.addresses.begin(); a != cand.addresses.end() && !unconditional; a++) {
+			const std::vector<iv_use>& uses = st.uses[a->inst->dest];
+			for (auto u = uses.begin(); u != uses.end(); u++) {
+				if (is_address_use(*u->inst, a->inst->dest) && ir_dominates(st.idom, u->block, st.latch)) {
+					unconditional = true;
+				}
+			}
+		}
+		if (!unconditional) return false;
+	}
+	// 添字をそのまま足しているだけなら、置き換えても命令は減らない
+	if (cand.scale == 1 && cand.derived.empty()) return false;
+	// アドレスの元が1個だけなら、アドレスそのものを増やしていく
+	int base = cand.addresses[0].base;
+	bool use_pointer = true;
+	for (auto a = cand.addresses.begin(); a != cand.addresses.end(); a++) {
+		if (a->base != base || a->scale != cand.scale) use_pointer = false;
+	}
+	if (use_pointer) {
+		const ir_inst* base_def = st.defs[base];
+		if (base_def != nullptr && base_def->op == IR_GV_BASE && st.gv_in_register) use_pointer = false;
+		const std::vector<iv_use>& base_uses = st.uses[base];
+		for (auto u = base_uses.begin(); u != base_uses.end(); u++) {
+			if (!st.loop->body.count(u->block)) continue;
+			bool is_address = false;
+			for (auto a = cand.addresses.begin(); a != cand.addresses.end(); a++) {
+				if (u->inst == a->inst) is_address = true;
+			}
+			if (!is_address) use_pointer = false;
+		}
+	}
+	st.preheader_insts.clear();
+	st.consts.clear();
+	st.materialized.clear();
+
+	// 新しい帰納変数の最初の値 (use_pointer ? base + init * scale : init * scale)
+	uint32_t init = 0;
+	bool init_const = get_const(st, cand.init, init);
+	int start;
+	if (init_const) {
+		uint32_t scaled = init * cand.scale;
+		if (!use_pointer) start = preheader_const(st, scaled, lineno);
+		else if (scaled == 0) start = materialize(st, base);
+		else start = preheader_op(st, IR_ADD, materialize(st, base), preheader_const(st, scaled, lineno), lineno);
+	} else {
+		start = preheader_scale(st, cand.init, cand.scale, lineno);
+		if (use_pointer) start = preheader_op(st, IR_ADD, materialize(st, base), start, lineno);
+	}
+	// ループを抜ける時の値
+	int end;
+	if (constant) {
+		uint32_t offset = static_cast<uint32_t>(distance * cand.scale);
+		if (init_const && !use_pointer) end = preheader_const(st, init * cand.scale + offset, lineno);
+		else if (offset == 0) end = start;
+		else end = preheader_op(st, IR_ADD, start, preheader_const(st, offset, lineno), lineno);
+	} else {
+		// ループに入らない場合は最初の値にする
+		int bound = materialize(st, cand.bound);
+		int diff = init_const && init == 0 ? bound : preheader_op(st, IR_SUB, bound, cand.init, lineno);
+		diff = preheader_scale(st, diff, cand.scale, lineno);
+		if (cand.cond != NEQ) {
+			ir_inst setcc(IR_SETCC, fn.new_value(), lineno);
+			setcc.args.push_back(cand.init);
+			setcc.args.push_back(bound);
+			setcc.cond = cand.cond;
+			st.preheader_insts.push_back(setcc);
+			int mask = preheader_op(st, IR_NEG, setcc.dest, -1, lineno);
+			diff = preheader_op(st, IR_AND, diff, mask, lineno);
+		}
+		end = init_const && init == 0 && !use_pointer ? diff : preheader_op(st, IR_ADD, start, diff, lineno);
+	}
+	int step = preheader_const(st, cand.step * cand.scale, lineno);
+
+	int phi = fn.new_value();
+	st.created.insert(phi);
+	ir_inst new_phi(IR_PHI, phi, lineno);
+	const ir_block& header = fn.blocks[st.loop->header];
+	for (auto p = header.preds.begin(); p != header.preds.end(); p++) {
+		new_phi.args.push_back(*p == st.loop->preheader ? start : -1);
+	}
+	ir_inst new_inc(IR_ADD, fn.new_value(), cand.inc->lineno);
+	new_inc.args.push_back(phi);
+	new_inc.args.push_back(step);
+	for (auto a = new_phi.args.begin(); a != new_phi.args.end(); a++) {
+		if (*a < 0) *a = new_inc.dest;
+	}
+
+	// ループの終了判定を新しい帰納変数で行う
+	bool stay_first = st.loop->body.count(fn.blocks[cand.branch_block].succs[0]) > 0;
+	cand.branch->args[0] = phi;
+	cand.branch->args[1] = end;
+	cand.branch->cond = stay_first ? NEQ : EQ;
+
+	// アドレスの計算を置き換える
+	std::set<int> removed;
+	removed.insert(cand.phi->dest);
+	removed.insert(cand.inc->dest);
+	removed.insert(cand.derived.begin(), cand.derived.end());
+	std::vector<std::pair<int, ir_inst> > scaled_indexes, offset_adds;
+	for (auto a = cand.addresses.begin(); a != cand.addresses.end(); a++) {
+		int address = a->inst->dest;
+		bool other_use = false;
+		const std::vector<iv_use>& uses = st.uses[address];
+		if (!use_pointer) {
+			a->inst->args[0] = a->base;
+			a->inst->args[1] = phi;
+			if (a->scale != cand.scale) {
+				// 係数が大きい配列は、新しい帰納変数を何倍かして使う
+				// (使う場所ごとに求める方が、値を長く置いておくよりレジスタを使わない)
+				uint32_t ratio = a->scale / cand.scale;
+				int shift = 0;
+				while ((1u << shift) < ratio) shift++;
+				bool use_shift = (1u << shift) == ratio;
+				ir_inst index(use_shift ? IR_SHL : IR_MUL, fn.new_value(), a->inst->lineno);
+				index.args.push_back(phi);
+				index.args.push_back(preheader_const(st, use_shift ? shift : ratio, lineno));
+				a->inst->args[1] = index.dest;
+				scaled_indexes.push_back(std::make_pair(address, index));
+			}
+		}
+		for (auto u = uses.begin(); u != uses.end(); u++) {
+			if (is_address_use(*u->inst, address)) {
+				if (use_pointer) u->inst->args[0] = phi;
+				u->inst->imm += a->offset;
+			} else {
+				other_use = true;
+			}
+		}
+		if (!other_use) {
+			if (use_pointer) removed.insert(address);
+			continue;
+		}
+		if (a->offset == 0 && !use_pointer) continue;
+		// アドレスとして以外の使用には、元の値を求め直して渡す
+		ir_inst add(IR_ADD, fn.new_value(), a->inst->lineno);
+		add.args.push_back(use_pointer ? phi : address);
+		add.args.push_back(preheader_const(st, a->offset, lineno));
+		for (auto u = uses.begin(); u != uses.end(); u++) {
+			if (is_address_use(*u->inst, address)) continue;
+			for (auto arg = u->inst->args.begin(); arg != u->inst->args.end(); arg++) {
+				if (*arg == address) *arg = add.dest;
+			}
+		}
+		if (use_pointer) {
+			// 元のアドレスの計算は消し、その位置で求める
+			add.dest = address;
+			*a->inst = add;
+		} else {
+			offset_adds.push_back(std::make_pair(address, add));
+		}
+	}
+
+	// ここからは命令を追加・削除するので、defsなどは使えなくなる
+	int inc_block = st.def_block[cand.inc->dest];
+	int inc_dest = cand.inc->dest;
+	for (auto itr = scaled_indexes.begin(); itr != scaled_indexes.end(); itr++) {
+		insert_before(fn.blocks[st.def_block[itr->first]], itr->first, itr->second);
+	}
+	for (auto itr = offset_adds.begin(); itr != offset_adds.end(); itr++) {
+		insert_after(fn.blocks[st.def_block[itr->first]], itr->first, itr->second);
+	}
+	insert_after(fn.blocks[inc_block], inc_dest, new_inc);
+	ir_block& head = fn.blocks[st.loop->header];
+	head.insts.insert(head.insts.begin(), new_phi);
+	ir_block& pre = fn.blocks[st.loop->preheader];
+	for (auto itr = st.preheader_insts.begin(); itr != st.preheader_insts.end(); itr++) {
+		ir_insert_before_terminator(pre, *itr);
+	}
+	for (auto bitr = st.loop->body.begin(); bitr != st.loop->body.end(); bitr++) {
+		std::vector<ir_inst>& insts = fn.blocks[*bitr].insts;
+		std::vector<ir_inst> kept;
+		for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+			if (itr->dest < 0 || !removed.count(itr->dest)) kept.push_back(*itr);
+		}
+		insts.swap(kept);
+	}
+	return true;
+}
+
+// ループの中で配列の添字に使う帰納変数を、アドレスと同じ割合で増える値に置き換える
+void ir_reduce_induction_variables(ir_function& fn, bool gv_in_register) {
+	std::vector<ir_loop> loops = ir_find_loops(fn);
+	if (loops.empty()) return;
+	if (ir_insert_preheaders(fn, loops)) loops = ir_find_loops(fn);
+	iv_status st(fn, gv_in_register);
+	st.idom = ir_compute_idom(fn);
+	for (auto litr = loops.begin(); litr != loops.end(); litr++) {
+		if (litr->preheader < 0) continue;
+		st.loop = &*litr;
+		const std::vector<int>& preds = fn.blocks[litr->header].preds;
+		if (preds.size() != 2) continue;
+		st.latch = preds[0] == litr->preheader ? preds[1] : preds[0];
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			collect_defs(st);
+			const std::vector<ir_inst>& insts = fn.blocks[litr->header].insts;
+			for (size_t i = 0; i < insts.size() && insts[i].op == IR_PHI; i++) {
+				if (st.created.count(insts[i].dest)) continue;
+				iv_candidate cand;
+				if (!analyze_candidate(st, st.defs[insts[i].dest], cand)) continue;
+				if (reduce_candidate(st, cand)) {
+					changed = true;
+					break;
+				}
+			}
+		}
+	}
+}
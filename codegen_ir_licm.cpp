@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include "codegen_ir.hpp"
+
+// 計算用に空けておくレジスタの数 (使う場所で作り直す定数や、定数の乗除算の展開に使う)
+static const int LICM_SPARE_REGS = 1;
+
+struct licm_status {
+	ir_function& fn;
+	bool gv_in_register; // グローバル変数領域の位置を専用のレジスタに置くか
+	int allocatable; // 値を置けるレジスタの数
+	int callee_saved; // 関数呼び出しをまたいで値を置けるレジスタの数
+	std::vector<ir_inst*> defs;
+	std::vector<int> def_block;
+	std::vector<int> use_count;
+
+	licm_status(ir_function& fn_, bool gv_in_register_) : fn(fn_), gv_in_register(gv_in_register_),
+		allocatable(gv_in_register_ ? 7 : 8), callee_saved(gv_in_register_ ? 3 : 4) {}
+};
+
+static void collect_defs(licm_status& ls) {
+	ls.defs.assign(ls.fn.num_values, nullptr);
+	ls.def_block.assign(ls.fn.num_values, -1);
+	ls.use_count.assign(ls.fn.num_values, 0);
+	for (size_t b = 0; b < ls.fn.blocks.size(); b++) {
+		for (auto itr = ls.fn.blocks[b].insts.begin(); itr != ls.fn.blocks[b].insts.end(); itr++) {
+			if (itr->dest >= 0) {
+				ls.defs[itr->dest] = &*itr;
+				ls.def_block[itr->dest] = b;
+			}
+			for (auto a = itr->args.begin(); a != itr->args.end(); a++) ls.use_count[*a]++;
+		}
+	}
+}
+
+// 使う場所で作り直すので、レジスタを占め続けない値か
+static bool is_remat(const licm_status& ls, int value) {
+	const ir_inst* def = ls.defs[value];
+	if (def == nullptr || def->keep_in_register) return false;
+	switch (def->op) {
+	case IR_CONST: case IR_FRAME_ADDR: return true;
+	case IR_GV_BASE: return ls.gv_in_register;
+	default: return false;
+	}
+}
+
+// 各ブロックの出口で生きている値を求める
+static std::vector<std::vector<bool> > compute_live_out(const ir_function& fn) {
+	size_t n = fn.blocks.size();
+	std::vector<std::vector<bool> > live_in(n, std::vector<bool>(fn.num_values, false));
+	std::vector<std::vector<bool> > live_out(live_in);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t b = n; b-- > 0;) {
+			const ir_block& block = fn.blocks[b];
+			std::vector<bool> live(fn.num_values, false);
+			for (auto s = block.succs.begin(); s != block.succs.end(); s++) {
+				const ir_block& succ = fn.blocks[*s];
+				for (int v = 0; v < fn.num_values; v++) {
+					if (live_in[*s][v]) live[v] = true;
+				}
+				size_t pred_index = std::find(succ.preds.begin(), succ.preds.end(), static_cast<int>(b)) -
+					succ.preds.begin();
+				for (auto p = succ.insts.begin(); p != succ.insts.end() && p->op == IR_PHI; p++) {
+					live[p->args[pred_index]] = true;
+				}
+			}
+			live_out[b] = live;
+			for (auto itr = block.insts.rbegin(); itr != block.insts.rend(); itr++) {
+				if (itr->dest >= 0) live[itr->dest] = false;
+				if (itr->op == IR_PHI) continue;
+				for (auto a = itr->args.begin(); a != itr->args.end(); a++) live[*a] = true;
+			}
+			if (live != live_in[b]) {
+				live_in[b] = live;
+				changed = true;
+			}
+		}
+	}
+	return live_out;
+}
+
+// ループの中で同時にレジスタに置く値の数の最大値を求める
+// across_call : 関数呼び出しをまたいで置く値の数の最大値 (呼び出しが無ければ-1)
+static int loop_pressure(const licm_status& ls, const ir_loop& loop,
+const std::vector<std::vector<bool> >& live_out, int& across_call) {
+	int pressure = 0;
+	across_call = -1;
+	for (auto bitr = loop.body.begin(); bitr != loop.body.end(); bitr++) {
+		const ir_block& block = ls.fn.blocks[*bitr];
+		std::vector<bool> live = live_out[*bitr];
+		int count = 0;
+		for (int v = 0; v < ls.fn.num_values; v++) {
+			if (live[v] && !is_remat(ls, v)) count++;
+		}
+		auto set_live = [&](int value, bool flag) {
+			if (live[value] == flag) return;
+			live[value] = flag;
+			if (!is_remat(ls, value)) count += flag ? 1 : -1;
+		};
+		pressure = std::max(pressure, count);
+		for (auto itr = block.insts.rbegin(); itr != block.insts.rend(); itr++) {
+			if (itr->dest >= 0) set_live(itr->dest, false);
+			bool is_call = itr->op == IR_CALL;
+			if (itr->op == IR_DIV || itr->op == IR_MOD) {
+				// 定数でない除数での除算は補助ルーチンを呼び出す
+				const ir_inst* divisor = ls.defs[itr->args[1]];
+				is_call = divisor == nullptr || divisor->op != IR_CONST || divisor->imm == 0;
+			}
+			if (is_call) across_call = std::max(across_call, count);
+			if (itr->op == IR_PHI) continue;
+			for (auto a = itr->args.begin(); a != itr->args.end(); a++) set_live(*a, true);
+			pressure = std::max(pressure, count);
+		}
+	}
+	return pressure;
+}
+
+// ループの外に出してよい命令か
+static bool is_hoistable(const ir_inst& inst) {
+	switch (inst.op) {
+	case IR_CONST: case IR_FRAME_ADDR:
+	case IR_ADD: case IR_SUB: case IR_MUL: case IR_AND: case IR_OR: case IR_XOR:
+	case IR_SHL: case IR_SHR: case IR_ASR: case IR_NEG: case IR_NOT:
+	case IR_EXT: case IR_SETCC:
+		return true;
+	default:
+		// 読み込みは書き込みとの関係、除算は補助ルーチンの呼び出しの重さがあるので、動かさない
+		return false;
+	}
+}
+
+// 使う場所で作り直す値のうち、レジスタに置いておくと作り直しが省ける使い方をしているか
+static bool needs_register(const licm_status& ls, const ir_inst& user, size_t arg_index) {
+	const ir_inst* def = ls.defs[user.args[arg_index]];
+	if (def->op == IR_CONST) {
+		// 小さい定数は1命令で作れる
+		if (def->imm < 256) return false;
+		// 定数での除算は除数をレジスタに置かない
+		return !((user.op == IR_DIV || user.op == IR_MOD) && arg_index == 1);
+	}
+	// スタック上の4バイトはSPからの位置で直接読み書きする
+	if ((user.op == IR_LOAD || user.op == IR_STORE) && arg_index == 0 && user.size == 4) {
+		uint32_t total = def->imm + user.imm;
+		if (total % 4 == 0 && total / 4 < 256) return false;
+	}
+	return true;
+}
+
+// 定数のオフセットを読み書きの命令に入れられないか
+static bool offset_out_of_range(const licm_status& ls, const ir_inst& inst) {
+	if (inst.imm == 0) return false;
+	const ir_inst* base = ls.defs[inst.args[0]];
+	if (base != nullptr && base->op == IR_FRAME_ADDR) return false;
+	bool is_signed = inst.op == IR_LOAD && inst.is_signed && inst.size < 4;
+	return is_signed || inst.imm % inst.size != 0 || inst.imm / inst.size >= 32;
+}
+
+// 1個のループの不変な計算を前置ブロックに移す
+static void hoist_loop(licm_status& ls, const ir_loop& loop) {
+	ir_function& fn = ls.fn;
+	std::vector<std::vector<bool> > live_out = compute_live_out(fn);
+	collect_defs(ls);
+	int across_call;
+	int pressure = loop_pressure(ls, loop, live_out, across_call);
+	int budget = ls.allocatable - LICM_SPARE_REGS;
+	// 値を1個増やしてもレジスタが足りるか
+	auto fits = [&](int delta) {
+		if (pressure + delta > budget) return false;
+		return across_call < 0 || across_call + delta <= ls.callee_saved;
+	};
+	auto accept = [&](int delta) {
+		pressure += delta;
+		if (across_call >= 0) across_call += delta;
+	};
+	auto in_loop = [&](int value) {
+		return ls.def_block[value] >= 0 && loop.body.count(ls.def_block[value]) > 0;
+	};
+	std::vector<ir_inst> hoisted;
+	std::set<int> hoisted_values;
+
+	// 引数が全てループの外で決まる計算を移す
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (auto bitr = loop.body.begin(); bitr != loop.body.end(); bitr++) {
+			const std::vector<ir_inst>& insts = fn.blocks[*bitr].insts;
+			for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+				const ir_inst& inst = *itr;
+				if (!is_hoistable(inst) || inst.dest < 0 || hoisted_values.count(inst.dest)) continue;
+				bool invariant = true;
+				for (auto a = inst.args.begin(); a != inst.args.end() && invariant; a++) {
+					if (in_loop(*a) && !hoisted_values.count(*a)) invariant = false;
+				}
+				if (!invariant) continue;
+				int delta = is_remat(ls, inst.dest) ? 0 : 1;
+				// ここでしか使わない引数は、ループの中でレジスタを占めなくなる
+				std::set<int> freed(inst.args.begin(), inst.args.end());
+				for (auto a = freed.begin(); a != freed.end(); a++) {
+					if (!is_remat(ls, *a) && ls.use_count[*a] == static_cast<int>(std::count(
+					inst.args.begin(), inst.args.end(), *a))) {
+						delta--;
+					}
+				}
+				if (delta > 0 && !fits(delta)) continue;
+				accept(delta);
+				hoisted.push_back(inst);
+				hoisted_values.insert(inst.dest);
+				changed = true;
+			}
+		}
+	}
+	for (auto bitr = loop.body.begin(); bitr != loop.body.end(); bitr++) {
+		std::vector<ir_inst>& insts = fn.blocks[*bitr].insts;
+		std::vector<ir_inst> kept;
+		for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+			if (itr->dest < 0 || !hoisted_values.count(itr->dest)) kept.push_back(*itr);
+		}
+		insts.swap(kept);
+	}
+	ir_block& pre = fn.blocks[loop.preheader];
+	for (auto itr = hoisted.begin(); itr != hoisted.end(); itr++) ir_insert_before_terminator(pre, *itr);
+	collect_defs(ls);
+
+	// 作り直しに手間のかかる定数や、スタック上のアドレスをレジスタに置いたままにする
+	std::map<int, int> remat_uses;
+	for (auto bitr = loop.body.begin(); bitr != loop.body.end(); bitr++) {
+		const std::vector<ir_inst>& insts = fn.blocks[*bitr].insts;
+		for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+			if (itr->op == IR_PHI) continue;
+			for (size_t i = 0; i < itr->args.size(); i++) {
+				const ir_inst* def = ls.defs[itr->args[i]];
+				if (def == nullptr || def->keep_in_register) continue;
+				if (def->op != IR_CONST && def->op != IR_FRAME_ADDR) continue;
+				if (needs_register(ls, *itr, i)) remat_uses[itr->args[i]]++;
+			}
+		}
+	}
+	std::vector<int> rename(fn.num_values, -1);
+	std::vector<ir_inst> copies;
+	// 作り直す手間が大きいもの (定数) を優先する
+	for (int pass = 0; pass < 2; pass++) {
+		for (auto itr = remat_uses.begin(); itr != remat_uses.end(); itr++) {
+			const ir_inst* def = ls.defs[itr->first];
+			if ((def->op == IR_CONST) != (pass == 0) || !fits(1)) continue;
+			accept(1);
+			ir_inst copy = *def;
+			copy.dest = fn.new_value();
+			copy.keep_in_register = true;
+			copies.push_back(copy);
+			rename.resize(fn.num_values, -1);
+			rename[itr->first] = copy.dest;
+		}
+	}
+	if (!copies.empty()) {
+		// ループの中の使用だけを置き換える
+		for (auto bitr = loop.body.begin(); bitr != loop.body.end(); bitr++) {
+			std::vector<ir_inst>& insts = fn.blocks[*bitr].insts;
+			for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+				if (itr->op == IR_PHI) continue;
+				for (size_t i = 0; i < itr->args.size(); i++) {
+					int r = rename[itr->args[i]];
+					if (r >= 0 && needs_register(ls, *itr, i)) itr->args[i] = r;
+				}
+			}
+		}
+		// ls.defs が前置ブロックを指していることがあるので、挿入は置き換えの後で行う
+		for (auto itr = copies.begin(); itr != copies.end(); itr++) ir_insert_before_terminator(pre, *itr);
+		collect_defs(ls);
+	}
+
+	// 命令に入らないオフセットを足したアドレスを、前置ブロックで求めておく
+	std::map<std::pair<int, uint32_t>, int> addresses;
+	std::vector<ir_inst> address_insts;
+	for (auto bitr = loop.body.begin(); bitr != loop.body.end(); bitr++) {
+		std::vector<ir_inst>& insts = fn.blocks[*bitr].insts;
+		for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+			if (itr->op != IR_LOAD && itr->op != IR_STORE) continue;
+			int base = itr->args[0];
+			if (in_loop(base)) continue;
+			if (!offset_out_of_range(ls, *itr)) continue;
+			std::pair<int, uint32_t> key(base, itr->imm);
+			auto found = addresses.find(key);
+			if (found == addresses.end()) {
+				if (!fits(1)) continue;
+				accept(1);
+				ir_inst offset(IR_CONST, fn.new_value(), itr->lineno);
+				offset.imm = itr->imm;
+				ir_inst add(IR_ADD, fn.new_value(), itr->lineno);
+				add.args.push_back(base);
+				add.args.push_back(offset.dest);
+				address_insts.push_back(offset);
+				address_insts.push_back(add);
+				found = addresses.insert(std::make_pair(key, add.dest)).first;
+			}
+			itr->args[0] = found->second;
+			itr->imm = 0;
+		}
+	}
+	for (auto itr = address_insts.begin(); itr != address_insts.end(); itr++) ir_insert_before_terminator(pre, *itr);
+}
+
+// ループの中で値が変わらない計算を、ループの前に移す
+void ir_hoist_loop_invariants(ir_function& fn, bool gv_in_register) {
+	std::vector<ir_loop> loops = ir_find_loops(fn);
+	if (loops.empty()) return;
+	if (ir_insert_preheaders(fn, loops)) loops = ir_find_loops(fn);
+	licm_status ls(fn, gv_in_register);
+	for (auto itr = loops.begin(); itr != loops.end(); itr++) {
+		if (itr->preheader < 0) continue;
+		hoist_loop(ls, *itr);
+	}
+}
@@ -0,0 +1,1167 @@
+#include <climits>
+#include <map>
+#include <vector>
+#include "codegen_ir.hpp"
+
+// 中間表現への変換中の状態
+// SSA形式の構築は Braun et al. "Simple and Efficient Construction of Static Single Assignment Form" の方法で行う
+struct lower_status {
+	ir_function fn;
+	codegen_status& status;
+	int cur; // 命令を追加しているブロック (負 : 到達できない位置)
+	std::vector<int> layout; // ブロックを使い始めた順番
+	std::vector<bool> sealed; // 分岐元が全て揃ったか
+	std::vector<std::map<int, int> > current_def; // ブロックごとの、変数 → 今の値
+	std::vector<std::map<int, int> > incomplete_phis; // 未完成のブロックに置いたPHI (変数 → 値)
+	std::map<var_info*, int> var_ids; // レジスタに置く変数 → 変数の番号
+	int num_vars;
+	std::map<var_info*, int> frame_offsets; // スタックに置く変数 → ローカル変数領域でのオフセット
+	std::vector<int> mem_offset; // スコープごとの、次に変数を置くオフセット
+	std::vector<int> continue_blocks;
+	std::vector<int> break_blocks;
+	std::map<int, int> label_blocks; // ラベルID (case・default・goto) → ブロック
+	int pragma_loop_bound;
+	int gv_base; // グローバル変数領域の先頭を表す値 (負 : まだ作っていない)
+	int undefined; // 値を設定されていない変数の値 (負 : まだ作っていない)
+
+	lower_status(codegen_status& status_) : status(status_), cur(-1), num_vars(0),
+		pragma_loop_bound(-1), gv_base(-1), undefined(-1) {}
+};
+
+// 変数をレジスタに置く (SSA形式の値で表す) かを判定する
+static bool is_ssa_variable(var_info* vinfo) {
+	return !vinfo->is_global && !vinfo->address_taken && is_scalar_type(vinfo->type);
+}
+
+static bool is_signed_integer(type_node* type) {
+	return type != nullptr && type->kind == TYPE_INTEGER && type->info.is_signed;
+}
+
+// ポインタの指す先のサイズ (ポインタでなければ1)
+static int pointer_mult(type_node* type) {
+	return is_pointer_type(type) && type->info.target_type != nullptr ? type->info.target_type->size : 1;
+}
+
+static int new_block(lower_status& ls) {
+	ls.fn.blocks.push_back(ir_block());
+	ls.sealed.push_back(false);
+	ls.current_def.push_back(std::map<int, int>());
+	ls.incomplete_phis.push_back(std::map<int, int>());
+	return ls.fn.blocks.size() - 1;
+}
+
+// ブロックに命令を追加し始める
+static void start_block(lower_status& ls, int block) {
+	ls.layout.push_back(block);
+	ls.cur = block;
+}
+
+// 到達できない位置に命令を追加する場合は、どこからも来ないブロックを作る
+static void ensure_block(lower_status& ls) {
+	if (ls.cur >= 0) return;
+	int block = new_block(ls);
+	ls.sealed[block] = true;
+	start_block(ls, block);
+}
+
+static void add_edge(lower_status& ls, int from, int to) {
+	if (ls.sealed[to]) throw codegen_error(ls.fn.lineno, "edge added to sealed IR block");
+	ls.fn.blocks[from].succs.push_back(to);
+	ls.fn.blocks[to].preds.push_back(from);
+}
+
+static int emit(lower_status& ls, const ir_inst& inst) {
+	ensure_block(ls);
+	ls.fn.blocks[ls.cur].insts.push_back(inst);
+	return inst.dest;
+}
+
+// 結果を持つ命令を追加し、結果の値を返す
+static int emit_value(lower_status& ls, ir_opcode op, int lineno, int arg0 = -1, int arg1 = -1) {
+	ir_inst inst(op, ls.fn.new_value(), lineno);
+	if (arg0 >= 0) inst.args.push_back(arg0);
+	if (arg1 >= 0) inst.args.push_back(arg1);
+	return emit(ls, inst);
+}
+
+static int emit_const(lower_status& ls, uint32_t value, int lineno) {
+	ir_inst inst(IR_CONST, ls.fn.new_value(), lineno);
+	inst.imm = value;
+	return emit(ls, inst);
+}
+
+// 入口のブロックの先頭に命令を置く (どこからでも使える値になる)
+static int emit_at_entry(lower_status& ls, ir_inst inst) {
+	inst.dest = ls.fn.new_value();
+	ls.fn.blocks[0].insts.insert(ls.fn.blocks[0].insts.begin(), inst);
+	return inst.dest;
+}
+
+static int gv_base_value(lower_status& ls) {
+	if (ls.gv_base < 0) ls.gv_base = emit_at_entry(ls, ir_inst(IR_GV_BASE, -1, ls.fn.lineno));
+	return ls.gv_base;
+}
+
+// 値をtypeの値として拡張する (typeが4バイト未満の整数型の場合のみ)
+static int extend_to_type(lower_status& ls, int value, type_node* type, int lineno) {
+	if (type == nullptr || type->kind != TYPE_INTEGER || type->size >= 4) return value;
+	ir_inst inst(IR_EXT, ls.fn.new_value(), lineno);
+	inst.args.push_back(value);
+	inst.size = type->size;
+	inst.is_signed = type->info.is_signed;
+	return emit(ls, inst);
+}
+
+static void jump_to(lower_status& ls, int target, int lineno) {
+	if (ls.cur < 0) return;
+	emit(ls, ir_inst(IR_JUMP, -1, lineno));
+	add_edge(ls, ls.cur, target);
+	ls.cur = -1;
+}
+
+static void branch_to(lower_status& ls, jcc_cond cond, int a, int b, int true_block, int false_block, int lineno) {
+	if (true_block == false_block) {
+		jump_to(ls, true_block, lineno);
+		return;
+	}
+	ir_inst inst(IR_BRANCH, -1, lineno);
+	inst.cond = cond;
+	inst.args.push_back(a);
+	inst.args.push_back(b);
+	emit(ls, inst);
+	add_edge(ls, ls.cur, true_block);
+	add_edge(ls, ls.cur, false_block);
+	ls.cur = -1;
+}
+
+// 今のブロックから次のブロックに流れ込み、次のブロックに命令を追加し始める
+static void enter_block(lower_status& ls, int block, int lineno) {
+	jump_to(ls, block, lineno);
+	start_block(ls, block);
+}
+
+static int read_variable(lower_status& ls, int var, int block);
+
+// PHIの引数を、各分岐元での変数の値で埋める
+static void add_phi_operands(lower_status& ls, int var, int phi, int block) {
+	std::vector<int> args;
+	const std::vector<int>& preds = ls.fn.blocks[block].preds;
+	for (auto itr = preds.begin(); itr != preds.end(); itr++) {
+		args.push_back(read_variable(ls, var, *itr));
+	}
+	std::vector<ir_inst>& insts = ls.fn.blocks[block].insts;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if (itr->op == IR_PHI && itr->dest == phi) {
+			itr->args = args;
+			return;
+		}
+	}
+}
+
+static int new_phi(lower_status& ls, int block) {
+	ir_inst phi(IR_PHI, ls.fn.new_value(), ls.fn.lineno);
+	std::vector<ir_inst>& insts = ls.fn.blocks[block].insts;
+	insts.insert(insts.begin(), phi);
+	return phi.dest;
+}
+
+static void write_variable(lower_status& ls, int var, int block, int value) {
+	ls.current_def[block][var] = value;
+}
+
+static int read_variable(lower_status& ls, int var, int block) {
+	auto itr = ls.current_def[block].find(var);
+	if (itr != ls.current_def[block].end()) return itr->second;
+	int value;
+	const std::vector<int>& preds = ls.fn.blocks[block].preds;
+	if (!ls.sealed[block]) {
+		value = new_phi(ls, block);
+		ls.incomplete_phis[block][var] = value;
+	} else if (preds.size() == 1) {
+		value = read_variable(ls, var, preds[0]);
+	} else if (preds.empty()) {
+		// 値を設定されずに読まれる変数は0とする
+		if (ls.undefined < 0) ls.undefined = emit_at_entry(ls, ir_inst(IR_CONST, -1, ls.fn.lineno));
+		value = ls.undefined;
+	} else {
+		value = new_phi(ls, block);
+		write_variable(ls, var, block, value);
+		add_phi_operands(ls, var, value, block);
+	}
+	write_variable(ls, var, block, value);
+	return value;
+}
+
+// ブロックの分岐元が全て揃ったので、未完成のPHIを埋める
+static void seal_block(lower_status& ls, int block) {
+	ls.sealed[block] = true;
+	std::map<int, int> phis;
+	phis.swap(ls.incomplete_phis[block]);
+	for (auto itr = phis.begin(); itr != phis.end(); itr++) {
+		add_phi_operands(ls, itr->first, itr->second, block);
+	}
+}
+
+static int read_var(lower_status& ls, int var) {
+	ensure_block(ls);
+	return read_variable(ls, var, ls.cur);
+}
+
+static void write_var(lower_status& ls, int var, int value) {
+	ensure_block(ls);
+	write_variable(ls, var, ls.cur, value);
+}
+
+static int new_temp_var(lower_status& ls) {
+	return ls.num_vars++;
+}
+
+// アドレスを基準の値と定数のオフセットに分けて表したもの
+struct lower_address {
+	int base;
+	uint32_t offset;
+	var_info* object; // ポインタの演算で元にした変数 (不明ならnullptr)
+
+	lower_address(int base_ = -1, uint32_t offset_ = 0, var_info* object_ = nullptr) :
+		base(base_), offset(offset_), object(object_) {}
+};
+
+// 代入先
+struct lower_lvalue {
+	int var; // レジスタに置く変数の番号 (負 : メモリ)
+	lower_address addr;
+	type_node* type;
+};
+
+static int lower_expr(lower_status& ls, expression_node* expr, int lineno);
+static lower_address lower_pointer(lower_status& ls, expression_node* expr, int lineno);
+
+static int address_value(lower_status& ls, const lower_address& addr, int lineno) {
+	if (addr.offset == 0) return addr.base;
+	return emit_value(ls, IR_ADD, lineno, addr.base, emit_const(ls, addr.offset, lineno));
+}
+
+// 識別子が表す変数のアドレスを求める
+static lower_address variable_address(lower_status& ls, expression_node* expr, int lineno) {
+	var_info* vinfo = expr->info.ident.info;
+	if (vinfo == nullptr) throw codegen_error(lineno, "unresolved identifier");
+	if (is_function_type(vinfo->type)) {
+		throw codegen_ir_unsupported(lineno, "function address used as value");
+	}
+	if (vinfo->is_global) return lower_address(gv_base_value(ls), vinfo->offset, vinfo);
+	auto itr = ls.frame_offsets.find(vinfo);
+	if (itr == ls.frame_offsets.end()) {
+		throw codegen_ir_unsupported(lineno, "address of register variable requested");
+	}
+	ir_inst inst(IR_FRAME_ADDR, ls.fn.new_value(), lineno);
+	inst.imm = itr->second;
+	return lower_address(emit(ls, inst), 0, vinfo);
+}
+
+// 整数の値にポインタ用の係数を掛ける
+static int scale_index(lower_status& ls, int value, int mult, int lineno) {
+	if (mult == 1) return value;
+	int two_pow = get_two_pow_num(mult);
+	if (two_pow > 0) return emit_value(ls, IR_SHL, lineno, value, emit_const(ls, two_pow, lineno));
+	return emit_value(ls, IR_MUL, lineno, value, emit_const(ls, mult, lineno));
+}
+
+// ポインタの値を求める (定数のオフセットは分けておく)
+static lower_address lower_pointer(lower_status& ls, expression_node* expr, int lineno) {
+	if (expr->kind == EXPR_IDENTIFIER) return variable_address(ls, expr, lineno);
+	if (expr->kind == EXPR_OPERATOR) {
+		expression_node* operand0 = expr->info.op.operands[0];
+		switch (expr->info.op.kind) {
+		case OP_NONE: case OP_PARENTHESIS:
+		case OP_ADDRESS: case OP_INDIRECTION: // 状態を変えるだけ
+		case OP_ARRAY_TO_POINTER: // 配列のアドレスと先頭要素のアドレスは同じ
+			return lower_pointer(ls, operand0, lineno);
+		case OP_ARRAY_REF: case OP_ADD:
+			{
+				expression_node* operand1 = expr->info.op.operands[1];
+				expression_node* ptr = is_pointer_type(operand0->type) ? operand0 : operand1;
+				expression_node* index = ptr == operand0 ? operand1 : operand0;
+				if (is_pointer_type(ptr->type) && index->kind == EXPR_INTEGER_LITERAL) {
+					lower_address addr = lower_pointer(ls, ptr, lineno);
+					addr.offset += index->info.value * pointer_mult(ptr->type);
+					return addr;
+				}
+				if (is_pointer_type(ptr->type)) {
+					// 添字が変数でも、指す先は元の変数の中にある
+					lower_address addr;
+					int base = -1, value = -1;
+					if (ptr == operand0) {
+						addr = lower_pointer(ls, ptr, lineno);
+						base = address_value(ls, addr, lineno);
+						value = lower_expr(ls, index, lineno);
+					} else {
+						value = lower_expr(ls, index, lineno);
+						addr = lower_pointer(ls, ptr, lineno);
+						base = address_value(ls, addr, lineno);
+					}
+					int scaled = scale_index(ls, value, pointer_mult(ptr->type), lineno);
+					return lower_address(emit_value(ls, IR_ADD, lineno, base, scaled), 0, addr.object);
+				}
+			}
+			break;
+		case OP_SUB:
+			{
+				expression_node* operand1 = expr->info.op.operands[1];
+				if (is_pointer_type(operand0->type) && operand1->kind == EXPR_INTEGER_LITERAL) {
+					lower_address addr = lower_pointer(ls, operand0, lineno);
+					addr.offset -= operand1->info.value * pointer_mult(operand0->type);
+					return addr;
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return lower_address(lower_expr(ls, expr, lineno), 0);
+}
+
+static lower_lvalue lower_lvalue_expr(lower_status& ls, expression_node* expr, int lineno) {
+	while (expr->kind == EXPR_OPERATOR &&
+	(expr->info.op.kind == OP_PARENTHESIS || expr->info.op.kind == OP_NONE)) {
+		expr = expr->info.op.operands[0];
+	}
+	lower_lvalue lv;
+	lv.type = expr->type;
+	lv.var = -1;
+	if (expr->kind == EXPR_IDENTIFIER && expr->info.ident.info != nullptr) {
+		auto itr = ls.var_ids.find(expr->info.ident.info);
+		if (itr != ls.var_ids.end()) {
+			lv.var = itr->second;
+			lv.type = expr->info.ident.info->type;
+			return lv;
+		}
+	}
+	lv.addr = lower_pointer(ls, expr, lineno);
+	return lv;
+}
+
+static int read_lvalue(lower_status& ls, const lower_lvalue& lv, int lineno) {
+	if (lv.var >= 0) return read_var(ls, lv.var);
+	ir_inst inst(IR_LOAD, ls.fn.new_value(), lineno);
+	inst.args.push_back(lv.addr.base);
+	inst.imm = lv.addr.offset;
+	inst.size = lv.type->size;
+	inst.is_signed = is_signed_integer(lv.type) && lv.type->size < 4;
+	inst.object = lv.addr.object;
+	return emit(ls, inst);
+}
+
+// 代入先に値を書き込み、代入式の値 (代入先の型に拡張した値) を返す
+static int write_lvalue(lower_status& ls, const lower_lvalue& lv, int value, int lineno) {
+	if (lv.var >= 0) {
+		int extended = extend_to_type(ls, value, lv.type, lineno);
+		write_var(ls, lv.var, extended);
+		return extended;
+	}
+	ir_inst inst(IR_STORE, -1, lineno);
+	inst.args.push_back(lv.addr.base);
+	inst.args.push_back(value);
+	inst.imm = lv.addr.offset;
+	inst.size = lv.type->size;
+	inst.object = lv.addr.object;
+	emit(ls, inst);
+	return extend_to_type(ls, value, lv.type, lineno);
+}
+
+// 比較演算子の条件 (左辺 条件 右辺 の時に真)
+static jcc_cond compare_cond(expression_node* expr) {
+	expression_node* operand0 = expr->info.op.operands[0];
+	expression_node* operand1 = expr->info.op.operands[1];
+	bool is_signed = false;
+	if (is_arithmetic_type(operand0->type) && is_arithmetic_type(operand1->type)) {
+		is_signed = is_signed_integer(usual_arithmetic_conversion(operand0->type, operand1->type));
+	}
+	switch (expr->info.op.kind) {
+	case OP_LESS: return is_signed ? L_SIGN : L_UNSIGN;
+	case OP_GREATER: return is_signed ? G_SIGN : G_UNSIGN;
+	case OP_LESS_EQUAL: return is_signed ? LE_SIGN : LE_UNSIGN;
+	case OP_GREATER_EQUAL: return is_signed ? GE_SIGN : GE_UNSIGN;
+	case OP_EQUAL: return EQ;
+	default: return NEQ;
+	}
+}
+
+static bool is_comparison(expression_node* expr) {
+	if (expr->kind != EXPR_OPERATOR) return false;
+	switch (expr->info.op.kind) {
+	case OP_LESS: case OP_GREATER: case OP_LESS_EQUAL: case OP_GREATER_EQUAL:
+	case OP_EQUAL: case OP_NOT_EQUAL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// 条件が真ならtrue_block、偽ならfalse_blockに分岐する
+static void lower_cond(lower_status& ls, expression_node* expr, int true_block, int false_block, int lineno) {
+	if (expr->kind == EXPR_INTEGER_LITERAL) {
+		ensure_block(ls);
+		jump_to(ls, expr->info.value != 0 ? true_block : false_block, lineno);
+		return;
+	}
+	if (expr->kind == EXPR_OPERATOR) {
+		expression_node** operands = expr->info.op.operands;
+		switch (expr->info.op.kind) {
+		case OP_NONE: case OP_PARENTHESIS:
+		case OP_ADDRESS: case OP_INDIRECTION:
+		case OP_ARRAY_TO_POINTER: case OP_FUNC_TO_FPTR:
+		case OP_PLUS: case OP_NEG: // 0か0でないかは変わらない
+			lower_cond(ls, operands[0], true_block, false_block, lineno);
+			return;
+		case OP_LNOT:
+			lower_cond(ls, operands[0], false_block, true_block, lineno);
+			return;
+		case OP_LESS: case OP_GREATER: case OP_LESS_EQUAL: case OP_GREATER_EQUAL:
+		case OP_EQUAL: case OP_NOT_EQUAL:
+			{
+				int a = lower_expr(ls, operands[0], lineno);
+				int b = lower_expr(ls, operands[1], lineno);
+				branch_to(ls, compare_cond(expr), a, b, true_block, false_block, lineno);
+			}
+			return;
+		case OP_LAND: case OP_LOR:
+			{
+				int middle = new_block(ls);
+				if (expr->info.op.kind == OP_LAND) {
+					lower_cond(ls, operands[0], middle, false_block, lineno);
+				} else {
+					lower_cond(ls, operands[0], true_block, middle, lineno);
+				}
+				seal_block(ls, middle);
+				start_block(ls, middle);
+				lower_cond(ls, operands[1], true_block, false_block, lineno);
+			}
+			return;
+		case OP_COND:
+			{
+				int cond_true = new_block(ls), cond_false = new_block(ls);
+				lower_cond(ls, operands[0], cond_true, cond_false, lineno);
+				seal_block(ls, cond_true);
+				start_block(ls, cond_true);
+				lower_cond(ls, operands[1], true_block, false_block, lineno);
+				seal_block(ls, cond_false);
+				start_block(ls, cond_false);
+				lower_cond(ls, operands[2], true_block, false_block, lineno);
+			}
+			return;
+		default:
+			break;
+		}
+	}
+	int value = lower_expr(ls, expr, lineno);
+	branch_to(ls, NEQ, value, emit_const(ls, 0, lineno), true_block, false_block, lineno);
+}
+
+// 条件が真なら1、偽なら0になる値を、分岐を用いて求める
+static int lower_bool_by_branch(lower_status& ls, expression_node* expr, int lineno) {
+	int var = new_temp_var(ls);
+	int true_block = new_block(ls), false_block = new_block(ls), join_block = new_block(ls);
+	lower_cond(ls, expr, true_block, false_block, lineno);
+	seal_block(ls, true_block);
+	start_block(ls, true_block);
+	write_var(ls, var, emit_const(ls, 1, lineno));
+	jump_to(ls, join_block, lineno);
+	seal_block(ls, false_block);
+	start_block(ls, false_block);
+	write_var(ls, var, emit_const(ls, 0, lineno));
+	jump_to(ls, join_block, lineno);
+	seal_block(ls, join_block);
+	start_block(ls, join_block);
+	return read_var(ls, var);
+}
+
+static int lower_setcc(lower_status& ls, jcc_cond cond, int a, int b, int lineno) {
+	ir_inst inst(IR_SETCC, ls.fn.new_value(), lineno);
+	inst.cond = cond;
+	inst.args.push_back(a);
+	inst.args.push_back(b);
+	return emit(ls, inst);
+}
+
+static int lower_divmod(lower_status& ls, bool want_remainder, bool is_signed, type_node* dividend_type,
+int a, int b, int lineno) {
+	ir_inst inst(want_remainder ? IR_MOD : IR_DIV, ls.fn.new_value(), lineno);
+	inst.args.push_back(a);
+	inst.args.push_back(b);
+	inst.is_signed = is_signed;
+	inst.type = dividend_type;
+	return emit(ls, inst);
+}
+
+// 呼び出す関数を直接指定できる場合、その名前を返す
+static const char* direct_call_name(expression_node* expr) {
+	while (expr->kind == EXPR_OPERATOR) {
+		switch (expr->info.op.kind) {
+		case OP_NONE: case OP_PARENTHESIS: case OP_ADDRESS: case OP_INDIRECTION: case OP_FUNC_TO_FPTR:
+			expr = expr->info.op.operands[0];
+			break;
+		default:
+			return nullptr;
+		}
+	}
+	if (expr->kind == EXPR_IDENTIFIER && expr->info.ident.info != nullptr &&
+	expr->info.ident.info->is_global && is_function_type(expr->info.ident.info->type)) {
+		return expr->info.ident.name;
+	}
+	return nullptr;
+}
+
+// 複合代入の演算を行う
+static int lower_compound_op(lower_status& ls, expression_node* expr, int old_value, int lineno) {
+	expression_node* operand0 = expr->info.op.operands[0];
+	expression_node* operand1 = expr->info.op.operands[1];
+	operator_type kind = expr->info.op.kind;
+	int rhs;
+	if (operand1->kind == EXPR_INTEGER_LITERAL &&
+	(kind == OP_ADD_ASSIGN || kind == OP_SUB_ASSIGN || kind == OP_SHL_ASSIGN || kind == OP_SHR_ASSIGN)) {
+		uint32_t value = operand1->info.value;
+		if (kind == OP_SHL_ASSIGN || kind == OP_SHR_ASSIGN) value &= 31;
+		else value *= pointer_mult(operand0->type);
+		rhs = emit_const(ls, value, lineno);
+	} else {
+		rhs = lower_expr(ls, operand1, lineno);
+		if (kind == OP_ADD_ASSIGN || kind == OP_SUB_ASSIGN) {
+			rhs = scale_index(ls, rhs, pointer_mult(operand0->type), lineno);
+		}
+	}
+	switch (kind) {
+	case OP_ADD_ASSIGN: return emit_value(ls, IR_ADD, lineno, old_value, rhs);
+	case OP_SUB_ASSIGN: return emit_value(ls, IR_SUB, lineno, old_value, rhs);
+	case OP_MUL_ASSIGN: return emit_value(ls, IR_MUL, lineno, old_value, rhs);
+	case OP_AND_ASSIGN: return emit_value(ls, IR_AND, lineno, old_value, rhs);
+	case OP_OR_ASSIGN: return emit_value(ls, IR_OR, lineno, old_value, rhs);
+	case OP_XOR_ASSIGN: return emit_value(ls, IR_XOR, lineno, old_value, rhs);
+	case OP_SHL_ASSIGN: return emit_value(ls, IR_SHL, lineno, old_value, rhs);
+	case OP_SHR_ASSIGN:
+		return emit_value(ls, is_signed_integer(operand0->type) ? IR_ASR : IR_SHR, lineno, old_value, rhs);
+	case OP_DIV_ASSIGN: case OP_MOD_ASSIGN:
+		return lower_divmod(ls, kind == OP_MOD_ASSIGN,
+			is_signed_integer(usual_arithmetic_conversion(operand0->type, operand1->type)),
+			operand0->type, old_value, rhs, lineno);
+	default:
+		throw codegen_error(lineno, "unexpected operator kind");
+	}
+}
+
+// 式の値を求める (値が無ければ負の数を返す)
+static int lower_expr(lower_status& ls, expression_node* expr, int lineno) {
+	switch (expr->kind) {
+	case EXPR_INTEGER_LITERAL:
+		return emit_const(ls, expr->info.value, lineno);
+	case EXPR_IDENTIFIER:
+		return address_value(ls, variable_address(ls, expr, lineno), lineno);
+	case EXPR_OPERATOR:
+		break;
+	}
+	expression_node** operands = expr->info.op.operands;
+	switch (expr->info.op.kind) {
+	case OP_NONE: case OP_PARENTHESIS: case OP_PLUS:
+		return lower_expr(ls, operands[0], lineno);
+	case OP_ADDRESS: case OP_INDIRECTION: case OP_ARRAY_TO_POINTER: case OP_FUNC_TO_FPTR:
+		return address_value(ls, lower_pointer(ls, expr, lineno), lineno);
+	case OP_READ_VALUE:
+		return read_lvalue(ls, lower_lvalue_expr(ls, operands[0], lineno), lineno);
+	case OP_SIZEOF:
+		if (expr->type == nullptr) throw codegen_error(lineno, "size of null type requested");
+		return emit_const(ls, expr->type->size, lineno);
+	case OP_NEG:
+		return emit_value(ls, IR_NEG, lineno, lower_expr(ls, operands[0], lineno));
+	case OP_NOT:
+		return emit_value(ls, IR_NOT, lineno, lower_expr(ls, operands[0], lineno));
+	case OP_CAST:
+		{
+			int value = lower_expr(ls, operands[0], lineno);
+			type_node* type = expr->info.op.cast_to;
+			if (value < 0 || type == nullptr || type->size >= 4 || is_void_type(type)) return value;
+			ir_inst inst(IR_EXT, ls.fn.new_value(), lineno);
+			inst.args.push_back(value);
+			inst.size = type->size;
+			inst.is_signed = is_signed_integer(type);
+			return emit(ls, inst);
+		}
+	case OP_LNOT:
+		if (is_comparison(operands[0]) || operands[0]->kind != EXPR_OPERATOR ||
+		(operands[0]->info.op.kind != OP_LAND && operands[0]->info.op.kind != OP_LOR)) {
+			if (is_comparison(operands[0])) {
+				expression_node* cmp = operands[0];
+				int a = lower_expr(ls, cmp->info.op.operands[0], lineno);
+				int b = lower_expr(ls, cmp->info.op.operands[1], lineno);
+				return lower_setcc(ls, ir_invert_cond(compare_cond(cmp)), a, b, lineno);
+			}
+			int value = lower_expr(ls, operands[0], lineno);
+			return lower_setcc(ls, EQ, value, emit_const(ls, 0, lineno), lineno);
+		}
+		return lower_bool_by_branch(ls, expr, lineno);
+	case OP_LESS: case OP_GREATER: case OP_LESS_EQUAL: case OP_GREATER_EQUAL:
+	case OP_EQUAL: case OP_NOT_EQUAL:
+		{
+			int a = lower_expr(ls, operands[0], lineno);
+			int b = lower_expr(ls, operands[1], lineno);
+			return lower_setcc(ls, compare_cond(expr), a, b, lineno);
+		}
+	case OP_LAND: case OP_LOR:
+		return lower_bool_by_branch(ls, expr, lineno);
+	case OP_ARRAY_REF: case OP_ADD:
+		{
+			expression_node* ptr = is_pointer_type(operands[1]->type) ? operands[1] : operands[0];
+			expression_node* index = ptr == operands[0] ? operands[1] : operands[0];
+			if (is_pointer_type(ptr->type)) {
+				if (index->kind == EXPR_INTEGER_LITERAL) {
+					return address_value(ls, lower_pointer(ls, expr, lineno), lineno);
+				}
+				int a = lower_expr(ls, operands[0], lineno);
+				int b = lower_expr(ls, operands[1], lineno);
+				int scaled = scale_index(ls, ptr == operands[0] ? b : a, pointer_mult(ptr->type), lineno);
+				return emit_value(ls, IR_ADD, lineno, ptr == operands[0] ? a : b, scaled);
+			}
+			int a = lower_expr(ls, operands[0], lineno);
+			int b = lower_expr(ls, operands[1], lineno);
+			return emit_value(ls, IR_ADD, lineno, a, b);
+		}
+	case OP_SUB:
+		{
+			if (is_pointer_type(operands[0]->type) && operands[1]->kind == EXPR_INTEGER_LITERAL) {
+				return address_value(ls, lower_pointer(ls, expr, lineno), lineno);
+			}
+			int a = lower_expr(ls, operands[0], lineno);
+			int b = lower_expr(ls, operands[1], lineno);
+			int mult = pointer_mult(operands[0]->type);
+			if (is_pointer_type(operands[1]->type)) {
+				// ポインタ同士の引き算は、要素サイズで割る (差は要素サイズの倍数なので、2の累乗ならシフトでよい)
+				int diff = emit_value(ls, IR_SUB, lineno, a, b);
+				if (mult <= 1) return diff;
+				int two_pow = get_two_pow_num(mult);
+				if (two_pow < 0) return lower_divmod(ls, false, true, expr->type, diff, emit_const(ls, mult, lineno), lineno);
+				return emit_value(ls, IR_ASR, lineno, diff, emit_const(ls, two_pow, lineno));
+			}
+			return emit_value(ls, IR_SUB, lineno, a, scale_index(ls, b, mult, lineno));
+		}
+	case OP_SHL: case OP_SHR:
+		{
+			int a = lower_expr(ls, operands[0], lineno);
+			int b = operands[1]->kind == EXPR_INTEGER_LITERAL ?
+				emit_const(ls, operands[1]->info.value & 31, lineno) : lower_expr(ls, operands[1], lineno);
+			ir_opcode op = expr->info.op.kind == OP_SHL ? IR_SHL :
+				is_signed_integer(expr->type) ? IR_ASR : IR_SHR;
+			return emit_value(ls, op, lineno, a, b);
+		}
+	case OP_MUL: case OP_AND: case OP_XOR: case OP_OR:
+		{
+			int a = lower_expr(ls, operands[0], lineno);
+			int b = lower_expr(ls, operands[1], lineno);
+			ir_opcode op = expr->info.op.kind == OP_MUL ? IR_MUL : expr->info.op.kind == OP_AND ? IR_AND :
+				expr->info.op.kind == OP_XOR ? IR_XOR : IR_OR;
+			return emit_value(ls, op, lineno, a, b);
+		}
+	case OP_DIV: case OP_MOD:
+		{
+			int a = lower_expr(ls, operands[0], lineno);
+			int b = lower_expr(ls, operands[1], lineno);
+			return lower_divmod(ls, expr->info.op.kind == OP_MOD, is_signed_integer(expr->type),
+				operands[0]->type, a, b, lineno);
+		}
+	case OP_ASSIGN:
+		{
+			lower_lvalue lv = lower_lvalue_expr(ls, operands[0], lineno);
+			int value = lower_expr(ls, operands[1], lineno);
+			return write_lvalue(ls, lv, value, lineno);
+		}
+	case OP_MUL_ASSIGN: case OP_DIV_ASSIGN: case OP_MOD_ASSIGN: case OP_ADD_ASSIGN: case OP_SUB_ASSIGN:
+	case OP_SHL_ASSIGN: case OP_SHR_ASSIGN: case OP_AND_ASSIGN: case OP_XOR_ASSIGN: case OP_OR_ASSIGN:
+		{
+			lower_lvalue lv = lower_lvalue_expr(ls, operands[0], lineno);
+			int old_value = read_lvalue(ls, lv, lineno);
+			int new_value = lower_compound_op(ls, expr, old_value, lineno);
+			return write_lvalue(ls, lv, new_value, lineno);
+		}
+	case OP_PRE_INC: case OP_PRE_DEC: case OP_POST_INC: case OP_POST_DEC:
+		{
+			operator_type kind = expr->info.op.kind;
+			lower_lvalue lv = lower_lvalue_expr(ls, operands[0], lineno);
+			int old_value = read_lvalue(ls, lv, lineno);
+			int step = emit_const(ls, pointer_mult(operands[0]->type), lineno);
+			int new_value = emit_value(ls, kind == OP_PRE_INC || kind == OP_POST_INC ? IR_ADD : IR_SUB,
+				lineno, old_value, step);
+			int written = write_lvalue(ls, lv, new_value, lineno);
+			return kind == OP_PRE_INC || kind == OP_PRE_DEC ? written : old_value;
+		}
+	case OP_COMMA:
+		lower_expr(ls, operands[0], lineno);
+		return lower_expr(ls, operands[1], lineno);
+	case OP_COND:
+		{
+			bool has_value = expr->type != nullptr && !is_void_type(expr->type);
+			int var = new_temp_var(ls);
+			int true_block = new_block(ls), false_block = new_block(ls), join_block = new_block(ls);
+			lower_cond(ls, operands[0], true_block, false_block, lineno);
+			seal_block(ls, true_block);
+			start_block(ls, true_block);
+			int true_value = lower_expr(ls, operands[1], lineno);
+			if (has_value) write_var(ls, var, true_value);
+			jump_to(ls, join_block, lineno);
+			seal_block(ls, false_block);
+			start_block(ls, false_block);
+			int false_value = lower_expr(ls, operands[2], lineno);
+			if (has_value) write_var(ls, var, false_value);
+			jump_to(ls, join_block, lineno);
+			seal_block(ls, join_block);
+			start_block(ls, join_block);
+			return has_value ? read_var(ls, var) : -1;
+		}
+	case OP_FUNC_CALL_NOARGS: case OP_FUNC_CALL:
+		{
+			if (expr->info.op.argument_num > 4) {
+				throw codegen_error(lineno, "unsupported function call (too many arguments)");
+			}
+			ir_inst inst(IR_CALL, -1, lineno);
+			const char* name = direct_call_name(operands[0]);
+			if (name != nullptr) {
+				inst.name = name;
+			} else {
+				inst.args.push_back(lower_expr(ls, operands[0], lineno));
+			}
+			for (int i = 0; i < expr->info.op.argument_num; i++) {
+				inst.args.push_back(lower_expr(ls, expr->info.op.arguments[i], lineno));
+			}
+			inst.dest = ls.fn.new_value();
+			return emit(ls, inst);
+		}
+	default:
+		throw codegen_error(lineno, "unsupported or invalid operator");
+	}
+}
+
+// スタックに置く変数の位置を決める (codegen_register_variable()と同じ規則で詰める)
+static void place_on_frame(lower_status& ls, var_info* vinfo, int size) {
+	int& offset = ls.mem_offset.back();
+	if (offset % vinfo->type->align != 0) offset += vinfo->type->align - (offset % vinfo->type->align);
+	ls.frame_offsets[vinfo] = offset;
+	offset += size;
+	if (ls.fn.frame_size < offset) ls.fn.frame_size = offset;
+}
+
+static int label_block(lower_status& ls, int label_id) {
+	auto itr = ls.label_blocks.find(label_id);
+	if (itr != ls.label_blocks.end()) return itr->second;
+	int block = new_block(ls);
+	ls.label_blocks[label_id] = block;
+	return block;
+}
+
+// switch文の分岐先のブロック (caseの無い値はdefault_blockに進む)
+static int switch_target_block(lower_status& ls, int label_id, int default_block) {
+	return label_id < 0 ? default_block : label_block(ls, label_id);
+}
+
+// plan.segments[first, last) を調べて分岐し、どれにも当たらなければdefault_blockに進む
+static void lower_switch_segments(lower_status& ls, const switch_plan& plan, int value,
+size_t first, size_t last, int default_block, int lineno) {
+	int split = codegen_switch_split_point(plan, first, last);
+	if (split >= 0) {
+		int lower_block = new_block(ls), upper_block = new_block(ls);
+		branch_to(ls, GE_UNSIGN, value, emit_const(ls, plan.segments[split].low, lineno),
+			upper_block, lower_block, lineno);
+		seal_block(ls, lower_block);
+		seal_block(ls, upper_block);
+		start_block(ls, lower_block);
+		lower_switch_segments(ls, plan, value, first, split, default_block, lineno);
+		start_block(ls, upper_block);
+		lower_switch_segments(ls, plan, value, split, last, default_block, lineno);
+		return;
+	}
+	for (size_t i = first; i < last; i++) {
+		const switch_segment& seg = plan.segments[i];
+		int next_block = i + 1 == last ? default_block : new_block(ls);
+		if (seg.kind == SWITCH_SEG_CASE) {
+			branch_to(ls, EQ, value, emit_const(ls, seg.low, lineno),
+				switch_target_block(ls, seg.labels[0], default_block), next_block, lineno);
+		} else {
+			// 値 - low が範囲の幅以下なら区間の中
+			int offset = seg.low == 0 ? value : emit_value(ls, IR_SUB, lineno, value, emit_const(ls, seg.low, lineno));
+			int span = emit_const(ls, seg.high - seg.low, lineno);
+			if (seg.kind == SWITCH_SEG_RANGE) {
+				branch_to(ls, LE_UNSIGN, offset, span,
+					switch_target_block(ls, seg.labels[0], default_block), next_block, lineno);
+			} else {
+				int inside_block = new_block(ls);
+				branch_to(ls, LE_UNSIGN, offset, span, inside_block, next_block, lineno);
+				seal_block(ls, inside_block);
+				start_block(ls, inside_block);
+				if (seg.kind == SWITCH_SEG_TABLE) {
+					ir_inst inst(IR_SWITCH, -1, lineno);
+					inst.args.push_back(offset);
+					emit(ls, inst);
+					std::map<int, int> succ_index;
+					for (auto itr = seg.labels.begin(); itr != seg.labels.end(); itr++) {
+						int target = switch_target_block(ls, *itr, default_block);
+						if (succ_index.find(target) == succ_index.end()) {
+							succ_index[target] = ls.fn.blocks[ls.cur].succs.size();
+							add_edge(ls, ls.cur, target);
+						}
+						ls.fn.blocks[ls.cur].insts.back().targets.push_back(succ_index[target]);
+					}
+					ls.cur = -1;
+				} else {
+					// 1を (値 - low) だけシフトし、分岐先ごとのビットの集合と重なるかを調べる
+					int bit = emit_value(ls, IR_SHL, lineno, emit_const(ls, 1, lineno), offset);
+					for (size_t b = 0; b < seg.bits.size(); b++) {
+						int miss_block = b + 1 == seg.bits.size() ? next_block : new_block(ls);
+						int masked = emit_value(ls, IR_AND, lineno, bit, emit_const(ls, seg.bits[b].second, lineno));
+						branch_to(ls, NEQ, masked, emit_const(ls, 0, lineno),
+							switch_target_block(ls, seg.bits[b].first, default_block), miss_block, lineno);
+						if (miss_block != next_block) {
+							seal_block(ls, miss_block);
+							start_block(ls, miss_block);
+						}
+					}
+				}
+			}
+		}
+		if (next_block != default_block) {
+			seal_block(ls, next_block);
+			start_block(ls, next_block);
+		}
+	}
+}
+
+// 全てのcaseで同じ変数に定数を代入するか定数をreturnするswitch文を、表引きにする
+// 表引きにできない、または普通に分岐するほうが得な場合はfalseを返す
+static bool lower_switch_lookup(lower_status& ls, ast_node* ast, int value, int end_block, int lineno) {
+	// 配置先が4バイト境界でなければ、PC相対のアドレス計算が合わない
+	if (ls.status.base_address % 4 != 0) return false;
+	switch_lookup lk;
+	if (!codegen_plan_switch_lookup(ast, lk, ls.status)) return false;
+	bool to_register = !lk.is_return && ls.var_ids.find(lk.vinfo) != ls.var_ids.end();
+	int default_label = ast->d.switch_d.info->default_label;
+	if (!codegen_switch_lookup_pays(ast, lk, default_label, 2, !lk.is_return && !to_register)) return false;
+	// 表の値は代入先の型に拡張済みなので、そのまま代入するかreturnする
+	auto put_result = [&](int result) {
+		if (lk.is_return) {
+			ir_inst inst(IR_RETURN, -1, lineno);
+			inst.args.push_back(result);
+			emit(ls, inst);
+			ls.cur = -1;
+			return;
+		}
+		lower_lvalue lv = lower_lvalue_expr(ls, lk.target, lineno);
+		if (lv.var >= 0) write_var(ls, lv.var, result);
+		else write_lvalue(ls, lv, result, lineno);
+		jump_to(ls, end_block, lineno);
+	};
+	// 範囲外ならdefaultの処理に進む
+	int offset = lk.low == 0 ? value : emit_value(ls, IR_SUB, lineno, value, emit_const(ls, lk.low, lineno));
+	int inside_block = new_block(ls);
+	int default_block = lk.default_exists ? new_block(ls) : end_block;
+	branch_to(ls, LE_UNSIGN, offset, emit_const(ls, lk.table.size() - 1, lineno), inside_block, default_block, lineno);
+	seal_block(ls, inside_block);
+	start_block(ls, inside_block);
+	ir_inst load(IR_TABLE_LOAD, ls.fn.new_value(), lineno);
+	load.args.push_back(offset);
+	load.table = lk.table;
+	load.size = lk.element_size;
+	load.is_signed = lk.element_signed;
+	put_result(emit(ls, load));
+	if (lk.default_exists) {
+		seal_block(ls, default_block);
+		start_block(ls, default_block);
+		put_result(emit_const(ls, lk.default_value, lineno));
+	}
+	return true;
+}
+
+static void lower_statement(lower_status& ls, ast_node* ast);
+
+// ループ本体・条件式などを変換する
+// loop_block : 本体の先頭、cond_block : 条件式の先頭、continue_block : continueの飛び先
+static void lower_loop_cond(lower_status& ls, expression_node* cond, int loop_block, int break_block, int lineno) {
+	if (cond != nullptr) {
+		lower_cond(ls, cond, loop_block, break_block, lineno);
+	} else {
+		jump_to(ls, loop_block, lineno);
+	}
+}
+
+// 文を中間表現にする
+static void lower_statement(lower_status& ls, ast_node* ast) {
+	int lineno = ast->lineno;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		ls.mem_offset.push_back(ls.mem_offset.back());
+		ls.pragma_loop_bound = -1;
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			lower_statement(ls, ast->d.array.nodes[i]);
+			if (ast->d.array.nodes[i]->kind != NODE_PRAGMA) ls.pragma_loop_bound = -1;
+		}
+		ls.mem_offset.pop_back();
+		break;
+	case NODE_VAR_DEFINE:
+		{
+			if (ast->d.var_def.initializer != nullptr) {
+				throw codegen_error(lineno, "variable initialization not supported yet");
+			}
+			var_info* vinfo = ast->d.var_def.info;
+			if (is_ssa_variable(vinfo)) {
+				if (ls.var_ids.find(vinfo) == ls.var_ids.end()) ls.var_ids[vinfo] = ls.num_vars++;
+			} else {
+				place_on_frame(ls, vinfo, vinfo->type->size);
+			}
+		}
+		break;
+	case NODE_EXPR:
+		lower_expr(ls, ast->d.expr.expression, lineno);
+		break;
+	case NODE_EMPTY:
+		break;
+	case NODE_PRAGMA:
+		{
+			size_t token_num = ast->d.array.num;
+			ast_node** tokens = ast->d.array.nodes;
+			if (token_num >= 1 && tokens[0]->kind == NODE_CONTROL_IDENTIFIER &&
+			std::string(tokens[0]->d.identifier.name) == "loop_bound") {
+				if (token_num < 2 || tokens[1]->kind != NODE_CONTROL_INTEGER) {
+					throw codegen_error(lineno, "invalid loop bound specification");
+				}
+				uint32_t bound = tokens[1]->d.integer.value;
+				ls.pragma_loop_bound = bound > INT_MAX ? INT_MAX : bound;
+			}
+		}
+		break;
+	case NODE_LABEL:
+		{
+			auto itr = ls.status.goto_labels.find(ast->d.label.name);
+			if (itr == ls.status.goto_labels.end()) {
+				throw codegen_error(lineno, std::string("unknown label") + ast->d.label.name);
+			}
+			enter_block(ls, label_block(ls, itr->second), lineno);
+			lower_statement(ls, ast->d.label.statement);
+		}
+		break;
+	case NODE_IF:
+		{
+			int true_block = new_block(ls), false_block = new_block(ls);
+			int end_block = ast->d.if_d.false_statement != nullptr ? new_block(ls) : false_block;
+			lower_cond(ls, ast->d.if_d.cond, true_block, false_block, lineno);
+			seal_block(ls, true_block);
+			start_block(ls, true_block);
+			lower_statement(ls, ast->d.if_d.true_statement);
+			if (ast->d.if_d.false_statement != nullptr) {
+				jump_to(ls, end_block, lineno);
+				seal_block(ls, false_block);
+				start_block(ls, false_block);
+				lower_statement(ls, ast->d.if_d.false_statement);
+			}
+			enter_block(ls, end_block, lineno);
+			seal_block(ls, end_block);
+		}
+		break;
+	case NODE_SWITCH:
+		{
+			int value = lower_expr(ls, ast->d.switch_d.expr, lineno);
+			switch_info* info = ast->d.switch_d.info;
+			int end_block = new_block(ls);
+			if (lower_switch_lookup(ls, ast, value, end_block, lineno)) {
+				enter_block(ls, end_block, lineno);
+				seal_block(ls, end_block);
+				break;
+			}
+			int default_block = info->default_label >= 0 ? label_block(ls, info->default_label) : end_block;
+			// caseの値を区間に分けて調べ、分岐する
+			switch_plan plan = codegen_plan_switch(info->case_labels, info->default_label, 2, true);
+			lower_switch_segments(ls, plan, value, 0, plan.segments.size(), default_block, lineno);
+			jump_to(ls, default_block, lineno);
+			ls.break_blocks.push_back(end_block);
+			lower_statement(ls, ast->d.switch_d.statement);
+			ls.break_blocks.pop_back();
+			enter_block(ls, end_block, lineno);
+			seal_block(ls, end_block);
+		}
+		break;
+	case NODE_CASE: case NODE_DEFAULT:
+		{
+			switch_label_info* info = ast->kind == NODE_CASE ? ast->d.case_d.info : ast->d.default_d.info;
+			int block = label_block(ls, info->label_id);
+			enter_block(ls, block, lineno);
+			seal_block(ls, block);
+			lower_statement(ls, ast->kind == NODE_CASE ? ast->d.case_d.statement : ast->d.default_d.statement);
+		}
+		break;
+	case NODE_WHILE:
+	case NODE_DO_WHILE:
+		{
+			long long loop_bound = ls.pragma_loop_bound;
+			ls.pragma_loop_bound = -1;
+			// do-whileでは、最初の1回は後方ジャンプを通らない
+			if (ast->kind == NODE_DO_WHILE && loop_bound > 0) loop_bound--;
+			int loop_block = new_block(ls), cond_block = new_block(ls), break_block = new_block(ls);
+			ls.fn.blocks[loop_block].loop_bound = static_cast<int>(loop_bound);
+			if (ast->kind == NODE_WHILE) jump_to(ls, cond_block, lineno);
+			enter_block(ls, loop_block, lineno);
+			ls.continue_blocks.push_back(cond_block);
+			ls.break_blocks.push_back(break_block);
+			lower_statement(ls, ast->d.while_d.statement);
+			ls.continue_blocks.pop_back();
+			ls.break_blocks.pop_back();
+			enter_block(ls, cond_block, lineno);
+			seal_block(ls, cond_block);
+			lower_loop_cond(ls, ast->d.while_d.cond, loop_block, break_block, lineno);
+			seal_block(ls, loop_block);
+			seal_block(ls, break_block);
+			start_block(ls, break_block);
+		}
+		break;
+	case NODE_FOR:
+		{
+			long long loop_bound = ls.pragma_loop_bound;
+			ls.pragma_loop_bound = -1;
+			if (loop_bound < 0) loop_bound = get_for_loop_count(ast);
+			if (loop_bound > INT_MAX) loop_bound = INT_MAX;
+			long long loop_min = get_for_loop_min_count(ast);
+			if (loop_min > loop_bound) loop_min = loop_bound;
+			ls.mem_offset.push_back(ls.mem_offset.back());
+			if (ast->d.for_d.init != nullptr) lower_statement(ls, ast->d.for_d.init);
+			int loop_block = new_block(ls), continue_block = new_block(ls);
+			int cond_block = new_block(ls), break_block = new_block(ls);
+			ls.fn.blocks[loop_block].loop_bound = static_cast<int>(loop_bound);
+			ls.fn.blocks[loop_block].loop_min = static_cast<int>(loop_min);
+			jump_to(ls, cond_block, lineno);
+			start_block(ls, loop_block);
+			ls.continue_blocks.push_back(continue_block);
+			ls.break_blocks.push_back(break_block);
+			lower_statement(ls, ast->d.for_d.body);
+			ls.continue_blocks.pop_back();
+			ls.break_blocks.pop_back();
+			enter_block(ls, continue_block, lineno);
+			seal_block(ls, continue_block);
+			if (ast->d.for_d.post != nullptr) lower_expr(ls, ast->d.for_d.post, lineno);
+			enter_block(ls, cond_block, lineno);
+			seal_block(ls, cond_block);
+			lower_loop_cond(ls, ast->d.for_d.cond, loop_block, break_block, lineno);
+			seal_block(ls, loop_block);
+			seal_block(ls, break_block);
+			start_block(ls, break_block);
+			ls.mem_offset.pop_back();
+		}
+		break;
+	case NODE_GOTO:
+		{
+			auto itr = ls.status.goto_labels.find(ast->d.label.name);
+			if (itr == ls.status.goto_labels.end()) {
+				throw codegen_error(lineno, std::string("unknown label") + ast->d.label.name);
+			}
+			jump_to(ls, label_block(ls, itr->second), lineno);
+		}
+		break;
+	case NODE_CONTINUE:
+		if (ls.continue_blocks.empty()) throw codegen_error(lineno, "continue without anything to continue");
+		jump_to(ls, ls.continue_blocks.back(), lineno);
+		break;
+	case NODE_BREAK:
+		if (ls.break_blocks.empty()) throw codegen_error(lineno, "break without anything to break");
+		jump_to(ls, ls.break_blocks.back(), lineno);
+		break;
+	case NODE_RETURN:
+		{
+			ir_inst inst(IR_RETURN, -1, lineno);
+			if (ast->d.ret.ret_expression != nullptr) {
+				expression_node* expr = ast->d.ret.ret_expression;
+				int value = lower_expr(ls, expr, lineno);
+				// 関数呼び出しの結果は呼び出し先で拡張済みなので、型が合えばそのまま返す (末尾呼び出しにできる)
+				bool extended = expr->kind == EXPR_OPERATOR &&
+					(expr->info.op.kind == OP_FUNC_CALL || expr->info.op.kind == OP_FUNC_CALL_NOARGS) &&
+					codegen_return_value_fits(expr->type, ls.status.return_type);
+				if (value >= 0 && !extended) value = extend_to_type(ls, value, ls.status.return_type, lineno);
+				if (value >= 0) inst.args.push_back(value);
+			}
+			emit(ls, inst);
+			ls.cur = -1;
+		}
+		break;
+	default:
+		throw codegen_error(lineno, "unexpected node passed to codegen_statement()");
+	}
+}
+
+// 文の中で定義された変数を集める
+static void collect_defined_vars(ast_node* ast, std::vector<var_info*>& vars) {
+	if (ast == nullptr) return;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) collect_defined_vars(ast->d.array.nodes[i], vars);
+		break;
+	case NODE_VAR_DEFINE: vars.push_back(ast->d.var_def.info); break;
+	case NODE_LABEL: collect_defined_vars(ast->d.label.statement, vars); break;
+	case NODE_IF:
+		collect_defined_vars(ast->d.if_d.true_statement, vars);
+		collect_defined_vars(ast->d.if_d.false_statement, vars);
+		break;
+	case NODE_SWITCH: collect_defined_vars(ast->d.switch_d.statement, vars); break;
+	case NODE_CASE: collect_defined_vars(ast->d.case_d.statement, vars); break;
+	case NODE_DEFAULT: collect_defined_vars(ast->d.default_d.statement, vars); break;
+	case NODE_WHILE: case NODE_DO_WHILE: collect_defined_vars(ast->d.while_d.statement, vars); break;
+	case NODE_FOR:
+		collect_defined_vars(ast->d.for_d.init, vars);
+		collect_defined_vars(ast->d.for_d.body, vars);
+		break;
+	default:
+		break;
+	}
+}
+
+// 前処理を済ませた関数定義を中間表現にする
+// 割り当てるレジスタが指定された変数がある場合は、指定を守れないので対応しない
+ir_function codegen_ir_lower(ast_node* ast, const std::vector<var_info*>& arguments, codegen_status& status) {
+	lower_status ls(status);
+	ls.fn.name = ast->d.func_def.name;
+	ls.fn.lineno = ast->lineno;
+	ls.fn.num_params = arguments.size();
+	std::vector<var_info*> vars(arguments);
+	collect_defined_vars(ast->d.func_def.body, vars);
+	for (auto itr = vars.begin(); itr != vars.end(); itr++) {
+		if ((*itr)->is_register && status.lv_reg_assign.at((*itr)->offset) >= 0) {
+			throw codegen_ir_unsupported(ast->lineno, "register specified for variable");
+		}
+	}
+
+	int entry = new_block(ls);
+	ls.sealed[entry] = true;
+	start_block(ls, entry);
+	ls.mem_offset.push_back(0);
+	// 引数を受け取る (アドレスを取られる引数はスタックに置く)
+	for (size_t i = 0; i < arguments.size(); i++) {
+		ir_inst param(IR_PARAM, ls.fn.new_value(), ast->lineno);
+		param.imm = i;
+		int value = emit(ls, param);
+		if (is_ssa_variable(arguments[i])) {
+			int var = ls.num_vars++;
+			ls.var_ids[arguments[i]] = var;
+			write_var(ls, var, extend_to_type(ls, value, arguments[i]->type, ast->lineno));
+		} else {
+			place_on_frame(ls, arguments[i], 4);
+			ir_inst addr(IR_FRAME_ADDR, ls.fn.new_value(), ast->lineno);
+			addr.imm = ls.frame_offsets[arguments[i]];
+			ir_inst store(IR_STORE, -1, ast->lineno);
+			store.object = arguments[i];
+			store.args.push_back(emit(ls, addr));
+			store.args.push_back(value);
+			emit(ls, store);
+		}
+	}
+	lower_statement(ls, ast->d.func_def.body);
+	if (ls.cur >= 0) {
+		emit(ls, ir_inst(IR_RETURN, -1, ast->lineno));
+		ls.cur = -1;
+	}
+	for (auto itr = ls.label_blocks.begin(); itr != ls.label_blocks.end(); itr++) {
+		if (!ls.sealed[itr->second]) seal_block(ls, itr->second);
+	}
+	// 使い始めた順に並べ、到達できないブロックを消す
+	ir_reorder_blocks(ls.fn, ls.layout);
+	ir_remove_unreachable_blocks(ls.fn);
+	return ls.fn;
+}
@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include "codegen_ir.hpp"
+
+// 再割り当てを繰り返す回数の上限
+static const int REGALLOC_MAX_ROUNDS = 16;
+// ループ1段あたりの使用回数の重み、および重みを増やすループの深さの上限
+static const double REGALLOC_LOOP_WEIGHT = 8;
+static const int REGALLOC_MAX_LOOP_DEPTH = 5;
+// 退避領域のワード数の上限 (SPからの読み書きの命令で届く範囲)
+static const int REGALLOC_MAX_SPILL_WORDS = 255;
+
+// 命令のパラメータのうち、レジスタを表すもの
+struct mir_operand {
+	int index;
+	bool use, def;
+};
+
+// 命令のパラメータのうちレジスタを表すものを求め、その数を返す
+static int get_operands(const mir_inst& inst, mir_operand ops[3]) {
+	int n = 0;
+	auto add = [&](int index, bool use, bool def) {
+		ops[n].index = index;
+		ops[n].use = use;
+		ops[n].def = def;
+		n++;
+	};
+	switch (inst.kind) {
+	case MIR_NUMBER:
+		add(0, false, true);
+		return n;
+	case MIR_MUL_CONST: case MIR_DIV_CONST:
+		add(0, false, true);
+		add(1, true, false);
+		return n;
+	case MIR_ASM:
+		break;
+	}
+	switch (inst.inst.kind) {
+	case MOV_LIT: case ADD_SP_LIT: case ADD_PC_LIT: case LDL_SP_LIT: case LDL_PC_LIT:
+		add(0, false, true);
+		break;
+	case MOV_REG: case NEG_REG: case NOT_REG:
+	case ADD_REG_LIT: case SUB_REG_LIT:
+	case SHL_REG_LIT: case SHR_REG_LIT: case ASR_REG_LIT:
+	case LDB_REG_LIT: case LDW_REG_LIT: case LDL_REG_LIT:
+	case REV_REG: case REV16_REG: case REVSH_REG:
+		add(0, false, true);
+		add(1, true, false);
+		break;
+	case ADD_LIT: case SUB_LIT:
+		add(0, true, true);
+		break;
+	case ADD_REG: case MUL_REG: case SHL_REG: case SHR_REG: case ASR_REG: case ROR_REG:
+	case AND_REG: case OR_REG: case XOR_REG: case BIC_REG: case ADC_REG: case SBC_REG:
+		add(0, true, true);
+		add(1, true, false);
+		break;
+	case ADD_REG_REG: case SUB_REG_REG:
+	case LDB_REG_REG: case LDBS_REG_REG: case LDW_REG_REG: case LDWS_REG_REG: case LDL_REG_REG:
+		add(0, false, true);
+		add(1, true, false);
+		add(2, true, false);
+		break;
+	case STB_REG_LIT: case STW_REG_LIT: case STL_REG_LIT:
+		add(0, true, false);
+		add(2, true, false);
+		break;
+	case STB_REG_REG: case STW_REG_REG: case STL_REG_REG:
+		add(0, true, false);
+		add(1, true, false);
+		add(2, true, false);
+		break;
+	case CMP_REG_LIT:
+	case JMP_INDIRECT: case CALL_INDIRECT:
+		add(0, true, false);
+		break;
+	case CMP_REG_REG: case CADD_REG_REG: case TEST_REG_REG:
+		add(0, true, false);
+		add(1, true, false);
+		break;
+	case STL_SP_LIT:
+		add(1, true, false);
+		break;
+	default:
+		break;
+	}
+	return n;
+}
+
+// 割り当ての対象にするレジスタか (R0～R7と仮想レジスタ)
+static bool is_tracked_reg(int reg) {
+	return (0 <= reg && reg < 8) || MIR_FIRST_VREG <= reg;
+}
+
+// 命令が読み書きするレジスタを求める
+void mir_get_regs(const mir_inst& inst, std::vector<int>& uses, std::vector<int>& defs) {
+	uses.clear();
+	defs.clear();
+	mir_operand ops[3];
+	int n = get_operands(inst, ops);
+	for (int i = 0; i < n; i++) {
+		int reg = static_cast<int>(inst.inst.params[ops[i].index]);
+		if (!is_tracked_reg(reg)) continue;
+		if (ops[i].use || (ops[i].def && inst.partial_def)) uses.push_back(reg);
+		if (ops[i].def) defs.push_back(reg);
+	}
+	for (int reg = 0; reg < 8; reg++) {
+		if ((inst.extra_uses >> reg) & 1) uses.push_back(reg);
+		if ((inst.extra_defs >> reg) & 1) defs.push_back(reg);
+	}
+}
+
+// 命令の中のレジスタfromをtoに置き換える
+static void replace_reg(mir_inst& inst, int from, int to) {
+	mir_operand ops[3];
+	int n = get_operands(inst, ops);
+	for (int i = 0; i < n; i++) {
+		if (static_cast<int>(inst.inst.params[ops[i].index]) == from) inst.inst.params[ops[i].index] = to;
+	}
+}
+
+// レジスタ同士のMOVなら、コピー元を返す (そうでなければ-1)
+static int copy_source(const mir_inst& inst) {
+	if (inst.kind != MIR_ASM || inst.inst.kind != MOV_REG || inst.extra_uses != 0 || inst.extra_defs != 0) {
+		return -1;
+	}
+	int src = static_cast<int>(inst.inst.params[1]);
+	return is_tracked_reg(src) && is_tracked_reg(static_cast<int>(inst.inst.params[0])) ? src : -1;
+}
+
+// レジスタの集合
+class reg_set {
+	std::vector<uint64_t> words;
+public:
+	explicit reg_set(int n = 0) : words((n + 63) / 64, 0) {}
+	bool has(int reg) const { return (words[reg / 64] >> (reg % 64)) & 1; }
+	void add(int reg) { words[reg / 64] |= UINT64_C(1) << (reg % 64); }
+	void remove(int reg) { words[reg / 64] &= ~(UINT64_C(1) << (reg % 64)); }
+	// 和集合をとり、変化したかを返す
+	bool merge(const reg_set& other) {
+		bool changed = false;
+		for (size_t i = 0; i < words.size(); i++) {
+			uint64_t merged = words[i] | other.words[i];
+			if (merged != words[i]) changed = true;
+			words[i] = merged;
+		}
+		return changed;
+	}
+	template<typename F> void for_each(F f) const {
+		for (size_t i = 0; i < words.size(); i++) {
+			uint64_t w = words[i];
+			while (w != 0) {
+				int bit = 0;
+				while (((w >> bit) & 1) == 0) bit++;
+				f(static_cast<int>(i * 64 + bit));
+				w &= ~(UINT64_C(1) << bit);
+			}
+		}
+	}
+};
+
+// 各ブロックの出口で生きているレジスタを求める
+static std::vector<reg_set> compute_live_out(const std::vector<mir_block>& blocks, int num_regs) {
+	size_t n = blocks.size();
+	std::vector<reg_set> gen(n, reg_set(num_regs)), kill(n, reg_set(num_regs));
+	std::vector<int> uses, defs;
+	for (size_t i = 0; i < n; i++) {
+		for (auto itr = blocks[i].insts.rbegin(); itr != blocks[i].insts.rend(); itr++) {
+			mir_get_regs(*itr, uses, defs);
+			for (auto d = defs.begin(); d != defs.end(); d++) {
+				kill[i].add(*d);
+				gen[i].remove(*d);
+			}
+			for (auto u = uses.begin(); u != uses.end(); u++) gen[i].add(*u);
+		}
+	}
+	std::vector<reg_set> live_in(n, reg_set(num_regs)), live_out(n, reg_set(num_regs));
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t i = n; i-- > 0;) {
+			for (auto s = blocks[i].succs.begin(); s != blocks[i].succs.end(); s++) {
+				live_out[i].merge(live_in[*s]);
+			}
+			reg_set in(num_regs);
+			in.merge(live_out[i]);
+			kill[i].for_each([&](int reg) { in.remove(reg); });
+			in.merge(gen[i]);
+			if (live_in[i].merge(in)) changed = true;
+		}
+	}
+	return live_out;
+}
+
+// 干渉グラフ
+struct interference_graph {
+	int num_regs;
+	std::vector<std::set<int> > adj; // 仮想レジスタ同士の干渉
+	std::vector<int> forbidden; // 仮想レジスタごとの、使えない物理レジスタ
+	std::vector<std::vector<int> > partners; // MOVで結ばれたレジスタ
+	std::vector<double> cost; // 退避した場合の重み付きの読み書きの回数
+	std::vector<bool> present;
+
+	explicit interference_graph(int n) : num_regs(n), adj(n), forbidden(n, 0), partners(n), cost(n, 0), present(n, false) {}
+
+	void add_edge(int a, int b) {
+		if (a == b) return;
+		if (a < MIR_FIRST_VREG && b < MIR_FIRST_VREG) return;
+		if (a < MIR_FIRST_VREG) {
+			forbidden[b] |= 1 << a;
+		} else if (b < MIR_FIRST_VREG) {
+			forbidden[a] |= 1 << b;
+		} else {
+			adj[a].insert(b);
+			adj[b].insert(a);
+		}
+	}
+};
+
+static interference_graph build_graph(const std::vector<mir_block>& blocks, int num_regs) {
+	interference_graph g(num_regs);
+	std::vector<reg_set> live_out = compute_live_out(blocks, num_regs);
+	std::vector<int> uses, defs;
+	for (size_t i = 0; i < blocks.size(); i++) {
+		double weight = 1;
+		for (int d = 0; d < blocks[i].loop_depth && d < REGALLOC_MAX_LOOP_DEPTH; d++) weight *= REGALLOC_LOOP_WEIGHT;
+		reg_set live = live_out[i];
+		for (auto itr = blocks[i].insts.rbegin(); itr != blocks[i].insts.rend(); itr++) {
+			mir_get_regs(*itr, uses, defs);
+			int src = copy_source(*itr);
+			for (auto d = defs.begin(); d != defs.end(); d++) {
+				live.for_each([&](int reg) {
+					if (reg != src) g.add_edge(*d, reg);
+				});
+			}
+			if (src >= 0) {
+				int dest = static_cast<int>(itr->inst.params[0]);
+				g.partners[dest].push_back(src);
+				g.partners[src].push_back(dest);
+			}
+			for (auto d = defs.begin(); d != defs.end(); d++) {
+				live.remove(*d);
+				if (*d >= MIR_FIRST_VREG) {
+					g.present[*d] = true;
+					g.cost[*d] += weight;
+				}
+			}
+			for (auto u = uses.begin(); u != uses.end(); u++) {
+				live.add(*u);
+				if (*u >= MIR_FIRST_VREG) {
+					g.present[*u] = true;
+					g.cost[*u] += weight;
+				}
+			}
+		}
+	}
+	return g;
+}
+
+static int count_bits(int value) {
+	int count = 0;
+	for (; value != 0; value &= value - 1) count++;
+	return count;
+}
+
+// グラフを彩色する (Briggsの楽観的彩色)
+// 割り当てられなかった仮想レジスタをspilledに入れる
+static std::vector<int> color_graph(const interference_graph& g, int allocatable,
+const std::set<int>& no_spill, std::vector<int>& spilled) {
+	int k = count_bits(allocatable);
+	std::vector<int> degree(g.num_regs, 0);
+	std::vector<bool> removed(g.num_regs, true);
+	std::set<int> remaining;
+	for (int v = MIR_FIRST_VREG; v < g.num_regs; v++) {
+		if (!g.present[v]) continue;
+		removed[v] = false;
+		remaining.insert(v);
+		degree[v] = g.adj[v].size() + count_bits(g.forbidden[v] & allocatable);
+	}
+	// 単純化
+	std::vector<int> stack;
+	while (!remaining.empty()) {
+		int chosen = -1;
+		for (auto itr = remaining.begin(); itr != remaining.end(); itr++) {
+			if (degree[*itr] < k) {
+				chosen = *itr;
+				break;
+			}
+		}
+		if (chosen < 0) {
+			// 退避の候補として、重みあたりの次数が大きいものを選ぶ
+			double best = 0;
+			for (auto itr = remaining.begin(); itr != remaining.end(); itr++) {
+				double score = no_spill.count(*itr) ? 0 : degree[*itr] / (g.cost[*itr] + 1);
+				if (chosen < 0 || score > best) {
+					chosen = *itr;
+					best = score;
+				}
+			}
+		}
+		remaining.erase(chosen);
+		removed[chosen] = true;
+		stack.push_back(chosen);
+		for (auto itr = g.adj[chosen].begin(); itr != g.adj[chosen].end(); itr++) {
+			if (!removed[*itr]) degree[*itr]--;
+		}
+	}
+	// 選択
+	std::vector<int> color(g.num_regs, -1);
+	for (int r = 0; r < 8; r++) color[r] = r;
+	for (auto itr = stack.rbegin(); itr != stack.rend(); itr++) {
+		int v = *itr;
+		int usable = allocatable & ~g.forbidden[v];
+		for (auto a = g.adj[v].begin(); a != g.adj[v].end(); a++) {
+			if (color[*a] >= 0) usable &= ~(1 << color[*a]);
+		}
+		if (usable == 0) {
+			spilled.push_back(v);
+			continue;
+		}
+		int chosen = -1;
+		// MOVで結ばれたレジスタと同じものを優先する
+		for (auto p = g.partners[v].begin(); p != g.partners[v].end() && chosen < 0; p++) {
+			if (color[*p] >= 0 && ((usable >> color[*p]) & 1)) chosen = color[*p];
+		}
+		for (int r = 0; r < 8 && chosen < 0; r++) {
+			if ((usable >> r) & 1) chosen = r;
+		}
+		color[v] = chosen;
+	}
+	return color;
+}
+
+// 値を作り直せる命令か (書き込み先のみを使い、他のレジスタを読まない)
+static bool is_remat_def(const mir_inst& inst) {
+	if (inst.extra_uses != 0 || inst.extra_defs != 0 || inst.partial_def) return false;
+	if (inst.kind == MIR_NUMBER) return true;
+	return inst.kind == MIR_ASM && (inst.inst.kind == MOV_LIT || inst.inst.kind == ADD_SP_LIT);
+}
+
+// 仮想レジスタを退避するコードを入れる
+static void insert_spill_code(std::vector<mir_block>& blocks, int& num_regs, const std::vector<int>& spilled,
+int spill_base, int& spill_words, std::set<int>& no_spill, int lineno) {
+	std::map<int, int> slot; // 仮想レジスタ → 退避先 (SPからのワード数)
+	std::map<int, mir_inst> remat; // 仮想レジスタ → 作り直す命令
+	std::map<int, int> def_count;
+	std::map<int, mir_inst> def_inst;
+	std::vector<int> uses, defs;
+	std::set<int> spilled_set(spilled.begin(), spilled.end());
+	for (auto b = blocks.begin(); b != blocks.end(); b++) {
+		for (auto itr = b->insts.begin(); itr != b->insts.end(); itr++) {
+			mir_get_regs(*itr, uses, defs);
+			for (auto d = defs.begin(); d != defs.end(); d++) {
+				if (spilled_set.count(*d)) {
+					def_count[*d]++;
+					def_inst.erase(*d);
+					def_inst.insert(std::make_pair(*d, *itr));
+				}
+			}
+		}
+	}
+	for (auto itr = spilled.begin(); itr != spilled.end(); itr++) {
+		if (def_count[*itr] == 1 && is_remat_def(def_inst.at(*itr))) {
+			remat.insert(std::make_pair(*itr, def_inst.at(*itr)));
+		} else {
+			if (spill_base + spill_words >= REGALLOC_MAX_SPILL_WORDS) {
+				throw codegen_ir_unsupported(lineno, "too many values to spill");
+			}
+			slot[*itr] = spill_base + spill_words++;
+		}
+	}
+	for (auto b = blocks.begin(); b != blocks.end(); b++) {
+		std::vector<mir_inst> new_insts;
+		for (auto itr = b->insts.begin(); itr != b->insts.end(); itr++) {
+			mir_get_regs(*itr, uses, defs);
+			mir_inst inst = *itr;
+			// 作り直せる値の定義は消す
+			bool drop = false;
+			for (auto d = defs.begin(); d != defs.end(); d++) {
+				if (remat.count(*d)) drop = true;
+			}
+			if (drop) continue;
+			std::vector<mir_inst> after;
+			std::map<int, int> temps;
+			for (auto u = uses.begin(); u != uses.end(); u++) {
+				if (!spilled_set.count(*u) || temps.count(*u)) continue;
+				int temp = num_regs++;
+				no_spill.insert(temp);
+				temps[*u] = temp;
+				auto r = remat.find(*u);
+				if (r != remat.end()) {
+					mir_inst load = r->second;
+					load.inst.params[0] = temp;
+					new_insts.push_back(load);
+				} else {
+					mir_inst load(asm_inst(LDL_SP_LIT, temp, slot[*u]));
+					load.inst.lineno = itr->inst.lineno;
+					new_insts.push_back(load);
+				}
+			}
+			for (auto d = defs.begin(); d != defs.end(); d++) {
+				if (!spilled_set.count(*d)) continue;
+				if (!temps.count(*d)) {
+					int temp = num_regs++;
+					no_spill.insert(temp);
+					temps[*d] = temp;
+				}
+				mir_inst store(asm_inst(STL_SP_LIT, slot[*d], temps[*d]));
+				store.inst.lineno = itr->inst.lineno;
+				after.push_back(store);
+			}
+			for (auto t = temps.begin(); t != temps.end(); t++) replace_reg(inst, t->first, t->second);
+			new_insts.push_back(inst);
+			new_insts.insert(new_insts.end(), after.begin(), after.end());
+		}
+		b->insts.swap(new_insts);
+	}
+}
+
+// MOVで結ばれた干渉しない仮想レジスタ同士を、彩色できなくならない範囲でまとめる (Briggsの基準)
+// まとめたものがあればtrueを返す
+static bool coalesce_copies(std::vector<mir_block>& blocks, int num_regs, int allocatable,
+const std::set<int>& no_spill) {
+	int k = count_bits(allocatable);
+	interference_graph g = build_graph(blocks, num_regs);
+	std::vector<int> alias(num_regs);
+	for (int i = 0; i < num_regs; i++) alias[i] = i;
+	auto degree = [&](int v) {
+		return static_cast<int>(g.adj[v].size()) + count_bits(g.forbidden[v] & allocatable);
+	};
+	bool merged = false;
+	for (auto b = blocks.begin(); b != blocks.end(); b++) {
+		for (auto itr = b->insts.begin(); itr != b->insts.end(); itr++) {
+			int src = copy_source(*itr);
+			if (src < MIR_FIRST_VREG) continue;
+			int dest = static_cast<int>(itr->inst.params[0]);
+			if (dest < MIR_FIRST_VREG) continue;
+			while (alias[src] != src) src = alias[src];
+			while (alias[dest] != dest) dest = alias[dest];
+			if (src == dest || g.adj[dest].count(src) || no_spill.count(src) || no_spill.count(dest)) continue;
+			int forbidden = (g.forbidden[dest] | g.forbidden[src]) & allocatable;
+			if (forbidden == allocatable) continue;
+			// まとめた後、次数がk以上の隣接ノードがk個未満なら安全にまとめられる
+			std::set<int> neighbors(g.adj[dest].begin(), g.adj[dest].end());
+			neighbors.insert(g.adj[src].begin(), g.adj[src].end());
+			int significant = count_bits(forbidden);
+			for (auto n = neighbors.begin(); n != neighbors.end(); n++) {
+				int d = degree(*n);
+				if (g.adj[*n].count(dest) && g.adj[*n].count(src)) d--;
+				if (d >= k) significant++;
+			}
+			if (significant >= k) continue;
+			// srcをdestにまとめる
+			for (auto n = g.adj[src].begin(); n != g.adj[src].end(); n++) {
+				g.adj[*n].erase(src);
+				g.adj[*n].insert(dest);
+				g.adj[dest].insert(*n);
+			}
+			g.adj[src].clear();
+			g.forbidden[dest] |= g.forbidden[src];
+			alias[src] = dest;
+			merged = true;
+		}
+	}
+	if (!merged) return false;
+	for (auto b = blocks.begin(); b != blocks.end(); b++) {
+		std::vector<mir_inst> insts;
+		for (auto itr = b->insts.begin(); itr != b->insts.end(); itr++) {
+			mir_operand ops[3];
+			int n = get_operands(*itr, ops);
+			for (int i = 0; i < n; i++) {
+				uint32_t& reg = itr->inst.params[ops[i].index];
+				int r = static_cast<int>(reg);
+				if (r < MIR_FIRST_VREG) continue;
+				while (alias[r] != r) r = alias[r];
+				reg = r;
+			}
+			int src = copy_source(*itr);
+			if (src >= 0 && src == static_cast<int>(itr->inst.params[0])) continue;
+			insts.push_back(*itr);
+		}
+		b->insts.swap(insts);
+	}
+	return true;
+}
+
+// 仮想レジスタに物理レジスタ (allocatableの中から) を割り当てる
+// 足りなければ値を作り直すか、スタック上のspill_baseワード目以降に退避する
+// 使った退避領域のワード数を返す
+int mir_allocate_registers(std::vector<mir_block>& blocks, int& num_regs, int allocatable,
+int spill_base, int lineno) {
+	int spill_words = 0;
+	std::set<int> no_spill;
+	for (int round = 0; round < REGALLOC_MAX_ROUNDS; round++) {
+		if (!coalesce_copies(blocks, num_regs, allocatable, no_spill)) break;
+	}
+	for (int round = 0; round < REGALLOC_MAX_ROUNDS; round++) {
+		interference_graph g = build_graph(blocks, num_regs);
+		std::vector<int> spilled;
+		std::vector<int> color = color_graph(g, allocatable, no_spill, spilled);
+		if (spilled.empty()) {
+			for (auto b = blocks.begin(); b != blocks.end(); b++) {
+				for (auto itr = b->insts.begin(); itr != b->insts.end(); itr++) {
+					mir_operand ops[3];
+					int n = get_operands(*itr, ops);
+					for (int i = 0; i < n; i++) {
+						uint32_t& reg = itr->inst.params[ops[i].index];
+						if (static_cast<int>(reg) >= MIR_FIRST_VREG) {
+							if (color[reg] < 0) throw codegen_error(lineno, "register allocation failed");
+							reg = color[reg];
+						}
+					}
+				}
+			}
+			return spill_words;
+		}
+		for (auto itr = spilled.begin(); itr != spilled.end(); itr++) {
+			if (no_spill.count(*itr)) throw codegen_ir_unsupported(lineno, "no registers available");
+		}
+		insert_spill_code(blocks, num_regs, spilled, spill_base, spill_words, no_spill, lineno);
+	}
+	throw codegen_ir_unsupported(lineno, "register allocation did not converge");
+}
+
+// 物理レジスタを割り当てた後の命令列について、各命令の直後で生きているR0～R7を求める
+std::vector<std::vector<int> > mir_live_after(const std::vector<mir_block>& blocks) {
+	std::vector<reg_set> live_out = compute_live_out(blocks, MIR_FIRST_VREG);
+	std::vector<std::vector<int> > result(blocks.size());
+	std::vector<int> uses, defs;
+	for (size_t b = 0; b < blocks.size(); b++) {
+		int live = 0;
+		live_out[b].for_each([&](int reg) { if (reg < 8) live |= 1 << reg; });
+		result[b].resize(blocks[b].insts.size());
+		for (size_t i = blocks[b].insts.size(); i-- > 0;) {
+			result[b][i] = live;
+			mir_get_regs(blocks[b].insts[i], uses, defs);
+			for (auto d = defs.begin(); d != defs.end(); d++) live &= ~(1 << *d);
+			for (auto u = uses.begin(); u != uses.end(); u++) live |= 1 << *u;
+		}
+	}
+	return result;
+}
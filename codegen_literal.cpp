@@ -0,0 +1,207 @@
+#include <map>
+#include <set>
+#include <vector>
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// PC相対の読み込みで届く最大の距離 (バイト)
+static const uint32_t LITERAL_MAX_DISTANCE = 1020;
+
+// リテラルプールから定数を読み込む要求を作る
+asm_inst codegen_literal_request(int dest_reg, uint32_t value) {
+	asm_inst inst(LDL_PC_LIT, dest_reg, value, 1);
+	inst.is_constant = true;
+	return inst;
+}
+
+// リテラルプールからの読み込みの要求かを判定する
+bool codegen_is_literal_request(const asm_inst& inst) {
+	return inst.kind == LDL_PC_LIT && inst.is_constant && inst.params[2] == 1;
+}
+
+// ラベルの直後に置いたデータ (表) のアドレスをPC相対で求める要求を作る
+asm_inst codegen_table_address_request(int dest_reg, const std::string& label) {
+	return asm_inst(ADD_PC_LIT, dest_reg, label, 0, 1);
+}
+
+// 表のアドレスを求める要求かを判定する
+bool codegen_is_table_address_request(const asm_inst& inst) {
+	return inst.kind == ADD_PC_LIT && inst.params[2] == 1 && inst.label != "";
+}
+
+// 読み込みの要求を、命令の組み合わせにして追加する
+static void append_synthesized(std::vector<asm_inst>& out, const asm_inst& request) {
+	std::vector<asm_inst> code = codegen_synthesize_number(request.params[0], request.params[1]);
+	codegen_set_lineno(code, request.lineno);
+	out.insert(out.end(), code.begin(), code.end());
+}
+
+// リテラルプールからの読み込みの要求を、命令の組み合わせに置き換える
+void codegen_expand_literals(std::vector<asm_inst>& insts) {
+	std::vector<asm_inst> out;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if (codegen_is_literal_request(*itr)) {
+			append_synthesized(out, *itr);
+		} else {
+			out.push_back(*itr);
+		}
+	}
+	insts.swap(out);
+}
+
+// 次の命令に実行が進まない命令かを判定する
+bool codegen_is_unconditional_transfer(const asm_inst& inst) {
+	switch (inst.kind) {
+	case JMP_DIRECT: case JMP_INDIRECT: case RET:
+		return true;
+	case JCC:
+		return inst.params[0] == ALWAYS;
+	case POP_REGS:
+		return (inst.params[0] & 0x100) != 0;
+	case MOV_REG: case ADD_REG:
+		return inst.params[0] == 15;
+	default:
+		return false;
+	}
+}
+
+// 表のアドレスを求める要求を、PC相対のアドレス計算にする
+static void resolve_table_addresses(std::vector<asm_inst>& insts) {
+	std::vector<uint32_t> addresses = asm_layout(insts);
+	std::map<std::string, uint32_t> table_address;
+	for (size_t i = 0; i < insts.size(); i++) {
+		if (insts[i].kind != LABEL) continue;
+		// ラベル自体はDDの詰め物の前を指すので、直後のデータのアドレスを使う
+		for (size_t j = i + 1; j < insts.size(); j++) {
+			if (insts[j].size() > 0) {
+				table_address[insts[i].label] = addresses[j];
+				break;
+			}
+		}
+	}
+	for (size_t i = 0; i < insts.size(); i++) {
+		if (!codegen_is_table_address_request(insts[i])) continue;
+		auto itr = table_address.find(insts[i].label);
+		uint32_t pc = (addresses[i] + 4) & ~UINT32_C(3);
+		if (itr == table_address.end() || itr->second < pc || itr->second - pc > LITERAL_MAX_DISTANCE ||
+		(itr->second - pc) % 4 != 0) {
+			throw codegen_error(insts[i].lineno, "table not reachable from PC");
+		}
+		insts[i].params[1] = (itr->second - pc) / 4;
+		insts[i].params[2] = 0;
+		insts[i].label = "";
+	}
+}
+
+// 関数の末尾にリテラルプールを置き、読み込みの要求をPC相対の読み込みにする
+// 表のアドレスを求める要求も、ここでアドレス計算にする
+// codegen_clean()の後に呼ぶこと (プールは実行されない位置に置くので、その後にコードを消されると困る)
+void codegen_place_literals(std::vector<asm_inst>& insts) {
+	// プールを置ける位置 (関数の末尾で、直前で実行が途切れている位置) を求める
+	std::vector<size_t> sites;
+	std::vector<int> site_of(insts.size(), -1); // 各命令から見て、最初に使えるプールの位置
+	{
+		bool in_function = false;
+		const asm_inst* last = nullptr;
+		for (size_t i = 0; i <= insts.size(); i++) {
+			if (i == insts.size() || is_function_label(insts[i])) {
+				if (in_function && last != nullptr && codegen_is_unconditional_transfer(*last)) sites.push_back(i);
+				in_function = i < insts.size();
+				last = nullptr;
+			} else if (insts[i].size() > 0 && insts[i].kind != DB && insts[i].kind != DB2 &&
+			insts[i].kind != DW && insts[i].kind != DD) {
+				last = &insts[i];
+			}
+		}
+		size_t next_site = 0;
+		for (size_t i = 0; i < insts.size(); i++) {
+			while (next_site < sites.size() && sites[next_site] <= i) next_site++;
+			if (next_site < sites.size()) site_of[i] = static_cast<int>(next_site);
+		}
+	}
+	std::set<size_t> inlined; // 命令の組み合わせにする要求の位置
+	std::set<std::pair<int, uint32_t> > no_defer; // 次のプールに回さない (プールの番号, 値)
+	for (;;) {
+		// 各要求を置くプールを決める
+		std::map<size_t, int> assigned; // 要求の位置 → プールの番号
+		std::vector<std::vector<uint32_t> > pools(sites.size()); // 各プールの値 (最初に使われた順)
+		std::vector<std::set<uint32_t> > pool_values(sites.size());
+		for (size_t i = 0; i < insts.size(); i++) {
+			if (!codegen_is_literal_request(insts[i]) || inlined.count(i) > 0) continue;
+			if (site_of[i] < 0) {
+				inlined.insert(i);
+				continue;
+			}
+			assigned[i] = site_of[i];
+			pool_values[site_of[i]].insert(insts[i].params[1]);
+		}
+		// 次の関数でも同じ値を使うなら、次のプールにまとめる
+		for (size_t k = 0; k + 1 < sites.size(); k++) {
+			for (auto itr = assigned.begin(); itr != assigned.end(); itr++) {
+				uint32_t value = insts[itr->first].params[1];
+				if (itr->second == static_cast<int>(k) && pool_values[k + 1].count(value) > 0 &&
+				no_defer.count(std::make_pair(site_of[itr->first], value)) == 0) {
+					itr->second = static_cast<int>(k + 1);
+				}
+			}
+		}
+		for (auto itr = assigned.begin(); itr != assigned.end(); itr++) {
+			std::vector<uint32_t>& pool = pools[itr->second];
+			uint32_t value = insts[itr->first].params[1];
+			bool found = false;
+			for (auto vitr = pool.begin(); vitr != pool.end(); vitr++) {
+				if (*vitr == value) found = true;
+			}
+			if (!found) pool.push_back(value);
+		}
+		// プールを挿入した命令列を作る
+		std::vector<asm_inst> out;
+		std::map<size_t, size_t> out_index; // 要求の位置 → outでの位置
+		std::vector<std::map<uint32_t, size_t> > entry_index(sites.size()); // プールの各値のoutでの位置
+		size_t next_site = 0;
+		for (size_t i = 0; i <= insts.size(); i++) {
+			while (next_site < sites.size() && sites[next_site] == i) {
+				std::vector<uint32_t>& pool = pools[next_site];
+				for (auto vitr = pool.begin(); vitr != pool.end(); vitr++) {
+					entry_index[next_site][*vitr] = out.size();
+					asm_inst entry(DD, *vitr);
+					entry.is_constant = true;
+					out.push_back(entry);
+				}
+				next_site++;
+			}
+			if (i == insts.size()) break;
+			if (codegen_is_literal_request(insts[i]) && inlined.count(i) > 0) {
+				append_synthesized(out, insts[i]);
+			} else {
+				if (assigned.count(i) > 0) out_index[i] = out.size();
+				out.push_back(insts[i]);
+			}
+		}
+		// 距離を確認し、届かなければ置き方を変えてやり直す
+		std::vector<uint32_t> addresses = asm_layout(out);
+		bool ok = true;
+		for (auto itr = assigned.begin(); itr != assigned.end(); itr++) {
+			size_t index = out_index[itr->first];
+			uint32_t value = insts[itr->first].params[1];
+			uint32_t pc = (addresses[index] + 4) & ~UINT32_C(3);
+			uint32_t entry_address = addresses[entry_index[itr->second][value]];
+			if (entry_address < pc || entry_address - pc > LITERAL_MAX_DISTANCE) {
+				if (itr->second != site_of[itr->first]) {
+					no_defer.insert(std::make_pair(site_of[itr->first], value));
+				} else {
+					inlined.insert(itr->first);
+				}
+				ok = false;
+			} else {
+				out[index].params[1] = (entry_address - pc) / 4;
+				out[index].params[2] = 0;
+			}
+		}
+		if (ok) {
+			insts.swap(out);
+			resolve_table_addresses(insts);
+			return;
+		}
+	}
+}
@@ -0,0 +1,225 @@
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// 1個のレジスタだけで完結する、値を変換する命令
+struct number_op {
+	asm_inst_kind kind;
+	uint32_t arg;
+
+	number_op(asm_inst_kind kind_ = EMPTY, uint32_t arg_ = 0) : kind(kind_), arg(arg_) {}
+};
+
+// 探索に使う命令の一覧を返す
+// (ROR・BICなどは2個目のレジスタが要るので対象外)
+static const std::vector<number_op>& get_number_ops() {
+	static std::vector<number_op> ops;
+	if (ops.empty()) {
+		for (uint32_t i = 1; i < 256; i++) {
+			ops.push_back(number_op(ADD_LIT, i));
+			ops.push_back(number_op(SUB_LIT, i));
+		}
+		for (uint32_t i = 1; i < 32; i++) {
+			ops.push_back(number_op(SHL_REG_LIT, i));
+			ops.push_back(number_op(SHR_REG_LIT, i));
+			ops.push_back(number_op(ASR_REG_LIT, i));
+		}
+		static const asm_inst_kind unary_ops[] = {NEG_REG, NOT_REG, MUL_REG, REV_REG, REV16_REG, REVSH_REG};
+		for (size_t i = 0; i < sizeof(unary_ops) / sizeof(unary_ops[0]); i++) {
+			ops.push_back(number_op(unary_ops[i]));
+		}
+	}
+	return ops;
+}
+
+static uint32_t rev16(uint32_t v) {
+	return ((v >> 8) & UINT32_C(0x00ff00ff)) | ((v << 8) & UINT32_C(0xff00ff00));
+}
+
+// 命令を実行した結果を返す
+static uint32_t apply_number_op(const number_op& op, uint32_t v) {
+	switch (op.kind) {
+	case ADD_LIT: return v + op.arg;
+	case SUB_LIT: return v - op.arg;
+	case SHL_REG_LIT: return v << op.arg;
+	case SHR_REG_LIT: return v >> op.arg;
+	case ASR_REG_LIT: return static_cast<uint32_t>(static_cast<int32_t>(v) >> op.arg);
+	case NEG_REG: return -v;
+	case NOT_REG: return ~v;
+	case MUL_REG: return v * v;
+	case REV_REG: return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+	case REV16_REG: return rev16(v);
+	case REVSH_REG: return static_cast<uint32_t>(static_cast<int16_t>(rev16(v) & 0xffff));
+	default: return v;
+	}
+}
+
+// 命令を実行するとvになる値の候補を返す (シフトで消えるビットは全部0か全部1のみ試す)
+static void number_op_sources(const number_op& op, uint32_t v, std::vector<uint32_t>& sources) {
+	sources.clear();
+	switch (op.kind) {
+	case ADD_LIT: sources.push_back(v - op.arg); break;
+	case SUB_LIT: sources.push_back(v + op.arg); break;
+	case NEG_REG: sources.push_back(-v); break;
+	case NOT_REG: sources.push_back(~v); break;
+	case REV_REG: sources.push_back(apply_number_op(op, v)); break;
+	case REV16_REG: sources.push_back(rev16(v)); break;
+	case REVSH_REG:
+		if (static_cast<uint32_t>(static_cast<int16_t>(v & 0xffff)) == v) sources.push_back(rev16(v) & 0xffff);
+		break;
+	case SHL_REG_LIT:
+		if ((v & ((UINT32_C(1) << op.arg) - 1)) == 0) {
+			sources.push_back(v >> op.arg);
+			sources.push_back((v >> op.arg) | ~(~UINT32_C(0) >> op.arg));
+		}
+		break;
+	case SHR_REG_LIT: case ASR_REG_LIT:
+		{
+			uint32_t low = (UINT32_C(1) << op.arg) - 1;
+			for (int i = 0; i < 2; i++) {
+				uint32_t source = (v << op.arg) | (i ? low : 0);
+				if (apply_number_op(op, source) == v) sources.push_back(source);
+			}
+		}
+		break;
+	default:
+		// MULは逆算しない
+		break;
+	}
+}
+
+// MOVの後に1命令までで作れる値の表 (値 → 命令の並び)
+// MOVの値は8ビット、命令はget_number_ops()の位置+1 (0 : 無し) をまとめて格納する
+static const std::unordered_map<uint32_t, uint32_t>& get_number_table() {
+	static std::unordered_map<uint32_t, uint32_t> table;
+	if (table.empty()) {
+		const std::vector<number_op>& ops = get_number_ops();
+		for (uint32_t i = 0; i < 256; i++) table[i] = i;
+		for (uint32_t i = 0; i < 256; i++) {
+			for (size_t j = 0; j < ops.size(); j++) {
+				uint32_t v = apply_number_op(ops[j], i);
+				if (table.find(v) == table.end()) table[v] = i | ((j + 1) << 8);
+			}
+		}
+	}
+	return table;
+}
+
+// 表に無い値を素早く弾くためのビット列 (値のハッシュの位置のビットを立てる)
+static const int NUMBER_FILTER_BITS = 24;
+static std::vector<uint32_t> number_filter;
+
+static uint32_t number_filter_hash(uint32_t v) {
+	return (v * UINT32_C(2654435761)) >> (32 - NUMBER_FILTER_BITS);
+}
+
+// 表を引く (無ければnullptr)
+static const uint32_t* lookup_number_table(uint32_t v) {
+	const std::unordered_map<uint32_t, uint32_t>& table = get_number_table();
+	if (number_filter.empty()) {
+		number_filter.assign(UINT32_C(1) << (NUMBER_FILTER_BITS - 5), 0);
+		for (auto itr = table.begin(); itr != table.end(); itr++) {
+			uint32_t h = number_filter_hash(itr->first);
+			number_filter[h >> 5] |= UINT32_C(1) << (h & 31);
+		}
+	}
+	uint32_t h = number_filter_hash(v);
+	if (((number_filter[h >> 5] >> (h & 31)) & 1) == 0) return nullptr;
+	auto itr = table.find(v);
+	return itr == table.end() ? nullptr : &itr->second;
+}
+
+// 表の値から命令の並びを作る
+static std::vector<number_op> table_sequence(uint32_t entry) {
+	std::vector<number_op> seq;
+	seq.push_back(number_op(MOV_LIT, entry & 0xff));
+	if ((entry >> 8) != 0) seq.push_back(get_number_ops()[(entry >> 8) - 1]);
+	return seq;
+}
+
+// 指定の数を作る最短の命令の並びを探す (max_insts命令以下で見つからなければ空を返す)
+static std::vector<number_op> search_number(uint32_t value, size_t max_insts) {
+	const std::vector<number_op>& ops = get_number_ops();
+	const uint32_t* found = lookup_number_table(value);
+	if (found != nullptr) {
+		std::vector<number_op> seq = table_sequence(*found);
+		if (seq.size() <= max_insts) return seq;
+		return std::vector<number_op>();
+	}
+	if (max_insts < 3) return std::vector<number_op>();
+	// 最後の1命令を逆算し、表で引く
+	std::vector<uint32_t> sources1, sources2;
+	for (size_t i = 0; i < ops.size(); i++) {
+		number_op_sources(ops[i], value, sources1);
+		for (auto itr = sources1.begin(); itr != sources1.end(); itr++) {
+			const uint32_t* entry = lookup_number_table(*itr);
+			if (entry != nullptr && (*entry >> 8) != 0) {
+				std::vector<number_op> seq = table_sequence(*entry);
+				seq.push_back(ops[i]);
+				return seq;
+			}
+		}
+	}
+	if (max_insts < 4) return std::vector<number_op>();
+	// 最後の2命令を逆算し、表で引く
+	for (size_t i = 0; i < ops.size(); i++) {
+		number_op_sources(ops[i], value, sources1);
+		for (auto itr1 = sources1.begin(); itr1 != sources1.end(); itr1++) {
+			for (size_t j = 0; j < ops.size(); j++) {
+				number_op_sources(ops[j], *itr1, sources2);
+				for (auto itr2 = sources2.begin(); itr2 != sources2.end(); itr2++) {
+					const uint32_t* entry = lookup_number_table(*itr2);
+					if (entry != nullptr && (*entry >> 8) != 0) {
+						std::vector<number_op> seq = table_sequence(*entry);
+						seq.push_back(ops[j]);
+						seq.push_back(ops[i]);
+						return seq;
+					}
+				}
+			}
+		}
+	}
+	return std::vector<number_op>();
+}
+
+// 指定の数を作る命令の並びを探索で求める (max_insts命令以下で見つからなければ空を返す)
+// 探索の範囲は、MOVの後に4命令まで (3命令目以降は逆算できる命令のみ)
+std::vector<asm_inst> codegen_search_number(int dest_reg, uint32_t value, size_t max_insts) {
+	// 探索結果を覚えておく (max_insts未満で見つからなかったものは、見つからなかった長さを覚える)
+	static std::map<uint32_t, std::vector<number_op> > found_cache;
+	static std::map<uint32_t, size_t> not_found_cache;
+	std::vector<number_op> seq;
+	auto found_itr = found_cache.find(value);
+	if (found_itr != found_cache.end()) {
+		seq = found_itr->second;
+		if (seq.size() > max_insts) seq.clear();
+	} else {
+		auto not_found_itr = not_found_cache.find(value);
+		if (not_found_itr == not_found_cache.end() || not_found_itr->second < max_insts) {
+			seq = search_number(value, max_insts);
+			if (seq.empty()) {
+				not_found_cache[value] = max_insts;
+			} else {
+				found_cache[value] = seq;
+			}
+		}
+	}
+	std::vector<asm_inst> result;
+	for (auto itr = seq.begin(); itr != seq.end(); itr++) {
+		switch (itr->kind) {
+		case MOV_LIT: case ADD_LIT: case SUB_LIT:
+			result.push_back(asm_inst(itr->kind, dest_reg, itr->arg));
+			break;
+		case SHL_REG_LIT: case SHR_REG_LIT: case ASR_REG_LIT:
+			result.push_back(asm_inst(itr->kind, dest_reg, dest_reg, itr->arg));
+			break;
+		default:
+			result.push_back(asm_inst(itr->kind, dest_reg, dest_reg));
+			break;
+		}
+		result.back().is_constant = true;
+	}
+	return result;
+}
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "ast.h"
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// ループ1段あたりの使用回数の重み、および重みを増やすループの深さの上限
+static const long long PROMOTE_LOOP_WEIGHT = 8;
+static const int PROMOTE_MAX_LOOP_DEPTH = 5;
+// 式の評価用に最低限残しておくレジスタの数
+static const int PROMOTE_MIN_TEMPS = 2;
+
+// 解析中の状態
+struct promote_status {
+	std::map<var_info*, long long> weights; // ループの深さで重み付けした使用回数
+	std::vector<var_info*> candidates; // 宣言順
+	int max_temps; // 式の評価に要りそうなレジスタ数の最大値
+	int loop_depth;
+};
+
+// 優先してレジスタに置く方を前にする比較関数 (重みが同じなら先に宣言された方)
+struct promote_compare {
+	const promote_status& ps;
+	std::map<var_info*, size_t> order;
+
+	promote_compare(const promote_status& ps_) : ps(ps_) {
+		for (size_t i = 0; i < ps.candidates.size(); i++) order[ps.candidates[i]] = i;
+	}
+	bool operator()(var_info* a, var_info* b) const {
+		long long wa = ps.weights.at(a), wb = ps.weights.at(b);
+		if (wa != wb) return wa > wb;
+		return order.at(a) < order.at(b);
+	}
+};
+
+// 自動でレジスタに置く候補かを判定する
+static bool is_promote_candidate(var_info* vinfo) {
+	return !vinfo->is_global && !vinfo->is_register && !vinfo->address_taken && is_scalar_type(vinfo->type);
+}
+
+// 式の中の変数の使用回数を数える
+static void promote_scan_expr(promote_status& ps, expression_node* expr) {
+	switch (expr->kind) {
+	case EXPR_INTEGER_LITERAL:
+		break;
+	case EXPR_IDENTIFIER:
+		{
+			auto itr = ps.weights.find(expr->info.ident.info);
+			if (itr != ps.weights.end()) {
+				long long weight = 1;
+				for (int i = 0; i < ps.loop_depth && i < PROMOTE_MAX_LOOP_DEPTH; i++) {
+					weight *= PROMOTE_LOOP_WEIGHT;
+				}
+				itr->second += weight;
+			}
+		}
+		break;
+	case EXPR_OPERATOR:
+		promote_scan_expr(ps, expr->info.op.operands[0]);
+		if (expr->info.op.kind > OP_DUMMY_BINARY_START) promote_scan_expr(ps, expr->info.op.operands[1]);
+		if (expr->info.op.kind > OP_DUMMY_TERNARY_START) promote_scan_expr(ps, expr->info.op.operands[2]);
+		break;
+	}
+}
+
+static void promote_scan_toplevel_expr(promote_status& ps, expression_node* expr) {
+	if (expr == nullptr) return;
+	promote_scan_expr(ps, expr);
+	if (expr->hint != nullptr && ps.max_temps < expr->hint->num_regs_to_use) {
+		ps.max_temps = expr->hint->num_regs_to_use;
+	}
+}
+
+// 文の中の変数の使用回数を数える
+static void promote_scan_statement(promote_status& ps, ast_node* ast) {
+	if (ast == nullptr) return;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			promote_scan_statement(ps, ast->d.array.nodes[i]);
+		}
+		break;
+	case NODE_VAR_DEFINE:
+		if (is_promote_candidate(ast->d.var_def.info)) {
+			ps.candidates.push_back(ast->d.var_def.info);
+			ps.weights[ast->d.var_def.info] = 0;
+		}
+		promote_scan_toplevel_expr(ps, ast->d.var_def.initializer);
+		break;
+	case NODE_EXPR:
+		promote_scan_toplevel_expr(ps, ast->d.expr.expression);
+		break;
+	case NODE_LABEL:
+		promote_scan_statement(ps, ast->d.label.statement);
+		break;
+	case NODE_IF:
+		promote_scan_toplevel_expr(ps, ast->d.if_d.cond);
+		promote_scan_statement(ps, ast->d.if_d.true_statement);
+		promote_scan_statement(ps, ast->d.if_d.false_statement);
+		break;
+	case NODE_SWITCH:
+		promote_scan_toplevel_expr(ps, ast->d.switch_d.expr);
+		promote_scan_statement(ps, ast->d.switch_d.statement);
+		break;
+	case NODE_CASE:
+		promote_scan_statement(ps, ast->d.case_d.statement);
+		break;
+	case NODE_DEFAULT:
+		promote_scan_statement(ps, ast->d.default_d.statement);
+		break;
+	case NODE_WHILE:
+	case NODE_DO_WHILE:
+		ps.loop_depth++;
+		promote_scan_toplevel_expr(ps, ast->d.while_d.cond);
+		promote_scan_statement(ps, ast->d.while_d.statement);
+		ps.loop_depth--;
+		break;
+	case NODE_FOR:
+		promote_scan_statement(ps, ast->d.for_d.init);
+		ps.loop_depth++;
+		promote_scan_toplevel_expr(ps, ast->d.for_d.cond);
+		promote_scan_toplevel_expr(ps, ast->d.for_d.post);
+		promote_scan_statement(ps, ast->d.for_d.body);
+		ps.loop_depth--;
+		break;
+	case NODE_RETURN:
+		promote_scan_toplevel_expr(ps, ast->d.ret.ret_expression);
+		break;
+	default:
+		break;
+	}
+}
+
+// メモリ上に残った変数の位置を、codegen_register_variable()と同じ規則で詰め直す
+static void relayout_statement(ast_node* ast, std::vector<int>& mem_offset, codegen_status& status) {
+	if (ast == nullptr) return;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		mem_offset.push_back(mem_offset.back());
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			relayout_statement(ast->d.array.nodes[i], mem_offset, status);
+		}
+		mem_offset.pop_back();
+		break;
+	case NODE_VAR_DEFINE:
+		{
+			var_info* vinfo = ast->d.var_def.info;
+			if (vinfo->is_register) break;
+			int& offset = mem_offset.back();
+			if (offset % vinfo->type->align != 0) offset += vinfo->type->align - (offset % vinfo->type->align);
+			vinfo->offset = offset;
+			offset += vinfo->type->size;
+			if (status.lv_mem_size < offset) status.lv_mem_size = offset;
+		}
+		break;
+	case NODE_LABEL:
+		relayout_statement(ast->d.label.statement, mem_offset, status);
+		break;
+	case NODE_IF:
+		relayout_statement(ast->d.if_d.true_statement, mem_offset, status);
+		relayout_statement(ast->d.if_d.false_statement, mem_offset, status);
+		break;
+	case NODE_SWITCH:
+		relayout_statement(ast->d.switch_d.statement, mem_offset, status);
+		break;
+	case NODE_CASE:
+		relayout_statement(ast->d.case_d.statement, mem_offset, status);
+		break;
+	case NODE_DEFAULT:
+		relayout_statement(ast->d.default_d.statement, mem_offset, status);
+		break;
+	case NODE_WHILE:
+	case NODE_DO_WHILE:
+		relayout_statement(ast->d.while_d.statement, mem_offset, status);
+		break;
+	case NODE_FOR:
+		mem_offset.push_back(mem_offset.back());
+		relayout_statement(ast->d.for_d.init, mem_offset, status);
+		relayout_statement(ast->d.for_d.body, mem_offset, status);
+		mem_offset.pop_back();
+		break;
+	default:
+		break;
+	}
+}
+
+// メモリ上に残った変数の位置を詰め直す (引数は4バイトずつ積む)
+static void relayout_memory(ast_node* body, const std::vector<var_info*>& arguments, codegen_status& status) {
+	std::vector<int> mem_offset(1, 0);
+	for (auto itr = arguments.begin(); itr != arguments.end(); itr++) {
+		if ((*itr)->is_register) continue;
+		(*itr)->offset = mem_offset.back();
+		mem_offset.back() += 4;
+	}
+	status.lv_mem_size = mem_offset.back();
+	relayout_statement(body, mem_offset, status);
+}
+
+// アドレスを取られない変数を、使用回数の多い順に空いているレジスタに置く
+// 前処理の後、レジスタの割り当ての前に呼ぶこと (registerやpragmaで指定された変数はそのまま)
+// arguments : 引数の情報 (宣言順)
+// レジスタに置いた変数を、優先度の高い順に返す
+std::vector<var_info*> codegen_promote_variables(ast_node* body, const std::vector<var_info*>& arguments,
+codegen_status& status) {
+	promote_status ps;
+	ps.max_temps = 0;
+	ps.loop_depth = 0;
+	for (auto itr = arguments.begin(); itr != arguments.end(); itr++) {
+		if (is_promote_candidate(*itr)) {
+			ps.candidates.push_back(*itr);
+			ps.weights[*itr] = 0;
+		}
+	}
+	promote_scan_statement(ps, body);
+
+	// 使えるレジスタの数を求める (codegen_func()での割り当てと同じ条件でグローバル変数用を除く)
+	int regs_free = 8 - status.lv_reg_size;
+	if (status.gv_exists && ((!status.entry_function && status.gv_access_exists) || status.call_exists)) {
+		regs_free--;
+	}
+	int temps = ps.max_temps < PROMOTE_MIN_TEMPS ? PROMOTE_MIN_TEMPS : ps.max_temps;
+	int promote_num = regs_free - temps;
+	// 関数呼び出しがあるなら、引数用で呼び出しの度に退避が要るR0～R3は使わず、R4～R7のみを使う
+	if (status.call_exists && promote_num > regs_free - 4) promote_num = regs_free - 4;
+	std::vector<var_info*> order;
+	if (promote_num <= 0) return order;
+
+	for (auto itr = ps.candidates.begin(); itr != ps.candidates.end(); itr++) {
+		if (ps.weights[*itr] > 0) order.push_back(*itr);
+	}
+	std::sort(order.begin(), order.end(), promote_compare(ps));
+	if (order.size() > static_cast<size_t>(promote_num)) order.resize(promote_num);
+	if (order.empty()) return order;
+	for (auto itr = order.begin(); itr != order.end(); itr++) {
+		(*itr)->is_register = true;
+		(*itr)->offset = status.lv_reg_size++;
+		status.lv_reg_assign.push_back(-1);
+	}
+	relayout_memory(body, arguments, status);
+	return order;
+}
+
+// 文の中で定義された変数を集める
+static void collect_var_defines(ast_node* ast, std::vector<var_info*>& vars) {
+	if (ast == nullptr) return;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			collect_var_defines(ast->d.array.nodes[i], vars);
+		}
+		break;
+	case NODE_VAR_DEFINE:
+		vars.push_back(ast->d.var_def.info);
+		break;
+	case NODE_LABEL:
+		collect_var_defines(ast->d.label.statement, vars);
+		break;
+	case NODE_IF:
+		collect_var_defines(ast->d.if_d.true_statement, vars);
+		collect_var_defines(ast->d.if_d.false_statement, vars);
+		break;
+	case NODE_SWITCH:
+		collect_var_defines(ast->d.switch_d.statement, vars);
+		break;
+	case NODE_CASE:
+		collect_var_defines(ast->d.case_d.statement, vars);
+		break;
+	case NODE_DEFAULT:
+		collect_var_defines(ast->d.default_d.statement, vars);
+		break;
+	case NODE_WHILE:
+	case NODE_DO_WHILE:
+		collect_var_defines(ast->d.while_d.statement, vars);
+		break;
+	case NODE_FOR:
+		collect_var_defines(ast->d.for_d.init, vars);
+		collect_var_defines(ast->d.for_d.body, vars);
+		break;
+	default:
+		break;
+	}
+}
+
+// レジスタ変数の枠slotを使う変数を全てメモリに移し、後ろの枠を詰める
+// (ブロックが異なる変数は同じ枠を共有するため、枠単位で移す)
+void codegen_demote_register_slot(int slot, ast_node* body, const std::vector<var_info*>& arguments,
+codegen_status& status) {
+	std::vector<var_info*> vars(arguments);
+	collect_var_defines(body, vars);
+	for (auto itr = vars.begin(); itr != vars.end(); itr++) {
+		if ((*itr)->is_global || !(*itr)->is_register) continue;
+		if ((*itr)->offset == slot) {
+			(*itr)->is_register = false;
+		} else if ((*itr)->offset > slot) {
+			(*itr)->offset--;
+		}
+	}
+	status.lv_reg_size--;
+	status.lv_reg_assign.erase(status.lv_reg_assign.begin() + slot);
+	relayout_memory(body, arguments, status);
+}
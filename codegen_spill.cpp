@@ -0,0 +1,219 @@
+#include <map>
+#include <vector>
+#include "ast.h"
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// PUSHとPOPで退避・復帰するのにかかるサイクル数
+static const int SPILL_PUSH_POP_CYCLES = 4;
+// R8～R11とのMOVで退避・復帰するのにかかるサイクル数
+static const int SPILL_HIGH_REG_CYCLES = 2;
+// 作り直しに使う命令の数の上限
+static const size_t REMAT_MAX_INSTS = 3;
+
+// 作り直しに使える命令かを判定する
+// regのみに書き込み、reg・SP・グローバル変数用のレジスタ以外を読まないものに限る
+static bool is_remat_inst(const asm_inst& inst, int reg, int gvreg, bool& reads_reg, bool& reads_sp) {
+	const uint32_t* p = inst.params;
+	if (static_cast<int>(p[0]) != reg) return false;
+	reads_reg = reads_sp = false;
+	switch (inst.kind) {
+	case MOV_LIT:
+		return true;
+	case LDL_PC_LIT:
+		return codegen_is_literal_request(inst);
+	case ADD_LIT: case SUB_LIT:
+		reads_reg = true;
+		return true;
+	case SHL_REG_LIT: case SHR_REG_LIT: case ASR_REG_LIT:
+	case NEG_REG: case NOT_REG: case MUL_REG: case REV_REG: case REV16_REG: case REVSH_REG:
+		reads_reg = true;
+		return static_cast<int>(p[1]) == reg;
+	case ADD_SP_LIT:
+		reads_sp = true;
+		return true;
+	case MOV_REG:
+		reads_sp = p[1] == 13;
+		return reads_sp || (gvreg >= 0 && static_cast<int>(p[1]) == gvreg);
+	case ADD_REG_LIT: case SUB_REG_LIT:
+		reads_reg = static_cast<int>(p[1]) == reg;
+		return reads_reg || (gvreg >= 0 && static_cast<int>(p[1]) == gvreg);
+	case ADD_REG:
+		reads_reg = true;
+		reads_sp = p[1] == 13;
+		return reads_sp || (gvreg >= 0 && static_cast<int>(p[1]) == gvreg);
+	default:
+		return false;
+	}
+}
+
+// 作り直しにかかるサイクル数 (リテラルプールからの読み込みは2サイクル)
+static int remat_cycles(const std::vector<asm_inst>& insts) {
+	int cycles = 0;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		cycles += codegen_is_literal_request(*itr) ? 2 : 1;
+	}
+	return cycles;
+}
+
+// 値を保持する間、その値を作り直せるなら作り直し方を記録する
+void codegen_hold_value(const codegen_expr_result& held, int stack_extra_offset, codegen_status& status) {
+	int reg = held.result_reg;
+	if (reg < 0 || 8 <= reg) return;
+	status.held_values.erase(reg);
+	if (held.insts.empty() || held.insts.size() > REMAT_MAX_INSTS) return;
+	bool sp_used = false;
+	for (size_t i = 0; i < held.insts.size(); i++) {
+		bool reads_reg, reads_sp;
+		if (!is_remat_inst(held.insts[i], reg, status.gv_access_register, reads_reg, reads_sp)) return;
+		// 最初の命令は、レジスタの元の値を読んではいけない
+		if (i == 0 && reads_reg) return;
+		if (reads_sp) sp_used = true;
+	}
+	codegen_status::held_value& value = status.held_values[reg];
+	value.insts = held.insts;
+	value.stack_extra_offset = sp_used ? stack_extra_offset : -1;
+}
+
+// 値の保持をやめる
+void codegen_release_value(int reg, codegen_status& status) {
+	status.held_values.erase(reg);
+}
+
+// heldの値を保持したまま、式のコード生成を行う
+codegen_expr_result codegen_expr_holding(const codegen_expr_result& held,
+expression_node* expr, int lineno, bool want_result, bool prefer_callee_save,
+int result_prefer_reg, int regs_available, int stack_extra_offset, codegen_status& status) {
+	codegen_hold_value(held, stack_extra_offset, status);
+	codegen_expr_result result = codegen_expr(expr, lineno, want_result, prefer_callee_save,
+		result_prefer_reg, regs_available, stack_extra_offset, status);
+	codegen_release_value(held.result_reg, status);
+	return result;
+}
+
+// 式の中で読み書きするレジスタ変数のレジスタを求める
+static int regs_used_by_expr(expression_node* expr, const codegen_status& status) {
+	if (expr == nullptr) return 0;
+	switch (expr->kind) {
+	case EXPR_IDENTIFIER:
+		{
+			var_info* vinfo = expr->info.ident.info;
+			if (vinfo != nullptr && vinfo->is_register && !vinfo->is_global) {
+				int reg = status.lv_reg_assign.at(vinfo->offset);
+				if (reg >= 0) return 1 << reg;
+			}
+		}
+		return 0;
+	case EXPR_OPERATOR:
+		{
+			int regs = regs_used_by_expr(expr->info.op.operands[0], status);
+			if (expr->info.op.kind > OP_DUMMY_BINARY_START) {
+				regs |= regs_used_by_expr(expr->info.op.operands[1], status);
+			}
+			if (expr->info.op.kind > OP_DUMMY_TERNARY_START) {
+				regs |= regs_used_by_expr(expr->info.op.operands[2], status);
+			}
+			return regs;
+		}
+	default:
+		return 0;
+	}
+}
+
+// 退避の方法
+enum spill_kind {
+	SPILL_REMAT, // 後で作り直す
+	SPILL_HIGH_REG, // R8～R11に移しておく
+	SPILL_PUSH // スタックに積んでおく
+};
+
+// レジスタが足りずに式のコード生成ができなかった時に、使用中のレジスタを1個退避して生成し直す
+// 退避するレジスタと方法は、作り直し・R8～R11への移動・PUSH/POPのうちサイクル数が最小のものを選ぶ
+// それでも足りなければ、呼び出したcodegen_expr()がさらに別のレジスタを退避する
+codegen_expr_result codegen_expr_with_spill(expression_node* expr, int lineno, bool want_result,
+bool prefer_callee_save, int result_prefer_reg, int regs_available, int stack_extra_offset,
+codegen_status& status) {
+	// 式が使うレジスタ変数、結果を置くレジスタ、グローバル変数用のレジスタは退避できない
+	int candidates = 0xff & ~regs_available & ~regs_used_by_expr(expr, status);
+	if (result_prefer_reg >= 0) candidates &= ~(1 << result_prefer_reg);
+	if (status.gv_access_register >= 0) candidates &= ~(1 << status.gv_access_register);
+	int high_reg = -1;
+	for (int reg = 8; reg < 12 && high_reg < 0; reg++) {
+		if (!((status.high_regs_in_use >> reg) & 1)) high_reg = reg;
+	}
+	int spill_reg = -1, spill_cycles = 0;
+	spill_kind kind = SPILL_PUSH;
+	for (int reg = 0; reg < 8; reg++) {
+		if (!((candidates >> reg) & 1)) continue;
+		int cycles = high_reg >= 0 ? SPILL_HIGH_REG_CYCLES : SPILL_PUSH_POP_CYCLES;
+		spill_kind reg_kind = high_reg >= 0 ? SPILL_HIGH_REG : SPILL_PUSH;
+		auto itr = status.held_values.find(reg);
+		if (itr != status.held_values.end() && (itr->second.stack_extra_offset < 0 ||
+		itr->second.stack_extra_offset == stack_extra_offset)) {
+			int rcycles = remat_cycles(itr->second.insts);
+			if (rcycles <= cycles) {
+				cycles = rcycles;
+				reg_kind = SPILL_REMAT;
+			}
+		}
+		if (spill_reg < 0 || cycles < spill_cycles) {
+			spill_reg = reg;
+			spill_cycles = cycles;
+			kind = reg_kind;
+		}
+	}
+	if (spill_reg < 0) throw codegen_register_error(lineno);
+
+	std::vector<asm_inst> result;
+	std::vector<asm_inst> remat_insts;
+	auto held_itr = status.held_values.find(spill_reg);
+	int high_regs_in_use_saved = status.high_regs_in_use;
+	switch (kind) {
+	case SPILL_REMAT:
+		remat_insts = held_itr->second.insts;
+		break;
+	case SPILL_HIGH_REG:
+		result.push_back(asm_inst(MOV_REG, high_reg, spill_reg));
+		status.registers_written |= 1 << high_reg;
+		status.high_regs_in_use |= 1 << high_reg;
+		break;
+	case SPILL_PUSH:
+		result.push_back(asm_inst(PUSH_REGS, 1 << spill_reg));
+		break;
+	}
+	int inner_stack_extra_offset = stack_extra_offset + (kind == SPILL_PUSH ? 4 : 0);
+	// 退避したレジスタは書き換えられるので、退避している間は作り直し方を消しておく
+	std::map<int, codegen_status::held_value> held_values_saved = status.held_values;
+	if (held_itr != status.held_values.end()) status.held_values.erase(held_itr);
+	// 結果を置くレジスタが空いていれば、それを指定する (退避したレジスタに置かれると移す必要がある)
+	int inner_prefer_reg = result_prefer_reg;
+	if (want_result && inner_prefer_reg < 0 && regs_available != 0) {
+		inner_prefer_reg = get_reg_to_use(lineno, regs_available, prefer_callee_save);
+	}
+	codegen_expr_result inner = codegen_expr(expr, lineno, want_result, prefer_callee_save,
+		inner_prefer_reg, regs_available | (1 << spill_reg), inner_stack_extra_offset, status);
+	status.held_values = held_values_saved;
+	status.high_regs_in_use = high_regs_in_use_saved;
+	result.insert(result.end(), inner.insts.begin(), inner.insts.end());
+
+	int result_reg = inner.result_reg;
+	if (want_result && result_reg == spill_reg) {
+		// 結果が退避したレジスタに置かれたので、他のレジスタに移す
+		result_reg = inner_prefer_reg >= 0 ? inner_prefer_reg :
+			get_reg_to_use(lineno, regs_available, prefer_callee_save);
+		result.push_back(asm_inst(MOV_REG, result_reg, spill_reg));
+		status.registers_written |= 1 << result_reg;
+	}
+	switch (kind) {
+	case SPILL_REMAT:
+		result.insert(result.end(), remat_insts.begin(), remat_insts.end());
+		break;
+	case SPILL_HIGH_REG:
+		result.push_back(asm_inst(MOV_REG, spill_reg, high_reg));
+		break;
+	case SPILL_PUSH:
+		result.push_back(asm_inst(POP_REGS, 1 << spill_reg));
+		break;
+	}
+	return codegen_expr_result(result, result_reg);
+}
@@ -1,6 +1,224 @@
 #include <vector>
+#include <climits>
 #include "codegen_internal.hpp"
 
+// 式が指定の変数を書き換える可能性があるかを調べる
+static bool expr_may_write_var(expression_node* expr, var_info* vinfo) {
+	if (expr == nullptr || expr->kind != EXPR_OPERATOR) return false;
+	switch (expr->info.op.kind) {
+	case OP_POST_INC: case OP_POST_DEC: case OP_PRE_INC: case OP_PRE_DEC:
+	case OP_ADDRESS:
+	case OP_ASSIGN:
+	case OP_MUL_ASSIGN: case OP_DIV_ASSIGN: case OP_MOD_ASSIGN: case OP_ADD_ASSIGN: case OP_SUB_ASSIGN:
+	case OP_SHL_ASSIGN: case OP_SHR_ASSIGN: case OP_AND_ASSIGN: case OP_XOR_ASSIGN: case OP_OR_ASSIGN:
+		if (expr->info.op.operands[0]->kind == EXPR_IDENTIFIER &&
+		expr->info.op.operands[0]->info.ident.info == vinfo) {
+			return true;
+		}
+		break;
+	default:
+		break;
+	}
+	if (expr_may_write_var(expr->info.op.operands[0], vinfo)) return true;
+	if (expr->info.op.kind > OP_DUMMY_BINARY_START &&
+	expr_may_write_var(expr->info.op.operands[1], vinfo)) return true;
+	if (expr->info.op.kind > OP_DUMMY_TERNARY_START &&
+	expr_may_write_var(expr->info.op.operands[2], vinfo)) return true;
+	return false;
+}
+
+// 文が指定の変数を書き換える可能性があるかを調べる
+// (ラベルがある場合、外から飛び込まれる可能性があるので、書き換えるとみなす)
+static bool statement_may_write_var(ast_node* ast, var_info* vinfo) {
+	if (ast == nullptr) return false;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			if (statement_may_write_var(ast->d.array.nodes[i], vinfo)) return true;
+		}
+		return false;
+	case NODE_VAR_DEFINE:
+		return expr_may_write_var(ast->d.var_def.initializer, vinfo);
+	case NODE_EXPR:
+		return expr_may_write_var(ast->d.expr.expression, vinfo);
+	case NODE_LABEL:
+		return true;
+	case NODE_IF:
+		return expr_may_write_var(ast->d.if_d.cond, vinfo) ||
+			statement_may_write_var(ast->d.if_d.true_statement, vinfo) ||
+			statement_may_write_var(ast->d.if_d.false_statement, vinfo);
+	case NODE_SWITCH:
+		return expr_may_write_var(ast->d.switch_d.expr, vinfo) ||
+			statement_may_write_var(ast->d.switch_d.statement, vinfo);
+	case NODE_CASE:
+		return statement_may_write_var(ast->d.case_d.statement, vinfo);
+	case NODE_DEFAULT:
+		return statement_may_write_var(ast->d.default_d.statement, vinfo);
+	case NODE_WHILE:
+	case NODE_DO_WHILE:
+		return expr_may_write_var(ast->d.while_d.cond, vinfo) ||
+			statement_may_write_var(ast->d.while_d.statement, vinfo);
+	case NODE_FOR:
+		return statement_may_write_var(ast->d.for_d.init, vinfo) ||
+			expr_may_write_var(ast->d.for_d.cond, vinfo) ||
+			expr_may_write_var(ast->d.for_d.post, vinfo) ||
+			statement_may_write_var(ast->d.for_d.body, vinfo);
+	case NODE_RETURN:
+		return expr_may_write_var(ast->d.ret.ret_expression, vinfo);
+	default:
+		return false;
+	}
+}
+
+// 値を指定の整数型で表せる値に変換する
+static long long convert_to_type(long long value, type_node* type) {
+	int bits = type->size * 8;
+	unsigned long long mask = bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+	unsigned long long uvalue = static_cast<unsigned long long>(value) & mask;
+	if (type->info.is_signed && bits < 64 && ((uvalue >> (bits - 1)) & 1)) {
+		return static_cast<long long>(uvalue) - static_cast<long long>(1ULL << bits);
+	}
+	return static_cast<long long>(uvalue);
+}
+
+// 「変数 = 定数; 変数 比較 定数; 変数を定数だけ増減」の形のforループの繰り返し回数を求める
+// 求められない場合は負の数を返す
+long long get_for_loop_count(ast_node* ast) {
+	// 繰り返し回数がこれより多い場合は求めない
+	static const long long count_limit = 1 << 20;
+	ast_node* init = ast->d.for_d.init;
+	expression_node* cond = ast->d.for_d.cond;
+	expression_node* post = ast->d.for_d.post;
+	if (init == nullptr || init->kind != NODE_EXPR || cond == nullptr || post == nullptr) return -1;
+	// 初期化
+	expression_node* init_expr = init->d.expr.expression;
+	if (init_expr->kind != EXPR_OPERATOR || init_expr->info.op.kind != OP_ASSIGN ||
+	init_expr->info.op.operands[0]->kind != EXPR_IDENTIFIER ||
+	init_expr->info.op.operands[1]->kind != EXPR_INTEGER_LITERAL) {
+		return -1;
+	}
+	var_info* vinfo = init_expr->info.op.operands[0]->info.ident.info;
+	if (vinfo->is_global || vinfo->address_taken || !is_integer_type(vinfo->type)) return -1;
+	long long value = convert_to_type(init_expr->info.op.operands[1]->info.value, vinfo->type);
+	// 条件式
+	if (cond->kind != EXPR_OPERATOR) return -1;
+	operator_type cond_op = cond->info.op.kind;
+	if (cond_op != OP_LESS && cond_op != OP_GREATER && cond_op != OP_LESS_EQUAL &&
+	cond_op != OP_GREATER_EQUAL && cond_op != OP_NOT_EQUAL) {
+		return -1;
+	}
+	expression_node* cond_left = cond->info.op.operands[0];
+	expression_node* cond_right = cond->info.op.operands[1];
+	if (cond_left->kind != EXPR_OPERATOR || cond_left->info.op.kind != OP_READ_VALUE ||
+	cond_left->info.op.operands[0]->kind != EXPR_IDENTIFIER ||
+	cond_left->info.op.operands[0]->info.ident.info != vinfo ||
+	cond_right->kind != EXPR_INTEGER_LITERAL) {
+		return -1;
+	}
+	type_node* cmp_type = usual_arithmetic_conversion(cond_left->type, cond_right->type);
+	if (cmp_type == NULL || !is_integer_type(cmp_type)) return -1;
+	long long limit = convert_to_type(cond_right->info.value, cmp_type);
+	// 更新式
+	if (post->kind != EXPR_OPERATOR || post->info.op.operands[0]->kind != EXPR_IDENTIFIER ||
+	post->info.op.operands[0]->info.ident.info != vinfo) {
+		return -1;
+	}
+	long long step;
+	switch (post->info.op.kind) {
+	case OP_POST_INC: case OP_PRE_INC: step = 1; break;
+	case OP_POST_DEC: case OP_PRE_DEC: step = -1; break;
+	case OP_ADD_ASSIGN: case OP_SUB_ASSIGN:
+		if (post->info.op.operands[1]->kind != EXPR_INTEGER_LITERAL) return -1;
+		step = static_cast<int32_t>(post->info.op.operands[1]->info.value);
+		if (post->info.op.kind == OP_SUB_ASSIGN) step = -step;
+		break;
+	default:
+		return -1;
+	}
+	// ループの中で変数が書き換えられないことを確認する
+	if (expr_may_write_var(cond, vinfo) || statement_may_write_var(ast->d.for_d.body, vinfo)) return -1;
+	// 実際に回してみる
+	long long count = 0;
+	for (;;) {
+		long long cmp_value = convert_to_type(value, cmp_type);
+		bool cond_result = false;
+		switch (cond_op) {
+		case OP_LESS: cond_result = cmp_value < limit; break;
+		case OP_GREATER: cond_result = cmp_value > limit; break;
+		case OP_LESS_EQUAL: cond_result = cmp_value <= limit; break;
+		case OP_GREATER_EQUAL: cond_result = cmp_value >= limit; break;
+		case OP_NOT_EQUAL: cond_result = cmp_value != limit; break;
+		default: break;
+		}
+		if (!cond_result) break;
+		if (++count > count_limit) return -1;
+		value = convert_to_type(value + step, vinfo->type);
+	}
+	return count;
+}
+
+// 文がループを途中で抜ける (breakやreturnやgotoをする) 可能性があるかを調べる
+// nested : 中のループやswitch文の中か (そこでのbreakは、そのループやswitch文を抜けるだけ)
+static bool statement_may_leave_loop(ast_node* ast, bool nested) {
+	if (ast == nullptr) return false;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			if (statement_may_leave_loop(ast->d.array.nodes[i], nested)) return true;
+		}
+		return false;
+	case NODE_LABEL:
+		return statement_may_leave_loop(ast->d.label.statement, nested);
+	case NODE_IF:
+		return statement_may_leave_loop(ast->d.if_d.true_statement, nested) ||
+			statement_may_leave_loop(ast->d.if_d.false_statement, nested);
+	case NODE_SWITCH:
+		return statement_may_leave_loop(ast->d.switch_d.statement, true);
+	case NODE_CASE:
+		return statement_may_leave_loop(ast->d.case_d.statement, nested);
+	case NODE_DEFAULT:
+		return statement_may_leave_loop(ast->d.default_d.statement, nested);
+	case NODE_WHILE:
+	case NODE_DO_WHILE:
+		return statement_may_leave_loop(ast->d.while_d.statement, true);
+	case NODE_FOR:
+		return statement_may_leave_loop(ast->d.for_d.body, true);
+	case NODE_BREAK:
+		return !nested;
+	case NODE_GOTO:
+	case NODE_RETURN:
+		return true;
+	default:
+		return false;
+	}
+}
+
+long long get_for_loop_min_count(ast_node* ast) {
+	if (statement_may_leave_loop(ast->d.for_d.body, false)) return -1;
+	return get_for_loop_count(ast);
+}
+
+// ループの後方ジャンプに繰り返し回数の上限と下限を設定する
+static void set_loop_bound(std::vector<asm_inst>& insts, const std::string& loop_label, long long bound,
+long long min = -1) {
+	if (bound < 0) return;
+	if (bound > INT_MAX) bound = INT_MAX;
+	if (min > bound) min = bound;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if ((itr->kind == JCC || itr->kind == JMP_DIRECT) && itr->label == loop_label) {
+			itr->loop_bound = static_cast<int>(bound);
+			itr->loop_min = static_cast<int>(min);
+		}
+	}
+}
+
+// 行番号が設定されていない命令に行番号を設定する
+void codegen_set_lineno(std::vector<asm_inst>& insts, int lineno) {
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if (itr->lineno == 0) itr->lineno = lineno;
+	}
+}
+
 // 文のコード生成を行う
 std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 	if (ast == nullptr) {
@@ -12,9 +230,11 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 		{
 			size_t num = ast->d.array.num;
 			ast_node** nodes = ast->d.array.nodes;
+			status.pragma_loop_bound = -1;
 			for (size_t i = 0; i < num; i++) {
 				std::vector<asm_inst> sub_result = codegen_statement(nodes[i], status);
 				result.insert(result.end(), sub_result.begin(), sub_result.end());
+				if (nodes[i]->kind != NODE_PRAGMA) status.pragma_loop_bound = -1;
 			}
 		}
 		break;
@@ -34,7 +254,19 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 		// 何もしない
 		break;
 	case NODE_PRAGMA:
-		// 何もしない
+		{
+			// 次のループの繰り返し回数の上限の指定を読み取る
+			size_t token_num = ast->d.array.num;
+			ast_node** tokens = ast->d.array.nodes;
+			if (token_num >= 1 && tokens[0]->kind == NODE_CONTROL_IDENTIFIER &&
+			std::string(tokens[0]->d.identifier.name) == "loop_bound") {
+				if (token_num < 2 || tokens[1]->kind != NODE_CONTROL_INTEGER) {
+					throw codegen_error(ast->lineno, "invalid loop bound specification");
+				}
+				uint32_t bound = tokens[1]->d.integer.value;
+				status.pragma_loop_bound = bound > INT_MAX ? INT_MAX : bound;
+			}
+		}
 		break;
 	case NODE_LABEL:
 		{
@@ -75,44 +307,30 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 			int available_regs = 0xff & ~status.registers_reserved;
 			codegen_expr_result expr_result = codegen_expr(ast->d.switch_d.expr, ast->lineno, true, false,
 				-1, available_regs, 0, status);
+			result.insert(result.end(), expr_result.insts.begin(), expr_result.insts.end());
 			available_regs &= ~(1 << expr_result.result_reg);
 			int default_label = ast->d.switch_d.info->default_label;
 			int end_label = status.next_label++;
 			if (default_label < 0) {
 				default_label = end_label;
 			}
+			// 定数の代入かreturnだけなら、表引きにする
+			std::vector<asm_inst> lookup;
+			if (codegen_switch_lookup(ast, expr_result.result_reg, end_label, available_regs, lookup, status)) {
+				result.insert(result.end(), lookup.begin(), lookup.end());
+				result.push_back(asm_inst(LABEL, get_label(end_label)));
+				break;
+			}
 			// 分岐部分を生成する
-			uint32_t prev_value = 0;
-			int compare_reg = -1;
-			auto& case_labels = ast->d.switch_d.info->case_labels;
-			for (auto itr = case_labels.begin(); itr != case_labels.end(); itr++) {
-				uint32_t value = itr->first;
-				std::string label = get_label(itr->second);
-				if (value < 256) {
-					// u8と比較する命令で直接比較する
-					result.push_back(asm_inst(CMP_REG_LIT, expr_result.result_reg, value));
-					result.push_back(asm_inst(JCC, EQ, label));
-				} else {
-					// 比較対象の値をレジスタに入れて比較する
-					if (compare_reg < 0) {
-						// レジスタを割り当てる
-						compare_reg = get_reg_to_use(ast->lineno, available_regs, false);
-						std::vector<asm_inst> ncode = codegen_put_number(compare_reg, value);
-						result.insert(result.end(), ncode.begin(), ncode.end());
-					} else if (value - prev_value < 256) {
-						// 前の値との差分が小さいので、差分を足す
-						result.push_back(asm_inst(ADD_LIT, compare_reg, value - prev_value));
-					} else {
-						// 値を最初から生成する
-						std::vector<asm_inst> ncode = codegen_put_number(compare_reg, value);
-						result.insert(result.end(), ncode.begin(), ncode.end());
-					}
-					prev_value = value;
-					result.push_back(asm_inst(CMP_REG_REG, expr_result.result_reg, compare_reg));
-					result.push_back(asm_inst(JCC, EQ, label));
-				}
+			int num_temps = 0;
+			for (int i = 0; i < 8; i++) {
+				if ((available_regs >> i) & 1) num_temps++;
 			}
-			result.push_back(asm_inst(JMP_DIRECT, get_label(default_label)));
+			switch_plan plan = codegen_plan_switch(ast->d.switch_d.info->case_labels, default_label,
+				num_temps, true);
+			std::vector<asm_inst> dispatch = codegen_switch_dispatch(plan, expr_result.result_reg, default_label,
+				available_regs, ast->lineno, status);
+			result.insert(result.end(), dispatch.begin(), dispatch.end());
 			// 中身の文のコードを生成する
 			status.break_labels.push_back(end_label);
 			std::vector<asm_inst> sub_result = codegen_statement(ast->d.switch_d.statement, status);
@@ -144,6 +362,9 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 			std::string continue_label = get_label(continue_label_id);
 			std::string loop_label = get_label(loop_label_id);
 			std::string break_label = get_label(break_label_id);
+			// 繰り返し回数の上限を取得する
+			long long loop_bound = status.pragma_loop_bound;
+			status.pragma_loop_bound = -1;
 			// continueとbreakに使うラベル情報を登録する
 			status.continue_labels.push_back(continue_label_id);
 			status.break_labels.push_back(break_label_id);
@@ -159,6 +380,9 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 			result.push_back(asm_inst(LABEL, continue_label));
 			std::vector<asm_inst> cond_result = codegen_conditional_jump(ast->d.while_d.cond, ast->lineno,
 				loop_label, true, 0xff & ~status.registers_reserved, 0, status);
+			// do-whileでは、最初の1回は後方ジャンプを通らない
+			if (ast->kind == NODE_DO_WHILE && loop_bound > 0) loop_bound--;
+			set_loop_bound(cond_result, loop_label, loop_bound);
 			result.insert(result.end(), cond_result.begin(), cond_result.end());
 			// ループ終了
 			result.push_back(asm_inst(LABEL, break_label));
@@ -177,6 +401,12 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 			std::string continue_label = get_label(continue_label_id);
 			std::string loop_label = get_label(loop_label_id);
 			std::string break_label = get_label(break_label_id);
+			// 繰り返し回数の上限を取得する (指定が無ければ、式から求める)
+			long long loop_bound = status.pragma_loop_bound;
+			status.pragma_loop_bound = -1;
+			if (loop_bound < 0) loop_bound = get_for_loop_count(ast);
+			// 繰り返し回数が決まっていれば、それを下限とする
+			long long loop_min = get_for_loop_min_count(ast);
 			// continueとbreakに使うラベル情報を登録する
 			status.continue_labels.push_back(continue_label_id);
 			status.break_labels.push_back(break_label_id);
@@ -205,6 +435,7 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 			} else {
 				cond_result.push_back(asm_inst(JMP_DIRECT, loop_label));
 			}
+			set_loop_bound(cond_result, loop_label, loop_bound, loop_min);
 			result.insert(result.end(), cond_result.begin(), cond_result.end());
 			// ループ終了
 			result.push_back(asm_inst(LABEL, break_label));
@@ -235,6 +466,12 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 		if (ast->d.ret.ret_expression != nullptr) {
 			codegen_expr_result eres = codegen_expr(ast->d.ret.ret_expression, ast->lineno, true, false,
 				0, 0xff & ~status.registers_reserved, 0, status);
+			// 関数呼び出しの結果をそのまま返す場合は、末尾呼び出しにできる
+			if (status.tail_call_allowed && eres.result_reg == 0 && !eres.insts.empty() &&
+			(eres.insts.back().kind == CALL_DIRECT || eres.insts.back().kind == CALL_INDIRECT) &&
+			codegen_is_tail_call(ast->d.ret.ret_expression, status.return_type)) {
+				eres.insts.back().params[1] = CALL_TAIL_OK;
+			}
 			result.insert(result.end(), eres.insts.begin(), eres.insts.end());
 			if (eres.result_reg != 0) {
 				result.push_back(asm_inst(MOV_REG, 0, eres.result_reg));
@@ -245,5 +482,7 @@ std::vector<asm_inst> codegen_statement(ast_node* ast, codegen_status& status) {
 	default:
 		throw codegen_error(ast->lineno, "unexpected node passed to codegen_statement()");
 	}
+	// 中の文で設定されなかった命令 (条件分岐など) は、この文から生成されたものとする
+	codegen_set_lineno(result, ast->lineno);
 	return result;
 }
@@ -186,7 +186,14 @@ void codegen_preprocess_statement(ast_node* ast, codegen_status& status) {
 			int label_id = status.next_label++;
 			ast->d.case_d.info = new switch_label_info(label_id);
 			info->case_labels[ast->d.case_d.number] = label_id;
-			codegen_preprocess_statement(ast->d.case_d.statement, status);
+			ast_node* statement = ast->d.case_d.statement;
+			codegen_preprocess_statement(statement, status);
+			// 文を挟まずに続くcase・defaultと同じ場所に分岐させ、分岐先が同じことを分かるようにする
+			if (statement != nullptr && statement->kind == NODE_CASE) {
+				info->case_labels[ast->d.case_d.number] = info->case_labels[statement->d.case_d.number];
+			} else if (statement != nullptr && statement->kind == NODE_DEFAULT) {
+				info->case_labels[ast->d.case_d.number] = info->default_label;
+			}
 		}
 		break;
 	case NODE_DEFAULT:
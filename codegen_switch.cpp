@@ -0,0 +1,647 @@
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// 1サイクルを何バイトとみなして、サイズと速度を合わせた費用にするか
+static const int SWITCH_CYCLE_WEIGHT = 4;
+// ジャンプ表にするcaseの数の下限
+static const size_t SWITCH_MIN_TABLE_CASES = 4;
+// ジャンプ表の範囲の幅の上限 (範囲の判定にu8との比較を使う)
+static const uint32_t SWITCH_MAX_TABLE_SPAN = 255;
+// ビットの集合で調べる範囲の幅の上限と、分岐先の数の上限
+static const uint32_t SWITCH_MAX_BITS_SPAN = 31;
+static const size_t SWITCH_MAX_BITS_TARGETS = 3;
+
+// 命令の並びのバイト数とサイクル数
+struct switch_cost {
+	int bytes, cycles;
+
+	switch_cost(int b = 0, int c = 0) : bytes(b), cycles(c) {}
+	switch_cost operator+(const switch_cost& o) const { return switch_cost(bytes + o.bytes, cycles + o.cycles); }
+	int total() const { return bytes + SWITCH_CYCLE_WEIGHT * cycles; }
+};
+
+// レジスタに定数を置く費用
+static switch_cost number_cost(uint32_t value) {
+	std::vector<asm_inst> code = codegen_put_number(0, value);
+	if (code.size() == 1 && codegen_is_literal_request(code[0])) return switch_cost(6, 2);
+	return switch_cost(2 * code.size(), code.size());
+}
+
+// 値と定数を比較する費用
+static switch_cost compare_cost(uint32_t value) {
+	if (value < 256) return switch_cost(2, 1);
+	return number_cost(value) + switch_cost(2, 1);
+}
+
+// 値から区間の下端を引く費用
+static switch_cost subtract_cost(uint32_t low) {
+	if (low == 0) return switch_cost();
+	if (low < 8) return switch_cost(2, 1);
+	if (low < 256 || -low < 256) return switch_cost(4, 2);
+	return number_cost(low) + switch_cost(2, 1);
+}
+
+// 区間の下端を引くのに使う一時レジスタの数
+static int subtract_temps(uint32_t low) {
+	return low == 0 ? 0 : 1;
+}
+
+// 区間でcaseの値を調べる費用
+// (サイクル数は、ジャンプ表では分岐するとき、それ以外では当たらずに次に進むときの目安)
+static switch_cost segment_cost(const switch_segment& seg) {
+	switch (seg.kind) {
+	case SWITCH_SEG_CASE:
+		// 比較 + 条件分岐
+		return compare_cost(seg.low) + switch_cost(2, 1);
+	case SWITCH_SEG_RANGE:
+		// 引き算 + 比較 + 条件分岐
+		return subtract_cost(seg.low) + compare_cost(seg.high - seg.low) + switch_cost(2, 1);
+	case SWITCH_SEG_TABLE:
+		// 引き算 + 比較 + 範囲外への条件分岐 + 2倍 + PCへの足し算 + 詰め物 + 表からの分岐
+		return subtract_cost(seg.low) + switch_cost(2 + 2 + 2 + 2 + 2 + 2 * (seg.high - seg.low + 1), 1 + 1 + 1 + 3 + 3);
+	case SWITCH_SEG_BITS:
+		{
+			// 引き算 + 比較 + 範囲外への条件分岐 + 1をシフト + 分岐先ごとにマスクを置いて調べる
+			switch_cost cost = subtract_cost(seg.low) + switch_cost(2 + 2 + 2 + 2, 1 + 1 + 1 + 1);
+			for (auto itr = seg.bits.begin(); itr != seg.bits.end(); itr++) {
+				cost = cost + number_cost(itr->second) + switch_cost(4, 1 + 1);
+			}
+			return cost;
+		}
+	}
+	return switch_cost();
+}
+
+// 区間で調べるのに使う一時レジスタの数
+static int segment_temps(const switch_segment& seg) {
+	switch (seg.kind) {
+	case SWITCH_SEG_CASE:
+		return seg.low < 256 ? 0 : 1;
+	case SWITCH_SEG_RANGE:
+		return subtract_temps(seg.low) + (seg.high - seg.low < 256 ? 0 : 1);
+	case SWITCH_SEG_TABLE:
+		return 1;
+	case SWITCH_SEG_BITS:
+		return 2;
+	}
+	return 0;
+}
+
+// switch文の分岐の方法を決める
+switch_plan codegen_plan_switch(const std::map<uint32_t, int>& case_labels, int default_label,
+int num_temps, bool allow_table) {
+	// defaultと同じ場所に分岐するcaseは調べなくてよい
+	std::vector<std::pair<uint32_t, int> > cases;
+	for (auto itr = case_labels.begin(); itr != case_labels.end(); itr++) {
+		if (itr->second != default_label) cases.push_back(*itr);
+	}
+	size_t n = cases.size();
+	// best[i] : 最初のi個のcaseを区間に分けて調べる費用の最小値
+	std::vector<int> best(n + 1, 0);
+	std::vector<switch_segment> best_last(n + 1);
+	std::vector<size_t> best_from(n + 1, 0);
+	for (size_t i = 1; i <= n; i++) {
+		bool first_candidate = true;
+		std::set<int> targets;
+		for (size_t j = i; j-- > 0;) {
+			// cases[j]～cases[i - 1]を1個の区間にする候補
+			targets.insert(cases[j].second);
+			uint32_t low = cases[j].first, high = cases[i - 1].first;
+			std::vector<switch_segment> candidates;
+			if (j + 1 == i) {
+				switch_segment seg(SWITCH_SEG_CASE, low, high);
+				seg.labels.push_back(cases[j].second);
+				candidates.push_back(seg);
+			} else if (targets.size() == 1 && high - low == i - 1 - j) {
+				switch_segment seg(SWITCH_SEG_RANGE, low, high);
+				seg.labels.push_back(cases[j].second);
+				candidates.push_back(seg);
+			}
+			if (allow_table && i - j >= SWITCH_MIN_TABLE_CASES && high - low <= SWITCH_MAX_TABLE_SPAN) {
+				switch_segment seg(SWITCH_SEG_TABLE, low, high);
+				seg.labels.assign(high - low + 1, default_label);
+				for (size_t k = j; k < i; k++) seg.labels[cases[k].first - low] = cases[k].second;
+				candidates.push_back(seg);
+			}
+			if (j + 1 < i && high - low <= SWITCH_MAX_BITS_SPAN && targets.size() <= SWITCH_MAX_BITS_TARGETS) {
+				switch_segment seg(SWITCH_SEG_BITS, low, high);
+				std::map<int, uint32_t> masks;
+				for (size_t k = j; k < i; k++) masks[cases[k].second] |= UINT32_C(1) << (cases[k].first - low);
+				// caseの値が小さい分岐先から順に調べる
+				for (size_t k = j; k < i; k++) {
+					auto mitr = masks.find(cases[k].second);
+					if (mitr == masks.end()) continue;
+					seg.bits.push_back(*mitr);
+					masks.erase(mitr);
+				}
+				candidates.push_back(seg);
+			}
+			for (auto itr = candidates.begin(); itr != candidates.end(); itr++) {
+				// 1個の値との比較は、一時レジスタが無い場合も (足りなければエラーにして) 使う
+				if (itr->kind != SWITCH_SEG_CASE && segment_temps(*itr) > num_temps) continue;
+				int cost = best[j] + segment_cost(*itr).total();
+				if (first_candidate || cost < best[i]) {
+					best[i] = cost;
+					best_last[i] = *itr;
+					best_from[i] = j;
+					first_candidate = false;
+				}
+			}
+			// これより広い範囲は、ジャンプ表にもビットの集合にも範囲の判定にもできない
+			if (high - low > SWITCH_MAX_TABLE_SPAN && (targets.size() > 1 || high - low != i - 1 - j)) break;
+		}
+	}
+	switch_plan plan;
+	for (size_t i = n; i > 0; i = best_from[i]) plan.segments.push_back(best_last[i]);
+	std::reverse(plan.segments.begin(), plan.segments.end());
+	return plan;
+}
+
+// segments[first, last) を二分探索で分ける位置を返す (分けずに順に調べる場合は負)
+int codegen_switch_split_point(const switch_plan& plan, size_t first, size_t last) {
+	if (last - first < 2) return -1;
+	size_t mid = first + (last - first) / 2;
+	switch_cost lower, upper;
+	for (size_t i = first; i < mid; i++) lower = lower + segment_cost(plan.segments[i]);
+	for (size_t i = mid; i < last; i++) upper = upper + segment_cost(plan.segments[i]);
+	// 順に調べると全ての区間を通るが、分けると比較・条件分岐・defaultへのジャンプが増える代わりに片方だけを通る
+	switch_cost linear = lower + upper;
+	switch_cost split = compare_cost(plan.segments[mid].low) + switch_cost(2 + 2, 1 + 1);
+	split.bytes += linear.bytes;
+	split.cycles += std::max(lower.cycles, upper.cycles);
+	return split.total() < linear.total() ? static_cast<int>(mid) : -1;
+}
+
+struct switch_emit_status {
+	std::vector<asm_inst> result;
+	const switch_plan& plan;
+	int value_reg;
+	int default_label;
+	int temps[2];
+	int lineno;
+	codegen_status& status;
+
+	switch_emit_status(const switch_plan& plan_, int value_reg_, int default_label_, int lineno_,
+		codegen_status& status_) : plan(plan_), value_reg(value_reg_), default_label(default_label_),
+			temps{-1, -1}, lineno(lineno_), status(status_) {}
+};
+
+// 値と定数を比較する (temp : 定数が大きいときに使うレジスタ)
+static void emit_compare(switch_emit_status& es, int reg, uint32_t value, int temp) {
+	if (value < 256) {
+		es.result.push_back(asm_inst(CMP_REG_LIT, reg, value));
+	} else {
+		std::vector<asm_inst> ncode = codegen_put_number(temp, value);
+		es.result.insert(es.result.end(), ncode.begin(), ncode.end());
+		es.result.push_back(asm_inst(CMP_REG_REG, reg, temp));
+	}
+}
+
+// tempに (値 - low) を置き、引いた値が入っているレジスタを返す
+static int emit_subtract(switch_emit_status& es, uint32_t low, int temp) {
+	if (low == 0) return es.value_reg;
+	if (low < 8) {
+		es.result.push_back(asm_inst(SUB_REG_LIT, temp, es.value_reg, low));
+	} else if (low < 256) {
+		es.result.push_back(asm_inst(MOV_REG, temp, es.value_reg));
+		es.result.push_back(asm_inst(SUB_LIT, temp, low));
+	} else if (-low < 256) {
+		es.result.push_back(asm_inst(MOV_REG, temp, es.value_reg));
+		es.result.push_back(asm_inst(ADD_LIT, temp, -low));
+	} else {
+		std::vector<asm_inst> ncode = codegen_put_number(temp, low);
+		es.result.insert(es.result.end(), ncode.begin(), ncode.end());
+		es.result.push_back(asm_inst(SUB_REG_REG, temp, es.value_reg, temp));
+	}
+	return temp;
+}
+
+// 区間の値かを調べ、当たれば分岐する (外れた場合はfail_labelに進むか、次に流れる)
+static void emit_segment(switch_emit_status& es, const switch_segment& seg, int fail_label) {
+	int t0 = es.temps[0], t1 = es.temps[1];
+	switch (seg.kind) {
+	case SWITCH_SEG_CASE:
+		emit_compare(es, es.value_reg, seg.low, t0);
+		es.result.push_back(asm_inst(JCC, EQ, get_label(seg.labels[0])));
+		break;
+	case SWITCH_SEG_RANGE:
+		{
+			int reg = emit_subtract(es, seg.low, t0);
+			emit_compare(es, reg, seg.high - seg.low, reg == t0 ? t1 : t0);
+			es.result.push_back(asm_inst(JCC, LE_UNSIGN, get_label(seg.labels[0])));
+		}
+		break;
+	case SWITCH_SEG_TABLE:
+		{
+			// 範囲内なら、(値 - low) の2倍をPCに足し、表の分岐命令に飛ぶ
+			// (PCは足し算の命令の4バイト先を指すので、間に実行されない詰め物を置く)
+			int reg = emit_subtract(es, seg.low, t0);
+			es.result.push_back(asm_inst(CMP_REG_LIT, reg, seg.high - seg.low));
+			es.result.push_back(asm_inst(JCC, G_UNSIGN, get_label(fail_label)));
+			es.result.push_back(asm_inst(SHL_REG_LIT, t0, reg, 1));
+			es.result.push_back(asm_inst(ADD_REG, 15, t0));
+			es.result.push_back(codegen_jump_table_entry(get_label(es.default_label)));
+			for (auto itr = seg.labels.begin(); itr != seg.labels.end(); itr++) {
+				es.result.push_back(codegen_jump_table_entry(get_label(*itr)));
+			}
+		}
+		break;
+	case SWITCH_SEG_BITS:
+		{
+			// 1を (値 - low) だけ左シフトし、分岐先ごとのビットの集合と重なるかを調べる
+			int reg = emit_subtract(es, seg.low, t0);
+			es.result.push_back(asm_inst(CMP_REG_LIT, reg, seg.high - seg.low));
+			es.result.push_back(asm_inst(JCC, G_UNSIGN, get_label(fail_label)));
+			es.result.push_back(asm_inst(MOV_LIT, t1, 1));
+			es.result.push_back(asm_inst(SHL_REG, t1, reg));
+			for (auto itr = seg.bits.begin(); itr != seg.bits.end(); itr++) {
+				std::vector<asm_inst> ncode = codegen_put_number(t0, itr->second);
+				es.result.insert(es.result.end(), ncode.begin(), ncode.end());
+				es.result.push_back(asm_inst(TEST_REG_REG, t1, t0));
+				es.result.push_back(asm_inst(JCC, NONZERO, get_label(itr->first)));
+			}
+		}
+		break;
+	}
+}
+
+// segments[first, last) を調べ、どれにも当たらなければdefaultに進む
+static void emit_segments(switch_emit_status& es, size_t first, size_t last) {
+	int split = codegen_switch_split_point(es.plan, first, last);
+	if (split >= 0) {
+		// 値 >= 分ける位置の区間の下端 なら後半を調べる
+		int upper_label = es.status.next_label++;
+		emit_compare(es, es.value_reg, es.plan.segments[split].low, es.temps[0]);
+		es.result.push_back(asm_inst(JCC, GE_UNSIGN, get_label(upper_label)));
+		emit_segments(es, first, split);
+		es.result.push_back(asm_inst(LABEL, get_label(upper_label)));
+		emit_segments(es, split, last);
+		return;
+	}
+	for (size_t i = first; i < last; i++) {
+		const switch_segment& seg = es.plan.segments[i];
+		bool is_last = i + 1 == last;
+		int fail_label = is_last ? es.default_label : -1;
+		if (!is_last && (seg.kind == SWITCH_SEG_TABLE || seg.kind == SWITCH_SEG_BITS)) {
+			fail_label = es.status.next_label++;
+		}
+		emit_segment(es, seg, fail_label);
+		if (is_last) {
+			// ジャンプ表の後には流れない
+			if (seg.kind != SWITCH_SEG_TABLE) es.result.push_back(asm_inst(JMP_DIRECT, get_label(es.default_label)));
+		} else if (fail_label >= 0) {
+			es.result.push_back(asm_inst(LABEL, get_label(fail_label)));
+		}
+	}
+}
+
+// value_regの値によって、planに従ってcaseのラベルに分岐するコードを生成する
+std::vector<asm_inst> codegen_switch_dispatch(const switch_plan& plan, int value_reg, int default_label,
+int regs_available, int lineno, codegen_status& status) {
+	switch_emit_status es(plan, value_reg, default_label, lineno, status);
+	// 使う分だけ一時レジスタを割り当てる
+	int num_temps = 0;
+	for (auto itr = plan.segments.begin(); itr != plan.segments.end(); itr++) {
+		int temps = segment_temps(*itr);
+		if (temps > num_temps) num_temps = temps;
+	}
+	for (size_t i = 1; i < plan.segments.size(); i++) {
+		if (plan.segments[i].low >= 256 && num_temps < 1) num_temps = 1;
+	}
+	for (int i = 0; i < num_temps; i++) {
+		es.temps[i] = get_reg_to_use(lineno, regs_available, false);
+		regs_available &= ~(1 << es.temps[i]);
+		status.registers_written |= 1 << es.temps[i];
+	}
+	emit_segments(es, 0, plan.segments.size());
+	if (plan.segments.empty()) es.result.push_back(asm_inst(JMP_DIRECT, get_label(default_label)));
+	return es.result;
+}
+
+// ジャンプ表の要素を作る
+asm_inst codegen_jump_table_entry(const std::string& label) {
+	return asm_inst(JMP_DIRECT, label, JMP_TABLE_ENTRY);
+}
+
+// 値を表引きにする表の大きさの上限
+// (範囲外への条件分岐が、表を飛び越えてdefaultの処理に届くようにする)
+static const uint32_t SWITCH_MAX_LOOKUP_BYTES = 224;
+
+// 表引きの表のバイト数 (4バイト単位に切り上げる)
+static uint32_t lookup_table_bytes(size_t num_elements, int element_size) {
+	return (num_elements * element_size + 3) & ~UINT32_C(3);
+}
+
+// トップレベルの演算子と括弧を外す
+static expression_node* strip_top_operators(expression_node* expr) {
+	while (expr != nullptr && expr->kind == EXPR_OPERATOR &&
+	(expr->info.op.kind == OP_NONE || expr->info.op.kind == OP_PARENTHESIS)) {
+		expr = expr->info.op.operands[0];
+	}
+	return expr;
+}
+
+// 定数を指定のバイト数の整数型に変換し、32ビットに拡張する
+static uint32_t extend_value(uint32_t value, int size, bool is_signed) {
+	if (size >= 4) return value;
+	uint32_t mask = UINT32_C(0xffffffff) >> (8 * (4 - size));
+	if (is_signed && ((value >> (8 * size - 1)) & 1)) return value | ~mask;
+	return value & mask;
+}
+
+// 文が「変数 = 定数」または「return 定数」なら、値を読み取る
+static bool read_lookup_value(ast_node* statement, bool first, switch_lookup& lk, uint32_t& value,
+const codegen_status& status) {
+	if (statement == nullptr) return false;
+	if (statement->kind == NODE_RETURN) {
+		if (!first && !lk.is_return) return false;
+		type_node* type = status.return_type;
+		expression_node* expr = strip_top_operators(statement->d.ret.ret_expression);
+		if (type == nullptr || type->kind != TYPE_INTEGER || expr == nullptr || expr->kind != EXPR_INTEGER_LITERAL) {
+			return false;
+		}
+		lk.is_return = true;
+		lk.size = type->size;
+		lk.is_signed = type->info.is_signed;
+		value = extend_value(expr->info.value, lk.size, lk.is_signed);
+		return true;
+	}
+	if (statement->kind != NODE_EXPR || (!first && lk.is_return)) return false;
+	expression_node* expr = strip_top_operators(statement->d.expr.expression);
+	if (expr == nullptr || expr->kind != EXPR_OPERATOR || expr->info.op.kind != OP_ASSIGN) return false;
+	expression_node* lhs = expr->info.op.operands[0];
+	expression_node* rhs = strip_top_operators(expr->info.op.operands[1]);
+	if (lhs->kind != EXPR_IDENTIFIER || lhs->info.ident.info == nullptr || lhs->type == nullptr ||
+	lhs->type->kind != TYPE_INTEGER || rhs == nullptr || rhs->kind != EXPR_INTEGER_LITERAL) {
+		return false;
+	}
+	if (!first && lhs->info.ident.info != lk.vinfo) return false;
+	lk.vinfo = lhs->info.ident.info;
+	lk.target = lhs;
+	lk.size = lhs->type->size;
+	lk.is_signed = lhs->type->info.is_signed;
+	value = extend_value(rhs->info.value, lk.size, lk.is_signed);
+	return true;
+}
+
+// switch文の中身が、全てのcaseで同じ変数に定数を代入するか、定数をreturnするものかを調べる
+static bool analyze_lookup(ast_node* body, switch_lookup& lk, const codegen_status& status) {
+	if (body == nullptr || body->kind != NODE_ARRAY) return false;
+	size_t num = body->d.array.num;
+	for (size_t i = 0; i < num; i++) {
+		// 文を挟まずに続くcase・defaultを集める
+		std::vector<uint32_t> numbers;
+		bool is_default = false;
+		ast_node* node = body->d.array.nodes[i];
+		while (node != nullptr && (node->kind == NODE_CASE || node->kind == NODE_DEFAULT)) {
+			if (node->kind == NODE_CASE) {
+				numbers.push_back(node->d.case_d.number);
+				node = node->d.case_d.statement;
+			} else {
+				is_default = true;
+				node = node->d.default_d.statement;
+			}
+		}
+		uint32_t value;
+		if ((numbers.empty() && !is_default) || !read_lookup_value(node, i == 0, lk, value, status)) return false;
+		// 代入の後は、breakするか中身の末尾でなければならない (returnの後のbreakは実行されない)
+		bool break_follows = i + 1 < num && body->d.array.nodes[i + 1]->kind == NODE_BREAK;
+		if (!lk.is_return && i + 1 < num && !break_follows) return false;
+		if (break_follows) i++;
+		for (auto itr = numbers.begin(); itr != numbers.end(); itr++) lk.values[*itr] = value;
+		if (is_default) {
+			lk.default_exists = true;
+			lk.default_value = value;
+		}
+		lk.group_values.push_back(value);
+	}
+	return !lk.values.empty();
+}
+
+// switch文が、全てのcaseで定数をreturnする (表引きで値を返せる形の) ものかを判定する
+// (戻り値の型を見ないので、表引きにできるかはcodegen_switch_lookup()で改めて判定する)
+bool codegen_switch_returns_constants(ast_node* ast) {
+	ast_node* body = ast->d.switch_d.statement;
+	if (body == nullptr || body->kind != NODE_ARRAY) return false;
+	bool case_exists = false;
+	for (size_t i = 0; i < body->d.array.num; i++) {
+		ast_node* node = body->d.array.nodes[i];
+		bool labeled = false;
+		while (node != nullptr && (node->kind == NODE_CASE || node->kind == NODE_DEFAULT)) {
+			if (node->kind == NODE_CASE) case_exists = true;
+			labeled = true;
+			node = node->kind == NODE_CASE ? node->d.case_d.statement : node->d.default_d.statement;
+		}
+		// returnの後のbreakは実行されない
+		if (!labeled && node != nullptr && node->kind == NODE_BREAK && i > 0) continue;
+		if (!labeled || node == nullptr || node->kind != NODE_RETURN) return false;
+		expression_node* expr = strip_top_operators(node->d.ret.ret_expression);
+		if (expr == nullptr || expr->kind != EXPR_INTEGER_LITERAL) return false;
+	}
+	return case_exists;
+}
+
+// switch文を表引きにできるかを調べ、表を作る
+bool codegen_plan_switch_lookup(ast_node* ast, switch_lookup& lk, const codegen_status& status) {
+	lk = switch_lookup();
+	if (!analyze_lookup(ast->d.switch_d.statement, lk, status)) return false;
+	// 値の差は32ビットで一周するので、最も広い隙間の後から始まる範囲を表にする (負のcaseの値にも対応する)
+	uint32_t low = lk.values.begin()->first, span = lk.values.rbegin()->first - low;
+	for (auto itr = std::next(lk.values.begin()); itr != lk.values.end(); itr++) {
+		uint32_t rotated_span = std::prev(itr)->first - itr->first;
+		if (rotated_span < span) {
+			low = itr->first;
+			span = rotated_span;
+		}
+	}
+	if (span >= SWITCH_MAX_LOOKUP_BYTES) return false;
+	// defaultが無ければ、範囲内に何もしない値があってはいけない
+	if (!lk.default_exists && lk.values.size() != span + 1) return false;
+	lk.low = low;
+	lk.table.assign(span + 1, lk.default_value);
+	for (auto itr = lk.values.begin(); itr != lk.values.end(); itr++) lk.table[itr->first - low] = itr->second;
+	// 全ての値を表せる、最も小さい要素で表を作る
+	bool fits[4] = {true, true, true, true}; // 1バイト, 1バイト符号付き, 2バイト, 2バイト符号付き
+	for (auto itr = lk.table.begin(); itr != lk.table.end(); itr++) {
+		if (*itr >= 0x100) fits[0] = false;
+		if (*itr != extend_value(*itr, 1, true)) fits[1] = false;
+		if (*itr >= 0x10000) fits[2] = false;
+		if (*itr != extend_value(*itr, 2, true)) fits[3] = false;
+	}
+	lk.element_size = 4;
+	lk.element_signed = false;
+	if (fits[0] || fits[1]) {
+		lk.element_size = 1;
+		lk.element_signed = !fits[0];
+	} else if (fits[2] || fits[3]) {
+		lk.element_size = 2;
+		lk.element_signed = !fits[2];
+	}
+	return lookup_table_bytes(lk.table.size(), lk.element_size) <= SWITCH_MAX_LOOKUP_BYTES;
+}
+
+// 表引きのほうが、普通に分岐するより費用が小さいかを判定する
+bool codegen_switch_lookup_pays(ast_node* ast, const switch_lookup& lk, int default_label, int num_temps,
+bool store_needed) {
+	switch_cost store_cost = store_needed ? switch_cost(2, 2) : switch_cost();
+	switch_plan plan = codegen_plan_switch(ast->d.switch_d.info->case_labels, default_label, num_temps, true);
+	switch_cost dispatch;
+	for (auto itr = plan.segments.begin(); itr != plan.segments.end(); itr++) {
+		dispatch = dispatch + segment_cost(*itr);
+	}
+	int bodies_bytes = 0, bodies_cycles = 0;
+	for (auto itr = lk.group_values.begin(); itr != lk.group_values.end(); itr++) {
+		// 値を置き、代入してbreakするか、returnする
+		switch_cost body = number_cost(*itr) + store_cost + switch_cost(2, 3);
+		bodies_bytes += body.bytes;
+		bodies_cycles = std::max(bodies_cycles, body.cycles);
+	}
+	int ordinary = dispatch.total() + bodies_bytes + SWITCH_CYCLE_WEIGHT * bodies_cycles;
+	// 引き算 + 比較 + 範囲外への条件分岐 + 要素のバイト数倍 + 表のアドレス + 読み込み + 代入 + 分岐
+	// + 表 (詰め物を含む) + defaultの処理
+	int element_size = lk.element_size;
+	switch_cost lookup = subtract_cost(lk.low) +
+		switch_cost(2 + 2 + (element_size > 1 ? 2 : 0) + 2 + 2 + 2, 1 + 1 + (element_size > 1 ? 1 : 0) + 1 + 2 + 3) +
+		store_cost;
+	lookup.bytes += lookup_table_bytes(lk.table.size(), element_size) + 2;
+	if (lk.default_exists) lookup.bytes += (number_cost(lk.default_value) + store_cost).bytes + (lk.is_return ? 2 : 0);
+	return lookup.total() < ordinary;
+}
+
+// 表引きの表 (ラベルと、リトルエンディアンで4バイトずつ詰めた要素) を作る
+std::vector<asm_inst> codegen_lookup_table(const std::string& label, const std::vector<uint32_t>& table,
+int element_size) {
+	std::vector<asm_inst> result;
+	result.push_back(asm_inst(LABEL, label));
+	uint32_t table_bytes = lookup_table_bytes(table.size(), element_size);
+	for (uint32_t pos = 0; pos < table_bytes; pos += 4) {
+		uint32_t word = 0;
+		for (uint32_t i = 0; i < 4; i += element_size) {
+			uint32_t index = (pos + i) / element_size;
+			if (index < table.size()) {
+				uint32_t mask = UINT32_C(0xffffffff) >> (8 * (4 - element_size));
+				word |= (table[index] & mask) << (8 * i);
+			}
+		}
+		asm_inst entry(DD, word);
+		entry.is_constant = true;
+		result.push_back(entry);
+	}
+	return result;
+}
+
+// 全てのcaseで同じ変数に定数を代入するか定数をreturnするswitch文を、表引きにしたコードを生成する
+// 表引きにできない、または普通に分岐するほうが得な場合はfalseを返す
+bool codegen_switch_lookup(ast_node* ast, int value_reg, int end_label, int regs_available,
+std::vector<asm_inst>& result, codegen_status& status) {
+	// 配置先が4バイト境界でなければ、PC相対のアドレス計算が合わない
+	if (status.base_address % 4 != 0) return false;
+	switch_lookup lk;
+	if (!codegen_plan_switch_lookup(ast, lk, status)) return false;
+	uint32_t low = lk.low, span = lk.table.size() - 1;
+	int element_size = lk.element_size;
+	asm_inst_kind load_inst = element_size == 1 ? (lk.element_signed ? LDBS_REG_REG : LDB_REG_REG) :
+		element_size == 2 ? (lk.element_signed ? LDWS_REG_REG : LDW_REG_REG) : LDL_REG_REG;
+	// 代入先を決める
+	codegen_mem_cache cache;
+	cache.size = lk.size;
+	cache.is_signed = lk.is_signed;
+	cache.is_register = false;
+	cache.use_two_params = false;
+	cache.mem_param2 = 0;
+	cache.regs_in_cache = 0;
+	if (lk.is_return) {
+		// 値はR0に置いてreturn_labelに分岐する
+	} else if (lk.vinfo->is_register) {
+		// 表から変数のレジスタに直接読み込む
+		cache.is_register = true;
+		cache.mem_param1 = status.lv_reg_assign.at(lk.vinfo->offset);
+	} else if (lk.vinfo->is_global) {
+		if (status.gv_access_register < 0 || lk.vinfo->offset % lk.size != 0 || lk.vinfo->offset / lk.size >= 32) {
+			return false;
+		}
+		cache.use_two_params = true;
+		cache.write_inst = lk.size == 1 ? STB_REG_LIT : lk.size == 2 ? STW_REG_LIT : STL_REG_LIT;
+		cache.mem_param1 = status.gv_access_register;
+		cache.mem_param2 = lk.vinfo->offset / lk.size;
+	} else {
+		// スタック上の変数は、SPからの読み書きができる4バイトのもののみ扱う
+		if (lk.size != 4 || lk.vinfo->offset % 4 != 0 || lk.vinfo->offset / 4 >= 256) return false;
+		cache.write_inst = STL_SP_LIT;
+		cache.mem_param1 = lk.vinfo->offset / 4;
+	}
+	// 使うレジスタ : 表のアドレス (読み込んだ値にも使う)、(値 - low) の要素のバイト数倍
+	bool index_temp_needed = low != 0 || element_size > 1;
+	int num_available = 0;
+	for (int i = 0; i < 8; i++) {
+		if ((regs_available >> i) & 1) num_available++;
+	}
+	if (num_available < (index_temp_needed ? 2 : 1)) return false;
+	// 普通に分岐する場合と費用を比べる
+	int default_label = ast->d.switch_d.info->default_label >= 0 ? ast->d.switch_d.info->default_label : end_label;
+	if (!codegen_switch_lookup_pays(ast, lk, default_label, num_available, !lk.is_return && !cache.is_register)) {
+		return false;
+	}
+	int lineno = ast->lineno;
+	int table_reg = get_reg_to_use(lineno, regs_available, false);
+	regs_available &= ~(1 << table_reg);
+	status.registers_written |= 1 << table_reg;
+	int index_reg = value_reg;
+	if (index_temp_needed) {
+		index_reg = get_reg_to_use(lineno, regs_available, false);
+		status.registers_written |= 1 << index_reg;
+	}
+	int table_label = status.next_label++;
+	int default_path_label = lk.default_exists ? status.next_label++ : end_label;
+	switch_plan no_plan;
+	switch_emit_status es(no_plan, value_reg, default_path_label, lineno, status);
+	// 範囲外ならdefaultの処理に進む
+	int reg = emit_subtract(es, low, index_reg);
+	es.result.push_back(asm_inst(CMP_REG_LIT, reg, span));
+	es.result.push_back(asm_inst(JCC, G_UNSIGN, get_label(default_path_label)));
+	if (element_size > 1) {
+		es.result.push_back(asm_inst(SHL_REG_LIT, index_reg, reg, get_two_pow_num(element_size)));
+		reg = index_reg;
+	}
+	// 表から値を読み、代入するかreturnする
+	es.result.push_back(codegen_table_address_request(table_reg, get_label(table_label)));
+	if (cache.is_register) {
+		es.result.push_back(asm_inst(load_inst, cache.mem_param1, table_reg, reg));
+		status.registers_written |= 1 << cache.mem_param1;
+	} else if (lk.is_return) {
+		es.result.push_back(asm_inst(load_inst, 0, table_reg, reg));
+	} else {
+		es.result.push_back(asm_inst(load_inst, table_reg, table_reg, reg));
+		codegen_expr_result store = codegen_mem_from_cache(cache, lineno, table_reg, true, false, 0, status);
+		es.result.insert(es.result.end(), store.insts.begin(), store.insts.end());
+	}
+	es.result.push_back(asm_inst(JMP_DIRECT, get_label(lk.is_return ? status.return_label : end_label)));
+	// 表
+	std::vector<asm_inst> table_code = codegen_lookup_table(get_label(table_label), lk.table, element_size);
+	es.result.insert(es.result.end(), table_code.begin(), table_code.end());
+	// defaultの処理
+	if (lk.default_exists) {
+		es.result.push_back(asm_inst(LABEL, get_label(default_path_label)));
+		if (lk.is_return) {
+			std::vector<asm_inst> ncode = codegen_put_number(0, lk.default_value);
+			es.result.insert(es.result.end(), ncode.begin(), ncode.end());
+			es.result.push_back(asm_inst(JMP_DIRECT, get_label(status.return_label)));
+		} else {
+			int value_dest = cache.is_register ? static_cast<int>(cache.mem_param1) : table_reg;
+			std::vector<asm_inst> ncode = codegen_put_number(value_dest, lk.default_value);
+			es.result.insert(es.result.end(), ncode.begin(), ncode.end());
+			status.registers_written |= 1 << value_dest;
+			if (!cache.is_register) {
+				codegen_expr_result store = codegen_mem_from_cache(cache, lineno, table_reg, true, false, 0, status);
+				es.result.insert(es.result.end(), store.insts.begin(), store.insts.end());
+			}
+		}
+	}
+	result.insert(result.end(), es.result.begin(), es.result.end());
+	return true;
+}
@@ -0,0 +1,186 @@
+#include <vector>
+#include "ast.h"
+#include "codegen.hpp"
+#include "codegen_internal.hpp"
+
+// 末尾呼び出しで渡せる引数の数の上限
+// (LRを戻すのにR3を使うので、R3は引数に使えない)
+static const int TAIL_CALL_MAX_ARGS = 3;
+// LRを戻すのに経由するレジスタ
+static const int TAIL_CALL_LR_VIA = 3;
+// 間接呼び出しの呼び出し先を置くレジスタ (退避したレジスタを戻すのに使わない)
+static const int TAIL_CALL_TARGET_REG = 12;
+
+// value_typeの値を返す関数の返り値を、そのままreturn_typeの返り値にできるか
+// (呼び出し先で拡張済みの値に、拡張をやり直す必要が無いか)
+bool codegen_return_value_fits(type_node* value_type, type_node* return_type) {
+	if (return_type == nullptr || return_type->kind != TYPE_INTEGER || return_type->size >= 4) return true;
+	if (value_type == nullptr || value_type->kind != TYPE_INTEGER || value_type->size > return_type->size) {
+		return false;
+	}
+	if (value_type->info.is_signed) return return_type->info.is_signed;
+	return value_type->size < return_type->size || !return_type->info.is_signed;
+}
+
+// 式がreturn_typeの関数から末尾呼び出しにできる関数呼び出しか
+bool codegen_is_tail_call(expression_node* expr, type_node* return_type) {
+	if (expr == nullptr || expr->kind != EXPR_OPERATOR) return false;
+	if (expr->info.op.kind == OP_FUNC_CALL) {
+		if (expr->info.op.argument_num > TAIL_CALL_MAX_ARGS) return false;
+	} else if (expr->info.op.kind != OP_FUNC_CALL_NOARGS) {
+		return false;
+	}
+	return codegen_return_value_fits(expr->type, return_type);
+}
+
+// 引数がnum_args個の関数呼び出しを末尾呼び出しにできるか
+bool codegen_tail_call_args_ok(int num_args) {
+	return num_args <= TAIL_CALL_MAX_ARGS;
+}
+
+static bool var_in_frame_escapes(const var_info* vinfo) {
+	return !vinfo->is_global && (vinfo->address_taken || !is_scalar_type(vinfo->type));
+}
+
+static bool frame_escapes_statement(ast_node* ast) {
+	if (ast == nullptr) return false;
+	switch (ast->kind) {
+	case NODE_ARRAY:
+		for (size_t i = 0; i < ast->d.array.num; i++) {
+			if (frame_escapes_statement(ast->d.array.nodes[i])) return true;
+		}
+		return false;
+	case NODE_VAR_DEFINE:
+		return var_in_frame_escapes(ast->d.var_def.info);
+	case NODE_LABEL:
+		return frame_escapes_statement(ast->d.label.statement);
+	case NODE_IF:
+		return frame_escapes_statement(ast->d.if_d.true_statement) ||
+			frame_escapes_statement(ast->d.if_d.false_statement);
+	case NODE_SWITCH:
+		return frame_escapes_statement(ast->d.switch_d.statement);
+	case NODE_CASE:
+		return frame_escapes_statement(ast->d.case_d.statement);
+	case NODE_DEFAULT:
+		return frame_escapes_statement(ast->d.default_d.statement);
+	case NODE_WHILE:
+	case NODE_DO_WHILE:
+		return frame_escapes_statement(ast->d.while_d.statement);
+	case NODE_FOR:
+		return frame_escapes_statement(ast->d.for_d.init) || frame_escapes_statement(ast->d.for_d.body);
+	default:
+		return false;
+	}
+}
+
+// 関数のスタック上の領域を、呼び出した関数が参照する可能性があるか
+// (アドレスを取られる変数や配列・構造体の変数があるか)
+bool codegen_frame_escapes(ast_node* body, const std::vector<var_info*>& arguments) {
+	for (auto itr = arguments.begin(); itr != arguments.end(); itr++) {
+		if (var_in_frame_escapes(*itr)) return true;
+	}
+	return frame_escapes_statement(body);
+}
+
+// 末尾呼び出しにする呼び出しの直後の、return_labelへのジャンプの位置を返す (できなければ0)
+static size_t tail_call_jump(const std::vector<asm_inst>& code, size_t call_pos, const std::string& return_label) {
+	const asm_inst& inst = code[call_pos];
+	if ((inst.kind != CALL_DIRECT && inst.kind != CALL_INDIRECT) || inst.params[1] != CALL_TAIL_OK) return 0;
+	size_t next = call_pos + 1;
+	while (next < code.size() && code[next].kind == EMPTY && code[next].comment == "") next++;
+	if (next >= code.size() || code[next].kind != JMP_DIRECT || code[next].label != return_label) return 0;
+	return next;
+}
+
+// 末尾呼び出しの印が付いた呼び出しの直後がreturn_labelへのジャンプなら、
+// 関数から戻る処理をしてから呼び出し先にジャンプするように書き換える
+// 他に関数呼び出しが残らなければ、LRの退避もやめる
+void codegen_tail_calls(std::vector<asm_inst>& code, const std::string& return_label) {
+	size_t epilogue_begin = code.size();
+	for (size_t i = 0; i < code.size(); i++) {
+		if (code[i].kind == LABEL && code[i].label == return_label) {
+			epilogue_begin = i + 1;
+			break;
+		}
+	}
+	bool tail_call_exists = false, other_call_exists = false;
+	for (size_t i = 0; i < code.size(); i++) {
+		if (code[i].kind != CALL_DIRECT && code[i].kind != CALL_INDIRECT) continue;
+		if (i < epilogue_begin && epilogue_begin < code.size() && tail_call_jump(code, i, return_label) > 0) {
+			tail_call_exists = true;
+		} else {
+			other_call_exists = true;
+			code[i].params[1] = 0;
+		}
+	}
+	if (!tail_call_exists) return;
+	// 呼び出し先から直接戻るので、LRを書き換える命令が残らなければ退避は不要
+	bool keep_lr = other_call_exists;
+	if (!keep_lr) {
+		for (size_t i = 0; i < epilogue_begin; i++) {
+			if (code[i].kind == PUSH_REGS && (code[i].params[0] & 0x100)) {
+				code[i].params[0] &= ~0x100;
+				if (code[i].params[0] == 0) {
+					code.erase(code.begin() + i);
+					epilogue_begin--;
+				}
+				break;
+			}
+		}
+	}
+
+	// 関数から戻る処理を取り出す (返り値の拡張は、呼び出し先で済んでいるので含めない)
+	size_t epilogue_body = epilogue_begin;
+	while (epilogue_body < code.size() && (code[epilogue_body].kind == SHL_REG_LIT ||
+	code[epilogue_body].kind == ASR_REG_LIT || code[epilogue_body].kind == SHR_REG_LIT) &&
+	code[epilogue_body].params[0] == 0 && code[epilogue_body].params[1] == 0) {
+		epilogue_body++;
+	}
+	std::vector<asm_inst> epilogue, tail_epilogue;
+	for (size_t i = epilogue_body; i < code.size(); i++) {
+		const asm_inst& inst = code[i];
+		if (inst.kind == POP_REGS && (inst.params[0] & 0x100)) {
+			int low_regs = inst.params[0] & 0xff;
+			if (keep_lr) {
+				// PCの代わりにLRに戻す
+				if (low_regs != 0) tail_epilogue.push_back(asm_inst(POP_REGS, low_regs));
+				tail_epilogue.push_back(asm_inst(POP_REGS, 1 << TAIL_CALL_LR_VIA));
+				tail_epilogue.push_back(asm_inst(MOV_REG, 14, TAIL_CALL_LR_VIA));
+				epilogue.push_back(inst);
+			} else {
+				if (low_regs != 0) {
+					tail_epilogue.push_back(asm_inst(POP_REGS, low_regs));
+					epilogue.push_back(asm_inst(POP_REGS, low_regs));
+				}
+				epilogue.push_back(asm_inst(RET));
+			}
+		} else {
+			if (inst.kind != RET) tail_epilogue.push_back(inst);
+			epilogue.push_back(inst);
+		}
+	}
+
+	std::vector<asm_inst> result;
+	for (size_t i = 0; i < epilogue_begin; i++) {
+		asm_inst& inst = code[i];
+		size_t jump = tail_call_jump(code, i, return_label);
+		if (jump == 0) {
+			result.push_back(inst);
+			continue;
+		}
+		std::vector<asm_inst> tail;
+		if (inst.kind == CALL_INDIRECT && static_cast<int>(inst.params[0]) != TAIL_CALL_TARGET_REG) {
+			tail.push_back(asm_inst(MOV_REG, TAIL_CALL_TARGET_REG, inst.params[0]));
+		}
+		tail.insert(tail.end(), tail_epilogue.begin(), tail_epilogue.end());
+		if (inst.kind == CALL_DIRECT) tail.push_back(asm_inst(JMP_DIRECT, inst.label));
+		else tail.push_back(asm_inst(JMP_INDIRECT, TAIL_CALL_TARGET_REG));
+		for (auto t = tail.begin(); t != tail.end(); t++) t->lineno = inst.lineno;
+		result.insert(result.end(), tail.begin(), tail.end());
+		// return_labelへのジャンプは不要になる
+		i = jump;
+	}
+	result.insert(result.end(), code.begin() + epilogue_begin, code.begin() + epilogue_body);
+	result.insert(result.end(), epilogue.begin(), epilogue.end());
+	code.swap(result);
+}
@@ -1,21 +1,86 @@
 #include <cstdio>
+#include <cstring>
 #include <vector>
 #include <string>
+#include <sstream>
 #include "ast.h"
 #include "asm.hpp"
 #include "codegen.hpp"
+#include "wcet.hpp"
+#include "size_report.hpp"
+#include "report_output.hpp"
 
-int main(void) {
+// 命令の行番号の対応表に1行追加する
+static void add_line_table_entry(std::stringstream& table, int listing_line,
+const asm_inst& inst, const std::string& function_name) {
+	table << listing_line << "\t" << inst.lineno << "\t" << inst.size() << "\t" <<
+		(function_name == "" ? "-" : function_name) << "\n";
+}
+
+int main(int argc, char* argv[]) {
+	report_output wcet_output, size_output, size_json_output, line_table_output, ir_dump_output;
+	bool line_comments = false;
+	codegen_options options;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--line-comments") == 0) {
+			line_comments = true;
+			continue;
+		}
+		if (strcmp(argv[i], "--ssa") == 0) {
+			options.use_ir = true;
+			continue;
+		}
+		if (parse_report_option(argv[i], "--line-table", line_table_output)) continue;
+		if (parse_report_option(argv[i], "--dump-ir", ir_dump_output)) continue;
+		if (parse_report_option(argv[i], "--wcet", wcet_output)) continue;
+		if (parse_report_option(argv[i], "--size-report", size_output)) continue;
+		if (parse_report_option(argv[i], "--size-report-json", size_json_output)) continue;
+		fprintf(stderr, "unknown option: %s\n", argv[i]);
+		return 1;
+	}
 	ast_node* ast;
 	ast = build_ast(stdin);
 	if (ast == NULL) return 1;
 	try {
-		std::vector<asm_inst> code = codegen(ast);
+		std::vector<gvar_layout> gv_layouts;
+		std::string ir_dump;
+		if (ir_dump_output.enabled) options.ir_dump = &ir_dump;
+		std::vector<asm_inst> code = codegen(ast, &gv_layouts, options);
+		if (ir_dump_output.enabled) {
+			if (!write_report(ir_dump_output, ir_dump)) return 1;
+		}
 		codegen_clean(code);
+		// 行番号の対応表の形式 : 出力の行番号, ソースコードの行番号, バイト数, 関数名
+		std::stringstream line_table;
+		line_table << "# listing_line\tsource_line\tbytes\tfunction\n";
+		int listing_line = 0, prev_lineno = 0;
+		std::string function_name = "";
 		for (auto itr = code.begin(); itr != code.end(); itr++) {
+			if (itr->kind == LABEL && !(itr->label[0] == '_' && itr->label[1] == '_')) {
+				function_name = itr->label;
+			}
+			if (line_comments && itr->kind != LABEL && itr->lineno != 0 && itr->lineno != prev_lineno) {
+				// 行が変わったことを示すコメントを出力する
+				printf("\t' #line %d\n", itr->lineno);
+				listing_line++;
+				prev_lineno = itr->lineno;
+			}
 			std::string inst_str = itr->to_string();
 			if (itr->kind != LABEL && inst_str.length() > 0) printf("\t");
 			printf("%s\n", inst_str.c_str());
+			listing_line++;
+			if (itr->size() > 0) add_line_table_entry(line_table, listing_line, *itr, function_name);
+		}
+		if (line_table_output.enabled) {
+			if (!write_report(line_table_output, line_table.str())) return 1;
+		}
+		if (wcet_output.enabled) {
+			if (!write_report(wcet_output, wcet_report(wcet_analyze(code)))) return 1;
+		}
+		if (size_output.enabled || size_json_output.enabled) {
+			size_info sinfo = size_analyze(code, gv_layouts);
+			if (size_output.enabled && !write_report(size_output, size_report_table(sinfo))) return 1;
+			if (size_json_output.enabled && !write_report(size_json_output, size_report_json(sinfo))) return 1;
 		}
 	} catch (codegen_error e) {
 		fprintf(stderr, "code generation error: %s\n", e.what());
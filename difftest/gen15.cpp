@@ -0,0 +1,626 @@
+// 差分テスト用のランダムなプログラムを生成する
+// 使い方 : gen15 SEED PROGRAM.c DRIVER.c [MAX_DEPTH]
+// PROGRAM.c : compile15で扱える範囲のプログラム (ホストのCコンパイラでもそのまま扱える)
+// DRIVER.c  : PROGRAM.cをインクルードして実行し、グローバル変数をsim15と同じ形式で出力する
+// MAX_DEPTH : 式の深さの上限 (既定は2、大きくするとレジスタが足りずにコンパイルできないことが増える)
+// 未定義動作を避けるため、以下のように生成する
+// * シフト量は & 31 で制限する
+// * 配列の添字は & (要素数-1) で制限する
+// * 除数は 0 と -1 にならないように加工する
+// * 副作用は文のトップレベルのみに置き、式の中で呼ぶ関数はグローバル変数を書き換えない
+// * 符号付き整数のオーバーフローは -fwrapv を付けてラップアラウンドさせる前提とする
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sstream>
+
+// 移植性のある擬似乱数 (xorshift32)
+static uint32_t rand_state;
+
+static uint32_t next_rand() {
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+// 0 以上 n 未満の整数を返す
+static int rand_int(int n) {
+	return static_cast<int>(next_rand() % static_cast<uint32_t>(n));
+}
+
+// 確率 percent % で true を返す
+static bool chance(int percent) {
+	return rand_int(100) < percent;
+}
+
+// 整数型
+struct int_type {
+	const char* name;
+	int size;
+	bool is_signed;
+};
+
+static const int_type int_types[] = {
+	{"char", 1, true}, {"unsigned char", 1, false},
+	{"short", 2, true}, {"unsigned short", 2, false},
+	{"int", 4, true}, {"unsigned int", 4, false}
+};
+static const int num_int_types = sizeof(int_types) / sizeof(int_types[0]);
+
+// 変数
+struct gen_var {
+	std::string name;
+	int type;
+	int count; // 0 : スカラー、それ以外 : 配列の要素数 (2の累乗)
+	int target; // ポインタの場合、指す配列 (globalsの位置)、それ以外は -1
+	bool is_global;
+	bool writable;
+
+	gen_var(const std::string& name_, int type_, int count_, bool is_global_) :
+		name(name_), type(type_), count(count_), target(-1), is_global(is_global_), writable(true) {}
+};
+
+// 関数
+struct gen_func {
+	std::string name;
+	bool is_pure; // true : 値を返し、グローバル変数を書き換えない
+	bool has_loop; // true : ループを含む (ループを含む関数を呼ぶ場合も含む)
+	std::vector<int> param_types;
+
+	gen_func() : is_pure(false), has_loop(false) {}
+};
+
+static int max_depth = 2;
+
+static std::vector<gen_var> globals;
+static std::vector<gen_func> funcs;
+
+// 生成中の関数の情報
+struct func_context {
+	bool is_pure;
+	int num_funcs_callable; // funcsのうち呼び出せる数 (前に定義したもののみ)
+	std::vector<gen_var> locals; // 引数・ローカル変数・ポインタ・ループカウンタ
+	int loop_depth;
+	bool has_loop;
+	int next_counter;
+	int stmt_budget;
+};
+
+static std::string type_name(int type) {
+	return int_types[type].name;
+}
+
+// 整数リテラルを生成する
+static std::string gen_literal() {
+	std::stringstream ss;
+	switch (rand_int(4)) {
+	case 0:
+		ss << rand_int(10);
+		break;
+	case 1:
+		ss << rand_int(256);
+		break;
+	case 2:
+		{
+			uint32_t value = next_rand();
+			if (value >= UINT32_C(0x80000000)) {
+				ss << "0x" << std::hex << value << "u";
+			} else {
+				ss << value;
+			}
+		}
+		break;
+	default:
+		ss << "0x" << std::hex << (next_rand() & 0xffff);
+		break;
+	}
+	return ss.str();
+}
+
+// 読める変数を列挙する (配列とポインタを除く)
+static std::vector<const gen_var*> readable_scalars(const func_context& ctx) {
+	std::vector<const gen_var*> result;
+	for (size_t i = 0; i < globals.size(); i++) {
+		if (globals[i].count == 0) result.push_back(&globals[i]);
+	}
+	for (size_t i = 0; i < ctx.locals.size(); i++) {
+		if (ctx.locals[i].count == 0 && ctx.locals[i].target < 0) result.push_back(&ctx.locals[i]);
+	}
+	return result;
+}
+
+// 書ける変数を列挙する (配列とポインタを除く)
+static std::vector<const gen_var*> writable_scalars(const func_context& ctx) {
+	std::vector<const gen_var*> result;
+	if (!ctx.is_pure) {
+		for (size_t i = 0; i < globals.size(); i++) {
+			if (globals[i].count == 0) result.push_back(&globals[i]);
+		}
+	}
+	for (size_t i = 0; i < ctx.locals.size(); i++) {
+		if (ctx.locals[i].count == 0 && ctx.locals[i].target < 0 && ctx.locals[i].writable) {
+			result.push_back(&ctx.locals[i]);
+		}
+	}
+	return result;
+}
+
+// ポインタを列挙する
+static std::vector<const gen_var*> pointers(const func_context& ctx) {
+	std::vector<const gen_var*> result;
+	for (size_t i = 0; i < ctx.locals.size(); i++) {
+		if (ctx.locals[i].target >= 0) result.push_back(&ctx.locals[i]);
+	}
+	return result;
+}
+
+// 配列を列挙する
+static std::vector<const gen_var*> arrays() {
+	std::vector<const gen_var*> result;
+	for (size_t i = 0; i < globals.size(); i++) {
+		if (globals[i].count > 0) result.push_back(&globals[i]);
+	}
+	return result;
+}
+
+static std::string gen_expr(func_context& ctx, int depth);
+
+// 範囲内に収めた添字を生成する
+static std::string gen_index(func_context& ctx, int depth, int count) {
+	std::stringstream ss;
+	ss << "(" << gen_expr(ctx, depth) << ") & " << (count - 1);
+	return ss.str();
+}
+
+// 配列要素またはポインタの指す先を表す左辺値を生成する
+static std::string gen_element(func_context& ctx, int depth) {
+	std::vector<const gen_var*> arrs = arrays();
+	std::vector<const gen_var*> ptrs = pointers(ctx);
+	if (!ptrs.empty() && chance(40)) {
+		const gen_var& p = *ptrs[rand_int(static_cast<int>(ptrs.size()))];
+		int count = globals[p.target].count;
+		std::string name = p.name;
+		switch (rand_int(3)) {
+		case 0:
+			return "*" + name;
+		case 1:
+			return name + "[" + gen_index(ctx, depth, count) + "]";
+		default:
+			return "*(" + name + " + (" + gen_index(ctx, depth, count) + "))";
+		}
+	}
+	const gen_var& a = *arrs[rand_int(static_cast<int>(arrs.size()))];
+	return a.name + "[" + gen_index(ctx, depth, a.count) + "]";
+}
+
+// 純粋な関数の呼び出しを生成する (呼べる関数が無ければ空文字列)
+static std::string gen_pure_call(func_context& ctx, int depth) {
+	std::vector<int> candidates;
+	for (int i = 0; i < ctx.num_funcs_callable; i++) {
+		if (funcs[i].is_pure && (ctx.loop_depth == 0 || !funcs[i].has_loop)) candidates.push_back(i);
+	}
+	if (candidates.empty()) return "";
+	const gen_func& f = funcs[candidates[rand_int(static_cast<int>(candidates.size()))]];
+	if (f.has_loop) ctx.has_loop = true;
+	std::string result = f.name + "(";
+	for (size_t i = 0; i < f.param_types.size(); i++) {
+		if (i > 0) result += ", ";
+		result += gen_expr(ctx, depth);
+	}
+	return result + ")";
+}
+
+// 除数に使えるよう、0 と -1 (INT_MIN / -1 が桁あふれする) にならない式にする
+static std::string make_divisor(const std::string& expr) {
+	// 定数で割る場合のコード生成も試すため、定数の除数もよく使う
+	static const char* constant_divisors[] = {
+		"3", "7", "10", "16", "60", "641", "1000", "65537", "-4", "-10",
+		"0x7fffffff", "0x80000000u", "0xfffffff0u"
+	};
+	static const int num_constant_divisors = sizeof(constant_divisors) / sizeof(constant_divisors[0]);
+	if (chance(30)) return constant_divisors[rand_int(num_constant_divisors)];
+	if (chance(50)) return "(((" + expr + ") & 0xffff) | 1)";
+	return "(((" + expr + ") & ~1) | 2)";
+}
+
+// 副作用の無い式を生成する
+static std::string gen_expr(func_context& ctx, int depth) {
+	static const char* binary_ops[] = {
+		"+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>",
+		"<", ">", "<=", ">=", "==", "!=", "&&", "||"
+	};
+	static const int num_binary_ops = sizeof(binary_ops) / sizeof(binary_ops[0]);
+	int kind = depth <= 0 ? rand_int(3) : rand_int(10);
+	switch (kind) {
+	case 0:
+		return gen_literal();
+	case 1: case 2:
+		{
+			std::vector<const gen_var*> vars = readable_scalars(ctx);
+			if (kind == 2 || vars.empty()) return gen_element(ctx, 0);
+			return vars[rand_int(static_cast<int>(vars.size()))]->name;
+		}
+	case 3:
+		{
+			static const char* unary_ops[] = {"-", "~", "!"};
+			return std::string(unary_ops[rand_int(3)]) + "(" + gen_expr(ctx, depth - 1) + ")";
+		}
+	case 4:
+		return "((" + type_name(rand_int(num_int_types)) + ")(" + gen_expr(ctx, depth - 1) + "))";
+	case 5:
+		return "((" + gen_expr(ctx, depth - 1) + ") ? (" + gen_expr(ctx, depth - 1) +
+			") : (" + gen_expr(ctx, depth - 1) + "))";
+	case 6:
+		{
+			std::string call = gen_pure_call(ctx, depth - 1);
+			if (!call.empty()) return call;
+		}
+		// fall through
+	default:
+		{
+			std::string op = binary_ops[rand_int(num_binary_ops)];
+			std::string left = gen_expr(ctx, depth - 1);
+			std::string right = gen_expr(ctx, depth - 1);
+			if (op == "<<" || op == ">>") right = "(" + right + ") & 31";
+			if (op == "/" || op == "%") right = make_divisor(right);
+			return "(" + left + ") " + op + " (" + right + ")";
+		}
+	}
+}
+
+static std::string indent_str(int indent) {
+	return std::string(indent, '\t');
+}
+
+static void gen_block(std::stringstream& out, func_context& ctx, int indent, int max_stmts);
+
+// 文を1個生成する
+static void gen_statement(std::stringstream& out, func_context& ctx, int indent) {
+	std::string ind = indent_str(indent);
+	ctx.stmt_budget--;
+	int kind = rand_int(ctx.stmt_budget > 0 && indent < 4 ? 12 : 6);
+	// ループの入れ子が深すぎる場合は、代わりに代入にする (文を必ず1個出力するため)
+	if ((kind == 8 || kind == 9) && ctx.loop_depth >= 2) kind = 0;
+	switch (kind) {
+	case 0: case 1:
+		{
+			// 代入
+			std::vector<const gen_var*> vars = writable_scalars(ctx);
+			if (vars.empty()) break;
+			const gen_var& v = *vars[rand_int(static_cast<int>(vars.size()))];
+			out << ind << v.name << " = " << gen_expr(ctx, max_depth) << ";\n";
+		}
+		break;
+	case 2:
+		{
+			// 複合代入・インクリメント
+			static const char* ops[] = {"+=", "-=", "*=", "&=", "|=", "^=", "<<=", ">>=", "/=", "%="};
+			std::vector<const gen_var*> vars = writable_scalars(ctx);
+			if (vars.empty()) break;
+			const gen_var& v = *vars[rand_int(static_cast<int>(vars.size()))];
+			int op = rand_int(12);
+			if (op == 10) {
+				out << ind << v.name << (chance(50) ? "++" : "--") << ";\n";
+			} else if (op == 11) {
+				out << ind << (chance(50) ? "++" : "--") << v.name << ";\n";
+			} else {
+				std::string value = gen_expr(ctx, max_depth - 1);
+				if (op == 6 || op == 7) value = "(" + value + ") & 31";
+				if (op >= 8) value = make_divisor(value);
+				out << ind << v.name << " " << ops[op] << " " << value << ";\n";
+			}
+		}
+		break;
+	case 3: case 4:
+		{
+			// 配列要素への書き込み
+			if (ctx.is_pure) {
+				std::vector<const gen_var*> vars = writable_scalars(ctx);
+				if (vars.empty()) break;
+				out << ind << vars[rand_int(static_cast<int>(vars.size()))]->name << " = " <<
+					gen_element(ctx, max_depth - 1) << ";\n";
+				break;
+			}
+			std::string target = gen_element(ctx, max_depth - 1);
+			if (chance(30)) {
+				out << ind << target << (chance(50) ? " += " : " ^= ") << gen_expr(ctx, max_depth - 1) << ";\n";
+			} else {
+				out << ind << target << " = " << gen_expr(ctx, max_depth) << ";\n";
+			}
+		}
+		break;
+	case 5:
+		{
+			// 関数呼び出し
+			std::vector<int> candidates;
+			for (int i = 0; i < ctx.num_funcs_callable; i++) {
+				// 実行時間が膨らまないよう、ループの中ではループを含む関数を呼ばない
+				if ((!ctx.is_pure || funcs[i].is_pure) && (ctx.loop_depth == 0 || !funcs[i].has_loop)) {
+					candidates.push_back(i);
+				}
+			}
+			if (candidates.empty()) {
+				// ローカル変数l0は必ずある
+				out << ind << "l0 = " << gen_expr(ctx, max_depth - 1) << ";\n";
+				break;
+			}
+			const gen_func& f = funcs[candidates[rand_int(static_cast<int>(candidates.size()))]];
+			if (f.has_loop) ctx.has_loop = true;
+			std::string call = f.name + "(";
+			for (size_t i = 0; i < f.param_types.size(); i++) {
+				if (i > 0) call += ", ";
+				call += gen_expr(ctx, max_depth - 1);
+			}
+			call += ")";
+			std::vector<const gen_var*> vars = writable_scalars(ctx);
+			if (f.is_pure && !vars.empty()) {
+				out << ind << vars[rand_int(static_cast<int>(vars.size()))]->name << " = " << call << ";\n";
+			} else {
+				out << ind << call << ";\n";
+			}
+		}
+		break;
+	case 6: case 7:
+		{
+			// if文
+			out << ind << "if (" << gen_expr(ctx, max_depth) << ") {\n";
+			gen_block(out, ctx, indent + 1, 3);
+			if (chance(50)) {
+				out << ind << "} else {\n";
+				gen_block(out, ctx, indent + 1, 3);
+			}
+			out << ind << "}\n";
+		}
+		break;
+	case 8: case 9:
+		{
+			// ループ (カウンタは中で書き換えない)
+			std::stringstream name;
+			name << "i" << ctx.next_counter++;
+			gen_var counter(name.str(), 4, 0, false);
+			counter.writable = false;
+			int bound = 1 + rand_int(8);
+			bool is_do_while = false;
+			if (kind == 8) {
+				out << ind << "for (" << counter.name << " = 0; " << counter.name << " < " << bound << "; " <<
+					counter.name << "++) {\n";
+			} else {
+				// 先頭でカウンタを減らすので、continueしても必ず終わる
+				is_do_while = chance(50);
+				out << ind << counter.name << " = " << bound << ";\n";
+				out << ind << (is_do_while ? "do {\n" : "while (" + counter.name + " > 0) {\n");
+				out << ind << "\t" << counter.name << "--;\n";
+			}
+			ctx.locals.push_back(counter);
+			ctx.loop_depth++;
+			ctx.has_loop = true;
+			gen_block(out, ctx, indent + 1, 4);
+			if (chance(30)) {
+				out << ind << "\tif (" << gen_expr(ctx, max_depth - 1) << ") " << (chance(50) ? "break" : "continue") << ";\n";
+			}
+			ctx.loop_depth--;
+			ctx.locals.pop_back();
+			out << ind << (is_do_while ? "} while (" + counter.name + " > 0);\n" : "}\n");
+		}
+		break;
+	case 10:
+		{
+			// switch文
+			out << ind << "switch ((" << gen_expr(ctx, max_depth - 1) << ") & 3) {\n";
+			int num_cases = 1 + rand_int(3);
+			int case_value = 0;
+			for (int i = 0; i < num_cases; i++) {
+				case_value += rand_int(2);
+				out << ind << "case " << case_value << ":\n";
+				case_value++;
+				gen_block(out, ctx, indent + 1, 2);
+				if (chance(70)) out << ind << "\tbreak;\n";
+			}
+			if (chance(60)) {
+				out << ind << "default:\n";
+				gen_block(out, ctx, indent + 1, 2);
+			}
+			out << ind << "}\n";
+		}
+		break;
+	default:
+		{
+			// ブロックの途中からの脱出
+			if (ctx.is_pure && !funcs.empty() && chance(50)) {
+				out << ind << "if (" << gen_expr(ctx, max_depth - 1) << ") return " << gen_expr(ctx, max_depth - 1) << ";\n";
+			} else {
+				std::vector<const gen_var*> vars = writable_scalars(ctx);
+				if (vars.empty()) break;
+				out << ind << vars[rand_int(static_cast<int>(vars.size()))]->name << " = " <<
+					gen_expr(ctx, max_depth - 2) << ";\n";
+			}
+		}
+		break;
+	}
+}
+
+// 文の並びを生成する
+static void gen_block(std::stringstream& out, func_context& ctx, int indent, int max_stmts) {
+	int num_stmts = 1 + rand_int(max_stmts);
+	for (int i = 0; i < num_stmts; i++) gen_statement(out, ctx, indent);
+}
+
+// 関数を1個生成する
+static void gen_function(std::stringstream& out, int index, bool is_main) {
+	gen_func& f = funcs[index];
+	func_context ctx;
+	ctx.is_pure = f.is_pure;
+	ctx.num_funcs_callable = index;
+	ctx.loop_depth = 0;
+	ctx.has_loop = false;
+	ctx.next_counter = 0;
+	ctx.stmt_budget = is_main ? 30 : 14;
+	if (is_main) out << "#pragma entry\n";
+	out << (f.is_pure || is_main ? "int " : "void ") << f.name << "(";
+	for (size_t i = 0; i < f.param_types.size(); i++) {
+		std::stringstream name;
+		name << "p" << i;
+		if (i > 0) out << ", ";
+		out << type_name(f.param_types[i]) << " " << name.str();
+		ctx.locals.push_back(gen_var(name.str(), f.param_types[i], 0, false));
+	}
+	out << ") {\n";
+	// ローカル変数 (初期化子は使えないので、宣言後に代入する)
+	std::stringstream init;
+	int num_locals = 1 + rand_int(4);
+	int num_register = 0;
+	for (int i = 0; i < num_locals; i++) {
+		std::stringstream name;
+		name << "l" << i;
+		int type = rand_int(num_int_types);
+		bool is_register = num_register < 2 && chance(25);
+		if (is_register) num_register++;
+		out << "\t" << (is_register ? "register " : "") << type_name(type) << " " << name.str() << ";\n";
+		ctx.locals.push_back(gen_var(name.str(), type, 0, false));
+		init << "\t" << name.str() << " = " << gen_literal() << ";\n";
+	}
+	// 配列を指すポインタ
+	std::vector<const gen_var*> arrs = arrays();
+	int num_pointers = rand_int(3);
+	for (int i = 0; i < num_pointers; i++) {
+		std::stringstream name;
+		name << "q" << i;
+		int target = static_cast<int>(arrs[rand_int(static_cast<int>(arrs.size()))] - &globals[0]);
+		gen_var p(name.str(), globals[target].type, 0, false);
+		p.target = target;
+		out << "\t" << type_name(p.type) << "* " << p.name << ";\n";
+		init << "\t" << p.name << " = " << globals[target].name << ";\n";
+		ctx.locals.push_back(p);
+	}
+	std::stringstream body;
+	while (ctx.stmt_budget > 0) gen_statement(body, ctx, 1);
+	if (is_main) {
+		body << "\treturn 0;\n";
+	} else if (f.is_pure) {
+		body << "\treturn " << gen_expr(ctx, max_depth) << ";\n";
+	}
+	f.has_loop = ctx.has_loop;
+	// ループカウンタは使った数だけ宣言する
+	for (int i = 0; i < ctx.next_counter; i++) out << "\tint i" << i << ";\n";
+	out << init.str() << body.str() << "}\n\n";
+}
+
+// sim15と同じ形式でグローバル変数を出力するドライバを生成する
+static std::string gen_driver(const std::string& program_name) {
+	std::stringstream out;
+	out << "#include <stdio.h>\n";
+	out << "#include <string.h>\n";
+	out << "#include <stdint.h>\n";
+	out << "#define main compile15_main\n";
+	out << "#include \"" << program_name << "\"\n";
+	out << "#undef main\n\n";
+	out << "static void print_global(const char* name, const void* data, int element_size, int count) {\n";
+	out << "\tint i;\n";
+	out << "\tuint32_t value = 0;\n";
+	out << "\tprintf(\"%s =\", name);\n";
+	out << "\tfor (i = 0; i < count; i++) {\n";
+	out << "\t\tuint8_t bytes[4] = {0, 0, 0, 0};\n";
+	out << "\t\tint j;\n";
+	out << "\t\tmemcpy(bytes, (const char*)data + i * element_size, element_size);\n";
+	out << "\t\tvalue = 0;\n";
+	out << "\t\tfor (j = element_size - 1; j >= 0; j--) value = (value << 8) | bytes[j];\n";
+	out << "\t\tprintf(\" 0x%0*X\", element_size * 2, (unsigned int)value);\n";
+	out << "\t}\n";
+	out << "\tif (count == 1) {\n";
+	out << "\t\tint shift = 32 - 8 * element_size;\n";
+	out << "\t\tprintf(\" (%d)\", (int)((int32_t)(value << shift) >> shift));\n";
+	out << "\t}\n";
+	out << "\tprintf(\"\\n\");\n";
+	out << "}\n\n";
+	out << "int main(void) {\n";
+	out << "\tcompile15_main();\n";
+	for (size_t i = 0; i < globals.size(); i++) {
+		const gen_var& g = globals[i];
+		out << "\tprint_global(\"" << g.name << "\", &" << g.name << ", " <<
+			int_types[g.type].size << ", " << (g.count == 0 ? 1 : g.count) << ");\n";
+	}
+	out << "\treturn 0;\n";
+	out << "}\n";
+	return out.str();
+}
+
+// プログラム全体を生成する
+static std::string gen_program() {
+	std::stringstream out;
+	int num_scalars = 2 + rand_int(5);
+	int num_arrays = 1 + rand_int(3);
+	for (int i = 0; i < num_scalars + num_arrays; i++) {
+		bool is_array = i >= num_scalars;
+		std::stringstream name;
+		if (is_array) name << "a" << (i - num_scalars); else name << "g" << i;
+		gen_var g(name.str(), rand_int(num_int_types), is_array ? 4 << rand_int(3) : 0, true);
+		out << type_name(g.type) << " " << g.name;
+		if (is_array) {
+			out << "[" << g.count << "]";
+			if (chance(50)) {
+				out << " = {";
+				int num_values = 1 + rand_int(g.count);
+				for (int j = 0; j < num_values; j++) out << (j > 0 ? ", " : "") << rand_int(100);
+				out << "}";
+			}
+		} else if (chance(50)) {
+			out << " = " << rand_int(1000);
+		}
+		out << ";\n";
+		globals.push_back(g);
+	}
+	out << "\n";
+	int num_funcs = 1 + rand_int(4);
+	for (int i = 0; i <= num_funcs; i++) {
+		gen_func f;
+		std::stringstream name;
+		bool is_main = i == num_funcs;
+		f.is_pure = !is_main && chance(50);
+		if (is_main) {
+			name << "main";
+		} else {
+			name << (f.is_pure ? "f" : "s") << i;
+			int num_params = rand_int(5);
+			for (int j = 0; j < num_params; j++) f.param_types.push_back(rand_int(num_int_types));
+		}
+		f.name = name.str();
+		funcs.push_back(f);
+		gen_function(out, i, is_main);
+	}
+	return out.str();
+}
+
+// ファイルに書き込む
+static bool write_file(const char* file_name, const std::string& data) {
+	FILE* fp = fopen(file_name, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "failed to open %s\n", file_name);
+		return false;
+	}
+	fputs(data.c_str(), fp);
+	fclose(fp);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 4 && argc != 5) {
+		fprintf(stderr, "usage: %s SEED PROGRAM.c DRIVER.c [MAX_DEPTH]\n", argc > 0 ? argv[0] : "gen15");
+		return 1;
+	}
+	rand_state = static_cast<uint32_t>(strtoul(argv[1], NULL, 0)) * UINT32_C(2654435761) + 1;
+	if (argc >= 5) max_depth = atoi(argv[4]) < 2 ? 2 : atoi(argv[4]);
+	if (rand_state == 0) rand_state = 1;
+	for (int i = 0; i < 8; i++) next_rand();
+	std::string program = gen_program();
+	// ドライバからは、プログラムを同じディレクトリにあるものとしてインクルードする
+	std::string program_name = argv[2];
+	size_t slash = program_name.find_last_of('/');
+	if (slash != std::string::npos) program_name = program_name.substr(slash + 1);
+	if (!write_file(argv[2], program)) return 1;
+	if (!write_file(argv[3], gen_driver(program_name))) return 1;
+	return 0;
+}
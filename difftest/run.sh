@@ -0,0 +1,108 @@
+#!/bin/sh
+# ランダムなプログラムで、compile15 + sim15 の実行結果とホストのCコンパイラでの実行結果を比較する
+#   sh difftest/run.sh [--count=N] [--seed=N] [--depth=N] [--out=DIR] [--old-compile15=PATH]
+# --count : 試すプログラムの数 (既定は100)
+# --seed : 最初のシード (既定は1、以降1ずつ増やす)
+# --depth : 生成する式の深さの上限 (既定は2)
+# --out : 結果を置くディレクトリ (既定は difftest_output)
+#         不一致・エラーとなったプログラムは DIR/SEED/ に残し、DIR/log.txt に記録する
+#         レジスタ不足でコンパイルできなかったもの (未対応) は失敗として扱わず、記録のみ行う
+# --old-compile15 : 比較対象の古いcompile15 (指定するとサイクル数の差を DIR/cycles.txt に記録する)
+# 使用するプログラムは環境変数 COMPILE15, SIM15, GEN15, HOST_CC で変更できる
+
+DIFFTEST_DIR=$(cd "$(dirname "$0")" && pwd)
+COMPILE15=${COMPILE15:-$DIFFTEST_DIR/../compile15}
+SIM15=${SIM15:-$DIFFTEST_DIR/../sim15}
+GEN15=${GEN15:-$DIFFTEST_DIR/gen15}
+HOST_CC=${HOST_CC:-cc}
+SIM_OPTIONS="--ram-size=0x10000 --max-steps=10000000"
+count=100
+seed=1
+depth=2
+out=difftest_output
+old_compile15=
+for arg in "$@"; do
+	case "$arg" in
+	--count=*) count=${arg#*=} ;;
+	--seed=*) seed=${arg#*=} ;;
+	--depth=*) depth=${arg#*=} ;;
+	--out=*) out=${arg#*=} ;;
+	--old-compile15=*) old_compile15=${arg#*=} ;;
+	*) echo "unknown option: $arg" >&2; exit 2 ;;
+	esac
+done
+
+mkdir -p "$out" || exit 2
+work=$(mktemp -d) || exit 2
+trap 'rm -rf "$work"' EXIT
+: > "$out/log.txt"
+if [ -n "$old_compile15" ]; then
+	echo "# seed cycles old_cycles delta" > "$out/cycles.txt"
+fi
+
+# 失敗したプログラムを残し、記録する
+record_failure() {
+	mkdir -p "$out/$seed"
+	cp "$work"/* "$out/$seed/"
+	echo "$seed: $1" >> "$out/log.txt"
+	echo "$seed: $1"
+}
+
+passed=0
+failed=0
+skipped=0
+unsupported=0
+total_delta=0
+last=$((seed + count))
+while [ "$seed" -lt "$last" ]; do
+	rm -f "$work"/*
+	"$GEN15" "$seed" "$work/prog.c" "$work/driver.c" "$depth" || exit 2
+	# ホストでの実行結果を期待値とする
+	if ! "$HOST_CC" -std=c99 -fwrapv -w -o "$work/host" "$work/driver.c" ||
+	! "$work/host" > "$work/host.out"; then
+		echo "$seed: host build or run failed, skipped" >> "$out/log.txt"
+		skipped=$((skipped + 1))
+		seed=$((seed + 1))
+		continue
+	fi
+	sort "$work/host.out" > "$work/expected.txt"
+	if ! "$COMPILE15" < "$work/prog.c" > "$work/prog.asm" 2> "$work/compile.err"; then
+		if grep -q "no registers available" "$work/compile.err"; then
+			echo "$seed: unsupported: $(head -n 1 "$work/compile.err")" >> "$out/log.txt"
+			unsupported=$((unsupported + 1))
+			seed=$((seed + 1))
+			continue
+		fi
+		record_failure "compile failed: $(head -n 1 "$work/compile.err")"
+		failed=$((failed + 1))
+	elif ! "$SIM15" $SIM_OPTIONS "$work/prog.asm" > "$work/sim.out" 2> "$work/sim.err"; then
+		record_failure "simulation failed: $(head -n 1 "$work/sim.err")"
+		failed=$((failed + 1))
+	else
+		sed '1,/^flags:/d' "$work/sim.out" | sort > "$work/actual.txt"
+		if ! cmp -s "$work/expected.txt" "$work/actual.txt"; then
+			diff "$work/expected.txt" "$work/actual.txt" > "$work/result.diff"
+			record_failure "result mismatch"
+			failed=$((failed + 1))
+		else
+			passed=$((passed + 1))
+			# 古いcompile15とのサイクル数の比較
+			if [ -n "$old_compile15" ] &&
+			"$old_compile15" < "$work/prog.c" > "$work/old.asm" 2> /dev/null &&
+			"$SIM15" $SIM_OPTIONS "$work/old.asm" > "$work/old.out" 2> /dev/null; then
+				cycles=$(sed -n 's/^cycles: //p' "$work/sim.out")
+				old_cycles=$(sed -n 's/^cycles: //p' "$work/old.out")
+				delta=$((cycles - old_cycles))
+				total_delta=$((total_delta + delta))
+				echo "$seed $cycles $old_cycles $delta" >> "$out/cycles.txt"
+			fi
+		fi
+	fi
+	seed=$((seed + 1))
+done
+
+echo "passed: $passed, failed: $failed, skipped: $skipped, unsupported: $unsupported"
+if [ -n "$old_compile15" ]; then
+	echo "total cycle delta against old compiler: $total_delta (details in $out/cycles.txt)"
+fi
+[ "$failed" -eq 0 ]
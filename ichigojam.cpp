@@ -0,0 +1,108 @@
+#include <cstdio>
+#include <cinttypes>
+#include <sstream>
+#include <vector>
+#include "ichigojam.hpp"
+
+// シミュレータの設定をIchigoJamのメモリ配置に合わせる
+void ichigojam_configure(sim_config& config) {
+	config.ram_size = ICHIGOJAM_RAM_SIZE;
+	config.rom_size = ICHIGOJAM_FONT_ADDRESS + ICHIGOJAM_FONT_SIZE;
+}
+
+// USR()の呼び出しと同様に実行を開始する準備をする
+ichigojam_saved_regs ichigojam_start(sim_machine& machine, uint32_t address, const ichigojam_env& env) {
+	uint32_t base = machine.config.ram_base;
+	for (int i = 0; i < ICHIGOJAM_VAR_NUM; i++) {
+		machine.write_memory(base + ICHIGOJAM_VAR_ADDRESS + 2 * i, 2, static_cast<uint16_t>(env.vars[i]));
+	}
+	// 画面は消しておく
+	for (int i = 0; i < ICHIGOJAM_SCREEN_WIDTH * ICHIGOJAM_SCREEN_HEIGHT; i++) {
+		machine.write_memory(base + ICHIGOJAM_VRAM_ADDRESS + i, 1, 0);
+	}
+	if (env.keys.size() >= ICHIGOJAM_KEY_SIZE) throw sim_error("too many keys");
+	for (uint32_t i = 0; i < ICHIGOJAM_KEY_SIZE; i++) {
+		machine.write_memory(base + ICHIGOJAM_KEY_ADDRESS + i, 1,
+			i < env.keys.size() ? static_cast<uint8_t>(env.keys[i]) : 0);
+	}
+	machine.start(address);
+	// USR(アドレス, 値) : R0に値、R1に仮想メモリの先頭のアドレスが渡される
+	machine.regs[0] = static_cast<uint32_t>(static_cast<int32_t>(env.usr_arg));
+	machine.regs[1] = base;
+	// 戻った時に比較できるよう、呼び出し先で保存するべきレジスタにBASIC側の値を模した値を入れておく
+	ichigojam_saved_regs saved;
+	for (int i = 4; i <= 11; i++) {
+		machine.regs[i] = UINT32_C(0x1c000000) + i * UINT32_C(0x01010101);
+	}
+	for (int i = 0; i < 14; i++) saved.regs[i] = machine.regs[i];
+	return saved;
+}
+
+// プログラムの配置の問題を文字列にする (問題が無ければ空文字列)
+std::string ichigojam_check_layout(const sim_machine& machine) {
+	uint32_t start = machine.config.base_address;
+	uint32_t end = start;
+	for (size_t i = 0; i < machine.insts.size(); i++) {
+		uint32_t inst_end = machine.addresses[i] + machine.insts[i].size() - machine.config.ram_base;
+		if (inst_end > end) end = inst_end;
+	}
+	static const struct {
+		uint32_t address, size;
+		const char* name;
+	} regions[] = {
+		{ICHIGOJAM_VAR_ADDRESS, 2 * ICHIGOJAM_VAR_NUM, "variables"},
+		{ICHIGOJAM_VRAM_ADDRESS, ICHIGOJAM_SCREEN_WIDTH * ICHIGOJAM_SCREEN_HEIGHT, "VRAM"},
+		{ICHIGOJAM_KEY_ADDRESS, ICHIGOJAM_RAM_SIZE - ICHIGOJAM_KEY_ADDRESS, "key buffer and stack"}
+	};
+	std::stringstream ss;
+	for (size_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+		if (start < regions[i].address + regions[i].size && regions[i].address < end) {
+			char buf[128];
+			snprintf(buf, sizeof(buf), "program (0x%03" PRIX32 "-0x%03" PRIX32 ") overlaps %s\n",
+				start, end - 1, regions[i].name);
+			ss << buf;
+		}
+	}
+	return ss.str();
+}
+
+// BASICに戻った時に呼び出し規約が守られていなければ、例外を投げる
+void ichigojam_check_return(const sim_machine& machine, const ichigojam_saved_regs& saved) {
+	for (int i = 4; i <= 13; i++) {
+		if (i == 12) continue;
+		if (machine.regs[i] != saved.regs[i]) {
+			std::stringstream ss;
+			ss << (i == 13 ? std::string("SP") : "R" + std::to_string(i)) << " not restored on return to BASIC";
+			throw sim_error(ss.str());
+		}
+	}
+}
+
+// BASICから見た実行結果 (USR()の戻り値・変数・画面) を文字列にする
+std::string ichigojam_report(const sim_machine& machine) {
+	uint32_t base = machine.config.ram_base;
+	std::stringstream ss;
+	// BASICの数値は16ビット
+	ss << "USR = " << static_cast<int16_t>(machine.regs[0]) << "\n";
+	for (int i = 0; i < ICHIGOJAM_VAR_NUM; i++) {
+		int16_t value = static_cast<int16_t>(machine.read_memory(base + ICHIGOJAM_VAR_ADDRESS + 2 * i, 2));
+		if (value != 0) ss << static_cast<char>('A' + i) << " = " << value << "\n";
+	}
+	// 画面は最後の空白でない行まで出力する (表示できない文字は.にする)
+	std::vector<std::string> lines;
+	size_t last_line = 0;
+	for (int y = 0; y < ICHIGOJAM_SCREEN_HEIGHT; y++) {
+		std::string line;
+		bool blank = true;
+		for (int x = 0; x < ICHIGOJAM_SCREEN_WIDTH; x++) {
+			uint32_t c = machine.read_memory(base + ICHIGOJAM_VRAM_ADDRESS + y * ICHIGOJAM_SCREEN_WIDTH + x, 1);
+			if (c != 0 && c != ' ') blank = false;
+			line += c == 0 ? ' ' : (0x20 <= c && c < 0x7f ? static_cast<char>(c) : '.');
+		}
+		lines.push_back(line);
+		if (!blank) last_line = lines.size();
+	}
+	ss << "screen:\n";
+	for (size_t i = 0; i < last_line; i++) ss << "|" << lines[i] << "|\n";
+	return ss.str();
+}
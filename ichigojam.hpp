@@ -0,0 +1,52 @@
+#ifndef ICHIGOJAM_HPP_GUARD_72758025_F3CF_4CEF_9534_24B9334A14EB
+#define ICHIGOJAM_HPP_GUARD_72758025_F3CF_4CEF_9534_24B9334A14EB
+
+#include <cstdint>
+#include <string>
+#include "sim.hpp"
+
+// IchigoJamの仮想メモリの配置 (USR()でR1に渡される位置からのオフセット)
+const uint32_t ICHIGOJAM_FONT_ADDRESS = 0x000; // 文字パターン 0x00～0xDF (書き込み不可)
+const uint32_t ICHIGOJAM_FONT_SIZE = 0x700;
+const uint32_t ICHIGOJAM_PCG_ADDRESS = 0x700; // 文字パターン 0xE0～0xFF (機械語の置き場所によく使う)
+const uint32_t ICHIGOJAM_VAR_ADDRESS = 0x800; // 変数A～Z (16ビット)
+const uint32_t ICHIGOJAM_VRAM_ADDRESS = 0x900; // 画面 (32x24文字)
+const uint32_t ICHIGOJAM_LIST_ADDRESS = 0xC00; // BASICのプログラム
+const uint32_t ICHIGOJAM_LIST_SIZE = 0x400;
+// 以下は実機には無い、シミュレータでの代用
+const uint32_t ICHIGOJAM_KEY_ADDRESS = 0x1000; // キーボードからの入力 (0で終わる文字列)
+const uint32_t ICHIGOJAM_KEY_SIZE = 0x80;
+const uint32_t ICHIGOJAM_RAM_SIZE = 0x1400; // KEYの後ろはスタック
+
+const int ICHIGOJAM_SCREEN_WIDTH = 32;
+const int ICHIGOJAM_SCREEN_HEIGHT = 24;
+const int ICHIGOJAM_VAR_NUM = 26;
+
+// USR()を呼ぶ時のBASIC側の状態
+struct ichigojam_env {
+	int16_t usr_arg; // USR()の第2引数 (R0に渡される)
+	int16_t vars[ICHIGOJAM_VAR_NUM];
+	std::string keys;
+
+	ichigojam_env() : usr_arg(0) {
+		for (int i = 0; i < ICHIGOJAM_VAR_NUM; i++) vars[i] = 0;
+	}
+};
+
+// USR()から戻った時に元に戻っているべきレジスタの値
+struct ichigojam_saved_regs {
+	uint32_t regs[14]; // R4～R11とSPのみ使う
+};
+
+// シミュレータの設定をIchigoJamのメモリ配置に合わせる
+void ichigojam_configure(sim_config& config);
+// USR()の呼び出しと同様に実行を開始する準備をする
+ichigojam_saved_regs ichigojam_start(sim_machine& machine, uint32_t address, const ichigojam_env& env);
+// プログラムの配置の問題を文字列にする (問題が無ければ空文字列)
+std::string ichigojam_check_layout(const sim_machine& machine);
+// BASICに戻った時に呼び出し規約が守られていなければ、例外を投げる
+void ichigojam_check_return(const sim_machine& machine, const ichigojam_saved_regs& saved);
+// BASICから見た実行結果 (USR()の戻り値・変数・画面) を文字列にする
+std::string ichigojam_report(const sim_machine& machine);
+
+#endif
@@ -0,0 +1,255 @@
+#include <cstdio>
+#include <cinttypes>
+#include <algorithm>
+#include <sstream>
+#include "profile.hpp"
+
+// 基本ブロックを終わらせる命令かを判定する
+static bool is_block_terminator(const asm_inst& inst) {
+	switch (inst.kind) {
+	case JCC: case JMP_DIRECT: case JMP_INDIRECT: case RET:
+		return true;
+	case POP_REGS:
+		return (inst.params[0] & 0x100) != 0;
+	case MOV_REG: case ADD_REG:
+		return inst.params[0] == 15;
+	default:
+		return false;
+	}
+}
+
+// 各命令が所属する関数と基本ブロックの名前を求める
+static void assign_names(const std::vector<asm_inst>& insts, profile_data& data) {
+	data.functions.assign(insts.size(), "(stub)");
+	data.blocks.assign(insts.size(), "");
+	std::string function = "(stub)", block = "@(top)";
+	std::string last_label = "(top)";
+	int insts_after_label = 0;
+	bool after_terminator = false, after_label = false;
+	for (size_t i = 0; i < insts.size(); i++) {
+		const asm_inst& inst = insts[i];
+		if (inst.kind == LABEL) {
+			if (is_function_label(inst)) function = inst.label;
+			if (!after_label) block = "@" + inst.label;
+			last_label = inst.label;
+			insts_after_label = 0;
+			after_label = true;
+			after_terminator = false;
+		} else if (inst.size() > 0) {
+			if (after_terminator) {
+				std::stringstream ss;
+				ss << "@" << last_label << "+" << insts_after_label;
+				block = ss.str();
+			}
+			after_label = false;
+			after_terminator = is_block_terminator(inst);
+			insts_after_label++;
+		}
+		data.functions[i] = function;
+		data.blocks[i] = block;
+	}
+}
+
+// 子ノードを探し、無ければ作る
+static int get_child_node(profile_data& data, int parent, const std::string& function) {
+	auto itr = data.call_nodes[parent].children.find(function);
+	if (itr != data.call_nodes[parent].children.end()) return itr->second;
+	int id = static_cast<int>(data.call_nodes.size());
+	data.call_nodes.push_back(profile_call_node(function, parent));
+	data.call_nodes[parent].children[function] = id;
+	return id;
+}
+
+// 計測しながら戻るまで実行する (machineはstart()済みであること)
+void profile_run(sim_machine& machine, profile_data& data) {
+	const std::vector<asm_inst>& insts = machine.insts;
+	data.inst_counts.assign(insts.size(), 0);
+	data.inst_cycles.assign(insts.size(), 0);
+	assign_names(insts, data);
+	data.call_nodes.clear();
+	auto start_itr = machine.inst_at.find(machine.regs[15]);
+	data.call_nodes.push_back(profile_call_node(
+		start_itr == machine.inst_at.end() ? "?" : data.functions[start_itr->second]));
+	data.call_nodes[0].calls = 1;
+	int current = 0;
+	// 呼び出し元のノードと戻り先のアドレス
+	std::vector<std::pair<int, uint32_t> > call_stack;
+	while (!machine.halted) {
+		uint32_t pc = machine.regs[15];
+		machine.step();
+		size_t index = machine.last_index;
+		const asm_inst& inst = insts[index];
+		data.inst_counts[index]++;
+		data.inst_cycles[index] += machine.last_cycles;
+		data.call_nodes[current].self_cycles += machine.last_cycles;
+		data.call_nodes[current].self_insts++;
+		if (machine.halted) break;
+		uint32_t next_pc = machine.regs[15];
+		auto next_itr = machine.inst_at.find(next_pc);
+		std::string next_function = next_itr == machine.inst_at.end() ? "?" : data.functions[next_itr->second];
+		if (inst.kind == CALL_DIRECT || inst.kind == CALL_INDIRECT) {
+			// 関数呼び出し
+			int child = get_child_node(data, current, next_function);
+			data.call_nodes[child].calls++;
+			call_stack.push_back(std::make_pair(current, pc + inst.size()));
+			current = child;
+		} else if (!call_stack.empty() && next_pc == call_stack.back().second) {
+			// 呼び出し元に戻る
+			current = call_stack.back().first;
+			call_stack.pop_back();
+		} else if (next_function != data.call_nodes[current].function) {
+			// 他の関数へのジャンプ (末尾呼び出し) は、呼び出し元から呼んだものとして扱う
+			int parent = data.call_nodes[current].parent;
+			int node = get_child_node(data, parent < 0 ? current : parent, next_function);
+			data.call_nodes[node].calls++;
+			current = node;
+		}
+	}
+	// 子孫を含むサイクル数を求める (子は必ず親より後ろにある)
+	for (size_t i = data.call_nodes.size(); i-- > 0; ) {
+		profile_call_node& node = data.call_nodes[i];
+		node.total_cycles += node.self_cycles;
+		if (node.parent >= 0) data.call_nodes[node.parent].total_cycles += node.total_cycles;
+	}
+}
+
+// 集計の1項目
+struct profile_entry {
+	std::string name;
+	uint64_t cycles, insts, calls, total_cycles;
+
+	profile_entry() : cycles(0), insts(0), calls(0), total_cycles(0) {}
+};
+
+// サイクル数の多い順に並べる
+static std::vector<profile_entry> sort_entries(const std::map<std::string, profile_entry>& entries) {
+	std::vector<profile_entry> result;
+	for (auto itr = entries.begin(); itr != entries.end(); itr++) {
+		result.push_back(itr->second);
+		result.back().name = itr->first;
+	}
+	std::stable_sort(result.begin(), result.end(), [](const profile_entry& a, const profile_entry& b) {
+		return a.cycles > b.cycles;
+	});
+	return result;
+}
+
+// 全体に対する割合を文字列にする
+static std::string percent(uint64_t value, uint64_t total) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%6.2f%%", total == 0 ? 0.0 : 100.0 * value / total);
+	return buf;
+}
+
+// 関数・基本ブロック・行ごとの集計結果を文字列にする
+std::string profile_flat_report(const sim_machine& machine, const profile_data& data) {
+	std::map<std::string, profile_entry> functions, blocks, lines;
+	for (size_t i = 0; i < machine.insts.size(); i++) {
+		if (data.inst_counts[i] == 0) continue;
+		profile_entry& func = functions[data.functions[i]];
+		func.cycles += data.inst_cycles[i];
+		func.insts += data.inst_counts[i];
+		profile_entry& block = blocks[data.blocks[i] + " (" + data.functions[i] + ")"];
+		block.cycles += data.inst_cycles[i];
+		block.insts += data.inst_counts[i];
+		std::stringstream line_name;
+		if (machine.insts[i].lineno > 0) line_name << "line " << machine.insts[i].lineno;
+		else line_name << "(unknown)";
+		profile_entry& line = lines[line_name.str()];
+		line.cycles += data.inst_cycles[i];
+		line.insts += data.inst_counts[i];
+	}
+	// 呼び出し回数と、再帰を二重に数えない子孫込みのサイクル数
+	for (size_t i = 0; i < data.call_nodes.size(); i++) {
+		const profile_call_node& node = data.call_nodes[i];
+		profile_entry& func = functions[node.function];
+		func.calls += node.calls;
+		bool nested = false;
+		for (int p = node.parent; p >= 0; p = data.call_nodes[p].parent) {
+			if (data.call_nodes[p].function == node.function) {
+				nested = true;
+				break;
+			}
+		}
+		if (!nested) func.total_cycles += node.total_cycles;
+	}
+	uint64_t total = machine.cycles;
+	std::stringstream ss;
+	char buf[512];
+	ss << "total cycles: " << total << ", instructions: " << machine.steps << "\n";
+	ss << "\nfunctions:\n";
+	snprintf(buf, sizeof(buf), "%8s %12s %12s %10s %12s  %s\n",
+		"%self", "self", "insts", "calls", "total", "name");
+	ss << buf;
+	std::vector<profile_entry> sorted = sort_entries(functions);
+	for (auto itr = sorted.begin(); itr != sorted.end(); itr++) {
+		snprintf(buf, sizeof(buf), "%8s %12" PRIu64 " %12" PRIu64 " %10" PRIu64 " %12" PRIu64 "  %s\n",
+			percent(itr->cycles, total).c_str(), itr->cycles, itr->insts, itr->calls,
+			itr->total_cycles, itr->name.c_str());
+		ss << buf;
+	}
+	for (int t = 0; t < 2; t++) {
+		ss << (t == 0 ? "\nbasic blocks:\n" : "\nsource lines:\n");
+		snprintf(buf, sizeof(buf), "%8s %12s %12s  %s\n", "%cycles", "cycles", "insts", "name");
+		ss << buf;
+		sorted = sort_entries(t == 0 ? blocks : lines);
+		for (auto itr = sorted.begin(); itr != sorted.end(); itr++) {
+			snprintf(buf, sizeof(buf), "%8s %12" PRIu64 " %12" PRIu64 "  %s\n",
+				percent(itr->cycles, total).c_str(), itr->cycles, itr->insts, itr->name.c_str());
+			ss << buf;
+		}
+	}
+	return ss.str();
+}
+
+// 呼び出し木のノードを出力する
+static void print_call_node(std::stringstream& ss, const profile_data& data, int id, int depth) {
+	const profile_call_node& node = data.call_nodes[id];
+	char buf[512];
+	snprintf(buf, sizeof(buf), "%12" PRIu64 " %12" PRIu64 " %10" PRIu64 "  %*s%s\n",
+		node.total_cycles, node.self_cycles, node.calls, depth * 2, "", node.function.c_str());
+	ss << buf;
+	// 子はサイクル数の多い順に出力する
+	std::vector<int> children;
+	for (auto itr = node.children.begin(); itr != node.children.end(); itr++) {
+		children.push_back(itr->second);
+	}
+	std::stable_sort(children.begin(), children.end(), [&data](int a, int b) {
+		return data.call_nodes[a].total_cycles > data.call_nodes[b].total_cycles;
+	});
+	for (auto itr = children.begin(); itr != children.end(); itr++) {
+		print_call_node(ss, data, *itr, depth + 1);
+	}
+}
+
+// 呼び出し木を文字列にする
+std::string profile_call_graph_report(const profile_data& data) {
+	std::stringstream ss;
+	char buf[128];
+	snprintf(buf, sizeof(buf), "%12s %12s %10s  %s\n", "total", "self", "calls", "function");
+	ss << buf;
+	if (!data.call_nodes.empty()) print_call_node(ss, data, 0, 0);
+	return ss.str();
+}
+
+// 命令ごとの実行回数とサイクル数を付けたリストを文字列にする
+std::string profile_listing_report(const sim_machine& machine, const profile_data& data) {
+	std::stringstream ss;
+	char buf[64];
+	int prev_lineno = 0;
+	for (size_t i = 0; i < machine.insts.size(); i++) {
+		const asm_inst& inst = machine.insts[i];
+		if (inst.kind != LABEL && inst.lineno != 0 && inst.lineno != prev_lineno) {
+			snprintf(buf, sizeof(buf), "%10s %10s  ", "", "");
+			ss << buf << "\t' #line " << inst.lineno << "\n";
+			prev_lineno = inst.lineno;
+		}
+		if (inst.size() > 0 && inst.kind != DB && inst.kind != DB2 && inst.kind != DW && inst.kind != DD) {
+			snprintf(buf, sizeof(buf), "%10" PRIu64 " %10" PRIu64 "  ", data.inst_counts[i], data.inst_cycles[i]);
+		} else {
+			snprintf(buf, sizeof(buf), "%10s %10s  ", "", "");
+		}
+		ss << buf << (inst.kind != LABEL && inst.kind != EMPTY ? "\t" : "") << inst.to_string() << "\n";
+	}
+	return ss.str();
+}
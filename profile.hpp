@@ -0,0 +1,42 @@
+#ifndef PROFILE_HPP_GUARD_539E6CA8_2731_4E62_B7EC_AD82FE74DA15
+#define PROFILE_HPP_GUARD_539E6CA8_2731_4E62_B7EC_AD82FE74DA15
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "sim.hpp"
+
+// 呼び出し木のノード
+struct profile_call_node {
+	std::string function;
+	int parent; // 負 : 根
+	uint64_t calls;
+	uint64_t self_cycles, self_insts;
+	uint64_t total_cycles; // 子孫を含む
+	std::map<std::string, int> children;
+
+	profile_call_node(const std::string& function_ = "", int parent_ = -1) :
+		function(function_), parent(parent_), calls(0),
+		self_cycles(0), self_insts(0), total_cycles(0) {}
+};
+
+// シミュレータでの実行の計測結果
+struct profile_data {
+	std::vector<uint64_t> inst_counts; // 命令ごとの実行回数
+	std::vector<uint64_t> inst_cycles; // 命令ごとのサイクル数
+	std::vector<std::string> functions; // 命令ごとの所属する関数
+	std::vector<std::string> blocks; // 命令ごとの所属する基本ブロック
+	std::vector<profile_call_node> call_nodes; // 0番が根
+};
+
+// 計測しながら戻るまで実行する (machineはstart()済みであること)
+void profile_run(sim_machine& machine, profile_data& data);
+// 関数・基本ブロック・行ごとの集計結果を文字列にする
+std::string profile_flat_report(const sim_machine& machine, const profile_data& data);
+// 呼び出し木を文字列にする
+std::string profile_call_graph_report(const profile_data& data);
+// 命令ごとの実行回数とサイクル数を付けたリストを文字列にする
+std::string profile_listing_report(const sim_machine& machine, const profile_data& data);
+
+#endif
@@ -0,0 +1,71 @@
+short g0;
+unsigned int g1 = 530;
+unsigned int a0[16] = {57, 57, 45, 23, 51, 95, 44, 48, 14, 23, 60, 57, 8, 10, 71};
+unsigned char a1[8];
+
+int f0(unsigned char p0, short p1, unsigned short p2) {
+	register int l0;
+	char l1;
+	short l2;
+	unsigned char l3;
+	unsigned int* q0;
+	unsigned int* q1;
+	l0 = 6;
+	l1 = 0xe52401ccu;
+	l2 = 934596365;
+	l3 = 4;
+	q0 = a0;
+	q1 = a0;
+	l1 = 168;
+	p1 = *(q0 + ((((a0[(a1[(g0) & 7]) & 15]) >= (p1)) || ((a0[(a1[(l1) & 7]) & 15]) != (p2))) & 15));
+	p1 = a0[((((0x2a05) ? (3) : (q0[(g1) & 15]))) - ((q1[(a1[(7) & 7]) & 15]) ^ (0xbecea1fau))) & 15];
+	switch ((g1) & 3) {
+	case 1:
+		p2 = 0x854;
+		if (((int)(q1[(l2) & 15]))) return a1[(l2) & 7];
+		break;
+	case 2:
+		p2 = q1[(11) & 15];
+		l3 = (~((g0) | (1))) == (((unsigned short)(p1)));
+	}
+	switch ((q1[(a0[(458833949) & 15]) & 15]) & 3) {
+	case 1:
+		if (*(q1 + ((l1) & 15))) {
+			++p2;
+		} else {
+			l2 = *(q0 + ((l0) & 15));
+		}
+		switch ((((char)((1664104850) % ((((20) & ~1) | 2))))) & 3) {
+		case 0:
+			--l0;
+			l2 = a0[(a0[(g0) & 15]) & 15];
+			break;
+		case 1:
+			l0 = -((p1) > (0xd2aef008u));
+			l1 = ((int)(~(*q0)));
+			break;
+		case 2:
+			p1 = *(q1 + ((-((p2) * (l0))) & 15));
+			break;
+		}
+		break;
+	case 2:
+		l0 = !(((unsigned char)((q1[(a1[(a1[(51599809) & 7]) & 7]) & 15]) && (*q0))));
+		p2 *= q0[(p0) & 15];
+	case 3:
+		p0 = (((unsigned short)((q1[(0xc14ab9d9u) & 15]) | (4)))) || (*q1);
+		l0 = a0[(p2) & 15];
+		break;
+	default:
+		l1 = a0[(((p0) == (l3)) >= (((unsigned int)(232)))) & 15];
+		l0 = ~((l1) <= (l1));
+	}
+	return q1[(l3) & 15];
+}
+
+#pragma entry
+int main() {
+	g0 = f0(1, 2, 3);
+	g1 = f0(g0, 5, 6);
+	return g1;
+}
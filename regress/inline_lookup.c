@@ -0,0 +1,40 @@
+int vowels;
+int narrow;
+int sum;
+
+int is_vowel(int c) {
+	switch (c) {
+	case 97: case 101: case 105: case 111: case 117:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+unsigned char wrap(int c) {
+	switch (c) {
+	case 0: return 44;
+	case 1: return 300;
+	case 2: return 255;
+	case 3: return 256;
+	case 4: return 7;
+	default: return 511;
+	}
+}
+
+#pragma entry
+int main() {
+	int c;
+	int x;
+	vowels = 0;
+	sum = 0;
+	for (c = 95; c < 120; c++) {
+		vowels += is_vowel(c);
+	}
+	for (c = 0; c < 6; c++) {
+		x = wrap(c);
+		sum = sum * 3 + x;
+		if (c == 1) narrow = x;
+	}
+	return vowels;
+}
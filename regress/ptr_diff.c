@@ -0,0 +1,11 @@
+int a[3];
+char c[5];
+int r1;
+int r2;
+int r3;
+#pragma entry
+void main() {
+	r1 = (&a + 2) - &a;
+	r2 = (&c + 7) - (&c + 1);
+	r3 = &c - (&c + 3);
+}
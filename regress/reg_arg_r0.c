@@ -0,0 +1,16 @@
+unsigned int a0[16];
+int k;
+int r;
+
+#pragma noinline
+int f(register unsigned int* p, register int i) {
+	return p[i & 15];
+}
+
+#pragma entry
+int main() {
+	a0[3] = 7;
+	k = 3;
+	r = f(a0, k);
+	return r;
+}
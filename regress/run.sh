@@ -0,0 +1,39 @@
+#!/bin/sh
+# 過去に誤ったコードを生成したプログラムをコンパイル・実行し、結果を検証する
+#   sh regress/run.sh
+# 各プログラムは通常のコード生成と --ssa の両方で試す
+# 使用するプログラムは環境変数 COMPILE15, SIM15 で変更できる
+
+REGRESS_DIR=$(cd "$(dirname "$0")" && pwd)
+COMPILE15=${COMPILE15:-$REGRESS_DIR/../compile15}
+SIM15=${SIM15:-$REGRESS_DIR/../sim15}
+
+work=$(mktemp -d) || exit 2
+trap 'rm -rf "$work"' EXIT
+
+failed=0
+for src in "$REGRESS_DIR"/*.c; do
+	name=$(basename "$src" .c)
+	for mode in "" --ssa; do
+		label="$name${mode:+ $mode}"
+		if ! "$COMPILE15" $mode < "$src" > "$work/$name.asm"; then
+			echo "$label: compile failed"
+			failed=1
+			continue
+		fi
+		if ! "$SIM15" "$work/$name.asm" > "$work/$name.out"; then
+			echo "$label: simulation failed"
+			failed=1
+			continue
+		fi
+		sed '1,/^flags:/d' "$work/$name.out" > "$work/$name.result"
+		if ! cmp -s "$work/$name.result" "$REGRESS_DIR/$name.expected"; then
+			diff "$REGRESS_DIR/$name.expected" "$work/$name.result"
+			echo "$label: wrong result"
+			failed=1
+			continue
+		fi
+		echo "$label: ok"
+	done
+done
+exit $failed
@@ -0,0 +1,55 @@
+int g;
+char cg;
+int out[12];
+int r;
+int f(int x) {
+	switch (x) {
+	case 1: return 10;
+	case 2: return -20;
+	case 3: return 30;
+	case 4: return 4000;
+	case 6: return 60;
+	default: return 7;
+	}
+}
+char h(unsigned int x) {
+	switch (x) {
+	case 5: return 1;
+	case 6: return -2;
+	case 7: return 3;
+	case 8: return 4;
+	case 9: return 5;
+	}
+	return 9;
+}
+#pragma entry
+void main() {
+	int i;
+	int v;
+	for (i = 0; i < 12; i++) {
+		switch (i) {
+		case 0: v = 3; break;
+		case 1: v = 5; break;
+		case 2: v = 8; break;
+		case 3: v = 13; break;
+		case 4: v = 21; break;
+		default: v = -1; break;
+		}
+		switch (i) {
+		case 2: g = 100; break;
+		case 3: g = 200; break;
+		case 4: g = 300; break;
+		case 5: g = 400; break;
+		case 6: g = 500; break;
+		}
+		switch (i) {
+		case 7: cg = 1; break;
+		case 8: cg = 2; break;
+		case 9: cg = -3; break;
+		case 10: cg = 4; break;
+		default: cg = 5; break;
+		}
+		out[i] = v * 1000000 + f(i) * 100 + h(i) + g + cg;
+		r = r + out[i];
+	}
+}
@@ -0,0 +1,35 @@
+#include <cstdio>
+#include <cstring>
+#include "report_output.hpp"
+
+// "--name" または "--name=FILE" 形式のオプションを解釈する
+bool parse_report_option(const char* arg, const char* name, report_output& output) {
+	size_t name_len = strlen(name);
+	if (strncmp(arg, name, name_len) != 0) return false;
+	if (arg[name_len] == '\0') {
+		output.enabled = true;
+		output.file_name = NULL;
+		return true;
+	} else if (arg[name_len] == '=') {
+		output.enabled = true;
+		output.file_name = arg + name_len + 1;
+		return true;
+	}
+	return false;
+}
+
+// 解析結果を出力する
+bool write_report(const report_output& output, const std::string& report) {
+	if (output.file_name == NULL) {
+		fputs(report.c_str(), stderr);
+		return true;
+	}
+	FILE* fp = fopen(output.file_name, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "failed to open %s\n", output.file_name);
+		return false;
+	}
+	fputs(report.c_str(), fp);
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,19 @@
+#ifndef REPORT_OUTPUT_HPP_GUARD_A605BA36_AE29_4EE5_83D9_B24DAB9FC655
+#define REPORT_OUTPUT_HPP_GUARD_A605BA36_AE29_4EE5_83D9_B24DAB9FC655
+
+#include <string>
+
+// 解析結果の出力先
+struct report_output {
+	bool enabled;
+	const char* file_name; // NULL : 標準エラー出力
+
+	report_output() : enabled(false), file_name(NULL) {}
+};
+
+// "--name" または "--name=FILE" 形式のオプションを解釈する
+bool parse_report_option(const char* arg, const char* name, report_output& output);
+// 解析結果を出力する
+bool write_report(const report_output& output, const std::string& report);
+
+#endif
@@ -0,0 +1,630 @@
+#include <cstdio>
+#include <cinttypes>
+#include <sstream>
+#include "sim.hpp"
+
+// アドレスを16進数の文字列にする
+static std::string address_to_string(uint32_t address) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "0x%08" PRIX32, address);
+	return buf;
+}
+
+// Thumb-1の命令として符号化できない理由を返す (符号化できれば空文字列)
+static std::string unencodable_reason(const asm_inst& inst) {
+	const uint32_t* p = inst.params;
+	// 下位レジスタ (R0〜R7) か
+	auto lo = [&](int n) { return p[n] <= 7; };
+	// 上位レジスタも使える命令のレジスタか (PCは不可)
+	auto any = [&](int n) { return p[n] <= 14; };
+	switch (inst.kind) {
+	case MOV_LIT: case ADD_LIT: case SUB_LIT: case CMP_REG_LIT:
+	case ADD_PC_LIT: case ADD_SP_LIT: case LDL_PC_LIT: case LDL_SP_LIT:
+		if (!lo(0)) return "high register";
+		if (p[1] > 255) return "immediate out of range";
+		break;
+	case STL_SP_LIT:
+		if (!lo(1)) return "high register";
+		if (p[0] > 255) return "immediate out of range";
+		break;
+	case MOV_REG:
+		if (p[0] > 15 || !any(1)) return "invalid register";
+		break;
+	case ADD_REG:
+		if (!any(0) && p[0] != 15) return "invalid register";
+		if (!any(1)) return "invalid register";
+		break;
+	case CMP_REG_REG:
+		if (!any(0) || !any(1)) return "invalid register";
+		break;
+	case ADD_REG_LIT: case SUB_REG_LIT:
+		if (!lo(0) || !lo(1)) return "high register";
+		if (p[2] > 7) return "immediate out of range";
+		break;
+	case SHL_REG_LIT:
+		if (!lo(0) || !lo(1)) return "high register";
+		if (p[2] > 31) return "immediate out of range";
+		break;
+	case SHR_REG_LIT: case ASR_REG_LIT:
+		// シフト量0は32として符号化される
+		if (!lo(0) || !lo(1)) return "high register";
+		if (p[2] < 1 || 32 < p[2]) return "immediate out of range";
+		break;
+	case LDB_REG_LIT: case LDW_REG_LIT: case LDL_REG_LIT:
+		if (!lo(0) || !lo(1)) return "high register";
+		if (p[2] > 31) return "immediate out of range";
+		break;
+	case STB_REG_LIT: case STW_REG_LIT: case STL_REG_LIT:
+		if (!lo(0) || !lo(2)) return "high register";
+		if (p[1] > 31) return "immediate out of range";
+		break;
+	case ADD_REG_REG: case SUB_REG_REG:
+	case LDB_REG_REG: case LDBS_REG_REG: case LDW_REG_REG: case LDWS_REG_REG: case LDL_REG_REG:
+	case STB_REG_REG: case STW_REG_REG: case STL_REG_REG:
+		if (!lo(0) || !lo(1) || !lo(2)) return "high register";
+		break;
+	case NEG_REG: case MUL_REG: case SHL_REG: case SHR_REG: case ASR_REG: case ROR_REG:
+	case NOT_REG: case AND_REG: case OR_REG: case XOR_REG: case BIC_REG: case ADC_REG: case SBC_REG:
+	case CADD_REG_REG: case TEST_REG_REG: case REV_REG: case REV16_REG: case REVSH_REG:
+		if (!lo(0) || !lo(1)) return "high register";
+		break;
+	case JCC:
+		if (p[0] > ALWAYS) return "invalid condition";
+		break;
+	case JMP_INDIRECT: case CALL_INDIRECT:
+		if (!any(0)) return "invalid register";
+		break;
+	case PUSH_REGS: case POP_REGS:
+		if (p[0] == 0 || p[0] > 0x1ff) return "invalid register list";
+		break;
+	case ADDSP_LIT: case SUBSP_LIT:
+		if (p[0] > 127) return "immediate out of range";
+		break;
+	case LDM_REGS: case STM_REGS:
+		if (!lo(0)) return "high register";
+		if (p[1] == 0 || p[1] > 0xff) return "invalid register list";
+		break;
+	default:
+		break;
+	}
+	return "";
+}
+
+// 分岐命令の飛び先までの距離が、符号化できる範囲かを判定する
+static bool branch_in_range(const asm_inst& inst, uint32_t address, uint32_t target) {
+	int64_t offset = static_cast<int64_t>(target) - (static_cast<int64_t>(address) + 4);
+	switch (inst.kind) {
+	case JCC: return -256 <= offset && offset <= 254;
+	case JMP_DIRECT: return -2048 <= offset && offset <= 2046;
+	case CALL_DIRECT: return -16777216 <= offset && offset <= 16777214;
+	default: return true;
+	}
+}
+
+// 命令列をRAMに配置する
+sim_machine::sim_machine(const std::vector<asm_inst>& insts_, const sim_config& config_) :
+config(config_), insts(insts_), addresses(insts_.size()), ram(config_.ram_size) {
+	if (config.base_address >= config.ram_size) {
+		throw sim_error("base address out of RAM");
+	}
+	// アドレスを割り当て、データを書き込む
+	uint32_t address = image_address();
+	std::vector<size_t> pending_labels;
+	int current_symbol = -1;
+	for (size_t i = 0; i < insts.size(); i++) {
+		const asm_inst& inst = insts[i];
+		if (inst.kind == LABEL) {
+			// ラベルは次に置くもののアドレスを指す
+			pending_labels.push_back(i);
+			continue;
+		}
+		if (inst.kind == EMPTY) {
+			addresses[i] = address;
+			continue;
+		}
+		address = asm_aligned_address(inst, address);
+		for (auto itr = pending_labels.begin(); itr != pending_labels.end(); itr++) {
+			addresses[*itr] = address;
+			labels[insts[*itr].label] = address;
+		}
+		pending_labels.clear();
+		addresses[i] = address;
+		if (address + inst.size() > config.ram_base + config.ram_size) {
+			throw sim_error("program too large for RAM");
+		}
+		if (is_data(inst)) {
+			// データを書き込み、コメントに書かれた名前を記録する
+			std::vector<std::string> names;
+			if (inst.kind == DB2) {
+				size_t sep = inst.comment.find(", ");
+				if (sep == std::string::npos) {
+					names.push_back(inst.comment);
+					names.push_back("");
+				} else {
+					names.push_back(inst.comment.substr(0, sep));
+					names.push_back(inst.comment.substr(sep + 2));
+				}
+			} else {
+				names.push_back(inst.comment);
+			}
+			int element_size = inst.kind == DW ? 2 : (inst.kind == DD ? 4 : 1);
+			int elements = inst.kind == DB2 ? 2 : 1;
+			for (int j = 0; j < elements; j++) {
+				uint32_t element_address = address + j * element_size;
+				write_memory(element_address, element_size, inst.params[j]);
+				if (names[j] != "" && names[j] != "*") {
+					symbols.push_back(sim_symbol(names[j], element_address, element_size));
+					current_symbol = static_cast<int>(symbols.size()) - 1;
+				}
+				if (current_symbol >= 0) symbols[current_symbol].size += element_size;
+			}
+		} else {
+			inst_at[address] = i;
+			current_symbol = -1;
+		}
+		address += inst.size();
+	}
+	for (auto itr = pending_labels.begin(); itr != pending_labels.end(); itr++) {
+		addresses[*itr] = address;
+		labels[insts[*itr].label] = address;
+	}
+	// アセンブラが受け付けない命令を拒否する
+	for (size_t i = 0; i < insts.size(); i++) {
+		const asm_inst& inst = insts[i];
+		if (inst.kind == EMPTY || inst.kind == LABEL || is_data(inst)) continue;
+		std::string reason = unencodable_reason(inst);
+		if (reason == "" && (inst.kind == JCC || inst.kind == JMP_DIRECT || inst.kind == CALL_DIRECT)) {
+			auto target = labels.find(inst.label);
+			if (target == labels.end()) {
+				reason = "undefined label " + inst.label;
+			} else if (!branch_in_range(inst, addresses[i], target->second)) {
+				reason = "branch target out of range";
+			}
+		}
+		if (reason != "") {
+			throw sim_error("unencodable instruction at " + address_to_string(addresses[i]) +
+				" (" + reason + "): " + inst.to_string());
+		}
+	}
+	for (int i = 0; i < 16; i++) regs[i] = 0;
+	flag_n = flag_z = flag_c = flag_v = false;
+	halted = true;
+	cycles = 0;
+	steps = 0;
+	last_index = 0;
+	last_cycles = 0;
+}
+
+// 実行開始位置の候補を返す (関数より前に命令があればプログラムの先頭、そうでなければmainか最初の関数)
+uint32_t sim_machine::default_entry() const {
+	// 関数より前に命令がある (old entry用のコードがある) なら、先頭から実行する
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if (itr->kind == EMPTY || is_data(*itr)) continue;
+		if (itr->kind == LABEL) {
+			if (itr->label[0] == '_' && itr->label[1] == '_') continue;
+			break;
+		}
+		return image_address();
+	}
+	auto main_itr = labels.find("main");
+	if (main_itr != labels.end()) return main_itr->second;
+	for (auto itr = insts.begin(); itr != insts.end(); itr++) {
+		if (itr->kind == LABEL && !(itr->label[0] == '_' && itr->label[1] == '_')) {
+			return label_address(itr->label);
+		}
+	}
+	throw sim_error("no function to execute");
+}
+
+// ラベルのアドレスを返す (無ければ例外を投げる)
+uint32_t sim_machine::label_address(const std::string& label) const {
+	auto itr = labels.find(label);
+	if (itr == labels.end()) throw sim_error("undefined label " + label);
+	return itr->second;
+}
+
+// 指定のアドレスから、戻り先をSIM_RETURN_ADDRESSとして実行を開始する準備をする
+void sim_machine::start(uint32_t address) {
+	regs[13] = config.ram_base + config.ram_size;
+	regs[14] = SIM_RETURN_ADDRESS | 1;
+	regs[15] = address;
+	halted = false;
+}
+
+// メモリを読む
+uint32_t sim_machine::read_memory(uint32_t address, int size) const {
+	if (address % size != 0) {
+		throw sim_error("unaligned read at " + address_to_string(address));
+	}
+	if (address < config.ram_base || address - config.ram_base > config.ram_size - size) {
+		throw sim_error("read from invalid address " + address_to_string(address));
+	}
+	uint32_t offset = address - config.ram_base;
+	uint32_t value = 0;
+	for (int i = size - 1; i >= 0; i--) {
+		value = (value << 8) | ram[offset + i];
+	}
+	return value;
+}
+
+// メモリに書き込む
+void sim_machine::write_memory(uint32_t address, int size, uint32_t value) {
+	if (address % size != 0) {
+		throw sim_error("unaligned write at " + address_to_string(address));
+	}
+	if (address < config.ram_base || address - config.ram_base > config.ram_size - size) {
+		throw sim_error("write to invalid address " + address_to_string(address));
+	}
+	if (address - config.ram_base < config.rom_size) {
+		throw sim_error("write to read-only address " + address_to_string(address));
+	}
+	uint32_t offset = address - config.ram_base;
+	for (int i = 0; i < size; i++) {
+		ram[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+	}
+}
+
+// レジスタを読む (PCは実行中の命令のアドレス+4として読める)
+uint32_t sim_machine::read_reg(int reg, uint32_t pc) const {
+	return reg == 15 ? pc + 4 : regs[reg];
+}
+
+void sim_machine::set_nz(uint32_t value) {
+	flag_n = (value >> 31) != 0;
+	flag_z = value == 0;
+}
+
+uint32_t sim_machine::add_with_carry(uint32_t a, uint32_t b, bool carry) {
+	uint64_t unsigned_sum = static_cast<uint64_t>(a) + b + (carry ? 1 : 0);
+	int64_t signed_sum = static_cast<int64_t>(static_cast<int32_t>(a)) +
+		static_cast<int32_t>(b) + (carry ? 1 : 0);
+	uint32_t result = static_cast<uint32_t>(unsigned_sum);
+	set_nz(result);
+	flag_c = (unsigned_sum >> 32) != 0;
+	flag_v = static_cast<int64_t>(static_cast<int32_t>(result)) != signed_sum;
+	return result;
+}
+
+bool sim_machine::check_cond(uint32_t cond) const {
+	switch (cond) {
+	case ZERO: case EQ: return flag_z;
+	case NONZERO: case NEQ: return !flag_z;
+	case CARRY: case GE_UNSIGN: return flag_c;
+	case NO_CARRY: case L_UNSIGN: return !flag_c;
+	case NEGATIVE: return flag_n;
+	case NON_NEGATIVE: return !flag_n;
+	case OVERFLOW: return flag_v;
+	case NO_OVERFLOW: return !flag_v;
+	case G_UNSIGN: return flag_c && !flag_z;
+	case LE_UNSIGN: return !flag_c || flag_z;
+	case GE_SIGN: return flag_n == flag_v;
+	case L_SIGN: return flag_n != flag_v;
+	case G_SIGN: return !flag_z && flag_n == flag_v;
+	case LE_SIGN: return flag_z || flag_n != flag_v;
+	case ALWAYS: return true;
+	default: throw sim_error("invalid condition");
+	}
+}
+
+void sim_machine::branch_to_label(const std::string& label, uint32_t& next_pc) {
+	next_pc = label_address(label);
+}
+
+// 1命令実行する
+void sim_machine::step() {
+	if (halted) throw sim_error("machine is not running");
+	if (config.max_steps > 0 && steps >= config.max_steps) throw sim_error("step limit exceeded");
+	uint32_t pc = regs[15];
+	auto index_itr = inst_at.find(pc);
+	if (index_itr == inst_at.end()) {
+		throw sim_error("no instruction at " + address_to_string(pc));
+	}
+	size_t index = index_itr->second;
+	const asm_inst& inst = insts[index];
+	uint32_t next_pc = pc + inst.size();
+	bool taken = false;
+	const uint32_t* p = inst.params;
+	switch (inst.kind) {
+	case MOV_LIT:
+		regs[p[0]] = p[1];
+		set_nz(regs[p[0]]);
+		break;
+	case MOV_REG:
+		if (p[0] == 15) {
+			next_pc = read_reg(p[1], pc) & ~UINT32_C(1);
+		} else {
+			regs[p[0]] = read_reg(p[1], pc);
+		}
+		break;
+	case ADD_LIT:
+		regs[p[0]] = add_with_carry(regs[p[0]], p[1], false);
+		break;
+	case SUB_LIT:
+		regs[p[0]] = add_with_carry(regs[p[0]], ~p[1], true);
+		break;
+	case ADD_PC_LIT:
+		regs[p[0]] = ((pc + 4) & ~UINT32_C(3)) + p[1] * 4;
+		break;
+	case ADD_REG:
+		if (p[0] == 15) {
+			next_pc = (read_reg(15, pc) + read_reg(p[1], pc)) & ~UINT32_C(1);
+		} else {
+			regs[p[0]] = read_reg(p[0], pc) + read_reg(p[1], pc);
+		}
+		break;
+	case ADD_REG_LIT:
+		regs[p[0]] = add_with_carry(regs[p[1]], p[2], false);
+		break;
+	case SUB_REG_LIT:
+		regs[p[0]] = add_with_carry(regs[p[1]], ~p[2], true);
+		break;
+	case ADD_REG_REG:
+		regs[p[0]] = add_with_carry(regs[p[1]], regs[p[2]], false);
+		break;
+	case SUB_REG_REG:
+		regs[p[0]] = add_with_carry(regs[p[1]], ~regs[p[2]], true);
+		break;
+	case NEG_REG:
+		regs[p[0]] = add_with_carry(0, ~regs[p[1]], true);
+		break;
+	case MUL_REG:
+		regs[p[0]] *= regs[p[1]];
+		set_nz(regs[p[0]]);
+		break;
+	case SHL_REG_LIT:
+		{
+			uint32_t value = regs[p[1]];
+			if (p[2] > 0) {
+				flag_c = p[2] <= 32 && ((value >> (32 - p[2])) & 1);
+				value = p[2] >= 32 ? 0 : value << p[2];
+			}
+			regs[p[0]] = value;
+			set_nz(value);
+		}
+		break;
+	case SHR_REG_LIT:
+		{
+			uint32_t value = regs[p[1]];
+			if (p[2] > 0) {
+				flag_c = p[2] <= 32 && ((value >> (p[2] - 1)) & 1);
+				value = p[2] >= 32 ? 0 : value >> p[2];
+			}
+			regs[p[0]] = value;
+			set_nz(value);
+		}
+		break;
+	case ASR_REG_LIT:
+		{
+			uint32_t value = regs[p[1]];
+			if (p[2] > 0) {
+				uint32_t shift = p[2] >= 32 ? 32 : p[2];
+				flag_c = ((value >> (shift - 1)) & 1) != 0;
+				int32_t svalue = static_cast<int32_t>(value);
+				value = static_cast<uint32_t>(shift >= 32 ? (svalue < 0 ? -1 : 0) : svalue >> shift);
+			}
+			regs[p[0]] = value;
+			set_nz(value);
+		}
+		break;
+	case SHL_REG: case SHR_REG: case ASR_REG: case ROR_REG:
+		{
+			uint32_t value = regs[p[0]];
+			uint32_t shift = regs[p[1]] & 0xff;
+			if (shift > 0) {
+				if (inst.kind == SHL_REG) {
+					flag_c = shift <= 32 && ((value >> (32 - shift)) & 1);
+					value = shift >= 32 ? 0 : value << shift;
+				} else if (inst.kind == SHR_REG) {
+					flag_c = shift <= 32 && ((value >> (shift - 1)) & 1);
+					value = shift >= 32 ? 0 : value >> shift;
+				} else if (inst.kind == ASR_REG) {
+					if (shift >= 32) shift = 32;
+					flag_c = ((value >> (shift - 1)) & 1) != 0;
+					int32_t svalue = static_cast<int32_t>(value);
+					value = static_cast<uint32_t>(shift >= 32 ? (svalue < 0 ? -1 : 0) : svalue >> shift);
+				} else {
+					shift &= 31;
+					if (shift > 0) value = (value >> shift) | (value << (32 - shift));
+					flag_c = (value >> 31) != 0;
+				}
+			}
+			regs[p[0]] = value;
+			set_nz(value);
+		}
+		break;
+	case NOT_REG:
+		regs[p[0]] = ~regs[p[1]];
+		set_nz(regs[p[0]]);
+		break;
+	case AND_REG:
+		regs[p[0]] &= regs[p[1]];
+		set_nz(regs[p[0]]);
+		break;
+	case OR_REG:
+		regs[p[0]] |= regs[p[1]];
+		set_nz(regs[p[0]]);
+		break;
+	case XOR_REG:
+		regs[p[0]] ^= regs[p[1]];
+		set_nz(regs[p[0]]);
+		break;
+	case BIC_REG:
+		regs[p[0]] &= ~regs[p[1]];
+		set_nz(regs[p[0]]);
+		break;
+	case ADC_REG:
+		regs[p[0]] = add_with_carry(regs[p[0]], regs[p[1]], flag_c);
+		break;
+	case SBC_REG:
+		regs[p[0]] = add_with_carry(regs[p[0]], ~regs[p[1]], flag_c);
+		break;
+	case LDB_REG_LIT: regs[p[0]] = read_memory(regs[p[1]] + p[2], 1); break;
+	case LDW_REG_LIT: regs[p[0]] = read_memory(regs[p[1]] + p[2] * 2, 2); break;
+	case LDL_REG_LIT: regs[p[0]] = read_memory(regs[p[1]] + p[2] * 4, 4); break;
+	case LDL_PC_LIT: regs[p[0]] = read_memory(((pc + 4) & ~UINT32_C(3)) + p[1] * 4, 4); break;
+	case LDB_REG_REG: regs[p[0]] = read_memory(regs[p[1]] + regs[p[2]], 1); break;
+	case LDBS_REG_REG:
+		regs[p[0]] = static_cast<uint32_t>(static_cast<int8_t>(read_memory(regs[p[1]] + regs[p[2]], 1)));
+		break;
+	case LDW_REG_REG: regs[p[0]] = read_memory(regs[p[1]] + regs[p[2]], 2); break;
+	case LDWS_REG_REG:
+		regs[p[0]] = static_cast<uint32_t>(static_cast<int16_t>(read_memory(regs[p[1]] + regs[p[2]], 2)));
+		break;
+	case LDL_REG_REG: regs[p[0]] = read_memory(regs[p[1]] + regs[p[2]], 4); break;
+	case STB_REG_LIT: write_memory(regs[p[0]] + p[1], 1, regs[p[2]]); break;
+	case STW_REG_LIT: write_memory(regs[p[0]] + p[1] * 2, 2, regs[p[2]]); break;
+	case STL_REG_LIT: write_memory(regs[p[0]] + p[1] * 4, 4, regs[p[2]]); break;
+	case STB_REG_REG: write_memory(regs[p[0]] + regs[p[1]], 1, regs[p[2]]); break;
+	case STW_REG_REG: write_memory(regs[p[0]] + regs[p[1]], 2, regs[p[2]]); break;
+	case STL_REG_REG: write_memory(regs[p[0]] + regs[p[1]], 4, regs[p[2]]); break;
+	case CMP_REG_LIT: add_with_carry(regs[p[0]], ~p[1], true); break;
+	case CMP_REG_REG: add_with_carry(regs[p[0]], ~regs[p[1]], true); break;
+	case CADD_REG_REG: add_with_carry(regs[p[0]], regs[p[1]], false); break;
+	case TEST_REG_REG: set_nz(regs[p[0]] & regs[p[1]]); break;
+	case JCC:
+		taken = check_cond(p[0]);
+		if (taken) branch_to_label(inst.label, next_pc);
+		break;
+	case JMP_DIRECT:
+		branch_to_label(inst.label, next_pc);
+		break;
+	case JMP_INDIRECT:
+		next_pc = read_reg(p[0], pc) & ~UINT32_C(1);
+		break;
+	case CALL_DIRECT:
+		regs[14] = next_pc | 1;
+		branch_to_label(inst.label, next_pc);
+		break;
+	case CALL_INDIRECT:
+		{
+			uint32_t target = read_reg(p[0], pc) & ~UINT32_C(1);
+			regs[14] = next_pc | 1;
+			next_pc = target;
+		}
+		break;
+	case RET:
+		next_pc = regs[14] & ~UINT32_C(1);
+		break;
+	case PUSH_REGS:
+		{
+			// 番号の小さいレジスタが低いアドレスに来る
+			uint32_t sp = regs[13];
+			for (int i = 8; i >= 0; i--) {
+				if ((p[0] >> i) & 1) {
+					sp -= 4;
+					write_memory(sp, 4, i == 8 ? regs[14] : regs[i]);
+				}
+			}
+			regs[13] = sp;
+		}
+		break;
+	case POP_REGS:
+		{
+			uint32_t sp = regs[13];
+			for (int i = 0; i <= 8; i++) {
+				if ((p[0] >> i) & 1) {
+					uint32_t value = read_memory(sp, 4);
+					sp += 4;
+					if (i == 8) next_pc = value & ~UINT32_C(1); else regs[i] = value;
+				}
+			}
+			regs[13] = sp;
+		}
+		break;
+	case ADDSP_LIT: regs[13] += p[0] * 4; break;
+	case SUBSP_LIT: regs[13] -= p[0] * 4; break;
+	case ADD_SP_LIT: regs[p[0]] = regs[13] + p[1] * 4; break;
+	case LDL_SP_LIT: regs[p[0]] = read_memory(regs[13] + p[1] * 4, 4); break;
+	case STL_SP_LIT: write_memory(regs[13] + p[0] * 4, 4, regs[p[1]]); break;
+	case REV_REG:
+		{
+			uint32_t v = regs[p[1]];
+			regs[p[0]] = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+		}
+		break;
+	case REV16_REG:
+		{
+			uint32_t v = regs[p[1]];
+			regs[p[0]] = ((v >> 8) & UINT32_C(0x00ff00ff)) | ((v << 8) & UINT32_C(0xff00ff00));
+		}
+		break;
+	case REVSH_REG:
+		{
+			uint32_t v = regs[p[1]];
+			regs[p[0]] = static_cast<uint32_t>(static_cast<int16_t>(((v >> 8) & 0xff) | ((v << 8) & 0xff00)));
+		}
+		break;
+	case LDM_REGS:
+		{
+			uint32_t address = regs[p[0]];
+			for (int i = 0; i <= 7; i++) {
+				if ((p[1] >> i) & 1) {
+					regs[i] = read_memory(address, 4);
+					address += 4;
+				}
+			}
+			// ベースレジスタがリストに含まれない場合、書き戻す
+			if (!((p[1] >> p[0]) & 1)) regs[p[0]] = address;
+		}
+		break;
+	case STM_REGS:
+		{
+			uint32_t address = regs[p[0]];
+			for (int i = 0; i <= 7; i++) {
+				if ((p[1] >> i) & 1) {
+					write_memory(address, 4, regs[i]);
+					address += 4;
+				}
+			}
+			regs[p[0]] = address;
+		}
+		break;
+	case NOP: case CPSID: case CPSIE: case WFI:
+		break;
+	default:
+		throw sim_error("unexpected instruction at " + address_to_string(pc));
+	}
+	last_index = index;
+	last_cycles = inst.cycles(taken);
+	cycles += last_cycles;
+	steps++;
+	regs[15] = next_pc;
+	if (next_pc == SIM_RETURN_ADDRESS) halted = true;
+}
+
+// 戻るまで実行する
+void sim_machine::run() {
+	while (!halted) step();
+}
+
+// asm15形式のテキストを命令列にする (' #line N のコメントから行番号も復元する)
+std::vector<asm_inst> sim_parse_listing(FILE* fp) {
+	std::vector<asm_inst> result;
+	std::string line;
+	int listing_line = 0, lineno = 0;
+	int c;
+	do {
+		c = getc(fp);
+		if (c != EOF && c != '\n') {
+			line += static_cast<char>(c);
+			continue;
+		}
+		if (c == EOF && line.empty()) break;
+		listing_line++;
+		asm_inst inst;
+		if (!asm_inst_from_string(line, inst)) {
+			std::stringstream ss;
+			ss << "invalid instruction at line " << listing_line << ": " << line;
+			throw sim_error(ss.str());
+		}
+		int marker;
+		if (inst.kind == EMPTY && sscanf(inst.comment.c_str(), "#line %d", &marker) == 1) {
+			lineno = marker;
+		} else {
+			inst.lineno = lineno;
+			result.push_back(inst);
+		}
+		line.clear();
+	} while (c != EOF);
+	return result;
+}
@@ -0,0 +1,92 @@
+#ifndef SIM_HPP_GUARD_1CF1A7F1_FAC9_4107_BE74_7C2E5E3DBAE2
+#define SIM_HPP_GUARD_1CF1A7F1_FAC9_4107_BE74_7C2E5E3DBAE2
+
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "asm.hpp"
+
+// 最初に呼び出した関数から戻ったことを表すアドレス
+const uint32_t SIM_RETURN_ADDRESS = UINT32_C(0xfffffffe);
+
+class sim_error : public std::runtime_error {
+public:
+	sim_error(const std::string& message) : std::runtime_error(message) {}
+};
+
+// シミュレータの設定
+struct sim_config {
+	uint32_t ram_base; // RAMの先頭のアドレス
+	uint32_t ram_size;
+	uint32_t rom_size; // RAMの先頭から書き込みを禁止する領域のサイズ
+	uint32_t base_address; // プログラムを置くRAM上のオフセット
+	uint64_t max_steps; // 実行する命令数の上限 (0 : 無制限)
+
+	sim_config() : ram_base(UINT32_C(0x10000000)), ram_size(UINT32_C(0x1000)), rom_size(0),
+		base_address(0x700), max_steps(UINT64_C(100000000)) {}
+};
+
+// 名前の付いたデータ (グローバル変数)
+struct sim_symbol {
+	std::string name;
+	uint32_t address;
+	int element_size;
+	int size;
+
+	sim_symbol(const std::string& name_ = "", uint32_t address_ = 0, int element_size_ = 1) :
+		name(name_), address(address_), element_size(element_size_), size(0) {}
+};
+
+// asm_instの命令列を実行するThumb-1シミュレータ
+struct sim_machine {
+	sim_config config;
+	std::vector<asm_inst> insts;
+	std::vector<uint32_t> addresses; // 各命令のアドレス
+	std::map<std::string, uint32_t> labels;
+	std::map<uint32_t, size_t> inst_at; // アドレス → 実行する命令の位置
+	std::vector<sim_symbol> symbols;
+	std::vector<uint8_t> ram;
+
+	uint32_t regs[16]; // R15は実行する命令のアドレス
+	bool flag_n, flag_z, flag_c, flag_v;
+	bool halted;
+	uint64_t cycles, steps;
+	size_t last_index; // 最後に実行した命令の位置
+	int last_cycles; // 最後に実行した命令のサイクル数
+
+	// 命令列をRAMに配置する
+	sim_machine(const std::vector<asm_inst>& insts_, const sim_config& config_ = sim_config());
+
+	// プログラムの先頭のアドレスを返す
+	uint32_t image_address() const { return config.ram_base + config.base_address; }
+	// 実行開始位置の候補を返す (関数より前に命令があればプログラムの先頭、そうでなければmainか最初の関数)
+	uint32_t default_entry() const;
+	// ラベルのアドレスを返す (無ければ例外を投げる)
+	uint32_t label_address(const std::string& label) const;
+
+	// 指定のアドレスから、戻り先をSIM_RETURN_ADDRESSとして実行を開始する準備をする
+	void start(uint32_t address);
+	// 1命令実行する
+	void step();
+	// 戻るまで実行する
+	void run();
+
+	// メモリを読み書きする (size : 1, 2, 4)
+	uint32_t read_memory(uint32_t address, int size) const;
+	void write_memory(uint32_t address, int size, uint32_t value);
+
+private:
+	uint32_t read_reg(int reg, uint32_t pc) const;
+	void set_nz(uint32_t value);
+	uint32_t add_with_carry(uint32_t a, uint32_t b, bool carry);
+	bool check_cond(uint32_t cond) const;
+	void branch_to_label(const std::string& label, uint32_t& next_pc);
+};
+
+// asm15形式のテキストを命令列にする (' #line N のコメントから行番号も復元する)
+std::vector<asm_inst> sim_parse_listing(FILE* fp);
+
+#endif
@@ -0,0 +1,189 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cinttypes>
+#include <vector>
+#include <string>
+#include "ast.h"
+#include "asm.hpp"
+#include "codegen.hpp"
+#include "sim.hpp"
+#include "profile.hpp"
+#include "ichigojam.hpp"
+#include "report_output.hpp"
+
+// 数値のオプションを解釈する
+static bool parse_number_option(const char* arg, const char* name, uint64_t& value) {
+	size_t name_len = strlen(name);
+	if (strncmp(arg, name, name_len) != 0 || arg[name_len] != '=') return false;
+	char* end;
+	value = strtoull(arg + name_len + 1, &end, 0);
+	if (*end != '\0' || arg[name_len + 1] == '\0') {
+		fprintf(stderr, "invalid number: %s\n", arg);
+		exit(1);
+	}
+	return true;
+}
+
+// ファイル名が".c"で終わるかを判定する
+static bool is_source_file(const char* file_name) {
+	size_t len = strlen(file_name);
+	return len >= 2 && strcmp(file_name + len - 2, ".c") == 0;
+}
+
+// 入力を読み込み、命令列を得る
+static std::vector<asm_inst> load_program(const char* file_name) {
+	FILE* fp = file_name == NULL ? stdin : fopen(file_name, "r");
+	if (fp == NULL) throw sim_error(std::string("failed to open ") + file_name);
+	std::vector<asm_inst> code;
+	if (file_name != NULL && is_source_file(file_name)) {
+		// ソースコードならコンパイルする
+		ast_node* ast = build_ast(fp);
+		fclose(fp);
+		if (ast == NULL) throw sim_error("failed to parse source code");
+		try {
+			code = codegen(ast);
+			codegen_clean(code);
+		} catch (codegen_error& e) {
+			throw sim_error(std::string("code generation error: ") + e.what());
+		}
+	} else {
+		code = sim_parse_listing(fp);
+		if (fp != stdin) fclose(fp);
+	}
+	return code;
+}
+
+// 実行結果を出力する
+static void print_state(const sim_machine& machine) {
+	printf("cycles: %" PRIu64 "\n", machine.cycles);
+	printf("instructions: %" PRIu64 "\n", machine.steps);
+	for (int i = 0; i < 16; i++) {
+		static const char* names[16] = {
+			"R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
+			"R8", "R9", "R10", "R11", "R12", "SP", "LR", "PC"
+		};
+		printf("%-3s = 0x%08" PRIX32 " (%" PRId32 ")\n",
+			names[i], machine.regs[i], static_cast<int32_t>(machine.regs[i]));
+	}
+	printf("flags: N=%d Z=%d C=%d V=%d\n",
+		machine.flag_n, machine.flag_z, machine.flag_c, machine.flag_v);
+	for (auto itr = machine.symbols.begin(); itr != machine.symbols.end(); itr++) {
+		printf("%s =", itr->name.c_str());
+		for (int offset = 0; offset + itr->element_size <= itr->size; offset += itr->element_size) {
+			uint32_t value = machine.read_memory(itr->address + offset, itr->element_size);
+			printf(" 0x%0*" PRIX32, itr->element_size * 2, value);
+		}
+		if (itr->size == itr->element_size) {
+			uint32_t value = machine.read_memory(itr->address, itr->element_size);
+			int shift = 32 - 8 * itr->element_size;
+			printf(" (%" PRId32 ")", static_cast<int32_t>(value << shift) >> shift);
+		}
+		printf("\n");
+	}
+}
+
+int main(int argc, char* argv[]) {
+	sim_config config;
+	const char* file_name = NULL;
+	const char* entry_name = NULL;
+	bool reg_given[13] = {false};
+	uint32_t reg_values[13] = {0};
+	report_output profile_output, call_graph_output, annotate_output;
+	bool ichigojam = false;
+	ichigojam_env env;
+	for (int i = 1; i < argc; i++) {
+		uint64_t value;
+		if (parse_report_option(argv[i], "--profile", profile_output) ||
+		parse_report_option(argv[i], "--call-graph", call_graph_output) ||
+		parse_report_option(argv[i], "--annotate", annotate_output)) {
+			continue;
+		} else if (strcmp(argv[i], "--ichigojam") == 0) {
+			// IchigoJamのメモリ配置にする (後に指定したオプションが優先される)
+			ichigojam = true;
+			ichigojam_configure(config);
+		} else if (parse_number_option(argv[i], "--usr-arg", value)) {
+			env.usr_arg = static_cast<int16_t>(value);
+		} else if (strncmp(argv[i], "--keys=", 7) == 0) {
+			env.keys = argv[i] + 7;
+		} else if (strncmp(argv[i], "--var-", 6) == 0) {
+			// --var-X=VALUE : BASICの変数の初期値
+			char var = static_cast<char>(toupper(static_cast<unsigned char>(argv[i][6])));
+			std::string name = std::string("--var-") + argv[i][6];
+			if (var < 'A' || 'Z' < var || !parse_number_option(argv[i], name.c_str(), value)) {
+				fprintf(stderr, "invalid variable option: %s\n", argv[i]);
+				return 1;
+			}
+			env.vars[var - 'A'] = static_cast<int16_t>(value);
+		} else if (strncmp(argv[i], "--entry=", 8) == 0) {
+			entry_name = argv[i] + 8;
+		} else if (parse_number_option(argv[i], "--base-address", value)) {
+			config.base_address = static_cast<uint32_t>(value);
+		} else if (parse_number_option(argv[i], "--ram-base", value)) {
+			config.ram_base = static_cast<uint32_t>(value);
+		} else if (parse_number_option(argv[i], "--ram-size", value)) {
+			config.ram_size = static_cast<uint32_t>(value);
+		} else if (parse_number_option(argv[i], "--max-steps", value)) {
+			config.max_steps = value;
+		} else if (argv[i][0] == '-' && argv[i][1] == '-' && argv[i][2] == 'r' &&
+		isdigit(static_cast<unsigned char>(argv[i][3]))) {
+			// --rN=VALUE : レジスタの初期値
+			int reg = atoi(argv[i] + 3);
+			std::string name = std::string("--r") + std::to_string(reg);
+			if (reg > 12 || !parse_number_option(argv[i], name.c_str(), value)) {
+				fprintf(stderr, "invalid register option: %s\n", argv[i]);
+				return 1;
+			}
+			reg_given[reg] = true;
+			reg_values[reg] = static_cast<uint32_t>(value);
+		} else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 1;
+		} else if (file_name == NULL) {
+			file_name = strcmp(argv[i], "-") == 0 ? NULL : argv[i];
+		} else {
+			fprintf(stderr, "too many input files\n");
+			return 1;
+		}
+	}
+	try {
+		std::vector<asm_inst> code = load_program(file_name);
+		sim_machine machine(code, config);
+		uint32_t entry = entry_name == NULL ? machine.default_entry() : machine.label_address(entry_name);
+		ichigojam_saved_regs saved;
+		if (ichigojam) {
+			std::string warning = ichigojam_check_layout(machine);
+			if (warning != "") fprintf(stderr, "warning: %s", warning.c_str());
+			saved = ichigojam_start(machine, entry, env);
+		} else {
+			// USR()と同様に、R1にRAMの先頭のアドレスを渡す
+			machine.regs[1] = config.ram_base;
+			machine.start(entry);
+		}
+		for (int i = 0; i < 13; i++) {
+			if (reg_given[i]) machine.regs[i] = saved.regs[i] = reg_values[i];
+		}
+		if (profile_output.enabled || call_graph_output.enabled || annotate_output.enabled) {
+			profile_data data;
+			profile_run(machine, data);
+			if (ichigojam) ichigojam_check_return(machine, saved);
+			print_state(machine);
+			if (profile_output.enabled &&
+			!write_report(profile_output, profile_flat_report(machine, data))) return 1;
+			if (call_graph_output.enabled &&
+			!write_report(call_graph_output, profile_call_graph_report(data))) return 1;
+			if (annotate_output.enabled &&
+			!write_report(annotate_output, profile_listing_report(machine, data))) return 1;
+		} else {
+			machine.run();
+			if (ichigojam) ichigojam_check_return(machine, saved);
+			print_state(machine);
+		}
+		if (ichigojam) fputs(ichigojam_report(machine).c_str(), stdout);
+	} catch (sim_error& e) {
+		fprintf(stderr, "simulation error: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <sstream>
+#include "size_report.hpp"
+
+// PUSH/POPで積み降ろしするバイト数を求める
+static int regs_bytes(uint32_t regs) {
+	int count = 0;
+	for (int i = 0; i <= 8; i++) {
+		if ((regs >> i) & 1) count++;
+	}
+	return count * 4;
+}
+
+// 命令列とグローバル変数の配置情報からサイズの内訳を求める
+size_info size_analyze(const std::vector<asm_inst>& insts, const std::vector<gvar_layout>& gv_layouts) {
+	size_info info;
+	info.globals = gv_layouts;
+	for (auto itr = gv_layouts.begin(); itr != gv_layouts.end(); itr++) {
+		info.data_bytes += itr->padding + itr->size;
+	}
+	int stack_depth = 0;
+	bool stack_unknown = false;
+	// 大きさは配置したアドレスから求め、アラインメントの詰め物も含める
+	// (関数の最初の命令の前の詰め物は、直前の関数の末尾のデータの後の詰め物として前の関数に含める)
+	std::vector<uint32_t> addresses = asm_layout(insts);
+	uint32_t end_address = 0;
+	bool function_started = false;
+	for (size_t i = 0; i < insts.size(); i++) {
+		auto itr = insts.begin() + i;
+		if (is_function_label(*itr)) {
+			info.functions.push_back(size_function_info(itr->label));
+			stack_depth = 0;
+			stack_unknown = false;
+			function_started = false;
+			continue;
+		}
+		int size = itr->size();
+		int padding = size > 0 ? static_cast<int>(addresses[i] - end_address) : 0;
+		if (size > 0) end_address = addresses[i] + size;
+		// リテラルプールは関数の一部として数える
+		if (is_data(*itr) && !itr->is_constant) continue;
+		if (info.functions.empty()) {
+			info.stub_bytes += padding + size;
+			continue;
+		}
+		size_function_info& func = info.functions.back();
+		if (size > 0) {
+			size_function_info& padded = !function_started && info.functions.size() >= 2 ?
+				info.functions[info.functions.size() - 2] : func;
+			padded.bytes += padding;
+			padded.padding_bytes += padding;
+			function_started = true;
+			func.bytes += size;
+			if (!is_data(*itr)) func.instructions++;
+			if (itr->is_constant) func.constant_bytes += size;
+		}
+		// スタックの使用量を命令の並び順に沿って見積もる
+		switch (itr->kind) {
+		case PUSH_REGS: stack_depth += regs_bytes(itr->params[0]); break;
+		case POP_REGS: stack_depth -= regs_bytes(itr->params[0]); break;
+		case SUBSP_LIT: stack_depth += itr->params[0] * 4; break;
+		case ADDSP_LIT: stack_depth -= itr->params[0] * 4; break;
+		case ADD_REG: case MOV_REG:
+			// レジスタを用いたSPの変更は追跡しない
+			if (itr->params[0] == 13) stack_unknown = true;
+			break;
+		default: break;
+		}
+		if (stack_unknown) {
+			func.stack_bytes = -1;
+		} else if (stack_depth > func.stack_bytes) {
+			func.stack_bytes = stack_depth;
+		}
+	}
+	for (auto itr = info.functions.begin(); itr != info.functions.end(); itr++) {
+		info.code_bytes += itr->bytes;
+	}
+	return info;
+}
+
+// サイズの内訳を、1行1項目の表形式の文字列にする
+std::string size_report_table(const size_info& info) {
+	std::stringstream ss;
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%-8s %-24s %7s %7s %7s %9s %7s\n",
+		"kind", "name", "bytes", "padding", "insts", "constants", "stack");
+	ss << buf;
+	for (auto itr = info.functions.begin(); itr != info.functions.end(); itr++) {
+		char stack_buf[16];
+		if (itr->stack_bytes < 0) snprintf(stack_buf, sizeof(stack_buf), "?");
+		else snprintf(stack_buf, sizeof(stack_buf), "%d", itr->stack_bytes);
+		snprintf(buf, sizeof(buf), "%-8s %-24s %7d %7d %7d %9d %7s\n",
+			"function", itr->name.c_str(), itr->bytes, itr->padding_bytes,
+			itr->instructions, itr->constant_bytes, stack_buf);
+		ss << buf;
+	}
+	for (auto itr = info.globals.begin(); itr != info.globals.end(); itr++) {
+		snprintf(buf, sizeof(buf), "%-8s %-24s %7d %7d %7s %9s %7s\n",
+			itr->name == "" ? "padding" : "global", itr->name == "" ? "-" : itr->name.c_str(),
+			itr->size + itr->padding, itr->padding, "-", "-", "-");
+		ss << buf;
+	}
+	if (info.stub_bytes > 0) {
+		snprintf(buf, sizeof(buf), "%-8s %-24s %7d %7s %7s %9s %7s\n",
+			"stub", "-", info.stub_bytes, "-", "-", "-", "-");
+		ss << buf;
+	}
+	snprintf(buf, sizeof(buf), "%-8s %-24s %7d %7s %7s %9s %7s\n",
+		"total", "-", info.data_bytes + info.stub_bytes + info.code_bytes, "-", "-", "-", "-");
+	ss << buf;
+	return ss.str();
+}
+
+// サイズの内訳を、JSON形式の文字列にする
+std::string size_report_json(const size_info& info) {
+	std::stringstream ss;
+	ss << "{\n";
+	ss << "  \"total_bytes\": " << (info.data_bytes + info.stub_bytes + info.code_bytes) << ",\n";
+	ss << "  \"data\": {\n";
+	ss << "    \"bytes\": " << info.data_bytes << ",\n";
+	ss << "    \"globals\": [";
+	bool is_first = true;
+	for (auto itr = info.globals.begin(); itr != info.globals.end(); itr++) {
+		ss << (is_first ? "\n" : ",\n");
+		ss << "      {\"name\": ";
+		if (itr->name == "") ss << "null"; else ss << "\"" << itr->name << "\"";
+		ss << ", \"offset\": " << itr->offset << ", \"size\": " << itr->size <<
+			", \"padding\": " << itr->padding << "}";
+		is_first = false;
+	}
+	ss << (is_first ? "]\n" : "\n    ]\n");
+	ss << "  },\n";
+	ss << "  \"code\": {\n";
+	ss << "    \"bytes\": " << (info.stub_bytes + info.code_bytes) << ",\n";
+	ss << "    \"stub_bytes\": " << info.stub_bytes << ",\n";
+	ss << "    \"functions\": [";
+	is_first = true;
+	for (auto itr = info.functions.begin(); itr != info.functions.end(); itr++) {
+		ss << (is_first ? "\n" : ",\n");
+		ss << "      {\"name\": \"" << itr->name << "\", \"bytes\": " << itr->bytes <<
+			", \"padding\": " << itr->padding_bytes << ", \"instructions\": " << itr->instructions <<
+			", \"constant_bytes\": " << itr->constant_bytes << ", \"stack_bytes\": ";
+		if (itr->stack_bytes < 0) ss << "null"; else ss << itr->stack_bytes;
+		ss << "}";
+		is_first = false;
+	}
+	ss << (is_first ? "]\n" : "\n    ]\n");
+	ss << "  }\n";
+	ss << "}\n";
+	return ss.str();
+}
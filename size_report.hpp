@@ -0,0 +1,40 @@
+#ifndef SIZE_REPORT_HPP_GUARD_B0A4CAB1_797C_4160_9C55_6F0F0B8F25D7
+#define SIZE_REPORT_HPP_GUARD_B0A4CAB1_797C_4160_9C55_6F0F0B8F25D7
+
+#include <string>
+#include <vector>
+#include "asm.hpp"
+#include "codegen.hpp"
+
+// 関数ごとのサイズ
+struct size_function_info {
+	std::string name;
+	int bytes; // アラインメントの詰め物を含む
+	int padding_bytes; // アラインメントの詰め物のバイト数
+	int instructions;
+	int constant_bytes; // 定数を置くための命令のバイト数
+	int stack_bytes; // 関数内で使うスタックの最大バイト数 (負 : 不明)
+
+	size_function_info(const std::string& name_ = "") : name(name_),
+		bytes(0), padding_bytes(0), instructions(0), constant_bytes(0), stack_bytes(0) {}
+};
+
+// プログラム全体のサイズの内訳
+struct size_info {
+	int data_bytes; // グローバル変数 (詰め物を含む)
+	int stub_bytes; // 最初の関数より前のコード (old entry用のコード)
+	int code_bytes; // 関数のコード
+	std::vector<size_function_info> functions;
+	std::vector<gvar_layout> globals;
+
+	size_info() : data_bytes(0), stub_bytes(0), code_bytes(0) {}
+};
+
+// 命令列とグローバル変数の配置情報からサイズの内訳を求める
+size_info size_analyze(const std::vector<asm_inst>& insts, const std::vector<gvar_layout>& gv_layouts);
+// サイズの内訳を、1行1項目の表形式の文字列にする
+std::string size_report_table(const size_info& info);
+// サイズの内訳を、JSON形式の文字列にする
+std::string size_report_json(const size_info& info);
+
+#endif
@@ -0,0 +1,496 @@
+#include <cstdio>
+#include <cinttypes>
+#include <map>
+#include <sstream>
+#include "wcet.hpp"
+
+// 経路をたどる際のサイクル数と、最悪の場合に通過するもの
+struct wcet_path {
+	uint64_t worst, best;
+	std::vector<std::string> trace;
+	std::string reason; // 最悪の場合の上限が求められない理由
+
+	wcet_path(uint64_t w = 0, uint64_t b = 0) : worst(w), best(b) {}
+};
+
+// 制御フローグラフの辺
+struct wcet_edge {
+	int to;
+	wcet_path path; // 分岐命令などのサイクル数
+	int bound; // 後方ジャンプの繰り返し回数の上限 (負 : 不明)
+	int min; // 後方ジャンプの繰り返し回数の下限 (負 : 不明)
+
+	wcet_edge(int to_ = 0, const wcet_path& path_ = wcet_path(), int bound_ = -1, int min_ = -1) :
+		to(to_), path(path_), bound(bound_), min(min_) {}
+};
+
+// 制御フローグラフのノード (基本ブロック、または畳み込んだループ)
+struct wcet_node {
+	wcet_path cost;
+	bool alive;
+	std::vector<wcet_edge> edges;
+
+	wcet_node() : alive(true) {}
+};
+
+// 解析全体で共有する情報
+struct wcet_context {
+	const std::vector<asm_inst>& insts;
+	std::vector<std::string> names;
+	std::vector<size_t> begins, ends; // 各関数の命令の範囲
+	std::map<std::string, size_t> function_ids;
+	std::vector<int> states; // 0 : 未解析, 1 : 解析中, 2 : 解析済み
+	std::vector<wcet_result> results;
+
+	wcet_context(const std::vector<asm_inst>& insts_) : insts(insts_) {}
+};
+
+// 上限の無い値を考慮して足し算をする
+static uint64_t wcet_add(uint64_t a, uint64_t b) {
+	if (a == WCET_UNBOUNDED || b == WCET_UNBOUNDED || a > WCET_UNBOUNDED - b) return WCET_UNBOUNDED;
+	return a + b;
+}
+
+// 上限の無い値を考慮して掛け算をする
+static uint64_t wcet_mul(uint64_t a, uint64_t b) {
+	if (a == 0 || b == 0) return 0;
+	if (a == WCET_UNBOUNDED || b == WCET_UNBOUNDED || a > WCET_UNBOUNDED / b) return WCET_UNBOUNDED;
+	return a * b;
+}
+
+// 経路の後ろに経路をつなげる
+static void wcet_append(wcet_path& path, const wcet_path& next) {
+	path.worst = wcet_add(path.worst, next.worst);
+	path.best = wcet_add(path.best, next.best);
+	path.trace.insert(path.trace.end(), next.trace.begin(), next.trace.end());
+	if (path.reason == "") path.reason = next.reason;
+}
+
+// 基本ブロックを終わらせる命令かを判定する
+static bool is_block_terminator(const asm_inst& inst) {
+	switch (inst.kind) {
+	case JCC: case JMP_DIRECT: case JMP_INDIRECT: case RET:
+		return true;
+	case POP_REGS:
+		return (inst.params[0] & 0x100) != 0;
+	case MOV_REG: case ADD_REG:
+		return inst.params[0] == 15;
+	default:
+		return false;
+	}
+}
+
+static const wcet_result& wcet_analyze_function(wcet_context& ctx, size_t func_id);
+
+// 関数呼び出しのサイクル数を求める (呼び出し命令自体は含まない)
+static wcet_path wcet_call_cost(wcet_context& ctx, const std::string& name) {
+	wcet_path path;
+	auto itr = ctx.function_ids.find(name);
+	if (itr == ctx.function_ids.end()) {
+		path.worst = WCET_UNBOUNDED;
+		path.reason = "call to unknown function " + name;
+	} else if (ctx.states[itr->second] == 1) {
+		path.worst = WCET_UNBOUNDED;
+		path.reason = "recursive call to " + name;
+	} else {
+		const wcet_result& res = wcet_analyze_function(ctx, itr->second);
+		path.worst = res.worst_cycles;
+		path.best = res.best_cycles;
+		if (res.worst_cycles == WCET_UNBOUNDED) {
+			path.reason = res.unbounded_reason + " (via " + name + ")";
+		}
+	}
+	return path;
+}
+
+// 範囲内のノードについて、startから前向きの辺のみをたどった最長・最短経路を求める
+static void wcet_longest_paths(const std::vector<wcet_node>& nodes, int start, int lo, int hi,
+std::vector<wcet_path>& dist, std::vector<bool>& reached) {
+	dist.assign(nodes.size(), wcet_path());
+	reached.assign(nodes.size(), false);
+	dist[start] = nodes[start].cost;
+	reached[start] = true;
+	for (int n = start; n <= hi; n++) {
+		if (!reached[n] || !nodes[n].alive) continue;
+		for (auto itr = nodes[n].edges.begin(); itr != nodes[n].edges.end(); itr++) {
+			if (itr->to <= n || itr->to < lo || hi < itr->to || !nodes[itr->to].alive) continue;
+			wcet_path candidate = dist[n];
+			wcet_append(candidate, itr->path);
+			wcet_append(candidate, nodes[itr->to].cost);
+			if (!reached[itr->to]) {
+				dist[itr->to] = candidate;
+				reached[itr->to] = true;
+			} else {
+				uint64_t best = dist[itr->to].best;
+				if (candidate.best < best) best = candidate.best;
+				if (candidate.worst > dist[itr->to].worst) dist[itr->to] = candidate;
+				dist[itr->to].best = best;
+			}
+		}
+	}
+}
+
+// 内側のループから順に、ループを1個のノードを迂回する辺に畳み込む
+static void wcet_fold_loops(std::vector<wcet_node>& nodes, int last_block) {
+	for (;;) {
+		// 最も後ろにあるループの先頭を探す
+		int header = -1;
+		for (int n = 1; n <= last_block; n++) {
+			if (!nodes[n].alive) continue;
+			for (auto itr = nodes[n].edges.begin(); itr != nodes[n].edges.end(); itr++) {
+				if (1 <= itr->to && itr->to <= n && header < itr->to) header = itr->to;
+			}
+		}
+		if (header < 0) break;
+		// ループの範囲と繰り返し回数の上限・下限を求める
+		// (下限は、後方ジャンプが1個だけのときのみ使う)
+		int last = header;
+		long long bound = -1, min = -1;
+		int back_edges = 0;
+		for (int n = header; n <= last_block; n++) {
+			if (!nodes[n].alive) continue;
+			for (auto itr = nodes[n].edges.begin(); itr != nodes[n].edges.end(); itr++) {
+				if (itr->to == header) {
+					last = n;
+					if (itr->bound >= 0 && (bound < 0 || itr->bound < bound)) bound = itr->bound;
+					min = itr->min;
+					back_edges++;
+				}
+			}
+		}
+		if (back_edges != 1 || bound < 0) min = -1;
+		if (min > bound) min = bound;
+		std::string loop_name = nodes[header].cost.trace.empty() ? "?" : nodes[header].cost.trace[0];
+		// ループ1周のサイクル数を求める
+		std::vector<wcet_path> dist_h;
+		std::vector<bool> reached_h;
+		wcet_longest_paths(nodes, header, header, last, dist_h, reached_h);
+		bool iterate = false;
+		wcet_path iteration;
+		uint64_t iteration_best = 0;
+		for (int n = header; n <= last; n++) {
+			if (!reached_h[n] || !nodes[n].alive) continue;
+			for (auto itr = nodes[n].edges.begin(); itr != nodes[n].edges.end(); itr++) {
+				if (itr->to != header) continue;
+				wcet_path candidate = dist_h[n];
+				wcet_append(candidate, itr->path);
+				if (!iterate || candidate.best < iteration_best) iteration_best = candidate.best;
+				if (!iterate || candidate.worst > iteration.worst) iteration = candidate;
+				iterate = true;
+			}
+		}
+		// ループに入る辺を集める
+		std::vector<std::pair<int, wcet_edge> > entries;
+		for (size_t n = 0; n < nodes.size(); n++) {
+			if (!nodes[n].alive || (header <= static_cast<int>(n) && static_cast<int>(n) <= last)) continue;
+			std::vector<wcet_edge> kept_edges;
+			for (auto itr = nodes[n].edges.begin(); itr != nodes[n].edges.end(); itr++) {
+				if (header <= itr->to && itr->to <= last) {
+					entries.push_back(std::make_pair(static_cast<int>(n), *itr));
+				} else {
+					kept_edges.push_back(*itr);
+				}
+			}
+			nodes[n].edges = kept_edges;
+		}
+		// 入口ごとに、ループを迂回する辺を作る
+		for (auto entry = entries.begin(); entry != entries.end(); entry++) {
+			int entry_node = entry->second.to;
+			std::vector<wcet_path> dist_e;
+			std::vector<bool> reached_e;
+			wcet_longest_paths(nodes, entry_node, header, last, dist_e, reached_e);
+			// 1周目 (入口から後方ジャンプまで) と、繰り返し全体
+			bool first_exists = false;
+			wcet_path first;
+			for (int n = entry_node; n <= last; n++) {
+				if (!reached_e[n] || !nodes[n].alive) continue;
+				for (auto itr = nodes[n].edges.begin(); itr != nodes[n].edges.end(); itr++) {
+					if (itr->to != header) continue;
+					wcet_path candidate = dist_e[n];
+					wcet_append(candidate, itr->path);
+					if (!first_exists) {
+						first = candidate;
+					} else {
+						if (candidate.best < first.best) first.best = candidate.best;
+						if (candidate.worst > first.worst) {
+							uint64_t best = first.best;
+							first = candidate;
+							first.best = best;
+						}
+					}
+					first_exists = true;
+				}
+			}
+			bool loop_taken = first_exists && bound != 0;
+			wcet_path loop_path;
+			if (loop_taken) {
+				std::stringstream summary;
+				summary << "loop " << loop_name << " x";
+				if (bound < 0) {
+					loop_path.worst = WCET_UNBOUNDED;
+					loop_path.reason = "loop at " + loop_name + " has no bound";
+					summary << "?";
+				} else {
+					uint64_t first_worst = first.worst > iteration.worst ? first.worst : iteration.worst;
+					loop_path.worst = wcet_add(first_worst, wcet_mul(iteration.worst, bound - 1));
+					loop_path.reason = first.reason != "" ? first.reason : iteration.reason;
+					summary << bound;
+				}
+				// 繰り返し回数の下限が分かっていれば、最短でもその回数だけ回る
+				loop_path.best = first.best;
+				if (min > 1) loop_path.best = wcet_add(first.best, wcet_mul(iteration_best, min - 1));
+				summary << " {";
+				for (size_t i = 0; i < iteration.trace.size(); i++) {
+					if (i > 0) summary << " -> ";
+					summary << iteration.trace[i];
+				}
+				summary << "}";
+				loop_path.trace.push_back(summary.str());
+			}
+			// ループから出る辺ごとに、迂回する辺を作る
+			for (int n = header; n <= last; n++) {
+				if (!nodes[n].alive) continue;
+				for (auto itr = nodes[n].edges.begin(); itr != nodes[n].edges.end(); itr++) {
+					if (header <= itr->to && itr->to <= last) continue;
+					// 必ず後方ジャンプをする場合は、ループを回らずに出る経路は最短経路にならない
+					bool direct = reached_e[n];
+					bool after_loop = loop_taken && reached_h[n];
+					bool must_loop = after_loop && min >= 1;
+					if (!direct && !after_loop) continue;
+					wcet_path path = entry->second.path;
+					wcet_path body;
+					if (direct) {
+						body = dist_e[n];
+					}
+					if (after_loop) {
+						wcet_path looped = loop_path;
+						wcet_append(looped, dist_h[n]);
+						if (!direct || looped.worst > body.worst) {
+							uint64_t best = direct && !must_loop && body.best < looped.best ? body.best : looped.best;
+							body = looped;
+							body.best = best;
+						} else if (must_loop || looped.best < body.best) {
+							body.best = looped.best;
+						}
+					}
+					wcet_append(path, body);
+					wcet_append(path, itr->path);
+					nodes[entry->first].edges.push_back(wcet_edge(itr->to, path, itr->bound));
+				}
+			}
+		}
+		// ループ内のノードを削除する
+		for (int n = header; n <= last; n++) {
+			nodes[n].alive = false;
+			nodes[n].edges.clear();
+		}
+	}
+}
+
+// ブロックb (1始まり) がジャンプ表の要素1個だけからなるかを判定する
+static bool is_jump_table_block(const std::vector<asm_inst>& insts, const std::vector<size_t>& block_begins,
+int b, size_t end) {
+	size_t b_begin = block_begins[b - 1];
+	size_t b_end = static_cast<size_t>(b) < block_begins.size() ? block_begins[b] : end;
+	int count = 0;
+	for (size_t i = b_begin; i < b_end; i++) {
+		if (insts[i].kind == EMPTY) continue;
+		if (insts[i].kind != JMP_DIRECT || insts[i].params[0] != JMP_TABLE_ENTRY) return false;
+		count++;
+	}
+	return count == 1;
+}
+
+// 関数を解析する
+static const wcet_result& wcet_analyze_function(wcet_context& ctx, size_t func_id) {
+	if (ctx.states[func_id] == 2) return ctx.results[func_id];
+	ctx.states[func_id] = 1;
+	const std::vector<asm_inst>& insts = ctx.insts;
+	size_t begin = ctx.begins[func_id], end = ctx.ends[func_id];
+
+	// 基本ブロックに分割する (0番はスタート、最後はゴールとする)
+	std::vector<size_t> block_begins;
+	std::vector<std::string> block_names;
+	std::map<std::string, int> label_blocks;
+	{
+		bool block_has_code = false, after_terminator = false;
+		std::string last_label = "";
+		int insts_after_label = 0;
+		for (size_t i = begin; i < end; i++) {
+			const asm_inst& inst = insts[i];
+			if (inst.kind == EMPTY) continue;
+			bool is_label = inst.kind == LABEL;
+			if (block_begins.empty() || after_terminator || (is_label && block_has_code)) {
+				block_begins.push_back(i);
+				std::stringstream name;
+				if (is_label) {
+					name << "@" << inst.label;
+				} else {
+					name << "@" << last_label << "+" << insts_after_label;
+				}
+				block_names.push_back(name.str());
+				block_has_code = false;
+			}
+			after_terminator = false;
+			if (is_label) {
+				label_blocks[inst.label] = static_cast<int>(block_begins.size());
+				last_label = inst.label;
+				insts_after_label = 0;
+			} else {
+				block_has_code = true;
+				after_terminator = is_block_terminator(inst);
+				insts_after_label++;
+			}
+		}
+	}
+	int num_blocks = static_cast<int>(block_begins.size());
+	int goal = num_blocks + 1;
+	std::vector<wcet_node> nodes(num_blocks + 2);
+	nodes[0].edges.push_back(wcet_edge(1));
+	for (int b = 1; b <= num_blocks; b++) {
+		size_t b_begin = block_begins[b - 1];
+		size_t b_end = b < num_blocks ? block_begins[b] : end;
+		wcet_node& node = nodes[b];
+		node.cost.trace.push_back(block_names[b - 1]);
+		const asm_inst* terminator = nullptr;
+		for (size_t i = b_begin; i < b_end; i++) {
+			const asm_inst& inst = insts[i];
+			if (is_block_terminator(inst)) {
+				terminator = &inst;
+				break;
+			}
+			uint64_t c = inst.cycles();
+			node.cost.worst = wcet_add(node.cost.worst, c);
+			node.cost.best = wcet_add(node.cost.best, c);
+			if (inst.kind == CALL_DIRECT) {
+				wcet_path callee = wcet_call_cost(ctx, inst.label);
+				callee.trace.clear();
+				wcet_append(node.cost, callee);
+			} else if (inst.kind == CALL_INDIRECT) {
+				node.cost.worst = WCET_UNBOUNDED;
+				if (node.cost.reason == "") node.cost.reason = "indirect call in " + block_names[b - 1];
+			}
+		}
+		int fallthrough = b < num_blocks ? b + 1 : goal;
+		if (terminator == nullptr) {
+			node.edges.push_back(wcet_edge(fallthrough));
+			continue;
+		}
+		// 分岐先を求める
+		bool has_target = terminator->kind == JCC || terminator->kind == JMP_DIRECT;
+		if (has_target) {
+			wcet_path path(terminator->cycles(true), terminator->cycles(true));
+			int target = goal;
+			auto itr = label_blocks.find(terminator->label);
+			if (itr != label_blocks.end()) {
+				target = itr->second;
+			} else {
+				// 他の関数へのジャンプ (末尾呼び出し)
+				wcet_path callee = wcet_call_cost(ctx, terminator->label);
+				callee.trace.clear();
+				callee.trace.push_back("@" + terminator->label);
+				wcet_append(path, callee);
+			}
+			node.edges.push_back(wcet_edge(target, path, terminator->loop_bound, terminator->loop_min));
+			if (terminator->kind == JCC && terminator->params[0] != ALWAYS) {
+				uint64_t c = terminator->cycles(false);
+				node.edges.push_back(wcet_edge(fallthrough, wcet_path(c, c)));
+			}
+		} else {
+			uint64_t c = terminator->cycles(true);
+			wcet_path path(c, c);
+			// ジャンプ表 (PCへの足し算の後に、実行されない詰め物と表の要素が1命令ずつのブロックとして並ぶ)
+			int table_end = b + 1;
+			if (terminator->kind == ADD_REG) {
+				while (table_end <= num_blocks && is_jump_table_block(insts, block_begins, table_end, end)) table_end++;
+			}
+			if (table_end - b >= 3) {
+				for (int t = b + 2; t < table_end; t++) node.edges.push_back(wcet_edge(t, path));
+				continue;
+			}
+			if (terminator->kind == JMP_INDIRECT || terminator->kind == MOV_REG || terminator->kind == ADD_REG) {
+				path.worst = WCET_UNBOUNDED;
+				path.reason = "indirect jump in " + block_names[b - 1];
+			}
+			node.edges.push_back(wcet_edge(goal, path));
+		}
+	}
+
+	// ループを畳み込み、スタートからゴールまでの経路を求める
+	wcet_fold_loops(nodes, num_blocks);
+	std::vector<wcet_path> dist;
+	std::vector<bool> reached;
+	wcet_longest_paths(nodes, 0, 0, goal, dist, reached);
+	wcet_result& result = ctx.results[func_id];
+	result.name = ctx.names[func_id];
+	if (reached[goal]) {
+		result.best_cycles = dist[goal].best;
+		result.worst_cycles = dist[goal].worst;
+		result.critical_path = dist[goal].trace;
+		if (result.worst_cycles == WCET_UNBOUNDED) result.unbounded_reason = dist[goal].reason;
+	} else {
+		result.best_cycles = WCET_UNBOUNDED;
+		result.worst_cycles = WCET_UNBOUNDED;
+		result.unbounded_reason = "function never returns";
+	}
+	ctx.states[func_id] = 2;
+	return result;
+}
+
+// 命令列を関数ごとに解析し、最良・最悪の実行サイクル数を見積もる
+std::vector<wcet_result> wcet_analyze(const std::vector<asm_inst>& insts) {
+	wcet_context ctx(insts);
+	// 関数の範囲を求める (最初の関数より前はデータなので対象外)
+	for (size_t i = 0; i < insts.size(); i++) {
+		if (is_function_label(insts[i])) {
+			if (!ctx.names.empty()) ctx.ends.push_back(i);
+			ctx.function_ids[insts[i].label] = ctx.names.size();
+			ctx.names.push_back(insts[i].label);
+			ctx.begins.push_back(i);
+		}
+	}
+	if (!ctx.names.empty()) ctx.ends.push_back(insts.size());
+	ctx.states.assign(ctx.names.size(), 0);
+	ctx.results.assign(ctx.names.size(), wcet_result());
+	for (size_t i = 0; i < ctx.names.size(); i++) {
+		wcet_analyze_function(ctx, i);
+	}
+	return ctx.results;
+}
+
+// サイクル数を文字列にする
+static std::string cycles_to_string(uint64_t cycles) {
+	if (cycles == WCET_UNBOUNDED) return "unbounded";
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%" PRIu64, cycles);
+	return buf;
+}
+
+// 見積もり結果を表形式の文字列にする
+std::string wcet_report(const std::vector<wcet_result>& results) {
+	std::stringstream ss;
+	size_t name_width = 8;
+	for (auto itr = results.begin(); itr != results.end(); itr++) {
+		if (itr->name.size() > name_width) name_width = itr->name.size();
+	}
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%-*s %12s %12s\n", static_cast<int>(name_width), "function", "best", "worst");
+	ss << buf;
+	for (auto itr = results.begin(); itr != results.end(); itr++) {
+		snprintf(buf, sizeof(buf), "%-*s %12s %12s\n", static_cast<int>(name_width), itr->name.c_str(),
+			cycles_to_string(itr->best_cycles).c_str(), cycles_to_string(itr->worst_cycles).c_str());
+		ss << buf;
+	}
+	for (auto itr = results.begin(); itr != results.end(); itr++) {
+		ss << "\n" << itr->name << ":\n";
+		if (itr->worst_cycles == WCET_UNBOUNDED) {
+			ss << "  unbounded: " << itr->unbounded_reason << "\n";
+		}
+		ss << "  critical path:";
+		for (size_t i = 0; i < itr->critical_path.size(); i++) {
+			ss << (i > 0 ? " ->" : "") << " " << itr->critical_path[i];
+		}
+		ss << "\n";
+	}
+	return ss.str();
+}
@@ -0,0 +1,28 @@
+#ifndef WCET_HPP_GUARD_40950CA2_DB38_464E_844C_4EDD083C16D6
+#define WCET_HPP_GUARD_40950CA2_DB38_464E_844C_4EDD083C16D6
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "asm.hpp"
+
+// 上限が求められない場合のサイクル数
+const uint64_t WCET_UNBOUNDED = UINT64_MAX;
+
+// 関数ごとの実行サイクル数の見積もり結果
+struct wcet_result {
+	std::string name;
+	uint64_t best_cycles;
+	uint64_t worst_cycles;
+	std::vector<std::string> critical_path; // 最悪の場合に通る経路
+	std::string unbounded_reason; // 上限が求められない理由
+
+	wcet_result() : best_cycles(0), worst_cycles(0) {}
+};
+
+// 命令列を関数ごとに解析し、最良・最悪の実行サイクル数を見積もる
+std::vector<wcet_result> wcet_analyze(const std::vector<asm_inst>& insts);
+// 見積もり結果を表形式の文字列にする
+std::string wcet_report(const std::vector<wcet_result>& results);
+
+#endif